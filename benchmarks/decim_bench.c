@@ -0,0 +1,161 @@
+/*
+
+Decimation stage benchmark
+
+Feeds a block of synthetic 1125Hz samples through the decimation stages of ICM_20948_Decim.h (float and Q15) and
+reports the cost per input sample: one stage from 1125Hz to 225Hz, and the cascade from 1125Hz to 225Hz to 100Hz.
+ns_per_output is the same time divided by the outputs of the last stage.
+
+  cmake -S . -B build -DICM_20948_BUILD_BENCHMARKS=ON -DCMAKE_BUILD_TYPE=Release && cmake --build build
+  ./build/benchmarks/icm20948_decim_bench [seconds per method] > results.json
+
+*/
+
+#include "ICM_20948_C.h"
+#include "ICM_20948_Decim.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifndef ICM_20948_LIBRARY_VERSION
+#define ICM_20948_LIBRARY_VERSION "unknown"
+#endif
+
+#define BENCH_BLOCK 1125 // Samples per block: one second at the fastest gyro ODR
+#define BENCH_TAPS 32
+
+typedef enum
+{
+  BENCH_FLOAT_225 = 0,
+  BENCH_FLOAT_225_100,
+  BENCH_Q15_225,
+  BENCH_Q15_225_100,
+  BENCH_NUM_METHODS
+} bench_method_e;
+
+static const char *bench_method_names[BENCH_NUM_METHODS] = {"ICM_20948_decim_update 1125/225Hz", "ICM_20948_decim_update 1125/225/100Hz",
+                                                             "ICM_20948_decim_q15_update 1125/225Hz", "ICM_20948_decim_q15_update 1125/225/100Hz"};
+
+static ICM_20948_AGMT_t bench_in[BENCH_BLOCK];
+static ICM_20948_AGMT_Scaled_t bench_in_scaled[BENCH_BLOCK];
+static ICM_20948_Decim_t bench_f1, bench_f2;
+static ICM_20948_Decim_Q15_t bench_q1, bench_q2;
+static volatile float bench_sink_f; // Keeps the outputs live
+static volatile int16_t bench_sink_q;
+
+static double bench_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + ((double)ts.tv_nsec * 1e-9);
+}
+
+static uint32_t bench_block(bench_method_e method) // Returns the number of outputs of the last stage
+{
+  uint32_t outputs = 0;
+  ICM_20948_AGMT_Scaled_t s1, s2;
+  ICM_20948_AGMT_t a1, a2;
+  for (uint32_t i = 0; i < BENCH_BLOCK; i++)
+  {
+    switch (method)
+    {
+    case BENCH_FLOAT_225:
+      if (ICM_20948_decim_update(&bench_f1, &bench_in_scaled[i], &s1))
+      {
+        bench_sink_f = s1.gyr.x;
+        outputs++;
+      }
+      break;
+    case BENCH_FLOAT_225_100:
+      if (ICM_20948_decim_update(&bench_f1, &bench_in_scaled[i], &s1) && ICM_20948_decim_update(&bench_f2, &s1, &s2))
+      {
+        bench_sink_f = s2.gyr.x;
+        outputs++;
+      }
+      break;
+    case BENCH_Q15_225:
+      if (ICM_20948_decim_q15_update(&bench_q1, &bench_in[i], &a1))
+      {
+        bench_sink_q = a1.gyr.axes.x;
+        outputs++;
+      }
+      break;
+    default:
+      if (ICM_20948_decim_q15_update(&bench_q1, &bench_in[i], &a1) && ICM_20948_decim_q15_update(&bench_q2, &a1, &a2))
+      {
+        bench_sink_q = a2.gyr.axes.x;
+        outputs++;
+      }
+      break;
+    }
+  }
+  return outputs;
+}
+
+static void bench_run(bench_method_e method, double seconds, bool last)
+{
+  uint64_t samples = 0;
+  uint64_t outputs = 0;
+  double start = bench_now();
+  double elapsed;
+  do
+  {
+    for (uint32_t r = 0; r < 16; r++)
+    {
+      outputs += bench_block(method);
+    }
+    samples += 16 * BENCH_BLOCK;
+    elapsed = bench_now() - start;
+  } while (elapsed < seconds);
+
+  printf("    {\"method\": \"%s\", \"samples\": %llu, \"outputs\": %llu, \"seconds\": %.6f, \"ns_per_sample\": %.1f, \"ns_per_output\": %.1f}%s\n",
+         bench_method_names[method], (unsigned long long)samples, (unsigned long long)outputs, elapsed, 1e9 * elapsed / (double)samples,
+         1e9 * elapsed / (double)outputs, last ? "" : ",");
+}
+
+int main(int argc, char **argv)
+{
+  double seconds = 1.0;
+  if (argc > 1)
+  {
+    seconds = atof(argv[1]);
+  }
+
+  // Level, with noise and a 180Hz vibration on all axes (+/- 2g, +/- 250dps)
+  srand(1);
+  for (uint32_t i = 0; i < BENCH_BLOCK; i++)
+  {
+    int16_t vib = (int16_t)(2000.0 * sin(2.0 * 3.14159265358979 * 180.0 * i / 1125.0));
+    bench_in[i].acc.axes.x = (int16_t)(vib + (rand() % 129) - 64);
+    bench_in[i].acc.axes.y = (int16_t)(vib + (rand() % 129) - 64);
+    bench_in[i].acc.axes.z = (int16_t)(16384 + vib + (rand() % 129) - 64);
+    bench_in[i].gyr.axes.x = (int16_t)(vib + (rand() % 33) - 16);
+    bench_in[i].gyr.axes.y = (int16_t)(vib + (rand() % 33) - 16);
+    bench_in[i].gyr.axes.z = (int16_t)(vib + (rand() % 33) - 16);
+    bench_in[i].fss.a = 0;
+    bench_in[i].fss.g = 0;
+    bench_in_scaled[i].acc.x = bench_in[i].acc.axes.x / 16.384f;
+    bench_in_scaled[i].acc.y = bench_in[i].acc.axes.y / 16.384f;
+    bench_in_scaled[i].acc.z = bench_in[i].acc.axes.z / 16.384f;
+    bench_in_scaled[i].gyr.x = bench_in[i].gyr.axes.x / 131.0f;
+    bench_in_scaled[i].gyr.y = bench_in[i].gyr.axes.y / 131.0f;
+    bench_in_scaled[i].gyr.z = bench_in[i].gyr.axes.z / 131.0f;
+  }
+  if ((ICM_20948_decim_init(&bench_f1, 1, 5, BENCH_TAPS) != ICM_20948_Stat_Ok) || (ICM_20948_decim_init(&bench_f2, 4, 9, BENCH_TAPS) != ICM_20948_Stat_Ok) ||
+      (ICM_20948_decim_q15_init(&bench_q1, 1, 5, BENCH_TAPS) != ICM_20948_Stat_Ok) || (ICM_20948_decim_q15_init(&bench_q2, 4, 9, BENCH_TAPS) != ICM_20948_Stat_Ok))
+  {
+    fprintf(stderr, "init failed\n");
+    return 1;
+  }
+
+  printf("{\n  \"benchmark\": \"decim\",\n  \"library_version\": \"%s\",\n  \"input_hz\": 1125,\n  \"taps\": %d,\n  \"block_samples\": %d,\n  \"results\": [\n",
+         ICM_20948_LIBRARY_VERSION, BENCH_TAPS, BENCH_BLOCK);
+  for (uint32_t m = 0; m < BENCH_NUM_METHODS; m++)
+  {
+    bench_run((bench_method_e)m, seconds, m == (BENCH_NUM_METHODS - 1));
+  }
+  printf("  ]\n}\n");
+  return 0;
+}
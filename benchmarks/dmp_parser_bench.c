@@ -0,0 +1,371 @@
+/*
+
+DMP FIFO parser throughput benchmark
+
+Generates synthetic DMP FIFO streams for a set of representative sensor combinations, feeds them to the
+parsers through an in-memory FIFO serif and reports frames per second, bytes per second, bus reads per
+frame, heap allocations and (approximate) stack use. Each case is run with inv_icm20948_read_dmp_data
+(one packet per call, fully decoded) and with ICM_20948_frame_drain (bulk reads, frame views, nothing decoded). The results are printed as one JSON document so
+they can be stored and compared across library versions.
+
+  cmake -S . -B build -DICM_20948_BUILD_BENCHMARKS=ON -DCMAKE_BUILD_TYPE=Release && cmake --build build
+  ./build/benchmarks/icm20948_dmp_parser_bench [seconds per case] > results.json
+
+*/
+
+#include "ICM_20948_C.h"
+#include "ICM_20948_Frame.h"
+#include "ICM_20948_REGISTERS.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef ICM_20948_LIBRARY_VERSION
+#define ICM_20948_LIBRARY_VERSION "unknown"
+#endif
+
+#define BENCH_STREAM_PACKETS 2048  // Packets in each generated stream. The stream is replayed until the time is up
+#define BENCH_STREAM_BYTES (BENCH_STREAM_PACKETS * 64)
+#define BENCH_FIFO_COUNT_MAX 4096  // The most the FIFO count registers report, like the real FIFO
+#define BENCH_STACK_PAINT 16384    // Bytes of stack painted to measure the parser's stack use
+#define BENCH_STACK_PATTERN 0xA5
+#define BENCH_STACK_GUARD 64       // Bytes just below the probe's frame (its own locals) that are not painted
+#define BENCH_DRAIN_BYTES 1024 // The ICM_20948_frame_drain buffer
+
+// Heap accounting. With BENCH_WRAP_MALLOC the build links with -Wl,--wrap=malloc etc. so every allocation the library makes is counted
+static long bench_allocations = 0;
+
+#if defined(BENCH_WRAP_MALLOC)
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void *__wrap_malloc(size_t size)
+{
+  bench_allocations++;
+  return __real_malloc(size);
+}
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+  bench_allocations++;
+  return __real_calloc(nmemb, size);
+}
+void *__wrap_realloc(void *ptr, size_t size)
+{
+  bench_allocations++;
+  return __real_realloc(ptr, size);
+}
+#endif
+
+// An in-memory FIFO. Only the registers the parser uses are modelled; everything else reads as zero
+typedef struct
+{
+  const uint8_t *stream;
+  uint32_t len;
+  uint32_t pos;
+  uint16_t count_snapshot; // FIFO_COUNTL returns the low byte of the count latched by the FIFO_COUNTH read
+  uint32_t reads;
+} bench_fifo_t;
+
+static ICM_20948_Status_e bench_fifo_write(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user)
+{
+  (void)regaddr;
+  (void)pdata;
+  (void)len;
+  (void)user;
+  return ICM_20948_Stat_Ok; // Bank selects
+}
+
+static ICM_20948_Status_e bench_fifo_read(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user)
+{
+  bench_fifo_t *fifo = (bench_fifo_t *)user;
+  uint32_t avail = fifo->len - fifo->pos;
+
+  fifo->reads++;
+  if (regaddr == AGB0_REG_FIFO_COUNT_H)
+  {
+    fifo->count_snapshot = (uint16_t)((avail > BENCH_FIFO_COUNT_MAX) ? BENCH_FIFO_COUNT_MAX : avail);
+    pdata[0] = (uint8_t)(fifo->count_snapshot >> 8);
+    if (len > 1)
+    {
+      pdata[1] = (uint8_t)(fifo->count_snapshot & 0xFF);
+    }
+  }
+  else if (regaddr == AGB0_REG_FIFO_COUNT_L)
+  {
+    pdata[0] = (uint8_t)(fifo->count_snapshot & 0xFF);
+  }
+  else if (regaddr == AGB0_REG_FIFO_R_W)
+  {
+    if (len > avail)
+    {
+      return ICM_20948_Stat_Err; // The parser read more than the FIFO count said was there
+    }
+    memcpy(pdata, &fifo->stream[fifo->pos], len);
+    fifo->pos += len;
+  }
+  else
+  {
+    memset(pdata, 0, len);
+  }
+  return ICM_20948_Stat_Ok;
+}
+
+// The cases
+typedef struct
+{
+  const char *name;
+  enum inv_icm20948_sensor sensors[4];
+  uint8_t num_sensors;
+  uint16_t header2_every; // Accuracy (header2) is only sent when it changes: include it in one packet in this many. 0 = never
+  uint16_t step_every;    // Step detector events. 0 = never
+  uint16_t activity_every; // Activity recognition events. 0 = never
+} bench_case_t;
+
+static const bench_case_t bench_cases[] = {
+    {"quat6", {INV_ICM20948_SENSOR_GAME_ROTATION_VECTOR}, 1, 0, 0, 0},
+    {"quat9_accel_gyro_compass", {INV_ICM20948_SENSOR_ROTATION_VECTOR, INV_ICM20948_SENSOR_RAW_ACCELEROMETER, INV_ICM20948_SENSOR_RAW_GYROSCOPE, INV_ICM20948_SENSOR_MAGNETIC_FIELD_UNCALIBRATED}, 4, 16, 0, 0},
+    {"example10_full", {INV_ICM20948_SENSOR_GAME_ROTATION_VECTOR, INV_ICM20948_SENSOR_RAW_GYROSCOPE, INV_ICM20948_SENSOR_RAW_ACCELEROMETER, INV_ICM20948_SENSOR_MAGNETIC_FIELD_UNCALIBRATED}, 4, 16, 0, 0},
+    {"activity_step_events", {INV_ICM20948_SENSOR_GAME_ROTATION_VECTOR, INV_ICM20948_SENSOR_STEP_DETECTOR}, 2, 0, 25, 100},
+};
+
+static uint32_t bench_rand_state = 12345;
+static uint8_t bench_rand(void)
+{
+  bench_rand_state = bench_rand_state * 1103515245u + 12345u;
+  return (uint8_t)(bench_rand_state >> 16);
+}
+
+// Build the stream. Returns its length; expected[] gets the header of each packet
+static uint32_t bench_generate(const bench_case_t *c, uint8_t *stream, uint16_t *expected)
+{
+  uint16_t ctl1 = 0;
+  for (uint8_t i = 0; i < c->num_sensors; i++)
+  {
+    ctl1 |= inv_icm20948_sensor_to_control_bits(c->sensors[i]);
+  }
+  uint16_t ctl2 = inv_icm20948_control_bits_to_header2(ctl1);
+  ctl1 &= ~(DMP_header_bitmap_Header2 | DMP_header_bitmap_Step_Detector); // Added per packet below
+
+  uint32_t len = 0;
+  for (uint32_t p = 0; p < BENCH_STREAM_PACKETS; p++)
+  {
+    uint16_t header = ctl1;
+    uint16_t header2 = 0;
+    if ((c->header2_every != 0) && ((p % c->header2_every) == 0))
+      header2 |= ctl2;
+    if ((c->activity_every != 0) && ((p % c->activity_every) == 0))
+      header2 |= DMP_header2_bitmap_Activity_Recog;
+    if ((c->step_every != 0) && ((p % c->step_every) == 0))
+      header |= DMP_header_bitmap_Step_Detector;
+    if (header2 != 0)
+      header |= DMP_header_bitmap_Header2;
+
+    uint16_t size = inv_icm20948_dmp_packet_size(header, header2, NULL);
+    uint8_t *pkt = &stream[len];
+    pkt[0] = (uint8_t)(header >> 8);
+    pkt[1] = (uint8_t)(header & 0xFF);
+    uint16_t i = 2;
+    if (header2 != 0)
+    {
+      pkt[i++] = (uint8_t)(header2 >> 8);
+      pkt[i++] = (uint8_t)(header2 & 0xFF);
+    }
+    for (; i < size; i++)
+    {
+      pkt[i] = bench_rand();
+    }
+    expected[p] = header;
+    len += size;
+  }
+  return len;
+}
+
+static double bench_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + ((double)ts.tv_nsec * 1e-9);
+}
+
+// Stack painting. The probe is called from the same frame as the parser, before and after it: it fills the
+// BENCH_STACK_PAINT bytes below its own frame (where the parser's frames go) with the pattern, then finds the
+// deepest byte that is no longer the pattern. It works through a pointer to that memory rather than a local array,
+// so the second call reads what the first one wrote (a fresh local array would be an uninitialized read).
+// BENCH_STACK_GUARD keeps the probe clear of its own frame and is counted as used
+static __attribute__((noinline)) uint32_t bench_stack_probe(bool paint)
+{
+  volatile uint8_t *area = (volatile uint8_t *)__builtin_frame_address(0) - BENCH_STACK_GUARD - BENCH_STACK_PAINT;
+  uint32_t untouched = 0;
+  if (paint)
+  {
+    for (uint32_t i = 0; i < BENCH_STACK_PAINT; i++)
+    {
+      area[i] = BENCH_STACK_PATTERN;
+    }
+    return 0;
+  }
+  while ((untouched < BENCH_STACK_PAINT) && (area[untouched] == BENCH_STACK_PATTERN)) // The stack grows down: count up from the deepest byte
+  {
+    untouched++;
+  }
+  return BENCH_STACK_PAINT - untouched + BENCH_STACK_GUARD;
+}
+
+// The parsers
+typedef enum
+{
+  BENCH_READ_DMP_DATA = 0,
+  BENCH_FRAME_DRAIN,
+  BENCH_NUM_DECODERS
+} bench_decoder_e;
+
+static const char *bench_decoder_names[BENCH_NUM_DECODERS] = {"inv_icm20948_read_dmp_data", "ICM_20948_frame_drain"};
+
+typedef struct
+{
+  bench_decoder_e decoder;
+  ICM_20948_Device_t dev;
+  icm_20948_DMP_data_t data;
+  ICM_20948_Frame_Drain_t drain;
+  uint8_t drain_buf[BENCH_DRAIN_BYTES];
+} bench_parser_t;
+
+// Parse the next frame. Returns its header, or 0 on an error
+static uint16_t bench_next(bench_parser_t *parser)
+{
+  if (parser->decoder == BENCH_READ_DMP_DATA)
+  {
+    ICM_20948_Status_e retval = inv_icm20948_read_dmp_data(&parser->dev, &parser->data);
+    return ((retval == ICM_20948_Stat_Ok) || (retval == ICM_20948_Stat_FIFOMoreDataAvail)) ? parser->data.header : 0;
+  }
+
+  ICM_20948_Frame_View_t view;
+  ICM_20948_Status_e retval = ICM_20948_frame_drain_next(&parser->drain, &view);
+  if (retval == ICM_20948_Stat_FIFONoDataAvail)
+  {
+    retval = ICM_20948_frame_drain(&parser->dev, &parser->drain);
+    if (retval != ICM_20948_Stat_Ok)
+      return 0;
+    retval = ICM_20948_frame_drain_next(&parser->drain, &view);
+  }
+  return (retval == ICM_20948_Stat_Ok) ? view.header : 0;
+}
+
+static void bench_rewind(bench_parser_t *parser, bench_fifo_t *fifo)
+{
+  fifo->pos = 0;
+  fifo->reads = 0;
+  ICM_20948_frame_drain_init(&parser->drain, parser->drain_buf, sizeof(parser->drain_buf));
+}
+
+static __attribute__((noinline)) uint16_t bench_parse_one(bench_parser_t *parser, uint32_t *stack)
+{
+  bench_stack_probe(true);
+  uint16_t header = bench_next(parser);
+  *stack = bench_stack_probe(false);
+  return header;
+}
+
+static void bench_run(const bench_case_t *c, bench_decoder_e decoder, double seconds, bool last)
+{
+  static uint8_t stream[BENCH_STREAM_BYTES];
+  static uint16_t expected[BENCH_STREAM_PACKETS];
+  static bench_parser_t parser;
+  bench_fifo_t fifo;
+  ICM_20948_Serif_t serif;
+
+  memset(&fifo, 0, sizeof(fifo));
+  fifo.stream = stream;
+  fifo.len = bench_generate(c, stream, expected);
+
+  serif.write = bench_fifo_write;
+  serif.read = bench_fifo_read;
+  serif.user = &fifo;
+  serif.write_async = NULL;
+  serif.read_async = NULL;
+
+  memset(&parser, 0, sizeof(parser));
+  parser.decoder = decoder;
+  parser.dev._last_bank = 255;
+  parser.dev._last_mems_bank = 255;
+  parser.dev._dmp_firmware_available = true; // The parser does not need the firmware to be loaded
+  ICM_20948_link_serif(&parser.dev, &serif);
+
+  // Stack use, measured on one pass of the stream after a warm-up pass (the first calls into libc go through the dynamic linker, which uses a lot of stack)
+  uint32_t stack = 0;
+  bench_rewind(&parser, &fifo);
+  for (uint32_t p = 0; p < BENCH_STREAM_PACKETS; p++)
+  {
+    bench_next(&parser);
+  }
+  bench_rewind(&parser, &fifo);
+  for (uint32_t p = 0; p < BENCH_STREAM_PACKETS; p++)
+  {
+    uint32_t used;
+    bench_parse_one(&parser, &used);
+    if (used > stack)
+      stack = used;
+  }
+
+  // Throughput
+  uint64_t frames = 0;
+  uint64_t bytes = 0;
+  uint64_t errors = 0;
+  long allocations = bench_allocations;
+  uint32_t reads = 0;
+  double start = bench_now();
+  double elapsed;
+  do
+  {
+    bench_rewind(&parser, &fifo);
+    for (uint32_t p = 0; p < BENCH_STREAM_PACKETS; p++)
+    {
+      if (bench_next(&parser) != expected[p])
+      {
+        errors++;
+        break;
+      }
+    }
+    frames += BENCH_STREAM_PACKETS;
+    bytes += fifo.len;
+    reads = fifo.reads;
+    elapsed = bench_now() - start;
+  } while ((elapsed < seconds) && (errors == 0));
+  allocations = bench_allocations - allocations;
+
+  printf("    {\"case\": \"%s\", \"decoder\": \"%s\", \"frames\": %llu, \"bytes\": %llu, \"seconds\": %.6f, "
+         "\"frames_per_s\": %.1f, \"bytes_per_s\": %.1f, \"bytes_per_frame\": %.2f, \"bus_reads_per_frame\": %.2f, "
+         "\"allocations\": ",
+         c->name, bench_decoder_names[decoder], (unsigned long long)frames, (unsigned long long)bytes, elapsed,
+         (double)frames / elapsed, (double)bytes / elapsed, (double)fifo.len / BENCH_STREAM_PACKETS, (double)reads / BENCH_STREAM_PACKETS);
+#if defined(BENCH_WRAP_MALLOC)
+  printf("%ld", allocations);
+#else
+  (void)allocations;
+  printf("null");
+#endif
+  printf(", \"stack_bytes\": %u, \"errors\": %llu}%s\n", stack, (unsigned long long)errors, last ? "" : ",");
+}
+
+int main(int argc, char **argv)
+{
+  double seconds = 1.0;
+  if (argc > 1)
+  {
+    seconds = atof(argv[1]);
+  }
+
+  uint32_t num_cases = sizeof(bench_cases) / sizeof(bench_cases[0]);
+  printf("{\n  \"benchmark\": \"dmp_parser\",\n  \"library_version\": \"%s\",\n  \"results\": [\n", ICM_20948_LIBRARY_VERSION);
+  for (uint32_t i = 0; i < num_cases; i++)
+  {
+    for (uint32_t d = 0; d < BENCH_NUM_DECODERS; d++)
+    {
+      bench_run(&bench_cases[i], (bench_decoder_e)d, seconds, (i == (num_cases - 1)) && (d == (BENCH_NUM_DECODERS - 1)));
+    }
+  }
+  printf("  ]\n}\n");
+  return 0;
+}
@@ -0,0 +1,129 @@
+/*
+
+Sensor fusion update rate benchmark
+
+Runs ICM_20948_fusion_update (float) and ICM_20948_fusion_q30_update (fixed point) over a block of synthetic
+ICM_20948_AGMT_t samples, in 6-axis and 9-axis mode, and reports updates per second and nanoseconds per update.
+
+  cmake -S . -B build -DICM_20948_BUILD_BENCHMARKS=ON -DCMAKE_BUILD_TYPE=Release && cmake --build build
+  ./build/benchmarks/icm20948_fusion_bench [seconds per method] > results.json
+
+On a microcontroller the cost of one update can be measured with examples/Arduino/Example11_HostFusion, which
+times each update with micros().
+
+*/
+
+#include "ICM_20948_C.h"
+#include "ICM_20948_Fusion.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifndef ICM_20948_LIBRARY_VERSION
+#define ICM_20948_LIBRARY_VERSION "unknown"
+#endif
+
+#define BENCH_BLOCK 512 // Samples per block
+#define BENCH_RATE 1125 // Hz: the fastest gyro ODR
+
+typedef enum
+{
+  BENCH_FLOAT_6 = 0,
+  BENCH_FLOAT_9,
+  BENCH_Q30_6,
+  BENCH_Q30_9,
+  BENCH_NUM_METHODS
+} bench_method_e;
+
+static const char *bench_method_names[BENCH_NUM_METHODS] = {"ICM_20948_fusion_update 6-axis", "ICM_20948_fusion_update 9-axis",
+                                                             "ICM_20948_fusion_q30_update 6-axis", "ICM_20948_fusion_q30_update 9-axis"};
+
+static ICM_20948_AGMT_t bench_in[BENCH_BLOCK];
+static ICM_20948_Fusion_t bench_f;
+static ICM_20948_Fusion_Q30_t bench_q;
+
+static double bench_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + ((double)ts.tv_nsec * 1e-9);
+}
+
+static void bench_block(bench_method_e method)
+{
+  for (uint32_t i = 0; i < BENCH_BLOCK; i++)
+  {
+    switch (method)
+    {
+    case BENCH_FLOAT_6:
+      ICM_20948_fusion_update(&bench_f, &bench_in[i], false);
+      break;
+    case BENCH_FLOAT_9:
+      ICM_20948_fusion_update(&bench_f, &bench_in[i], true);
+      break;
+    case BENCH_Q30_6:
+      ICM_20948_fusion_q30_update(&bench_q, &bench_in[i], false);
+      break;
+    default:
+      ICM_20948_fusion_q30_update(&bench_q, &bench_in[i], true);
+      break;
+    }
+  }
+}
+
+static void bench_run(bench_method_e method, double seconds, bool last)
+{
+  uint64_t updates = 0;
+  double start = bench_now();
+  double elapsed;
+  do
+  {
+    for (uint32_t r = 0; r < 16; r++)
+    {
+      bench_block(method);
+    }
+    updates += 16 * BENCH_BLOCK;
+    elapsed = bench_now() - start;
+  } while (elapsed < seconds);
+
+  printf("    {\"method\": \"%s\", \"updates\": %llu, \"seconds\": %.6f, \"updates_per_s\": %.1f, \"ns_per_update\": %.1f}%s\n",
+         bench_method_names[method], (unsigned long long)updates, elapsed, (double)updates / elapsed, 1e9 * elapsed / (double)updates, last ? "" : ",");
+}
+
+int main(int argc, char **argv)
+{
+  double seconds = 1.0;
+  if (argc > 1)
+  {
+    seconds = atof(argv[1]);
+  }
+
+  // Level and still, with noise, facing north: 1g on z (+/- 2g), a 20uT / -40uT field (AK09916 axes)
+  srand(1);
+  for (uint32_t i = 0; i < BENCH_BLOCK; i++)
+  {
+    bench_in[i].acc.axes.x = (int16_t)((rand() % 129) - 64);
+    bench_in[i].acc.axes.y = (int16_t)((rand() % 129) - 64);
+    bench_in[i].acc.axes.z = (int16_t)(16384 + (rand() % 129) - 64);
+    bench_in[i].gyr.axes.x = (int16_t)((rand() % 33) - 16);
+    bench_in[i].gyr.axes.y = (int16_t)((rand() % 33) - 16);
+    bench_in[i].gyr.axes.z = (int16_t)((rand() % 33) - 16);
+    bench_in[i].mag.axes.x = (int16_t)(133 + (rand() % 9) - 4);
+    bench_in[i].mag.axes.y = (int16_t)((rand() % 9) - 4);
+    bench_in[i].mag.axes.z = (int16_t)(267 + (rand() % 9) - 4);
+    bench_in[i].fss.a = 0; // +/- 2g
+    bench_in[i].fss.g = 2; // +/- 1000dps
+  }
+  ICM_20948_fusion_init(&bench_f, (float)BENCH_RATE, ICM_20948_FUSION_KP, 0.1f);
+  ICM_20948_fusion_q30_init(&bench_q, BENCH_RATE, ICM_20948_FUSION_KP_Q16, 6554); // Ki 0.1
+
+  printf("{\n  \"benchmark\": \"fusion\",\n  \"library_version\": \"%s\",\n  \"rate_hz\": %d,\n  \"block_samples\": %d,\n  \"results\": [\n",
+         ICM_20948_LIBRARY_VERSION, BENCH_RATE, BENCH_BLOCK);
+  for (uint32_t m = 0; m < BENCH_NUM_METHODS; m++)
+  {
+    bench_run((bench_method_e)m, seconds, m == (BENCH_NUM_METHODS - 1));
+  }
+  printf("  ]\n}\n");
+  return 0;
+}
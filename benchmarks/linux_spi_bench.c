@@ -0,0 +1,162 @@
+/*
+
+Linux spidev FIFO drain benchmark (ICM_20948_Linux_SPI.h)
+
+Times a FIFO drain through the spidev serif three ways: ICM_20948_linux_spi_drain_FIFO (one SPI_IOC_MESSAGE),
+ICM_20948_read_FIFO in ICM_20948_FIFO_MAX_BURST pieces (as the DMP parser reads it) and ICM_20948_read_FIFO a byte
+at a time. Reports the ioctls per drain, as counted by the serif, and the wall time per drain.
+
+Given a device, it drains a real ICM-20948 (whatever the FIFO holds: the data is not checked), so the time includes
+the real syscalls and the bus. Without one it runs on the fake spidev of tests/fake_spidev.h, which times only the
+library and the ioctl dispatch, with no kernel or bus in the way.
+
+  cmake -S . -B build -DICM_20948_BUILD_BENCHMARKS=ON -DCMAKE_BUILD_TYPE=Release && cmake --build build
+  ./build/benchmarks/icm20948_linux_spi_bench [seconds per method] [/dev/spidevB.C] [drain bytes] > results.json
+
+*/
+
+#include "ICM_20948_C.h"
+#include "ICM_20948_Linux_SPI.h"
+#include "fake_spidev.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifndef ICM_20948_LIBRARY_VERSION
+#define ICM_20948_LIBRARY_VERSION "unknown"
+#endif
+
+#define BENCH_MAX_DRAIN 4096 // The FIFO size
+
+typedef enum
+{
+  BENCH_DRAIN = 0,
+  BENCH_MAX_BURST,
+  BENCH_BYTES,
+  BENCH_NUM_METHODS
+} bench_method_e;
+
+static const char *bench_method_names[BENCH_NUM_METHODS] = {"ICM_20948_linux_spi_drain_FIFO", "ICM_20948_read_FIFO x ICM_20948_FIFO_MAX_BURST",
+                                                             "ICM_20948_read_FIFO x 1"};
+
+static ICM_20948_Linux_SPI_t bench_bus;
+static ICM_20948_Device_t bench_dev;
+static uint8_t bench_fill[BENCH_MAX_DRAIN];
+static uint8_t bench_buf[BENCH_MAX_DRAIN];
+static bool bench_fake;
+
+static double bench_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + ((double)ts.tv_nsec * 1e-9);
+}
+
+static ICM_20948_Status_e bench_drain(bench_method_e method, uint32_t bytes)
+{
+  ICM_20948_Status_e retval = ICM_20948_Stat_Ok;
+  switch (method)
+  {
+  case BENCH_DRAIN:
+    return ICM_20948_linux_spi_drain_FIFO(&bench_dev, bench_buf, bytes);
+  case BENCH_MAX_BURST:
+    for (uint32_t pos = 0; (retval == ICM_20948_Stat_Ok) && (pos < bytes); pos += ICM_20948_FIFO_MAX_BURST)
+    {
+      retval = ICM_20948_read_FIFO(&bench_dev, &bench_buf[pos], ((bytes - pos) > ICM_20948_FIFO_MAX_BURST) ? ICM_20948_FIFO_MAX_BURST : (uint8_t)(bytes - pos));
+    }
+    return retval;
+  default:
+    for (uint32_t pos = 0; (retval == ICM_20948_Stat_Ok) && (pos < bytes); pos++)
+    {
+      retval = ICM_20948_read_FIFO(&bench_dev, &bench_buf[pos], 1);
+    }
+    return retval;
+  }
+}
+
+static bool bench_run(bench_method_e method, uint32_t bytes, double seconds, bool last)
+{
+  uint64_t drains = 0;
+  double elapsed = 0.0;
+  ICM_20948_linux_spi_reset_counters(&bench_bus);
+  do
+  {
+    if (bench_fake)
+    {
+      ICM_20948_sim_fifo_push(&fake_spi_sim, bench_fill, bytes); // Not timed
+    }
+    double start = bench_now();
+    ICM_20948_Status_e retval = bench_drain(method, bytes);
+    elapsed += bench_now() - start;
+    if (retval != ICM_20948_Stat_Ok)
+    {
+      fprintf(stderr, "%s failed: %d\n", bench_method_names[method], retval);
+      return false;
+    }
+    drains++;
+  } while (elapsed < seconds);
+
+  printf("    {\"method\": \"%s\", \"drains\": %llu, \"seconds\": %.6f, \"syscalls_per_drain\": %.1f, \"us_per_drain\": %.2f, \"MB_per_s\": %.2f}%s\n",
+         bench_method_names[method], (unsigned long long)drains, elapsed, (double)bench_bus.syscalls / (double)drains, 1e6 * elapsed / (double)drains,
+         ((double)bytes * (double)drains) / (elapsed * 1e6), last ? "" : ",");
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  double seconds = 1.0;
+  const char *path = FAKE_SPI_PATH;
+  uint32_t bytes = 512;
+  if (argc > 1)
+  {
+    seconds = atof(argv[1]);
+  }
+  if (argc > 2)
+  {
+    path = argv[2];
+  }
+  if (argc > 3)
+  {
+    bytes = (uint32_t)atoi(argv[3]);
+  }
+  if ((bytes == 0) || (bytes > BENCH_MAX_DRAIN))
+  {
+    fprintf(stderr, "drain bytes must be 1 to %d\n", BENCH_MAX_DRAIN);
+    return 1;
+  }
+  bench_fake = (strcmp(path, FAKE_SPI_PATH) == 0);
+
+  ICM_20948_Serif_t serif;
+  ICM_20948_sim_init(&fake_spi_sim);
+  for (uint32_t i = 0; i < sizeof(bench_fill); i++)
+  {
+    bench_fill[i] = (uint8_t)i;
+  }
+  if (ICM_20948_linux_spi_open(&bench_bus, path, ICM_20948_LINUX_SPI_MAX_SPEED) != ICM_20948_Stat_Ok)
+  {
+    fprintf(stderr, "cannot open %s\n", path);
+    return 1;
+  }
+  ICM_20948_linux_spi_serif(&bench_bus, &serif);
+  bench_dev._last_bank = 255; // Invalid, so the first ICM_20948_set_bank always writes
+  bench_dev._last_mems_bank = 255;
+  ICM_20948_link_serif(&bench_dev, &serif);
+  if ((ICM_20948_check_id(&bench_dev) != ICM_20948_Stat_Ok) || (ICM_20948_sleep(&bench_dev, false) != ICM_20948_Stat_Ok))
+  {
+    fprintf(stderr, "no ICM-20948 on %s\n", path);
+    ICM_20948_linux_spi_close(&bench_bus);
+    return 1;
+  }
+
+  printf("{\n  \"benchmark\": \"linux_spi\",\n  \"library_version\": \"%s\",\n  \"device\": \"%s\",\n  \"speed_hz\": %u,\n  \"drain_bytes\": %u,\n  \"results\": [\n",
+         ICM_20948_LIBRARY_VERSION, bench_fake ? "fake" : path, bench_bus.speed_hz, bytes);
+  bool ok = true;
+  for (uint32_t m = 0; ok && (m < BENCH_NUM_METHODS); m++)
+  {
+    ok = bench_run((bench_method_e)m, bytes, seconds, m == (BENCH_NUM_METHODS - 1));
+  }
+  printf("  ]\n}\n");
+  ICM_20948_linux_spi_close(&bench_bus);
+  return ok ? 0 : 1;
+}
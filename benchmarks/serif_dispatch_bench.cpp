@@ -0,0 +1,273 @@
+/*
+
+Bus dispatch benchmark: ICM_20948_T (transport bound at compile time) vs the ICM_20948_Serif_t function pointers
+
+Both sides talk to the same in-memory register file through the same read and write functions, so the difference
+is the dispatch and the layering above it: the template calls the transport directly (and the compiler can inline
+it), the C layer goes through execute_r/w, the serif pointers and the bank cache. Reports the time per call and,
+on x86, the time stamp counter ticks per call, for:
+
+  register read: one 1-byte read (ICM_20948_T::read vs ICM_20948_execute_r)
+  getAGMT: the bank 0 burst and the full-scale read back (ICM_20948_T::getAGMT vs ICM_20948_get_agmt)
+  getAGMT cached fss: the bank 0 burst only (ICM_20948_T::getAGMT(false) vs ICM_20948_queue_agmt and a pop)
+  readFIFO: a 64-byte FIFO read (ICM_20948_T::readFIFO vs ICM_20948_read_FIFO)
+
+bus_calls_per_call shows the bus work on each side: the same, except that ICM_20948_get_agmt also reads
+ACCEL_CONFIG_2. For the code size of the two, build the
+icm20948_serif_size target (serif_size_template.cpp and serif_size_fnptr.c).
+
+  cmake -S . -B build -DICM_20948_BUILD_BENCHMARKS=ON -DCMAKE_BUILD_TYPE=Release && cmake --build build
+  ./build/benchmarks/icm20948_serif_dispatch_bench [seconds per method] > results.json
+  cmake --build build --target icm20948_serif_size
+
+*/
+
+// The system headers first: ICM_20948_C.h declares memcmp itself, which C++ only accepts after <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ICM_20948_T.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC 1
+#endif
+
+#ifndef ICM_20948_LIBRARY_VERSION
+#define ICM_20948_LIBRARY_VERSION "unknown"
+#endif
+
+#define BENCH_FIFO_BYTES 64
+#define BENCH_BATCH 1024 // Calls between clock reads
+
+typedef enum
+{
+  BENCH_T_READ = 0,
+  BENCH_C_READ,
+  BENCH_T_AGMT,
+  BENCH_C_AGMT,
+  BENCH_T_AGMT_CACHED,
+  BENCH_C_AGMT_CACHED,
+  BENCH_T_FIFO,
+  BENCH_C_FIFO,
+  BENCH_NUM_METHODS
+} bench_method_e;
+
+static const char *bench_method_names[BENCH_NUM_METHODS] = {"ICM_20948_T::read", "ICM_20948_execute_r",
+                                                             "ICM_20948_T::getAGMT", "ICM_20948_get_agmt",
+                                                             "ICM_20948_T::getAGMT(false)", "ICM_20948_queue_agmt",
+                                                             "ICM_20948_T::readFIFO", "ICM_20948_read_FIFO"};
+
+// The register file: four banks, REG_BANK_SEL selects, FIFO_R_W streams a counter
+static uint8_t bench_regs[4][128];
+static uint8_t bench_bank;
+static uint8_t bench_fifo_next;
+static uint32_t bench_bus_calls;
+
+static inline ICM_20948_Status_e bench_bus_read(uint8_t reg, uint8_t *pdata, uint32_t len)
+{
+  bench_bus_calls++;
+  if ((reg & 0x7F) == AGB0_REG_FIFO_R_W)
+  {
+    for (uint32_t i = 0; i < len; i++)
+      pdata[i] = bench_fifo_next++;
+    return ICM_20948_Stat_Ok;
+  }
+  for (uint32_t i = 0; i < len; i++)
+    pdata[i] = bench_regs[bench_bank][(reg + i) & 0x7F];
+  return ICM_20948_Stat_Ok;
+}
+
+static inline ICM_20948_Status_e bench_bus_write(uint8_t reg, uint8_t *pdata, uint32_t len)
+{
+  bench_bus_calls++;
+  for (uint32_t i = 0; i < len; i++)
+  {
+    uint8_t r = (reg + i) & 0x7F;
+    if (r == REG_BANK_SEL)
+      bench_bank = (pdata[i] >> 4) & 0x03;
+    bench_regs[bench_bank][r] = pdata[i];
+  }
+  return ICM_20948_Stat_Ok;
+}
+
+struct BenchTransport
+{
+  static ICM_20948_Status_e read(uint8_t reg, uint8_t *pdata, uint32_t len) { return bench_bus_read(reg, pdata, len); }
+  static ICM_20948_Status_e write(uint8_t reg, uint8_t *pdata, uint32_t len) { return bench_bus_write(reg, pdata, len); }
+};
+
+// ICM_20948_T keeps the register access protected, as ICM_20948 does: open it up for the benchmark
+class BenchICM : public ICM_20948_T<BenchTransport>
+{
+public:
+  using ICM_20948_T<BenchTransport>::read;
+  using ICM_20948_T<BenchTransport>::getAGMT;
+  using ICM_20948_T<BenchTransport>::agmt;
+};
+
+static ICM_20948_Status_e bench_serif_read(uint8_t reg, uint8_t *pdata, uint32_t len, void *user)
+{
+  (void)user;
+  return bench_bus_read(reg, pdata, len);
+}
+
+static ICM_20948_Status_e bench_serif_write(uint8_t reg, uint8_t *pdata, uint32_t len, void *user)
+{
+  (void)user;
+  return bench_bus_write(reg, pdata, len);
+}
+
+static BenchICM bench_t;
+static ICM_20948_Device_t bench_dev;
+static ICM_20948_Serif_t bench_serif;
+static ICM_20948_Sample_t bench_slots[2];
+static ICM_20948_Sample_Queue_t bench_queue;
+static uint8_t bench_fifo[BENCH_FIFO_BYTES];
+static ICM_20948_AGMT_t bench_agmt;
+static volatile uint32_t bench_sink; // Keeps the results live
+
+static double bench_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + ((double)ts.tv_nsec * 1e-9);
+}
+
+static uint64_t bench_ticks(void)
+{
+#if defined(BENCH_HAVE_TSC)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+static ICM_20948_Status_e bench_call(bench_method_e method)
+{
+  uint8_t value;
+  ICM_20948_Status_e retval;
+  ICM_20948_Sample_t sample;
+  switch (method)
+  {
+  case BENCH_T_READ:
+    retval = bench_t.read(AGB0_REG_INT_STATUS_1, &value, 1);
+    bench_sink = value;
+    return retval;
+  case BENCH_C_READ:
+    retval = ICM_20948_execute_r(&bench_dev, AGB0_REG_INT_STATUS_1, &value, 1);
+    bench_sink = value;
+    return retval;
+  case BENCH_T_AGMT:
+    retval = bench_t.getAGMT(true);
+    bench_sink = (uint32_t)bench_t.agmt.acc.axes.x;
+    return retval;
+  case BENCH_C_AGMT:
+    retval = ICM_20948_get_agmt(&bench_dev, &bench_agmt);
+    bench_sink = (uint32_t)bench_agmt.acc.axes.x;
+    return retval;
+  case BENCH_T_AGMT_CACHED:
+    retval = bench_t.getAGMT(false);
+    bench_sink = (uint32_t)bench_t.agmt.acc.axes.x;
+    return retval;
+  case BENCH_C_AGMT_CACHED:
+    retval = ICM_20948_queue_agmt(&bench_dev, &bench_queue, 0);
+    ICM_20948_queue_pop(&bench_queue, &sample);
+    bench_sink = (uint32_t)sample.agmt.acc.axes.x;
+    return retval;
+  case BENCH_T_FIFO:
+    retval = bench_t.readFIFO(bench_fifo, BENCH_FIFO_BYTES);
+    bench_sink = bench_fifo[BENCH_FIFO_BYTES - 1];
+    return retval;
+  default:
+    retval = ICM_20948_read_FIFO(&bench_dev, bench_fifo, BENCH_FIFO_BYTES);
+    bench_sink = bench_fifo[BENCH_FIFO_BYTES - 1];
+    return retval;
+  }
+}
+
+static bool bench_run(bench_method_e method, double seconds, bool last)
+{
+  // The two sides share the register file but each has its own bank cache: forget both and start from bank 0,
+  // as a loop that only reads sensor data would
+  bench_t.device()->_last_bank = 255;
+  bench_dev._last_bank = 255;
+  bool t_side = ((method % 2) == 0);
+  if ((t_side ? bench_t.getAGMT(false) : ICM_20948_set_bank(&bench_dev, 0)) != ICM_20948_Stat_Ok)
+  {
+    return false;
+  }
+
+  uint64_t calls = 0;
+  uint64_t ticks = 0;
+  uint32_t bus_calls = bench_bus_calls;
+  double start = bench_now();
+  double elapsed;
+  do
+  {
+    uint64_t t0 = bench_ticks();
+    for (uint32_t i = 0; i < BENCH_BATCH; i++)
+    {
+      if (bench_call(method) != ICM_20948_Stat_Ok)
+      {
+        return false;
+      }
+    }
+    ticks += bench_ticks() - t0;
+    calls += BENCH_BATCH;
+    elapsed = bench_now() - start;
+  } while (elapsed < seconds);
+  bus_calls = bench_bus_calls - bus_calls;
+
+  printf("    {\"method\": \"%s\", \"calls\": %llu, \"seconds\": %.6f, \"ns_per_call\": %.2f, ", bench_method_names[method],
+         (unsigned long long)calls, elapsed, 1e9 * elapsed / (double)calls);
+#if defined(BENCH_HAVE_TSC)
+  printf("\"tsc_per_call\": %.1f, ", (double)ticks / (double)calls);
+#endif
+  printf("\"bus_calls_per_call\": %.2f}%s\n", (double)bus_calls / (double)calls, last ? "" : ",");
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  double seconds = 1.0;
+  if (argc > 1)
+  {
+    seconds = atof(argv[1]);
+  }
+
+  srand(1);
+  for (uint32_t b = 0; b < 4; b++)
+  {
+    for (uint32_t r = 0; r < 128; r++)
+    {
+      bench_regs[b][r] = (uint8_t)rand();
+    }
+  }
+
+  memset(&bench_dev, 0, sizeof(bench_dev));
+  bench_dev._last_bank = 255;
+  bench_dev._last_mems_bank = 255;
+  bench_serif.read = bench_serif_read;
+  bench_serif.write = bench_serif_write;
+  bench_serif.user = NULL;
+  bench_serif.read_async = NULL;
+  bench_serif.write_async = NULL;
+  ICM_20948_link_serif(&bench_dev, &bench_serif);
+  ICM_20948_queue_init(&bench_queue, bench_slots, 2);
+
+  printf("{\n  \"benchmark\": \"serif_dispatch\",\n  \"library_version\": \"%s\",\n  \"fifo_bytes\": %d,\n  \"results\": [\n",
+         ICM_20948_LIBRARY_VERSION, BENCH_FIFO_BYTES);
+  for (uint32_t m = 0; m < BENCH_NUM_METHODS; m++)
+  {
+    if (!bench_run((bench_method_e)m, seconds, m == (BENCH_NUM_METHODS - 1)))
+    {
+      fprintf(stderr, "%s failed\n", bench_method_names[m]);
+      return 1;
+    }
+  }
+  printf("  ]\n}\n");
+  return 0;
+}
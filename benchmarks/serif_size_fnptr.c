@@ -0,0 +1,57 @@
+/*
+
+Code size probe: the bus reached through the ICM_20948_Serif_t function pointers (the C layer, as ICM_20948 does)
+
+The same calls as serif_size_template.cpp (getAGMT, a FIFO count and a FIFO read on an in-memory register file) so
+that the two images differ only in how the bus is reached. Linked on its own with unused sections dropped, see the
+icm20948_serif_size target in CMakeLists.txt.
+
+*/
+
+#include "ICM_20948_C.h"
+
+#include <string.h>
+
+static volatile uint8_t size_regs[128];
+
+static ICM_20948_Status_e size_read(uint8_t reg, uint8_t *pdata, uint32_t len, void *user)
+{
+  (void)user;
+  for (uint32_t i = 0; i < len; i++)
+    pdata[i] = size_regs[(reg + i) & 0x7F];
+  return ICM_20948_Stat_Ok;
+}
+
+static ICM_20948_Status_e size_write(uint8_t reg, uint8_t *pdata, uint32_t len, void *user)
+{
+  (void)user;
+  for (uint32_t i = 0; i < len; i++)
+    size_regs[(reg + i) & 0x7F] = pdata[i];
+  return ICM_20948_Stat_Ok;
+}
+
+static const ICM_20948_Serif_t size_serif = {
+    size_write, // write
+    size_read,  // read
+    NULL,       // user
+    NULL,       // write_async
+    NULL,       // read_async
+};
+
+int main(void)
+{
+  ICM_20948_Device_t dev;
+  ICM_20948_AGMT_t agmt;
+  uint8_t fifo[64];
+  uint16_t count = 0;
+  memset(&dev, 0, sizeof(dev));
+  dev._last_bank = 255;
+  dev._last_mems_bank = 255;
+  ICM_20948_link_serif(&dev, &size_serif);
+  if ((ICM_20948_get_agmt(&dev, &agmt) != ICM_20948_Stat_Ok) || (ICM_20948_get_FIFO_count(&dev, &count) != ICM_20948_Stat_Ok) ||
+      (ICM_20948_read_FIFO(&dev, fifo, (count < sizeof(fifo)) ? count : sizeof(fifo)) != ICM_20948_Stat_Ok))
+  {
+    return 1;
+  }
+  return agmt.acc.axes.x + fifo[0];
+}
@@ -0,0 +1,49 @@
+/*
+
+Code size probe: the bus bound at compile time (ICM_20948_T)
+
+The same calls as serif_size_fnptr.c (getAGMT, a FIFO count and a FIFO read on an in-memory register file) so that
+the two images differ only in how the bus is reached. Linked on its own with unused sections dropped, see the
+icm20948_serif_size target in CMakeLists.txt.
+
+*/
+
+#include "ICM_20948_T.h"
+
+static volatile uint8_t size_regs[128];
+
+struct SizeTransport
+{
+  static ICM_20948_Status_e read(uint8_t reg, uint8_t *pdata, uint32_t len)
+  {
+    for (uint32_t i = 0; i < len; i++)
+      pdata[i] = size_regs[(reg + i) & 0x7F];
+    return ICM_20948_Stat_Ok;
+  }
+  static ICM_20948_Status_e write(uint8_t reg, uint8_t *pdata, uint32_t len)
+  {
+    for (uint32_t i = 0; i < len; i++)
+      size_regs[(reg + i) & 0x7F] = pdata[i];
+    return ICM_20948_Stat_Ok;
+  }
+};
+
+class SizeICM : public ICM_20948_T<SizeTransport>
+{
+public:
+  using ICM_20948_T<SizeTransport>::getAGMT;
+  using ICM_20948_T<SizeTransport>::agmt;
+};
+
+int main(void)
+{
+  SizeICM icm;
+  uint8_t fifo[64];
+  uint16_t count = 0;
+  if ((icm.getAGMT(true) != ICM_20948_Stat_Ok) || (icm.getFIFOcount(&count) != ICM_20948_Stat_Ok) ||
+      (icm.readFIFO(fifo, (count < sizeof(fifo)) ? count : sizeof(fifo)) != ICM_20948_Stat_Ok))
+  {
+    return 1;
+  }
+  return icm.agmt.acc.axes.x + fifo[0];
+}
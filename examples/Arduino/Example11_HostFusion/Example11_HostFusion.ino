@@ -0,0 +1,147 @@
+/****************************************************************
+ * Example11_HostFusion.ino
+ * ICM 20948 Arduino Library Demo
+ * Fuse the accelerometer, gyro and magnetometer into a quaternion on the microcontroller (no DMP needed)
+ * and measure how long each update takes
+ *
+ * Please see License.md for the license information.
+ *
+ * Distributed as-is; no warranty is given.
+ ***************************************************************/
+#include "ICM_20948.h" // Click here to get the library: http://librarymanager/All#SparkFun_ICM_20948_IMU
+
+//#define USE_SPI       // Uncomment this to use SPI
+
+//#define USE_FIXED_POINT // Uncomment this to use the integer (Q30) filter, for processors without an FPU
+
+#define USE_MAG true // false for 6-axis fusion (yaw drifts)
+
+#define SERIAL_PORT Serial
+
+#define SPI_PORT SPI // Your desired SPI port.       Used only when "USE_SPI" is defined
+#define CS_PIN 2     // Which pin you connect CS to. Used only when "USE_SPI" is defined
+
+#define WIRE_PORT Wire // Your desired Wire port.      Used when "USE_SPI" is not defined
+#define AD0_VAL 1      // The value of the last bit of the I2C address.                \
+                       // On the SparkFun 9DoF IMU breakout the default is 1, and when \
+                       // the ADR jumper is closed the value becomes 0
+
+#define SAMPLE_RATE_DIVIDER 10 // The accel and gyro run at 1125 / (1 + 10) = 102.3Hz
+
+#ifdef USE_SPI
+ICM_20948_SPI myICM; // If using SPI create an ICM_20948_SPI object
+#else
+ICM_20948_I2C myICM; // Otherwise create an ICM_20948_I2C object
+#endif
+
+#ifdef USE_FIXED_POINT
+ICM_20948_Fusion_Q30_t fusion;
+#else
+ICM_20948_Fusion_t fusion;
+#endif
+
+unsigned long updateMicros = 0; // Time spent in the fusion updates
+unsigned long updates = 0;
+
+void setup()
+{
+
+  SERIAL_PORT.begin(115200);
+  while (!SERIAL_PORT)
+  {
+  };
+
+#ifdef USE_SPI
+  SPI_PORT.begin();
+#else
+  WIRE_PORT.begin();
+  WIRE_PORT.setClock(400000);
+#endif
+
+  bool initialized = false;
+  while (!initialized)
+  {
+
+#ifdef USE_SPI
+    myICM.begin(CS_PIN, SPI_PORT);
+#else
+    myICM.begin(WIRE_PORT, AD0_VAL);
+#endif
+
+    SERIAL_PORT.print(F("Initialization of the sensor returned: "));
+    SERIAL_PORT.println(myICM.statusString());
+    if (myICM.status != ICM_20948_Stat_Ok)
+    {
+      SERIAL_PORT.println("Trying again...");
+      delay(500);
+    }
+    else
+    {
+      initialized = true;
+    }
+  }
+
+  // The filter needs to know how often it is updated
+  ICM_20948_smplrt_t mySmplrt;
+  mySmplrt.a = SAMPLE_RATE_DIVIDER;
+  mySmplrt.g = SAMPLE_RATE_DIVIDER;
+  myICM.setSampleRate((ICM_20948_Internal_Acc | ICM_20948_Internal_Gyr), mySmplrt);
+  SERIAL_PORT.print(F("setSampleRate returned: "));
+  SERIAL_PORT.println(myICM.statusString());
+
+#ifdef USE_FIXED_POINT
+  ICM_20948_fusion_q30_init(&fusion, 1125 / (1 + SAMPLE_RATE_DIVIDER), ICM_20948_FUSION_KP_Q16, ICM_20948_FUSION_KI_Q16);
+#else
+  ICM_20948_fusion_init(&fusion, 1125.0 / (1 + SAMPLE_RATE_DIVIDER), ICM_20948_FUSION_KP, ICM_20948_FUSION_KI);
+#endif
+}
+
+void loop()
+{
+  if (myICM.dataReady())
+  {
+    myICM.getAGMT(); // Hard-iron offsets should be removed from myICM.agmt.mag here
+
+    unsigned long start = micros();
+#ifdef USE_FIXED_POINT
+    ICM_20948_fusion_q30_update(&fusion, &myICM.agmt, USE_MAG);
+#else
+    ICM_20948_fusion_update(&fusion, &myICM.agmt, USE_MAG);
+#endif
+    updateMicros += micros() - start;
+    updates++;
+
+    if (updates == 100)
+    {
+#ifdef USE_FIXED_POINT
+      ICM_20948_Euler_Q16_t euler;
+      ICM_20948_quat_q30_to_euler(&fusion.q, &euler);
+      double roll = (double)euler.roll / 65536.0;
+      double pitch = (double)euler.pitch / 65536.0;
+      double yaw = (double)euler.yaw / 65536.0;
+#else
+      ICM_20948_Euler_t euler;
+      ICM_20948_quat_to_euler(&fusion.q, &euler);
+      double roll = euler.roll;
+      double pitch = euler.pitch;
+      double yaw = euler.yaw;
+#endif
+
+      SERIAL_PORT.print(F("Roll:"));
+      SERIAL_PORT.print(roll, 1);
+      SERIAL_PORT.print(F(" Pitch:"));
+      SERIAL_PORT.print(pitch, 1);
+      SERIAL_PORT.print(F(" Yaw:"));
+      SERIAL_PORT.print(yaw, 1);
+      SERIAL_PORT.print(F(" Microseconds per update:"));
+      SERIAL_PORT.println((double)updateMicros / updates, 1);
+
+      updateMicros = 0;
+      updates = 0;
+    }
+  }
+  else
+  {
+    delay(1); // Don't hammer the bus while waiting for the next sample
+  }
+}
@@ -152,6 +152,11 @@ void setup()
   //success &= (myICM.setDMPODRrate(DMP_ODR_Reg_Cpass, 0) == ICM_20948_Stat_Ok); // Set to the maximum
   //success &= (myICM.setDMPODRrate(DMP_ODR_Reg_Cpass_Calibr, 0) == ICM_20948_Stat_Ok); // Set to the maximum
 
+  // Restore the biases the DMP learned last time, so Quat9 is accurate straight away.
+  // Save them with myICM.getDMPBiases(biasBlob) once the accuracy is high, and keep biasBlob in EEPROM / flash
+  //uint8_t biasBlob[ICM_20948_BIAS_BLOB_BYTES]; // Load this from non-volatile memory
+  //myICM.setDMPBiases(biasBlob); // Returns ICM_20948_Stat_ParamErr if biasBlob has not been saved yet (or is corrupt)
+
   // Enable the FIFO
   success &= (myICM.enableFIFO() == ICM_20948_Stat_Ok);
 
@@ -208,60 +208,30 @@ void loop()
 
       //SERIAL_PORT.printf("Quat6 data is: Q1:%ld Q2:%ld Q3:%ld\r\n", data.Quat6.Data.Q1, data.Quat6.Data.Q2, data.Quat6.Data.Q3);
 
-      // Scale to +/- 1
-      double q1 = ((double)data.Quat6.Data.Q1) / 1073741824.0; // Convert to double. Divide by 2^30
-      double q2 = ((double)data.Quat6.Data.Q2) / 1073741824.0; // Convert to double. Divide by 2^30
-      double q3 = ((double)data.Quat6.Data.Q3) / 1073741824.0; // Convert to double. Divide by 2^30
-
-      /*
-      SERIAL_PORT.print(F("Q1:"));
-      SERIAL_PORT.print(q1, 3);
-      SERIAL_PORT.print(F(" Q2:"));
-      SERIAL_PORT.print(q2, 3);
-      SERIAL_PORT.print(F(" Q3:"));
-      SERIAL_PORT.println(q3, 3);
-*/
-
-      // Convert the quaternions to Euler angles (roll, pitch, yaw)
-      // https://en.wikipedia.org/w/index.php?title=Conversion_between_quaternions_and_Euler_angles&section=8#Source_code_2
-
-      double q0 = sqrt(1.0 - ((q1 * q1) + (q2 * q2) + (q3 * q3)));
-
-      double q2sqr = q2 * q2;
-
-      // roll (x-axis rotation)
-      double t0 = +2.0 * (q0 * q1 + q2 * q3);
-      double t1 = +1.0 - 2.0 * (q1 * q1 + q2sqr);
-      double roll = atan2(t0, t1) * 180.0 / PI;
-
-      // pitch (y-axis rotation)
-      double t2 = +2.0 * (q0 * q2 - q3 * q1);
-      t2 = t2 > 1.0 ? 1.0 : t2;
-      t2 = t2 < -1.0 ? -1.0 : t2;
-      double pitch = asin(t2) * 180.0 / PI;
-
-      // yaw (z-axis rotation)
-      double t3 = +2.0 * (q0 * q3 + q1 * q2);
-      double t4 = +1.0 - 2.0 * (q2sqr + q3 * q3);
-      double yaw = atan2(t3, t4) * 180.0 / PI;
+      // Rebuild Q0 and convert the quaternion to Euler angles (roll, pitch, yaw) in degrees.
+      // See util/ICM_20948_Quat.h for the rotation matrix, the gravity vector and integer-only (Q30) versions.
+      ICM_20948_Quat_t q;
+      ICM_20948_Euler_t euler;
+      ICM_20948_quat_from_dmp(&data, DMP_header_bitmap_Quat6, &q);
+      ICM_20948_quat_to_euler(&q, &euler);
 
 #ifndef QUAT_ANIMATION
       SERIAL_PORT.print(F("Roll:"));
-      SERIAL_PORT.print(roll, 1);
+      SERIAL_PORT.print(euler.roll, 1);
       SERIAL_PORT.print(F(" Pitch:"));
-      SERIAL_PORT.print(pitch, 1);
+      SERIAL_PORT.print(euler.pitch, 1);
       SERIAL_PORT.print(F(" Yaw:"));
-      SERIAL_PORT.println(yaw, 1);
+      SERIAL_PORT.println(euler.yaw, 1);
 #else
       // Output the Quaternion data in the format expected by ZaneL's Node.js Quaternion animation tool
       SERIAL_PORT.print(F("{\"quat_w\":"));
-      SERIAL_PORT.print(q0, 3);
+      SERIAL_PORT.print(q.w, 3);
       SERIAL_PORT.print(F(", \"quat_x\":"));
-      SERIAL_PORT.print(q1, 3);
+      SERIAL_PORT.print(q.x, 3);
       SERIAL_PORT.print(F(", \"quat_y\":"));
-      SERIAL_PORT.print(q2, 3);
+      SERIAL_PORT.print(q.y, 3);
       SERIAL_PORT.print(F(", \"quat_z\":"));
-      SERIAL_PORT.print(q3, 3);
+      SERIAL_PORT.print(q.z, 3);
       SERIAL_PORT.println(F("}"));
 #endif
     }
@@ -8,10 +8,18 @@ ICM_20948_Status_e ICM_20948_write_I2C(uint8_t reg, uint8_t *data, uint32_t len,
 ICM_20948_Status_e ICM_20948_read_I2C(uint8_t reg, uint8_t *buff, uint32_t len, void *user);
 ICM_20948_Status_e ICM_20948_write_SPI(uint8_t reg, uint8_t *buff, uint32_t len, void *user);
 ICM_20948_Status_e ICM_20948_read_SPI(uint8_t reg, uint8_t *buff, uint32_t len, void *user);
+#if defined(ICM_20948_USE_BUS_STATS)
+static uint32_t ICM_20948_micros(void) { return (uint32_t)micros(); } // micros returns unsigned long, which is not uint32_t on every core
+#endif
 
 // Base
 ICM_20948::ICM_20948()
 {
+  ICM_20948_fss_t fss; // The power-on defaults: +/- 2g and +/- 250dps
+  fss.a = 0;
+  fss.g = 0;
+  fss.reserved_0 = 0;
+  ICM_20948_scale_init(&_scale, fss);
 }
 
 void ICM_20948::enableDebugging(Stream &debugPort)
@@ -131,6 +139,12 @@ void ICM_20948::debugPrintStatus(ICM_20948_Status_e stat)
   case ICM_20948_Stat_InvalDMPRegister:
     debugPrint(F("Invalid DMP Register"));
     break;
+  case ICM_20948_Stat_QueueFull:
+    debugPrint(F("Sample Queue Full"));
+    break;
+  case ICM_20948_Stat_BusBusy:
+    debugPrint(F("Bus Busy"));
+    break;
   default:
     debugPrint(F("Unknown Status"));
     break;
@@ -139,11 +153,56 @@ void ICM_20948::debugPrintStatus(ICM_20948_Status_e stat)
 
 ICM_20948_AGMT_t ICM_20948::getAGMT(void)
 {
+  ICM_20948_BUS_CTX_ENTER(&_device, ICM_20948_Bus_Ctx_GetAGMT);
   status = ICM_20948_get_agmt(&_device, &agmt);
+  ICM_20948_BUS_CTX_LEAVE(&_device);
+
+  return agmt;
+}
 
+ICM_20948_Status_e ICM_20948::getAGMTAsync(uint8_t *buff, ICM_20948_Serif_Done_t done, void *context)
+{
+  status = ICM_20948_get_agmt_async(&_device, buff, done, context);
+  return status;
+}
+
+ICM_20948_AGMT_t ICM_20948::decodeAGMT(const uint8_t *buff)
+{
+  ICM_20948_decode_agmt(buff, _device._fss, &agmt);
   return agmt;
 }
 
+ICM_20948_Status_e ICM_20948::queueAGMT(ICM_20948_Sample_Queue_t *queue, uint32_t timestamp)
+{
+  // Deliberately does not touch 'status' or 'agmt': this can be called from an ISR or another task while the application is using them
+  return ICM_20948_queue_agmt(&_device, queue, timestamp);
+}
+
+ICM_20948_Status_e ICM_20948::dequeueAGMT(ICM_20948_Sample_Queue_t *queue, uint32_t *timestamp)
+{
+  ICM_20948_Sample_t sample;
+  status = ICM_20948_queue_pop(queue, &sample);
+  if (status == ICM_20948_Stat_Ok)
+  {
+    agmt = sample.agmt; // So that accX() etc. return the dequeued sample
+    if (timestamp != NULL)
+      *timestamp = sample.timestamp;
+  }
+  return status;
+}
+
+ICM_20948_Status_e ICM_20948::getBusStats(ICM_20948_Bus_Ctx_e ctx, ICM_20948_Bus_Stats_t *stats)
+{
+  status = ICM_20948_get_bus_stats(&_device, ctx, stats);
+  return status;
+}
+
+ICM_20948_Status_e ICM_20948::resetBusStats(void)
+{
+  status = ICM_20948_reset_bus_stats(&_device);
+  return status;
+}
+
 float ICM_20948::magX(void)
 {
   return getMagUT(agmt.mag.axes.x);
@@ -159,9 +218,18 @@ float ICM_20948::magZ(void)
   return getMagUT(agmt.mag.axes.z);
 }
 
+const ICM_20948_Scale_t *ICM_20948::scale(void)
+{
+  if ((agmt.fss.a != _scale.fss.a) || (agmt.fss.g != _scale.fss.g))
+  {
+    ICM_20948_scale_init(&_scale, agmt.fss); // Only when the full scale changes, not per sample
+  }
+  return &_scale;
+}
+
 float ICM_20948::getMagUT(int16_t axis_val)
 {
-  return (((float)axis_val) * 0.15);
+  return ((float)axis_val) * _scale.mag;
 }
 
 float ICM_20948::accX(void)
@@ -181,24 +249,7 @@ float ICM_20948::accZ(void)
 
 float ICM_20948::getAccMG(int16_t axis_val)
 {
-  switch (agmt.fss.a)
-  {
-  case 0:
-    return (((float)axis_val) / 16.384);
-    break;
-  case 1:
-    return (((float)axis_val) / 8.192);
-    break;
-  case 2:
-    return (((float)axis_val) / 4.096);
-    break;
-  case 3:
-    return (((float)axis_val) / 2.048);
-    break;
-  default:
-    return 0;
-    break;
-  }
+  return ((float)axis_val) * scale()->acc;
 }
 
 float ICM_20948::gyrX(void)
@@ -218,24 +269,7 @@ float ICM_20948::gyrZ(void)
 
 float ICM_20948::getGyrDPS(int16_t axis_val)
 {
-  switch (agmt.fss.g)
-  {
-  case 0:
-    return (((float)axis_val) / 131);
-    break;
-  case 1:
-    return (((float)axis_val) / 65.5);
-    break;
-  case 2:
-    return (((float)axis_val) / 32.8);
-    break;
-  case 3:
-    return (((float)axis_val) / 16.4);
-    break;
-  default:
-    return 0;
-    break;
-  }
+  return ((float)axis_val) * scale()->gyr;
 }
 
 float ICM_20948::temp(void)
@@ -245,7 +279,21 @@ float ICM_20948::temp(void)
 
 float ICM_20948::getTempC(int16_t val)
 {
-  return (((float)val - 21) / 333.87) + 21;
+  return (((float)val) * _scale.tmp) + _scale.tmp_off;
+}
+
+ICM_20948_AGMT_Scaled_t ICM_20948::getScaledAGMT(void)
+{
+  ICM_20948_AGMT_Scaled_t scaled;
+  ICM_20948_scale_agmt(scale(), &agmt, &scaled);
+  return scaled;
+}
+
+ICM_20948_AGMT_Fixed_t ICM_20948::getFixedAGMT(void)
+{
+  ICM_20948_AGMT_Fixed_t fixed;
+  ICM_20948_fixed_agmt(&agmt, &fixed);
+  return fixed;
 }
 
 const char *ICM_20948::statusString(ICM_20948_Status_e stat)
@@ -310,6 +358,12 @@ const char *ICM_20948::statusString(ICM_20948_Status_e stat)
   case ICM_20948_Stat_InvalDMPRegister:
     return "Invalid DMP Register";
     break;
+  case ICM_20948_Stat_QueueFull:
+    return "Sample Queue Full";
+    break;
+  case ICM_20948_Stat_BusBusy:
+    return "Bus Busy";
+    break;
   default:
     return "Unknown Status";
     break;
@@ -400,6 +454,13 @@ ICM_20948_Status_e ICM_20948::setSampleMode(uint8_t sensor_id_bm, uint8_t lp_con
 ICM_20948_Status_e ICM_20948::setFullScale(uint8_t sensor_id_bm, ICM_20948_fss_t fss)
 {
   status = ICM_20948_set_full_scale(&_device, (ICM_20948_InternalSensorID_bm)sensor_id_bm, fss);
+  if (status == ICM_20948_Stat_Ok) // Keep agmt.fss current so that decodeAGMT can scale correctly without reading it back
+  {
+    if (sensor_id_bm & ICM_20948_Internal_Acc)
+      agmt.fss.a = fss.a;
+    if (sensor_id_bm & ICM_20948_Internal_Gyr)
+      agmt.fss.g = fss.g;
+  }
   return status;
 }
 
@@ -1000,6 +1061,12 @@ ICM_20948_Status_e ICM_20948::readFIFO(uint8_t *data, uint8_t len)
   return status;
 }
 
+ICM_20948_Status_e ICM_20948::readFIFOAsync(uint8_t *data, uint32_t len, ICM_20948_Serif_Done_t done, void *context)
+{
+  status = ICM_20948_read_FIFO_async(&_device, data, len, done, context);
+  return status;
+}
+
 // DMP
 
 ICM_20948_Status_e ICM_20948::enableDMP(bool enable)
@@ -1115,7 +1182,33 @@ ICM_20948_Status_e ICM_20948::readDMPdataFromFIFO(icm_20948_DMP_data_t *data)
 {
   if (_device._dmp_firmware_available == true) // Should we attempt to set the data from the FIFO?
   {
+    ICM_20948_BUS_CTX_ENTER(&_device, ICM_20948_Bus_Ctx_ReadDMPData);
     status = inv_icm20948_read_dmp_data(&_device, data);
+    ICM_20948_BUS_CTX_LEAVE(&_device);
+    return status;
+  }
+  return ICM_20948_Stat_DMPNotSupported;
+}
+
+ICM_20948_Status_e ICM_20948::readDMPframeFromFIFO(uint8_t *frame, uint16_t space, uint16_t *len)
+{
+  if (_device._dmp_firmware_available == true) // Should we attempt to read a frame from the FIFO?
+  {
+    ICM_20948_BUS_CTX_ENTER(&_device, ICM_20948_Bus_Ctx_ReadDMPData);
+    status = inv_icm20948_read_dmp_frame(&_device, frame, space, len);
+    ICM_20948_BUS_CTX_LEAVE(&_device);
+    return status;
+  }
+  return ICM_20948_Stat_DMPNotSupported;
+}
+
+ICM_20948_Status_e ICM_20948::drainDMPFIFO(ICM_20948_Frame_Drain_t *drain)
+{
+  if (_device._dmp_firmware_available == true) // Should we attempt to drain the FIFO?
+  {
+    ICM_20948_BUS_CTX_ENTER(&_device, ICM_20948_Bus_Ctx_ReadDMPData);
+    status = ICM_20948_frame_drain(&_device, drain);
+    ICM_20948_BUS_CTX_LEAVE(&_device);
     return status;
   }
   return ICM_20948_Stat_DMPNotSupported;
@@ -1136,6 +1229,144 @@ ICM_20948_Status_e ICM_20948::setGyroSF(unsigned char div, int gyro_level)
   return ICM_20948_Stat_DMPNotSupported;
 }
 
+ICM_20948_Status_e ICM_20948::setDMPBatchMode(bool enable, uint32_t samples, uint16_t mask)
+{
+  if (_device._dmp_firmware_available == true) // Should we attempt to set batch mode?
+  {
+    status = inv_icm20948_set_dmp_batch(&_device, enable, mask, samples);
+    debugPrint(F("ICM_20948::setDMPBatchMode:  _dataOutCtl2: "));
+    debugPrintf((int)_device._dataOutCtl2);
+    debugPrintln(F(""));
+    return status;
+  }
+  return ICM_20948_Stat_DMPNotSupported;
+}
+
+ICM_20948_Status_e ICM_20948::setDMPBatchWindow(uint32_t window_ms, float sample_rate_hz, uint16_t mask)
+{
+  uint32_t samples = inv_icm20948_dmp_batch_threshold(window_ms, sample_rate_hz);
+  if (samples == 0)
+  {
+    status = ICM_20948_Stat_ParamErr;
+    return status;
+  }
+  return (setDMPBatchMode(true, samples, mask));
+}
+
+ICM_20948_Status_e ICM_20948::getDMPBatchCount(uint32_t *count)
+{
+  if (_device._dmp_firmware_available == true) // Should we attempt to read the batch counter?
+  {
+    status = inv_icm20948_get_dmp_batch_count(&_device, count);
+    return status;
+  }
+  return ICM_20948_Stat_DMPNotSupported;
+}
+
+ICM_20948_Status_e ICM_20948::setDMPFIFOWatermark(uint16_t bytes)
+{
+  if (_device._dmp_firmware_available == true) // Should we attempt to set the watermark?
+  {
+    status = inv_icm20948_set_dmp_fifo_watermark(&_device, bytes);
+    return status;
+  }
+  return ICM_20948_Stat_DMPNotSupported;
+}
+
+ICM_20948_Status_e ICM_20948::setDMPCompassCalibration(const ICM_20948_MagCal_Result_t *cal)
+{
+  if (_device._dmp_firmware_available == true) // Should we attempt to write the calibration?
+  {
+    int32_t b2s[9];
+    int32_t mtx[9];
+    int32_t bias[3];
+    status = inv_icm20948_get_dmp_mount(&_device, b2s); // Keep the mounting (setDMPMount)
+    if (status != ICM_20948_Stat_Ok)
+      return status;
+    ICM_20948_magcal_to_dmp(cal, b2s, mtx, bias);
+    status = inv_icm20948_set_dmp_compass_cal(&_device, mtx, bias);
+    return status;
+  }
+  return ICM_20948_Stat_DMPNotSupported;
+}
+
+ICM_20948_Status_e ICM_20948::setDMPMount(ICM_20948_Mount_e mount)
+{
+  int32_t b2s[9];
+  status = ICM_20948_mount_matrix(mount, b2s);
+  if (status != ICM_20948_Stat_Ok)
+    return status;
+  return (setDMPMountMatrix(b2s));
+}
+
+ICM_20948_Status_e ICM_20948::setDMPMountMatrix(const int32_t *b2s)
+{
+  if (_device._dmp_firmware_available == true) // Should we attempt to write the mounting?
+  {
+    status = inv_icm20948_set_dmp_mount(&_device, b2s);
+    return status;
+  }
+  return ICM_20948_Stat_DMPNotSupported;
+}
+
+ICM_20948_Status_e ICM_20948::getDMPBiases(uint8_t *blob)
+{
+  if (_device._dmp_firmware_available == true) // Should we attempt to read the biases?
+  {
+    status = inv_icm20948_get_dmp_biases(&_device, blob);
+    return status;
+  }
+  return ICM_20948_Stat_DMPNotSupported;
+}
+
+ICM_20948_Status_e ICM_20948::setDMPBiases(const uint8_t *blob)
+{
+  if (_device._dmp_firmware_available == true) // Should we attempt to write the biases?
+  {
+    status = inv_icm20948_set_dmp_biases(&_device, blob);
+    return status;
+  }
+  return ICM_20948_Stat_DMPNotSupported;
+}
+
+ICM_20948_Status_e ICM_20948::setDMPGyroBias(const ICM_20948_TempComp_t *tc)
+{
+  if (_device._dmp_firmware_available == true) // Should we attempt to write the bias?
+  {
+    int32_t bias[3];
+    int32_t dmp[3];
+    if (!ICM_20948_tempcomp_bias(tc, ICM_20948_fixed_tmp_cdegc(agmt.tmp.val), bias))
+      return ICM_20948_Stat_NoData;
+    ICM_20948_tempcomp_to_dmp(bias, dmp);
+    status = inv_icm20948_set_dmp_gyro_bias(&_device, dmp);
+    return status;
+  }
+  return ICM_20948_Stat_DMPNotSupported;
+}
+
+ICM_20948_Status_e ICM_20948::initDMPTimeline(ICM_20948_Timeline_t *timeline, uint8_t gyro_smplrt_div, uint16_t odr_interval, ICM_20948_Timeline_Footer_e footer)
+{
+  if (_device._dmp_firmware_available == true) // The PLL correction is only read when the DMP is used
+  {
+    if (_device._gyroSF == 0) // setGyroSF has not been called, so _gyroSFpll is not the chip's correction
+    {
+      debugPrintln(F("ICM_20948::initDMPTimeline: call initializeDMP (or setGyroSF) first"));
+      status = ICM_20948_Stat_NoData;
+      return status;
+    }
+    uint32_t tick_ns = ICM_20948_time_gyro_period_ns(gyro_smplrt_div, _device._gyroSFpll);
+    ICM_20948_timeline_init(timeline, tick_ns, (uint32_t)odr_interval + 1, footer); // 32 bits: an interval of 65535 is 65536 samples
+    debugPrint(F("ICM_20948::initDMPTimeline:  pll: "));
+    debugPrintf((int)_device._gyroSFpll);
+    debugPrint(F("  sample period (ns): "));
+    debugPrintf((int)tick_ns);
+    debugPrintln(F(""));
+    status = ICM_20948_Stat_Ok;
+    return status;
+  }
+  return ICM_20948_Stat_DMPNotSupported;
+}
+
 // Combine all of the DMP start-up code from the earlier DMP examples
 // This function is defined as __attribute__((weak)) so you can overwrite it if you want to,
 //   e.g. to modify the sample rate
@@ -1150,6 +1381,8 @@ ICM_20948_Status_e ICM_20948::initializeDMP(void)
 
   ICM_20948_Status_e  worstResult = ICM_20948_Stat_Ok;
 
+  ICM_20948_BUS_CTX_ENTER(&_device, ICM_20948_Bus_Ctx_InitializeDMP);
+
 #if defined(ICM_20948_USE_DMP)
 
   // The ICM-20948 is awake and ready but hasn't been configured. Let's step through the configuration
@@ -1310,32 +1543,15 @@ ICM_20948_Status_e ICM_20948::initializeDMP(void)
   // Y = raw_x * CPASS_MTX_10 + raw_y * CPASS_MTX_11 + raw_z * CPASS_MTX_12
   // Z = raw_x * CPASS_MTX_20 + raw_y * CPASS_MTX_21 + raw_z * CPASS_MTX_22
   // The AK09916 produces a 16-bit signed output in the range +/-32752 corresponding to +/-4912uT. 1uT = 6.66 ADU.
-  // 2^30 / 6.66666 = 161061273 = 0x9999999
-  const unsigned char mountMultiplierZero[4] = {0x00, 0x00, 0x00, 0x00};
-  const unsigned char mountMultiplierPlus[4] = {0x09, 0x99, 0x99, 0x99};  // Value taken from InvenSense Nucleo example
-  const unsigned char mountMultiplierMinus[4] = {0xF6, 0x66, 0x66, 0x67}; // Value taken from InvenSense Nucleo example
-  result = writeDMPmems(CPASS_MTX_00, 4, &mountMultiplierPlus[0]); if (result > worstResult) worstResult = result;
-  result = writeDMPmems(CPASS_MTX_01, 4, &mountMultiplierZero[0]); if (result > worstResult) worstResult = result;
-  result = writeDMPmems(CPASS_MTX_02, 4, &mountMultiplierZero[0]); if (result > worstResult) worstResult = result;
-  result = writeDMPmems(CPASS_MTX_10, 4, &mountMultiplierZero[0]); if (result > worstResult) worstResult = result;
-  result = writeDMPmems(CPASS_MTX_11, 4, &mountMultiplierMinus[0]); if (result > worstResult) worstResult = result;
-  result = writeDMPmems(CPASS_MTX_12, 4, &mountMultiplierZero[0]); if (result > worstResult) worstResult = result;
-  result = writeDMPmems(CPASS_MTX_20, 4, &mountMultiplierZero[0]); if (result > worstResult) worstResult = result;
-  result = writeDMPmems(CPASS_MTX_21, 4, &mountMultiplierZero[0]); if (result > worstResult) worstResult = result;
-  result = writeDMPmems(CPASS_MTX_22, 4, &mountMultiplierMinus[0]); if (result > worstResult) worstResult = result;
+  // 2^30 / 6.66666 = 161061273 = 0x9999999 (ICM_20948_CPASS_UT_PER_LSB_Q30: value taken from InvenSense Nucleo example)
+  // The AK09916 y and z axes are the opposite way to the accel/gyro, so CPASS_MTX_11 and CPASS_MTX_22 are negative.
 
   // Configure the B2S Mounting Matrix
-  const unsigned char b2sMountMultiplierZero[4] = {0x00, 0x00, 0x00, 0x00};
-  const unsigned char b2sMountMultiplierPlus[4] = {0x40, 0x00, 0x00, 0x00}; // Value taken from InvenSense Nucleo example
-  result = writeDMPmems(B2S_MTX_00, 4, &b2sMountMultiplierPlus[0]); if (result > worstResult) worstResult = result;
-  result = writeDMPmems(B2S_MTX_01, 4, &b2sMountMultiplierZero[0]); if (result > worstResult) worstResult = result;
-  result = writeDMPmems(B2S_MTX_02, 4, &b2sMountMultiplierZero[0]); if (result > worstResult) worstResult = result;
-  result = writeDMPmems(B2S_MTX_10, 4, &b2sMountMultiplierZero[0]); if (result > worstResult) worstResult = result;
-  result = writeDMPmems(B2S_MTX_11, 4, &b2sMountMultiplierPlus[0]); if (result > worstResult) worstResult = result;
-  result = writeDMPmems(B2S_MTX_12, 4, &b2sMountMultiplierZero[0]); if (result > worstResult) worstResult = result;
-  result = writeDMPmems(B2S_MTX_20, 4, &b2sMountMultiplierZero[0]); if (result > worstResult) worstResult = result;
-  result = writeDMPmems(B2S_MTX_21, 4, &b2sMountMultiplierZero[0]); if (result > worstResult) worstResult = result;
-  result = writeDMPmems(B2S_MTX_22, 4, &b2sMountMultiplierPlus[0]); if (result > worstResult) worstResult = result;
+  // The identity (1 = 2^30 = 0x40000000, value taken from InvenSense Nucleo example): the chip axes are the board axes.
+  // setDMPMountMatrix writes B2S_MTX_00-22 and the compass matrix above (CPASS_MTX_00-22) in one burst each.
+  // Call setDMPMount after initializeDMP if the chip is turned on the board
+  static const int32_t b2sIdentity[9] = {ICM_20948_Q30(1.0), 0, 0, 0, ICM_20948_Q30(1.0), 0, 0, 0, ICM_20948_Q30(1.0)};
+  result = setDMPMountMatrix(b2sIdentity); if (result > worstResult) worstResult = result;
 
   // Configure the DMP Gyro Scaling Factor
   // @param[in] gyro_div Value written to GYRO_SMPLRT_DIV register, where
@@ -1385,6 +1601,8 @@ ICM_20948_Status_e ICM_20948::initializeDMP(void)
 
 #endif
 
+  ICM_20948_BUS_CTX_LEAVE(&_device);
+
   return worstResult;
 }
 
@@ -1424,6 +1642,8 @@ ICM_20948_Status_e ICM_20948_I2C::begin(TwoWire &wirePort, bool ad0val, uint8_t
   _serif.write = ICM_20948_write_I2C;
   _serif.read = ICM_20948_read_I2C;
   _serif.user = (void *)this; // refer to yourself in the user field
+  _serif.write_async = NULL;  // TwoWire is blocking. Users with DMA can plug in their own async functions
+  _serif.read_async = NULL;
 
   // Link the serif
   _device._serif = &_serif;
@@ -1439,10 +1659,20 @@ ICM_20948_Status_e ICM_20948_I2C::begin(TwoWire &wirePort, bool ad0val, uint8_t
   _device._last_mems_bank = 255;    // Initialize _last_mems_bank. Make it invalid. It will be set by the first call of inv_icm20948_write_mems.
   _device._gyroSF = 0;              // Use this to record the GyroSF, calculated by inv_icm20948_set_gyro_sf
   _device._gyroSFpll = 0;
+  _device._fss.a = 0;               // The power-on full scale (+/- 2g, +/- 250dps). Kept up to date by setFullScale and getAGMT
+  _device._fss.g = 0;
+  _device._bus_busy = false;
+  _device._async_done = NULL;
+  _device._async_context = NULL;
   _device._enabled_Android_0 = 0;      // Keep track of which Android sensors are enabled: 0-31
   _device._enabled_Android_1 = 0;      // Keep track of which Android sensors are enabled: 32-
   _device._enabled_Android_intr_0 = 0; // Keep track of which Android sensor interrupts are enabled: 0-31
+  _device._dataOutCtl1_fifo = 0;       // No outputs have been enabled yet
   _device._enabled_Android_intr_1 = 0; // Keep track of which Android sensor interrupts are enabled: 32-
+#if defined(ICM_20948_USE_BUS_STATS)
+  ICM_20948_reset_bus_stats(&_device);                          // Start counting from zero, against ICM_20948_Bus_Ctx_Other
+  ICM_20948_set_bus_stats_clock(&_device, ICM_20948_micros); // Measure the time on the bus with micros
+#endif
 
   // Perform default startup
   // Do a minimal startupDefault if using the DMP. User can always call startupDefault(false) manually if required.
@@ -1621,6 +1851,8 @@ ICM_20948_Status_e ICM_20948_SPI::begin(uint8_t csPin, SPIClass &spiPort, uint32
   _serif.write = ICM_20948_write_SPI;
   _serif.read = ICM_20948_read_SPI;
   _serif.user = (void *)this; // refer to yourself in the user field
+  _serif.write_async = NULL;  // SPIClass is blocking. Users with DMA can plug in their own async functions
+  _serif.read_async = NULL;
 
   // Link the serif
   _device._serif = &_serif;
@@ -1636,10 +1868,20 @@ ICM_20948_Status_e ICM_20948_SPI::begin(uint8_t csPin, SPIClass &spiPort, uint32
   _device._last_mems_bank = 255;    // Initialize _last_mems_bank. Make it invalid. It will be set by the first call of inv_icm20948_write_mems.
   _device._gyroSF = 0;              // Use this to record the GyroSF, calculated by inv_icm20948_set_gyro_sf
   _device._gyroSFpll = 0;
+  _device._fss.a = 0;               // The power-on full scale (+/- 2g, +/- 250dps). Kept up to date by setFullScale and getAGMT
+  _device._fss.g = 0;
+  _device._bus_busy = false;
+  _device._async_done = NULL;
+  _device._async_context = NULL;
   _device._enabled_Android_0 = 0;      // Keep track of which Android sensors are enabled: 0-31
   _device._enabled_Android_1 = 0;      // Keep track of which Android sensors are enabled: 32-
   _device._enabled_Android_intr_0 = 0; // Keep track of which Android sensor interrupts are enabled: 0-31
+  _device._dataOutCtl1_fifo = 0;       // No outputs have been enabled yet
   _device._enabled_Android_intr_1 = 0; // Keep track of which Android sensor interrupts are enabled: 32-
+#if defined(ICM_20948_USE_BUS_STATS)
+  ICM_20948_reset_bus_stats(&_device);                          // Start counting from zero, against ICM_20948_Bus_Ctx_Other
+  ICM_20948_set_bus_stats_clock(&_device, ICM_20948_micros); // Measure the time on the bus with micros
+#endif
 
   // Perform default startup
   // Do a minimal startupDefault if using the DMP. User can always call startupDefault(false) manually if required.
@@ -9,6 +9,13 @@ A C++ interface to the ICM-20948
 
 #include "util/ICM_20948_C.h" // The C backbone. ICM_20948_USE_DMP is defined in here.
 #include "util/AK09916_REGISTERS.h"
+#include "util/ICM_20948_Time.h" // DMP frame timestamps
+#include "util/ICM_20948_Frame.h" // Compact DMP frames
+#include "util/ICM_20948_Quat.h"  // Quaternion math for the DMP orientation outputs
+#include "util/ICM_20948_Fusion.h" // Sensor fusion on the host, for builds without the DMP
+#include "util/ICM_20948_MagCal.h" // Magnetometer hard and soft iron calibration
+#include "util/ICM_20948_TempComp.h" // Gyro bias against temperature
+#include "util/ICM_20948_Decim.h" // Decimation and anti-alias filtering
 
 #include "Arduino.h" // Arduino support
 #include "Wire.h"
@@ -28,6 +35,9 @@ private:
 protected:
   ICM_20948_Device_t _device;
 
+  ICM_20948_Scale_t _scale;            // Unit conversion factors for _scale.fss
+  const ICM_20948_Scale_t *scale(void); // Recomputes _scale if agmt.fss has changed
+
   float getTempC(int16_t val);
   float getGyrDPS(int16_t axis_val);
   float getAccMG(int16_t axis_val);
@@ -75,6 +85,24 @@ public:
   ICM_20948_AGMT_t agmt;          // Acceleometer, Gyroscope, Magenetometer, and Temperature data
   ICM_20948_AGMT_t getAGMT(void); // Updates the agmt field in the object and also returns a copy directly
 
+  // Asynchronous AGMT read for serifs with read_async (e.g. DMA). Start the transfer into buff (ICM_20948_AGMT_RAW_BYTES), then call decodeAGMT(buff) once done has been called.
+  // decodeAGMT uses the full-scale settings cached in the device, which are kept up to date by getAGMT and setFullScale.
+  ICM_20948_Status_e getAGMTAsync(uint8_t *buff, ICM_20948_Serif_Done_t done, void *context = NULL);
+  ICM_20948_AGMT_t decodeAGMT(const uint8_t *buff);
+
+  // Sample queue: a lock-free single-producer / single-consumer ring of timestamped samples (see ICM_20948_queue_init)
+  // queueAGMT is the producer. Call it from the INT ISR (only if your core allows bus transactions in an ISR) or from a high-priority task.
+  // queueAGMT never selects a bank: it returns ICM_20948_Stat_BusBusy (a dropped sample) if it would interrupt a transfer or bank 0 is not selected.
+  // getAGMT leaves bank 0 selected, so call it once before starting the producer. Other calls may leave another bank selected.
+  // dequeueAGMT is the consumer. It copies the oldest sample into the agmt field so accX() etc. can be used as normal.
+  ICM_20948_Status_e queueAGMT(ICM_20948_Sample_Queue_t *queue, uint32_t timestamp);
+  ICM_20948_Status_e dequeueAGMT(ICM_20948_Sample_Queue_t *queue, uint32_t *timestamp = NULL); // Returns ICM_20948_Stat_NoData if the queue is empty
+
+  // Bus statistics: transactions, bytes, bank switches and time on the bus, counted separately for getAGMT, readDMPdataFromFIFO and initializeDMP
+  // These return ICM_20948_Stat_NotImpl unless ICM_20948_USE_BUS_STATS is defined in util/ICM_20948_C.h
+  ICM_20948_Status_e getBusStats(ICM_20948_Bus_Ctx_e ctx, ICM_20948_Bus_Stats_t *stats);
+  ICM_20948_Status_e resetBusStats(void);
+
   float magX(void); // micro teslas
   float magY(void); // micro teslas
   float magZ(void); // micro teslas
@@ -89,6 +117,9 @@ public:
 
   float temp(void); // degrees celsius
 
+  ICM_20948_AGMT_Scaled_t getScaledAGMT(void); // All ten values of the agmt field in their units (as above), in one pass. Does not read the sensor: call after getAGMT, decodeAGMT or dequeueAGMT
+  ICM_20948_AGMT_Fixed_t getFixedAGMT(void);   // As getScaledAGMT, in integer units (mg Q16.16, mdps, nT, centi-degC) so that no float code is needed. See ICM_20948_fixed_agmt
+
   ICM_20948_Status_e status;                                              // Status from latest operation
   const char *statusString(ICM_20948_Status_e stat = ICM_20948_Stat_NUM); // Returns a human-readable status message. Defaults to status member, but prints string for supplied status if supplied
 
@@ -170,6 +201,7 @@ public:
   ICM_20948_Status_e setFIFOmode(bool snapshot = false); // Default to Stream (non-Snapshot) mode
   ICM_20948_Status_e getFIFOcount(uint16_t *count);
   ICM_20948_Status_e readFIFO(uint8_t *data, uint8_t len = 1);
+  ICM_20948_Status_e readFIFOAsync(uint8_t *data, uint32_t len, ICM_20948_Serif_Done_t done, void *context = NULL); // Drain len bytes in one transfer. Falls back to a blocking read if the serif has no read_async
 
   //DMP
 
@@ -190,16 +222,16 @@ public:
   //  Configuring Accel gain
   //  Configure I2C_SLV0 and I2C_SLV1 to: request mag data from the hidden reserved AK09916 registers; trigger Single Measurements
   //  Configure I2C Master ODR (default to 68.75Hz)
+  //  Additional FIFO output control: FIFO_WATERMARK, BM_BATCH_MASK, BM_BATCH_CNTR, BM_BATCH_THLD
+  //  Biases: save and load (getDMPBiases / setDMPBiases)
 
   // To Do:
-  //  Additional FIFO output control: FIFO_WATERMARK, BM_BATCH_MASK, BM_BATCH_CNTR, BM_BATCH_THLD
   //  Configuring DMP features: PED_STD_STEPCTR, PED_STD_TIMECTR
   //  Enabling Activity Recognition (BAC) feature
   //  Enabling Significant Motion Detect (SMD) feature
   //  Enabling Tilt Detector feature
   //  Enabling Pick Up Gesture feature
   //  Enabling Fsync detection feature
-  //  Biases: add save and load methods
 
   ICM_20948_Status_e enableDMP(bool enable = true);
   ICM_20948_Status_e resetDMP(void);
@@ -211,7 +243,20 @@ public:
   ICM_20948_Status_e readDMPmems(unsigned short reg, unsigned int length, unsigned char *data);
   ICM_20948_Status_e setDMPODRrate(enum DMP_ODR_Registers odr_reg, int interval);
   ICM_20948_Status_e readDMPdataFromFIFO(icm_20948_DMP_data_t *data);
+  ICM_20948_Status_e readDMPframeFromFIFO(uint8_t *frame, uint16_t space, uint16_t *len); // Read one compact frame (see util/ICM_20948_Frame.h). space must be at least icm_20948_DMP_Maximum_Packet_Bytes
+  ICM_20948_Status_e drainDMPFIFO(ICM_20948_Frame_Drain_t *drain); // Read everything in the FIFO into the drain buffer, then walk it with ICM_20948_frame_drain_next
   ICM_20948_Status_e setGyroSF(unsigned char div, int gyro_level);
+  ICM_20948_Status_e setDMPBatchMode(bool enable, uint32_t samples = 0, uint16_t mask = DMP_Data_ready_Gyro); // Interrupt once per batch of samples of the sensors in mask. Disable the per-sensor interrupts with enableDMPSensorInt
+  ICM_20948_Status_e setDMPBatchWindow(uint32_t window_ms, float sample_rate_hz, uint16_t mask = DMP_Data_ready_Gyro); // Batch for window_ms. sample_rate_hz is the rate of the sensor in mask, e.g. 1125 / (1 + gyro divider)
+  ICM_20948_Status_e getDMPBatchCount(uint32_t *count);
+  ICM_20948_Status_e setDMPFIFOWatermark(uint16_t bytes = 800);
+  ICM_20948_Status_e setDMPMount(ICM_20948_Mount_e mount = ICM_20948_Mount_Xp_Yp); // How the chip is turned on the board: the DMP outputs are then in the board axes. Call after initializeDMP
+  ICM_20948_Status_e setDMPMountMatrix(const int32_t *b2s);                       // The same for any rotation: nine Q30 values, row-major (see ICM_20948_Q30). ICM_20948_Stat_ParamErr if b2s is not a rotation
+  ICM_20948_Status_e setDMPCompassCalibration(const ICM_20948_MagCal_Result_t *cal); // Hard and soft iron from ICM_20948_magcal_solve (util/ICM_20948_MagCal.h), into CPASS_MTX_xx and CPASS_BIAS_x. Call after initializeDMP and setDMPMount
+  ICM_20948_Status_e getDMPBiases(uint8_t *blob);       // Save the learned gyro, accel and compass biases: ICM_20948_BIAS_BLOB_BYTES to keep in non-volatile memory
+  ICM_20948_Status_e setDMPBiases(const uint8_t *blob); // Restore them after initializeDMP and before enableDMP(true). ICM_20948_Stat_ParamErr if the blob is not valid
+  ICM_20948_Status_e setDMPGyroBias(const ICM_20948_TempComp_t *tc); // The bias from a temperature model (util/ICM_20948_TempComp.h) at the temperature of the last getAGMT, into GYRO_BIAS_x. ICM_20948_Stat_NoData if the model is empty
+  ICM_20948_Status_e initDMPTimeline(ICM_20948_Timeline_t *timeline, uint8_t gyro_smplrt_div = 19, uint16_t odr_interval = 0, ICM_20948_Timeline_Footer_e footer = ICM_20948_Timeline_Footer_Delta); // Timestamp frames using the PLL correction read by setGyroSF (initializeDMP). Match the gyro divider and the DMP ODR interval. ICM_20948_Stat_NoData if setGyroSF has not been called
   ICM_20948_Status_e initializeDMP(void) __attribute__((weak)); // Combine all of the DMP start-up code in one place. Can be overwritten if required
 };
 
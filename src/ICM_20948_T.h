@@ -0,0 +1,253 @@
+/*
+
+A header-only C++ interface to the ICM-20948 with the bus bound at compile time
+
+ICM_20948 reaches the bus through the ICM_20948_Serif_t function pointers. That keeps it flexible but stops
+the compiler from inlining the register accesses. ICM_20948_T takes the bus as a template parameter instead:
+a policy class with two static functions
+
+  struct MyTransport
+  {
+    static ICM_20948_Status_e read(uint8_t reg, uint8_t *pdata, uint32_t len);
+    static ICM_20948_Status_e write(uint8_t reg, uint8_t *pdata, uint32_t len);
+  };
+
+  ICM_20948_T<MyTransport> myICM;
+
+The hot paths (register access, bank selection, getAGMT and the FIFO) call the transport directly so they can
+be inlined into tight bus code. Everything else goes through the portable C layer (ICM_20948_C.h) using
+device(), which shares the same bank cache, so the two can be mixed freely.
+
+This header does not depend on Arduino.h: the transport decides what bus library to use.
+
+*/
+
+#ifndef _ICM_20948_T_H_
+#define _ICM_20948_T_H_
+
+#include "util/ICM_20948_C.h"
+
+template <class Transport>
+class ICM_20948_T
+{
+private:
+  static ICM_20948_Status_e serifWrite(uint8_t reg, uint8_t *pdata, uint32_t len, void *user)
+  {
+    (void)user;
+    return Transport::write(reg, pdata, len);
+  }
+  static ICM_20948_Status_e serifRead(uint8_t reg, uint8_t *pdata, uint32_t len, void *user)
+  {
+    (void)user;
+    return Transport::read(reg, pdata, len);
+  }
+
+  static const ICM_20948_Serif_t _serif; // Used by the C layer only. Static, so copying the object is safe
+
+  // The hot paths bypass ICM_20948_execute_r/w, so they count their own bus statistics
+  inline ICM_20948_Status_e transportRead(uint8_t reg, uint8_t *pdata, uint32_t len)
+  {
+#if defined(ICM_20948_USE_BUS_STATS)
+    ICM_20948_Bus_Stats_t *stats = &_device._bus_stats[_device._bus_ctx];
+    uint32_t start = (_device._bus_clock != NULL) ? _device._bus_clock() : 0;
+    ICM_20948_Status_e retval = Transport::read(reg, pdata, len);
+    if (_device._bus_clock != NULL)
+    {
+      stats->time_us += _device._bus_clock() - start;
+    }
+    stats->reads++;
+    stats->bytes_read += len;
+    return retval;
+#else
+    return Transport::read(reg, pdata, len);
+#endif
+  }
+  inline ICM_20948_Status_e transportWrite(uint8_t reg, uint8_t *pdata, uint32_t len)
+  {
+#if defined(ICM_20948_USE_BUS_STATS)
+    ICM_20948_Bus_Stats_t *stats = &_device._bus_stats[_device._bus_ctx];
+    uint32_t start = (_device._bus_clock != NULL) ? _device._bus_clock() : 0;
+    ICM_20948_Status_e retval = Transport::write(reg, pdata, len);
+    if (_device._bus_clock != NULL)
+    {
+      stats->time_us += _device._bus_clock() - start;
+    }
+    stats->writes++;
+    stats->bytes_written += len;
+    return retval;
+#else
+    return Transport::write(reg, pdata, len);
+#endif
+  }
+
+protected:
+  ICM_20948_Device_t _device;
+
+public:
+  ICM_20948_T()
+  {
+    _device._serif = &_serif;
+#if defined(ICM_20948_USE_DMP)
+    _device._dmp_firmware_available = true; // Initialize _dmp_firmware_available
+#else
+    _device._dmp_firmware_available = false; // Initialize _dmp_firmware_available
+#endif
+    _device._firmware_loaded = false; // Initialize _firmware_loaded
+    _device._last_bank = 255;         // Initialize _last_bank. Make it invalid. It will be set by the first call of setBank.
+    _device._last_mems_bank = 255;    // Initialize _last_mems_bank. Make it invalid. It will be set by the first call of inv_icm20948_write_mems.
+    _device._gyroSF = 0;              // Use this to record the GyroSF, calculated by inv_icm20948_set_gyro_sf
+    _device._gyroSFpll = 0;
+    _device._fss.a = 0;               // The power-on full scale (+/- 2g, +/- 250dps). Kept up to date by setFullScale and getAGMT
+    _device._fss.g = 0;
+    _device._bus_busy = false;
+    _device._async_done = NULL;
+    _device._async_context = NULL;
+    _device._enabled_Android_0 = 0;      // Keep track of which Android sensors are enabled: 0-31
+    _device._enabled_Android_1 = 0;      // Keep track of which Android sensors are enabled: 32-
+    _device._enabled_Android_intr_0 = 0; // Keep track of which Android sensor interrupts are enabled: 0-31
+    _device._enabled_Android_intr_1 = 0; // Keep track of which Android sensor interrupts are enabled: 32-
+    _device._dataOutCtl1 = 0;
+    _device._dataOutCtl1_fifo = 0;
+    _device._dataOutCtl2 = 0;
+    _device._dataRdyStatus = 0;
+    _device._motionEventCtl = 0;
+    _device._dataIntrCtl = 0;
+#if defined(ICM_20948_USE_BUS_STATS)
+    ICM_20948_reset_bus_stats(&_device);
+    _device._bus_clock = NULL; // The transport has no clock. Use ICM_20948_set_bus_stats_clock(device(), ...) to measure time_us
+#endif
+    agmt.fss.a = 0; // The power-on defaults: +/- 2g and +/- 250dps
+    agmt.fss.g = 0;
+  }
+
+  ICM_20948_Device_t *device(void) { return &_device; } // For everything else: pass this to the ICM_20948_C functions
+
+  ICM_20948_AGMT_t agmt; // Acceleometer, Gyroscope, Magenetometer, and Temperature data
+
+  // direct read/write
+  inline ICM_20948_Status_e read(uint8_t reg, uint8_t *pdata, uint32_t len) { return transportRead(reg, pdata, len); }
+  inline ICM_20948_Status_e write(uint8_t reg, uint8_t *pdata, uint32_t len) { return transportWrite(reg, pdata, len); }
+
+  inline ICM_20948_Status_e setBank(uint8_t bank)
+  {
+    if (bank > 3)
+    {
+      return ICM_20948_Stat_ParamErr;
+    }
+    if (bank == _device._last_bank) // Do we need to change bank?
+    {
+#if defined(ICM_20948_USE_BUS_STATS)
+      _device._bus_stats[_device._bus_ctx].bank_redundant++;
+#endif
+      return ICM_20948_Stat_Ok; // Bail if we don't need to change bank to avoid unnecessary bus traffic
+    }
+#if defined(ICM_20948_USE_BUS_STATS)
+    _device._bus_stats[_device._bus_ctx].bank_switches++;
+#endif
+    _device._last_bank = 255; // Unknown until the write is done: ICM_20948_queue_agmt must not read in between
+    uint8_t sel = (uint8_t)((bank << 4) & 0x30); // bits 5:4 of REG_BANK_SEL
+    ICM_20948_Status_e retval = transportWrite(REG_BANK_SEL, &sel, 1);
+    if (retval == ICM_20948_Stat_Ok)
+    {
+      _device._last_bank = bank; // Store the new bank only once it is selected
+    }
+    return retval;
+  }
+
+  // Device Level
+  ICM_20948_Status_e checkID(void) { return ICM_20948_check_id(&_device); }
+  ICM_20948_Status_e swReset(void) { return ICM_20948_sw_reset(&_device); }
+  ICM_20948_Status_e sleep(bool on = false) { return ICM_20948_sleep(&_device, on); }
+  ICM_20948_Status_e lowPower(bool on = true) { return ICM_20948_low_power(&_device, on); }
+
+  ICM_20948_Status_e setFullScale(uint8_t sensor_id_bm, ICM_20948_fss_t fss) { return ICM_20948_set_full_scale(&_device, (ICM_20948_InternalSensorID_bm)sensor_id_bm, fss); } // Updates _device._fss, which getAGMT(false) scales with
+
+  // Higher Level
+  // If readFSS is false the full-scale settings are taken from device()->_fss (kept current by setFullScale and getAGMT) instead of being read back, saving three transactions per sample
+  inline ICM_20948_Status_e getAGMT(bool readFSS = true)
+  {
+    ICM_20948_BUS_CTX_ENTER(&_device, ICM_20948_Bus_Ctx_GetAGMT);
+    ICM_20948_Status_e retval = readAGMT(readFSS);
+    ICM_20948_BUS_CTX_LEAVE(&_device);
+    return retval;
+  }
+
+private:
+  inline ICM_20948_Status_e readAGMT(bool readFSS)
+  {
+    uint8_t buff[ICM_20948_AGMT_RAW_BYTES];
+    ICM_20948_Status_e retval;
+
+    if (readFSS) // Read the bank 2 configs first, so that the data burst is last and bank 0 is left selected (as ICM_20948_get_agmt does)
+    {
+      ICM_20948_ACCEL_CONFIG_t acfg;
+      ICM_20948_GYRO_CONFIG_1_t gcfg1;
+      retval = setBank(2);
+      if (retval == ICM_20948_Stat_Ok)
+        retval = transportRead(AGB2_REG_ACCEL_CONFIG, (uint8_t *)&acfg, sizeof(acfg));
+      if (retval == ICM_20948_Stat_Ok)
+        retval = transportRead(AGB2_REG_GYRO_CONFIG_1, (uint8_t *)&gcfg1, sizeof(gcfg1));
+      if (retval != ICM_20948_Stat_Ok)
+      {
+        return retval;
+      }
+      _device._fss.a = acfg.ACCEL_FS_SEL;
+      _device._fss.g = gcfg1.GYRO_FS_SEL;
+    }
+
+    retval = setBank(0);
+    if (retval != ICM_20948_Stat_Ok)
+    {
+      return retval;
+    }
+    retval = transportRead(AGB0_REG_ACCEL_XOUT_H, buff, ICM_20948_AGMT_RAW_BYTES);
+    if (retval != ICM_20948_Stat_Ok)
+    {
+      return retval;
+    }
+
+    ICM_20948_decode_agmt(buff, _device._fss, &agmt);
+    return retval;
+  }
+
+public:
+
+  //FIFO
+  inline ICM_20948_Status_e getFIFOcount(uint16_t *count)
+  {
+    uint8_t buff[2];
+    ICM_20948_Status_e retval = setBank(0);
+    if (retval != ICM_20948_Stat_Ok)
+    {
+      return retval;
+    }
+    retval = transportRead(AGB0_REG_FIFO_COUNT_H, buff, 2); // FIFO_COUNTH and FIFO_COUNTL in one burst
+    if (retval != ICM_20948_Stat_Ok)
+    {
+      return retval;
+    }
+    *count = (((uint16_t)(buff[0] & 0x1F)) << 8) | buff[1];
+    return retval;
+  }
+
+  inline ICM_20948_Status_e readFIFO(uint8_t *data, uint32_t len = 1)
+  {
+    ICM_20948_Status_e retval = setBank(0);
+    if (retval != ICM_20948_Stat_Ok)
+    {
+      return retval;
+    }
+    return transportRead(AGB0_REG_FIFO_R_W, data, len);
+  }
+};
+
+template <class Transport>
+const ICM_20948_Serif_t ICM_20948_T<Transport>::_serif = {
+    ICM_20948_T<Transport>::serifWrite, // write
+    ICM_20948_T<Transport>::serifRead,  // read
+    NULL,                               // user
+    NULL,                               // write_async
+    NULL,                               // read_async
+};
+
+#endif /* _ICM_20948_T_H_ */
@@ -38,7 +38,7 @@ const int DMP_Raw_Gyro_Byte_Ordering[icm_20948_DMP_Raw_Gyro_Bytes + icm_20948_DM
         1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10};
 const int DMP_Activity_Recognition_Byte_Ordering[icm_20948_DMP_Activity_Recognition_Bytes] =
     {
-        0, 1, 5, 4, 3, 2};
+        0, 1, 7, 6, 5, 4}; // Skip Data.Reserved: the timestamp goes to bytes 4-7
 const int DMP_Secondary_On_Off_Byte_Ordering[icm_20948_DMP_Secondary_On_Off_Bytes] =
     {
         1, 0};
@@ -115,6 +115,8 @@ const ICM_20948_Serif_t NullSerif = {
     NULL, // write
     NULL, // read
     NULL, // user
+    NULL, // write_async
+    NULL, // read_async
 };
 
 // Private function prototypes
@@ -140,7 +142,22 @@ ICM_20948_Status_e ICM_20948_execute_w(ICM_20948_Device_t *pdev, uint8_t regaddr
   {
     return ICM_20948_Stat_NotImpl;
   }
-  return (*pdev->_serif->write)(regaddr, pdata, len, pdev->_serif->user);
+  pdev->_bus_busy = true;
+#if defined(ICM_20948_USE_BUS_STATS)
+  ICM_20948_Bus_Stats_t *stats = &pdev->_bus_stats[pdev->_bus_ctx];
+  uint32_t start = (pdev->_bus_clock != NULL) ? pdev->_bus_clock() : 0;
+  ICM_20948_Status_e retval = (*pdev->_serif->write)(regaddr, pdata, len, pdev->_serif->user);
+  if (pdev->_bus_clock != NULL)
+  {
+    stats->time_us += pdev->_bus_clock() - start;
+  }
+  stats->writes++;
+  stats->bytes_written += len;
+#else
+  ICM_20948_Status_e retval = (*pdev->_serif->write)(regaddr, pdata, len, pdev->_serif->user);
+#endif
+  pdev->_bus_busy = false;
+  return retval;
 }
 
 ICM_20948_Status_e ICM_20948_execute_r(ICM_20948_Device_t *pdev, uint8_t regaddr, uint8_t *pdata, uint32_t len)
@@ -149,7 +166,175 @@ ICM_20948_Status_e ICM_20948_execute_r(ICM_20948_Device_t *pdev, uint8_t regaddr
   {
     return ICM_20948_Stat_NotImpl;
   }
-  return (*pdev->_serif->read)(regaddr, pdata, len, pdev->_serif->user);
+  pdev->_bus_busy = true;
+#if defined(ICM_20948_USE_BUS_STATS)
+  ICM_20948_Bus_Stats_t *stats = &pdev->_bus_stats[pdev->_bus_ctx];
+  uint32_t start = (pdev->_bus_clock != NULL) ? pdev->_bus_clock() : 0;
+  ICM_20948_Status_e retval = (*pdev->_serif->read)(regaddr, pdata, len, pdev->_serif->user);
+  if (pdev->_bus_clock != NULL)
+  {
+    stats->time_us += pdev->_bus_clock() - start;
+  }
+  stats->reads++;
+  stats->bytes_read += len;
+#else
+  ICM_20948_Status_e retval = (*pdev->_serif->read)(regaddr, pdata, len, pdev->_serif->user);
+#endif
+  pdev->_bus_busy = false;
+  return retval;
+}
+
+// Completion of an asynchronous transfer: the bus is free again, then tell the caller
+static void ICM_20948_async_done(ICM_20948_Status_e status, void *context)
+{
+  ICM_20948_Device_t *pdev = (ICM_20948_Device_t *)context;
+  pdev->_bus_busy = false;
+  if (pdev->_async_done != NULL)
+  {
+    pdev->_async_done(status, pdev->_async_context);
+  }
+}
+
+ICM_20948_Status_e ICM_20948_execute_w_async(ICM_20948_Device_t *pdev, uint8_t regaddr, uint8_t *pdata, uint32_t len, ICM_20948_Serif_Done_t done, void *context)
+{
+  if (pdev->_serif->write_async == NULL)
+  {
+    // No async support: do a blocking write and complete immediately
+    ICM_20948_Status_e retval = ICM_20948_execute_w(pdev, regaddr, pdata, len);
+    if ((retval == ICM_20948_Stat_Ok) && (done != NULL))
+    {
+      done(retval, context);
+    }
+    return retval;
+  }
+#if defined(ICM_20948_USE_BUS_STATS)
+  pdev->_bus_stats[pdev->_bus_ctx].writes++; // The transfer time is not known here, so time_us is not updated
+  pdev->_bus_stats[pdev->_bus_ctx].bytes_written += len;
+#endif
+  pdev->_async_done = done;
+  pdev->_async_context = context;
+  pdev->_bus_busy = true; // Until the transfer completes
+  ICM_20948_Status_e retval = (*pdev->_serif->write_async)(regaddr, pdata, len, ICM_20948_async_done, (void *)pdev, pdev->_serif->user);
+  if (retval != ICM_20948_Stat_Ok)
+  {
+    pdev->_bus_busy = false; // Not started, so done will not be called
+  }
+  return retval;
+}
+
+ICM_20948_Status_e ICM_20948_execute_r_async(ICM_20948_Device_t *pdev, uint8_t regaddr, uint8_t *pdata, uint32_t len, ICM_20948_Serif_Done_t done, void *context)
+{
+  if (pdev->_serif->read_async == NULL)
+  {
+    // No async support: do a blocking read and complete immediately
+    ICM_20948_Status_e retval = ICM_20948_execute_r(pdev, regaddr, pdata, len);
+    if ((retval == ICM_20948_Stat_Ok) && (done != NULL))
+    {
+      done(retval, context);
+    }
+    return retval;
+  }
+#if defined(ICM_20948_USE_BUS_STATS)
+  pdev->_bus_stats[pdev->_bus_ctx].reads++; // The transfer time is not known here, so time_us is not updated
+  pdev->_bus_stats[pdev->_bus_ctx].bytes_read += len;
+#endif
+  pdev->_async_done = done;
+  pdev->_async_context = context;
+  pdev->_bus_busy = true; // Until the transfer completes
+  ICM_20948_Status_e retval = (*pdev->_serif->read_async)(regaddr, pdata, len, ICM_20948_async_done, (void *)pdev, pdev->_serif->user);
+  if (retval != ICM_20948_Stat_Ok)
+  {
+    pdev->_bus_busy = false; // Not started, so done will not be called
+  }
+  return retval;
+}
+
+typedef struct
+{
+  volatile bool done;
+  volatile ICM_20948_Status_e status;
+} ICM_20948_Wait_t;
+
+static void ICM_20948_wait_done(ICM_20948_Status_e status, void *context)
+{
+  ICM_20948_Wait_t *wait = (ICM_20948_Wait_t *)context;
+  wait->status = status;
+  wait->done = true;
+}
+
+// A blocking read that uses read_async when the serif has it (e.g. so that long bursts go by DMA), and spins until done. It frees the
+// bus, not the CPU: callers that want to overlap work with the transfer use the _async functions directly
+static ICM_20948_Status_e ICM_20948_execute_r_wait(ICM_20948_Device_t *pdev, uint8_t regaddr, uint8_t *pdata, uint32_t len)
+{
+  if (pdev->_serif->read_async == NULL)
+  {
+    return ICM_20948_execute_r(pdev, regaddr, pdata, len);
+  }
+
+  ICM_20948_Wait_t wait;
+  wait.done = false;
+  wait.status = ICM_20948_Stat_Ok;
+  ICM_20948_Status_e retval = ICM_20948_execute_r_async(pdev, regaddr, pdata, len, ICM_20948_wait_done, &wait);
+  if (retval != ICM_20948_Stat_Ok)
+  {
+    return retval; // Not started, so done will not be called
+  }
+  while (!wait.done) // done may be called from an interrupt or another thread
+  {
+  }
+  ICM_20948_QUEUE_BARRIER(); // Do not use pdata before seeing done
+  return wait.status;
+}
+
+ICM_20948_Status_e ICM_20948_reset_bus_stats(ICM_20948_Device_t *pdev)
+{
+#if defined(ICM_20948_USE_BUS_STATS)
+  for (uint8_t ctx = 0; ctx < ICM_20948_Bus_Ctx_NUM; ctx++)
+  {
+    ICM_20948_Bus_Stats_t *stats = &pdev->_bus_stats[ctx];
+    stats->reads = 0;
+    stats->writes = 0;
+    stats->bytes_read = 0;
+    stats->bytes_written = 0;
+    stats->bank_switches = 0;
+    stats->bank_redundant = 0;
+    stats->time_us = 0;
+  }
+  pdev->_bus_ctx = ICM_20948_Bus_Ctx_Other;
+  return ICM_20948_Stat_Ok;
+#else
+  (void)pdev;
+  return ICM_20948_Stat_NotImpl;
+#endif
+}
+
+ICM_20948_Status_e ICM_20948_set_bus_stats_clock(ICM_20948_Device_t *pdev, uint32_t (*clock_us)(void))
+{
+#if defined(ICM_20948_USE_BUS_STATS)
+  pdev->_bus_clock = clock_us;
+  return ICM_20948_Stat_Ok;
+#else
+  (void)pdev;
+  (void)clock_us;
+  return ICM_20948_Stat_NotImpl;
+#endif
+}
+
+ICM_20948_Status_e ICM_20948_get_bus_stats(ICM_20948_Device_t *pdev, ICM_20948_Bus_Ctx_e ctx, ICM_20948_Bus_Stats_t *stats)
+{
+#if defined(ICM_20948_USE_BUS_STATS)
+  if ((stats == NULL) || (ctx >= ICM_20948_Bus_Ctx_NUM))
+  {
+    return ICM_20948_Stat_ParamErr;
+  }
+  *stats = pdev->_bus_stats[ctx];
+  return ICM_20948_Stat_Ok;
+#else
+  (void)pdev;
+  (void)ctx;
+  (void)stats;
+  return ICM_20948_Stat_NotImpl;
+#endif
 }
 
 //Transact directly with an I2C device, one byte at a time
@@ -259,11 +444,24 @@ ICM_20948_Status_e ICM_20948_set_bank(ICM_20948_Device_t *pdev, uint8_t bank)
   } // Only 4 possible banks
 
   if (bank == pdev->_last_bank) // Do we need to change bank?
-    return ICM_20948_Stat_Ok;   // Bail if we don't need to change bank to avoid unnecessary bus traffic
+  {
+#if defined(ICM_20948_USE_BUS_STATS)
+    pdev->_bus_stats[pdev->_bus_ctx].bank_redundant++;
+#endif
+    return ICM_20948_Stat_Ok; // Bail if we don't need to change bank to avoid unnecessary bus traffic
+  }
 
-  pdev->_last_bank = bank;   // Store the requested bank (before we bit-shift)
-  bank = (bank << 4) & 0x30; // bits 5:4 of REG_BANK_SEL
-  return ICM_20948_execute_w(pdev, REG_BANK_SEL, &bank, 1);
+#if defined(ICM_20948_USE_BUS_STATS)
+  pdev->_bus_stats[pdev->_bus_ctx].bank_switches++;
+#endif
+  pdev->_last_bank = 255; // Unknown until the write is done: ICM_20948_queue_agmt must not read in between
+  uint8_t sel = (uint8_t)((bank << 4) & 0x30); // bits 5:4 of REG_BANK_SEL
+  ICM_20948_Status_e retval = ICM_20948_execute_w(pdev, REG_BANK_SEL, &sel, 1);
+  if (retval == ICM_20948_Stat_Ok)
+  {
+    pdev->_last_bank = bank; // Store the new bank only once it is selected
+  }
+  return retval;
 }
 
 ICM_20948_Status_e ICM_20948_sw_reset(ICM_20948_Device_t *pdev)
@@ -634,6 +832,10 @@ ICM_20948_Status_e ICM_20948_set_full_scale(ICM_20948_Device_t *pdev, ICM_20948_
     retval |= ICM_20948_execute_r(pdev, AGB2_REG_ACCEL_CONFIG, (uint8_t *)&reg, sizeof(ICM_20948_ACCEL_CONFIG_t));
     reg.ACCEL_FS_SEL = fss.a;
     retval |= ICM_20948_execute_w(pdev, AGB2_REG_ACCEL_CONFIG, (uint8_t *)&reg, sizeof(ICM_20948_ACCEL_CONFIG_t));
+    if (retval == ICM_20948_Stat_Ok)
+    {
+      pdev->_fss.a = fss.a;
+    }
   }
   if (sensors & ICM_20948_Internal_Gyr)
   {
@@ -642,6 +844,10 @@ ICM_20948_Status_e ICM_20948_set_full_scale(ICM_20948_Device_t *pdev, ICM_20948_
     retval |= ICM_20948_execute_r(pdev, AGB2_REG_GYRO_CONFIG_1, (uint8_t *)&reg, sizeof(ICM_20948_GYRO_CONFIG_1_t));
     reg.GYRO_FS_SEL = fss.g;
     retval |= ICM_20948_execute_w(pdev, AGB2_REG_GYRO_CONFIG_1, (uint8_t *)&reg, sizeof(ICM_20948_GYRO_CONFIG_1_t));
+    if (retval == ICM_20948_Stat_Ok)
+    {
+      pdev->_fss.g = fss.g;
+    }
   }
   return retval;
 }
@@ -961,13 +1167,49 @@ ICM_20948_Status_e ICM_20948_get_agmt(ICM_20948_Device_t *pdev, ICM_20948_AGMT_t
   }
 
   ICM_20948_Status_e retval = ICM_20948_Stat_Ok;
-  const uint8_t numbytes = 14 + 9; //Read Accel, gyro, temp, and 9 bytes of mag
+  const uint8_t numbytes = ICM_20948_AGMT_RAW_BYTES; //Read Accel, gyro, temp, and 9 bytes of mag
   uint8_t buff[numbytes];
 
-  // Get readings
+  // Get settings to be able to compute scaled values
+  retval |= ICM_20948_set_bank(pdev, 2);
+  ICM_20948_ACCEL_CONFIG_t acfg;
+  retval |= ICM_20948_execute_r(pdev, (uint8_t)AGB2_REG_ACCEL_CONFIG, (uint8_t *)&acfg, 1 * sizeof(acfg));
+  pdev->_fss.a = acfg.ACCEL_FS_SEL; // Worth noting that without explicitly setting the FS range of the accelerometer it was showing the register value for +/- 2g but the reported values were actually scaled to the +/- 16g range
+                                    // Wait a minute... now it seems like this problem actually comes from the digital low-pass filter. When enabled the value is 1/8 what it should be...
+  retval |= ICM_20948_set_bank(pdev, 2);
+  ICM_20948_GYRO_CONFIG_1_t gcfg1;
+  retval |= ICM_20948_execute_r(pdev, (uint8_t)AGB2_REG_GYRO_CONFIG_1, (uint8_t *)&gcfg1, 1 * sizeof(gcfg1));
+  pdev->_fss.g = gcfg1.GYRO_FS_SEL;
+  ICM_20948_ACCEL_CONFIG_2_t acfg2;
+  retval |= ICM_20948_execute_r(pdev, (uint8_t)AGB2_REG_ACCEL_CONFIG_2, (uint8_t *)&acfg2, 1 * sizeof(acfg2));
+
+  // Get readings last, so that bank 0 is left selected for ICM_20948_queue_agmt
   retval |= ICM_20948_set_bank(pdev, 0);
-  retval |= ICM_20948_execute_r(pdev, (uint8_t)AGB0_REG_ACCEL_XOUT_H, buff, numbytes);
+  retval |= ICM_20948_execute_r_wait(pdev, (uint8_t)AGB0_REG_ACCEL_XOUT_H, buff, numbytes);
+
+  ICM_20948_decode_agmt(buff, pdev->_fss, pagmt);
+
+  return retval;
+}
+
+ICM_20948_Status_e ICM_20948_get_agmt_async(ICM_20948_Device_t *pdev, uint8_t *buff, ICM_20948_Serif_Done_t done, void *context)
+{
+  if (buff == NULL)
+  {
+    return ICM_20948_Stat_ParamErr;
+  }
+
+  ICM_20948_Status_e retval = ICM_20948_set_bank(pdev, 0); // The bank select is short. Do it synchronously
+  if (retval != ICM_20948_Stat_Ok)
+  {
+    return retval;
+  }
+
+  return ICM_20948_execute_r_async(pdev, (uint8_t)AGB0_REG_ACCEL_XOUT_H, buff, ICM_20948_AGMT_RAW_BYTES, done, context);
+}
 
+void ICM_20948_decode_agmt(const uint8_t *buff, ICM_20948_fss_t fss, ICM_20948_AGMT_t *pagmt)
+{
   pagmt->acc.axes.x = ((buff[0] << 8) | (buff[1] & 0xFF));
   pagmt->acc.axes.y = ((buff[2] << 8) | (buff[3] & 0xFF));
   pagmt->acc.axes.z = ((buff[4] << 8) | (buff[5] & 0xFF));
@@ -984,18 +1226,260 @@ ICM_20948_Status_e ICM_20948_get_agmt(ICM_20948_Device_t *pdev, ICM_20948_AGMT_t
   pagmt->mag.axes.z = ((buff[20] << 8) | (buff[19] & 0xFF));
   pagmt->magStat2 = buff[22];
 
-  // Get settings to be able to compute scaled values
-  retval |= ICM_20948_set_bank(pdev, 2);
-  ICM_20948_ACCEL_CONFIG_t acfg;
-  retval |= ICM_20948_execute_r(pdev, (uint8_t)AGB2_REG_ACCEL_CONFIG, (uint8_t *)&acfg, 1 * sizeof(acfg));
-  pagmt->fss.a = acfg.ACCEL_FS_SEL; // Worth noting that without explicitly setting the FS range of the accelerometer it was showing the register value for +/- 2g but the reported values were actually scaled to the +/- 16g range
-                                    // Wait a minute... now it seems like this problem actually comes from the digital low-pass filter. When enabled the value is 1/8 what it should be...
-  retval |= ICM_20948_set_bank(pdev, 2);
-  ICM_20948_GYRO_CONFIG_1_t gcfg1;
-  retval |= ICM_20948_execute_r(pdev, (uint8_t)AGB2_REG_GYRO_CONFIG_1, (uint8_t *)&gcfg1, 1 * sizeof(gcfg1));
-  pagmt->fss.g = gcfg1.GYRO_FS_SEL;
-  ICM_20948_ACCEL_CONFIG_2_t acfg2;
-  retval |= ICM_20948_execute_r(pdev, (uint8_t)AGB2_REG_ACCEL_CONFIG_2, (uint8_t *)&acfg2, 1 * sizeof(acfg2));
+  pagmt->fss = fss;
+}
+
+// The sensitivity of each full-scale setting, as a reciprocal. Indexed by ACCEL_FS_SEL and GYRO_FS_SEL
+static const float ICM_20948_acc_mg_per_lsb[4] = {1.0f / 16.384f, 1.0f / 8.192f, 1.0f / 4.096f, 1.0f / 2.048f};
+static const float ICM_20948_gyr_dps_per_lsb[4] = {1.0f / 131.0f, 1.0f / 65.5f, 1.0f / 32.8f, 1.0f / 16.4f};
+#define ICM_20948_MAG_UT_PER_LSB 0.15f
+#define ICM_20948_TMP_LSB_PER_DEGC 333.87f
+#define ICM_20948_TMP_ROOM_DEGC 21.0f // The reading at room temperature is 21 LSB
+
+void ICM_20948_scale_init(ICM_20948_Scale_t *scale, ICM_20948_fss_t fss)
+{
+  scale->acc = ICM_20948_acc_mg_per_lsb[fss.a];
+  scale->gyr = ICM_20948_gyr_dps_per_lsb[fss.g];
+  scale->mag = ICM_20948_MAG_UT_PER_LSB;
+  scale->tmp = 1.0f / ICM_20948_TMP_LSB_PER_DEGC;
+  scale->tmp_off = ICM_20948_TMP_ROOM_DEGC - (ICM_20948_TMP_ROOM_DEGC / ICM_20948_TMP_LSB_PER_DEGC); // ((val - 21) / 333.87) + 21 = (val * tmp) + tmp_off
+  scale->fss = fss;
+}
+
+void ICM_20948_scale_agmt(const ICM_20948_Scale_t *scale, const ICM_20948_AGMT_t *agmt, ICM_20948_AGMT_Scaled_t *scaled)
+{
+  scaled->acc.x = (float)agmt->acc.axes.x * scale->acc;
+  scaled->acc.y = (float)agmt->acc.axes.y * scale->acc;
+  scaled->acc.z = (float)agmt->acc.axes.z * scale->acc;
+
+  scaled->gyr.x = (float)agmt->gyr.axes.x * scale->gyr;
+  scaled->gyr.y = (float)agmt->gyr.axes.y * scale->gyr;
+  scaled->gyr.z = (float)agmt->gyr.axes.z * scale->gyr;
+
+  scaled->mag.x = (float)agmt->mag.axes.x * scale->mag;
+  scaled->mag.y = (float)agmt->mag.axes.y * scale->mag;
+  scaled->mag.z = (float)agmt->mag.axes.z * scale->mag;
+
+  scaled->tmp = ((float)agmt->tmp.val * scale->tmp) + scale->tmp_off;
+}
+
+// Fixed-point conversion. A factor k is split into its integer part and a 16-bit fraction, so that
+// |raw| * fraction fits in 32 bits: round(|raw| * k) = |raw| * integer + ((|raw| * fraction + 0x8000) >> 16).
+// The sign is applied afterwards so that nothing shifts a negative number
+typedef struct
+{
+  uint16_t integer;
+  uint16_t fraction; // Q16
+} ICM_20948_Fixed_Factor_t;
+
+static const ICM_20948_Fixed_Factor_t ICM_20948_gyr_mdps_per_lsb[4] = {
+    {7, 41523},  // 1000 / 131
+    {15, 17510}, // 1000 / 65.5
+    {30, 31969}, // 1000 / 32.8
+    {60, 63938}, // 1000 / 16.4
+};
+static const ICM_20948_Fixed_Factor_t ICM_20948_tmp_cdegc_per_lsb = {0, 19629}; // 100 / 333.87
+
+static int32_t ICM_20948_fixed_mul(int32_t raw, ICM_20948_Fixed_Factor_t k)
+{
+  uint32_t mag = (raw < 0) ? (uint32_t)(-raw) : (uint32_t)raw; // At most 32789 (the temperature reading less 21)
+  uint32_t out = (mag * k.integer) + (((mag * k.fraction) + 0x8000) >> 16);
+  return (raw < 0) ? -(int32_t)out : (int32_t)out;
+}
+
+int32_t ICM_20948_fixed_acc_mg_q16(int16_t raw, uint8_t fs_sel)
+{
+  return (int32_t)raw * ((int32_t)4000 << (fs_sel & 0x03)); // 1000 * 65536 / 16384 = 4000
+}
+
+int32_t ICM_20948_fixed_gyr_mdps(int16_t raw, uint8_t fs_sel)
+{
+  return ICM_20948_fixed_mul(raw, ICM_20948_gyr_mdps_per_lsb[fs_sel & 0x03]);
+}
+
+int32_t ICM_20948_fixed_mag_nt(int16_t raw)
+{
+  return (int32_t)raw * 150;
+}
+
+int32_t ICM_20948_fixed_tmp_cdegc(int16_t raw)
+{
+  return ICM_20948_fixed_mul((int32_t)raw - 21, ICM_20948_tmp_cdegc_per_lsb) + 2100; // ((raw - 21) / 333.87) + 21 degC
+}
+
+void ICM_20948_fixed_agmt(const ICM_20948_AGMT_t *agmt, ICM_20948_AGMT_Fixed_t *fixed)
+{
+  fixed->acc.x = ICM_20948_fixed_acc_mg_q16(agmt->acc.axes.x, agmt->fss.a);
+  fixed->acc.y = ICM_20948_fixed_acc_mg_q16(agmt->acc.axes.y, agmt->fss.a);
+  fixed->acc.z = ICM_20948_fixed_acc_mg_q16(agmt->acc.axes.z, agmt->fss.a);
+
+  fixed->gyr.x = ICM_20948_fixed_gyr_mdps(agmt->gyr.axes.x, agmt->fss.g);
+  fixed->gyr.y = ICM_20948_fixed_gyr_mdps(agmt->gyr.axes.y, agmt->fss.g);
+  fixed->gyr.z = ICM_20948_fixed_gyr_mdps(agmt->gyr.axes.z, agmt->fss.g);
+
+  fixed->mag.x = ICM_20948_fixed_mag_nt(agmt->mag.axes.x);
+  fixed->mag.y = ICM_20948_fixed_mag_nt(agmt->mag.axes.y);
+  fixed->mag.z = ICM_20948_fixed_mag_nt(agmt->mag.axes.z);
+
+  fixed->tmp = ICM_20948_fixed_tmp_cdegc(agmt->tmp.val);
+}
+
+int32_t ICM_20948_fixed_round(int64_t v, uint8_t n)
+{
+  v += ((int64_t)1) << (n - 1);
+  return (int32_t)((v < 0) ? ~((~v) >> n) : (v >> n)); // Floor, without relying on how the compiler shifts negative numbers
+}
+
+uint32_t ICM_20948_fixed_sqrt(uint64_t x)
+{
+  // One result bit per step
+  uint64_t rem = x;
+  uint64_t root = 0;
+  uint64_t bit = ((uint64_t)1) << 62;
+  while (bit > rem)
+  {
+    bit >>= 2;
+  }
+  while (bit != 0)
+  {
+    if (rem >= root + bit)
+    {
+      rem -= root + bit;
+      root = (root >> 1) + bit;
+    }
+    else
+    {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  if ((rem > root) && (root < 0xFFFFFFFF))
+  {
+    root++; // Round to nearest
+  }
+  return (uint32_t)root;
+}
+
+int32_t ICM_20948_fixed_quat_q0(int32_t q1, int32_t q2, int32_t q3)
+{
+  const uint64_t one = ((uint64_t)1) << 60; // 1.0 squared, in Q60
+  uint64_t sum = ((uint64_t)((int64_t)q1 * q1)) + ((uint64_t)((int64_t)q2 * q2)) + ((uint64_t)((int64_t)q3 * q3));
+  if (sum >= one)
+  {
+    return 0;
+  }
+  return (int32_t)ICM_20948_fixed_sqrt(one - sum);
+}
+
+// Sample queue
+
+ICM_20948_Status_e ICM_20948_queue_init(ICM_20948_Sample_Queue_t *q, ICM_20948_Sample_t *buffer, uint32_t capacity)
+{
+  if ((q == NULL) || (buffer == NULL))
+  {
+    return ICM_20948_Stat_ParamErr;
+  }
+
+  // The free-running indices can only tell full from empty if the capacity is a power of two no larger than half the index range
+  if ((capacity < 2) || ((capacity & (capacity - 1)) != 0) || (capacity > ((((uint32_t)(ICM_20948_queue_index_t)(~0)) >> 1) + 1)))
+  {
+    return ICM_20948_Stat_ParamErr;
+  }
+
+  q->_buffer = buffer;
+  q->_mask = (ICM_20948_queue_index_t)(capacity - 1);
+  q->_head = 0;
+  q->_tail = 0;
+  q->_dropped = 0;
+
+  return ICM_20948_Stat_Ok;
+}
+
+ICM_20948_Status_e ICM_20948_queue_push(ICM_20948_Sample_Queue_t *q, const ICM_20948_Sample_t *sample)
+{
+  if ((q == NULL) || (sample == NULL))
+  {
+    return ICM_20948_Stat_ParamErr;
+  }
+
+  ICM_20948_queue_index_t head = q->_head;
+  if ((ICM_20948_queue_index_t)(head - q->_tail) > q->_mask) // Full?
+  {
+    q->_dropped = q->_dropped + 1;
+    return ICM_20948_Stat_QueueFull;
+  }
+
+  q->_buffer[head & q->_mask] = *sample;
+  ICM_20948_QUEUE_BARRIER();
+  q->_head = (ICM_20948_queue_index_t)(head + 1); // Publish
+
+  return ICM_20948_Stat_Ok;
+}
+
+ICM_20948_Status_e ICM_20948_queue_pop(ICM_20948_Sample_Queue_t *q, ICM_20948_Sample_t *sample)
+{
+  if ((q == NULL) || (sample == NULL))
+  {
+    return ICM_20948_Stat_ParamErr;
+  }
+
+  ICM_20948_queue_index_t tail = q->_tail;
+  if (tail == q->_head) // Empty?
+  {
+    return ICM_20948_Stat_NoData;
+  }
+
+  ICM_20948_QUEUE_BARRIER(); // Do not read the slot before we have seen the head that published it
+  *sample = q->_buffer[tail & q->_mask];
+  ICM_20948_QUEUE_BARRIER(); // Finish reading the slot before handing it back to the producer
+  q->_tail = (ICM_20948_queue_index_t)(tail + 1);
+
+  return ICM_20948_Stat_Ok;
+}
+
+uint32_t ICM_20948_queue_count(ICM_20948_Sample_Queue_t *q)
+{
+  if (q == NULL)
+  {
+    return 0;
+  }
+  return (uint32_t)((ICM_20948_queue_index_t)(q->_head - q->_tail));
+}
+
+ICM_20948_Status_e ICM_20948_queue_agmt(ICM_20948_Device_t *pdev, ICM_20948_Sample_Queue_t *q, uint32_t timestamp)
+{
+  if (q == NULL)
+  {
+    return ICM_20948_Stat_ParamErr;
+  }
+
+  ICM_20948_queue_index_t head = q->_head;
+  if ((ICM_20948_queue_index_t)(head - q->_tail) > q->_mask) // Full? Don't waste bus time on a sample we can't store
+  {
+    q->_dropped = q->_dropped + 1;
+    return ICM_20948_Stat_QueueFull;
+  }
+
+  // One bank 0 burst and no bank select, so the application's _last_bank stays true. See ICM_20948_C.h
+  if (pdev->_bus_busy || (pdev->_last_bank != 0))
+  {
+    q->_dropped = q->_dropped + 1;
+    return ICM_20948_Stat_BusBusy;
+  }
+  uint8_t buff[ICM_20948_AGMT_RAW_BYTES];
+  ICM_20948_Status_e retval = ICM_20948_execute_r(pdev, (uint8_t)AGB0_REG_ACCEL_XOUT_H, buff, ICM_20948_AGMT_RAW_BYTES);
+  if (retval != ICM_20948_Stat_Ok)
+  {
+    return retval;
+  }
+
+  // Decode straight into the free slot. The consumer can't see it until _head moves on
+  ICM_20948_Sample_t *slot = &q->_buffer[head & q->_mask];
+  ICM_20948_decode_agmt(buff, pdev->_fss, &slot->agmt);
+  slot->timestamp = timestamp;
+
+  ICM_20948_QUEUE_BARRIER();
+  q->_head = (ICM_20948_queue_index_t)(head + 1); // Publish
 
   return retval;
 }
@@ -1067,6 +1551,8 @@ ICM_20948_Status_e ICM_20948_reset_FIFO(ICM_20948_Device_t *pdev)
     return retval;
   }
 
+  pdev->_dataOutCtl1_fifo = pdev->_dataOutCtl1; // Empty: from now on only the enabled outputs can arrive
+
   return retval;
 }
 
@@ -1104,29 +1590,22 @@ ICM_20948_Status_e ICM_20948_get_FIFO_count(ICM_20948_Device_t *pdev, uint16_t *
 {
   ICM_20948_Status_e retval = ICM_20948_Stat_Ok;
 
-  ICM_20948_FIFO_COUNTH_t ctrlh;
-  ICM_20948_FIFO_COUNTL_t ctrll;
+  uint8_t ctrl[2]; // FIFO_COUNTH and FIFO_COUNTL
   retval = ICM_20948_set_bank(pdev, 0);
   if (retval != ICM_20948_Stat_Ok)
   {
     return retval;
   }
 
-  retval = ICM_20948_execute_r(pdev, AGB0_REG_FIFO_COUNT_H, (uint8_t *)&ctrlh, sizeof(ICM_20948_FIFO_COUNTH_t));
+  retval = ICM_20948_execute_r(pdev, AGB0_REG_FIFO_COUNT_H, ctrl, 2); // Read both in one burst. Reading FIFO_COUNTH latches FIFO_COUNTL too
   if (retval != ICM_20948_Stat_Ok)
   {
     return retval;
   }
 
-  ctrlh.FIFO_COUNTH &= 0x1F; // Datasheet says "FIFO_CNT[12:8]"
-
-  retval = ICM_20948_execute_r(pdev, AGB0_REG_FIFO_COUNT_L, (uint8_t *)&ctrll, sizeof(ICM_20948_FIFO_COUNTL_t));
-  if (retval != ICM_20948_Stat_Ok)
-  {
-    return retval;
-  }
+  ctrl[0] &= 0x1F; // Datasheet says "FIFO_CNT[12:8]"
 
-  *count = (((uint16_t)ctrlh.FIFO_COUNTH) << 8) | (uint16_t)ctrll.FIFO_COUNTL;
+  *count = (((uint16_t)ctrl[0]) << 8) | (uint16_t)ctrl[1];
 
   return retval;
 }
@@ -1141,7 +1620,7 @@ ICM_20948_Status_e ICM_20948_read_FIFO(ICM_20948_Device_t *pdev, uint8_t *data,
     return retval;
   }
 
-  retval = ICM_20948_execute_r(pdev, AGB0_REG_FIFO_R_W, data, len);
+  retval = ICM_20948_execute_r_wait(pdev, AGB0_REG_FIFO_R_W, data, len);
   if (retval != ICM_20948_Stat_Ok)
   {
     return retval;
@@ -1150,12 +1629,23 @@ ICM_20948_Status_e ICM_20948_read_FIFO(ICM_20948_Device_t *pdev, uint8_t *data,
   return retval;
 }
 
-// DMP
-
-ICM_20948_Status_e ICM_20948_enable_DMP(ICM_20948_Device_t *pdev, bool enable)
+ICM_20948_Status_e ICM_20948_read_FIFO_async(ICM_20948_Device_t *pdev, uint8_t *data, uint32_t len, ICM_20948_Serif_Done_t done, void *context)
 {
-  ICM_20948_Status_e retval = ICM_20948_Stat_Ok;
-
+  ICM_20948_Status_e retval = ICM_20948_set_bank(pdev, 0);
+  if (retval != ICM_20948_Stat_Ok)
+  {
+    return retval;
+  }
+
+  return ICM_20948_execute_r_async(pdev, AGB0_REG_FIFO_R_W, data, len, done, context);
+}
+
+// DMP
+
+ICM_20948_Status_e ICM_20948_enable_DMP(ICM_20948_Device_t *pdev, bool enable)
+{
+  ICM_20948_Status_e retval = ICM_20948_Stat_Ok;
+
   ICM_20948_USER_CTRL_t ctrl;
   retval = ICM_20948_set_bank(pdev, 0);
   if (retval != ICM_20948_Stat_Ok)
@@ -1513,6 +2003,46 @@ ICM_20948_Status_e inv_icm20948_read_mems(ICM_20948_Device_t *pdev, unsigned sho
   return result;
 }
 
+ICM_20948_Status_e inv_icm20948_write_mems_int32(ICM_20948_Device_t *pdev, unsigned short reg, uint8_t count, const int32_t *values)
+{
+  unsigned char data[ICM_20948_MEMS_INT32_MAX * 4];
+
+  if ((count == 0) || (count > ICM_20948_MEMS_INT32_MAX))
+    return ICM_20948_Stat_ParamErr;
+
+  for (uint8_t i = 0; i < count; i++) // Big-endian
+  {
+    uint32_t v = (uint32_t)values[i];
+    data[(i * 4) + 0] = (unsigned char)(v >> 24);
+    data[(i * 4) + 1] = (unsigned char)((v >> 16) & 0xff);
+    data[(i * 4) + 2] = (unsigned char)((v >> 8) & 0xff);
+    data[(i * 4) + 3] = (unsigned char)(v & 0xff);
+  }
+  return inv_icm20948_write_mems(pdev, reg, (unsigned int)count * 4, (const unsigned char *)&data);
+}
+
+ICM_20948_Status_e inv_icm20948_read_mems_int32(ICM_20948_Device_t *pdev, unsigned short reg, uint8_t count, int32_t *values)
+{
+  ICM_20948_Status_e result = ICM_20948_Stat_Ok;
+  unsigned char data[ICM_20948_MEMS_INT32_MAX * 4];
+
+  if ((count == 0) || (count > ICM_20948_MEMS_INT32_MAX))
+    return ICM_20948_Stat_ParamErr;
+
+  result = inv_icm20948_read_mems(pdev, reg, (unsigned int)count * 4, data);
+  if (result != ICM_20948_Stat_Ok)
+  {
+    return result;
+  }
+
+  for (uint8_t i = 0; i < count; i++) // Big-endian
+  {
+    const unsigned char *b = &data[i * 4];
+    values[i] = (int32_t)(((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3]);
+  }
+  return result;
+}
+
 ICM_20948_Status_e inv_icm20948_set_dmp_sensor_period(ICM_20948_Device_t *pdev, enum DMP_ODR_Registers odr_reg, uint16_t interval)
 {
   // Set the ODR registers and clear the ODR counter
@@ -1724,26 +2254,15 @@ ICM_20948_Status_e inv_icm20948_enable_dmp_sensor(ICM_20948_Device_t *pdev, enum
   }
 
   // Check if Accel, Gyro/Gyro_Calibr or Compass_Calibr/Quat9/GeoMag/Compass are to be enabled. If they are then we need to request the accuracy data via header2.
-  uint16_t delta2 = 0;
-  if ((delta & DMP_Data_Output_Control_1_Accel) > 0)
-  {
-    delta2 |= DMP_Data_Output_Control_2_Accel_Accuracy;
-  }
-  if (((delta & DMP_Data_Output_Control_1_Gyro_Calibr) > 0) || ((delta & DMP_Data_Output_Control_1_Gyro) > 0))
-  {
-    delta2 |= DMP_Data_Output_Control_2_Gyro_Accuracy;
-  }
-  if (((delta & DMP_Data_Output_Control_1_Compass_Calibr) > 0) || ((delta & DMP_Data_Output_Control_1_Compass) > 0) || ((delta & DMP_Data_Output_Control_1_Quat9) > 0) || ((delta & DMP_Data_Output_Control_1_Geomag) > 0))
-  {
-    delta2 |= DMP_Data_Output_Control_2_Compass_Accuracy;
-  }
-  // TO DO: Add DMP_Data_Output_Control_2_Pickup etc. if required
+  uint16_t delta2 = inv_icm20948_control_bits_to_header2(delta);
+  delta2 |= pdev->_dataOutCtl2 & DMP_Data_Output_Control_2_Batch_Mode_Enable; // Keep batch mode (see inv_icm20948_set_dmp_batch)
 
   // Write the sensor control bits into memory address DATA_OUT_CTL1
   unsigned char data_output_control_reg[2];
   data_output_control_reg[0] = (unsigned char)(delta >> 8);
   data_output_control_reg[1] = (unsigned char)(delta & 0xff);
   pdev->_dataOutCtl1 = delta; // Diagnostics
+  pdev->_dataOutCtl1_fifo |= delta; // Packets from an output we have just disabled can still be in the FIFO: keep accepting them until it is reset
   result = inv_icm20948_write_mems(pdev, DATA_OUT_CTL1, 2, (const unsigned char *)&data_output_control_reg);
   if (result != ICM_20948_Stat_Ok)
   {
@@ -1888,14 +2407,55 @@ ICM_20948_Status_e inv_icm20948_enable_dmp_sensor_int(ICM_20948_Device_t *pdev,
   return result;
 }
 
+// Re-read the FIFO count, a bounded number of times, until at least needed bytes are available
+static ICM_20948_Status_e inv_icm20948_wait_for_FIFO(ICM_20948_Device_t *pdev, uint16_t *fifo_count, uint16_t needed)
+{
+  for (uint8_t poll = 0; (*fifo_count < needed) && (poll < ICM_20948_FIFO_POLLS); poll++)
+  {
+    ICM_20948_Status_e result = ICM_20948_get_FIFO_count(pdev, fifo_count);
+    if (result != ICM_20948_Stat_Ok)
+      return result;
+  }
+  if (*fifo_count < needed)
+    return ICM_20948_Stat_FIFOIncompleteData;
+  return ICM_20948_Stat_Ok;
+}
+
+// Lost sync with the packets: throw away what is in the FIFO so the next read starts on a header
+static ICM_20948_Status_e inv_icm20948_resync_FIFO(ICM_20948_Device_t *pdev, ICM_20948_Status_e reason)
+{
+  ICM_20948_Status_e result = ICM_20948_reset_FIFO(pdev);
+  if (result != ICM_20948_Stat_Ok)
+    return result;
+  return reason;
+}
+
 ICM_20948_Status_e inv_icm20948_read_dmp_data(ICM_20948_Device_t *pdev, icm_20948_DMP_data_t *data)
+{
+  uint8_t packet[icm_20948_DMP_Maximum_Packet_Bytes];
+  uint16_t size;
+
+  ICM_20948_Status_e result = inv_icm20948_read_dmp_frame(pdev, packet, sizeof(packet), &size);
+  if ((result != ICM_20948_Stat_Ok) && (result != ICM_20948_Stat_FIFOMoreDataAvail))
+    return result;
+
+  ICM_20948_Status_e decoded = inv_icm20948_decode_dmp_packet(packet, size, data);
+  if (decoded != ICM_20948_Stat_Ok)
+    return decoded;
+
+  return result;
+}
+
+ICM_20948_Status_e inv_icm20948_read_dmp_frame(ICM_20948_Device_t *pdev, uint8_t *packet, uint16_t space, uint16_t *len)
 {
   ICM_20948_Status_e result = ICM_20948_Stat_Ok;
-  uint8_t fifoBytes[icm_20948_DMP_Maximum_Bytes]; // Interim storage for the FIFO data
 
   if (pdev->_dmp_firmware_available == false)
     return ICM_20948_Stat_DMPNotSupported;
 
+  if ((packet == NULL) || (len == NULL) || (space < icm_20948_DMP_Maximum_Packet_Bytes))
+    return ICM_20948_Stat_ParamErr; // The size is only known once the headers have been read, so there must be room for the largest packet
+
   // Check how much data is in the FIFO
   uint16_t fifo_count;
   result = ICM_20948_get_FIFO_count(pdev, &fifo_count);
@@ -1906,472 +2466,636 @@ ICM_20948_Status_e inv_icm20948_read_dmp_data(ICM_20948_Device_t *pdev, icm_2094
     return ICM_20948_Stat_FIFONoDataAvail;     // Bail if no header is available
 
   // Read the header (2 bytes)
-  data->header = 0; // Clear the existing header
-  uint16_t aShort = 0;
-  result = ICM_20948_read_FIFO(pdev, &fifoBytes[0], icm_20948_DMP_Header_Bytes);
+  result = ICM_20948_read_FIFO(pdev, &packet[0], icm_20948_DMP_Header_Bytes);
   if (result != ICM_20948_Stat_Ok)
     return result;
-  for (int i = 0; i < icm_20948_DMP_Header_Bytes; i++)
-  {
-    aShort |= ((uint16_t)fifoBytes[i]) << (8 - (i * 8));
-  }
-  data->header = aShort;                    // Store the header in data->header
+  uint16_t header = (((uint16_t)packet[0]) << 8) | packet[1];
+  uint16_t pos = icm_20948_DMP_Header_Bytes;
   fifo_count -= icm_20948_DMP_Header_Bytes; // Decrement the count
 
+  // The header decides how many bytes we read. If it is corrupt we would read the wrong amount and lose sync with every packet after it,
+  // so check it against the outputs we enabled (if we know them). Outputs disabled since the FIFO was last reset still count: their
+  // packets are valid, and treating them as corrupt would reset the FIFO and lose every packet queued behind them
+  result = inv_icm20948_check_dmp_header(pdev->_dataOutCtl1_fifo, header);
+  if (result != ICM_20948_Stat_Ok)
+    return inv_icm20948_resync_FIFO(pdev, result);
+
   // If the header indicates a header2 is present then read that now
-  data->header2 = 0;                                  // Clear the existing header2
-  if ((data->header & DMP_header_bitmap_Header2) > 0) // If the header2 bit is set
+  uint16_t header2 = 0;
+  if ((header & DMP_header_bitmap_Header2) > 0) // If the header2 bit is set
   {
-    if (fifo_count < icm_20948_DMP_Header2_Bytes) // Check if we need to read the FIFO count again
-    {
-      result = ICM_20948_get_FIFO_count(pdev, &fifo_count);
-      if (result != ICM_20948_Stat_Ok)
-        return result;
-    }
-    if (fifo_count < icm_20948_DMP_Header2_Bytes)
-      return ICM_20948_Stat_FIFOIncompleteData; // Bail if no header2 is available
-    // Read the header (2 bytes)
-    aShort = 0;
-    result = ICM_20948_read_FIFO(pdev, &fifoBytes[0], icm_20948_DMP_Header2_Bytes);
+    result = inv_icm20948_wait_for_FIFO(pdev, &fifo_count, icm_20948_DMP_Header2_Bytes);
+    if (result == ICM_20948_Stat_FIFOIncompleteData)
+      return inv_icm20948_resync_FIFO(pdev, result);
     if (result != ICM_20948_Stat_Ok)
       return result;
-    for (int i = 0; i < icm_20948_DMP_Header2_Bytes; i++)
-    {
-      aShort |= ((uint16_t)fifoBytes[i]) << (8 - (i * 8));
-    }
-    data->header2 = aShort;                    // Store the header2 in data->header2
+    result = ICM_20948_read_FIFO(pdev, &packet[pos], icm_20948_DMP_Header2_Bytes);
+    if (result != ICM_20948_Stat_Ok)
+      return result;
+    header2 = (((uint16_t)packet[pos]) << 8) | packet[pos + 1];
+    pos += icm_20948_DMP_Header2_Bytes;
     fifo_count -= icm_20948_DMP_Header2_Bytes; // Decrement the count
   }
 
-  if ((data->header & DMP_header_bitmap_Accel) > 0) // case DMP_header_bitmap_Accel:
+  result = inv_icm20948_check_dmp_header2(header, header2);
+  if (result != ICM_20948_Stat_Ok)
+    return inv_icm20948_resync_FIFO(pdev, result);
+
+  // Now we know the size of the packet. Wait for all of it, then read it in as few bursts as possible
+  uint16_t size = inv_icm20948_dmp_packet_size(header, header2, NULL);
+  result = inv_icm20948_wait_for_FIFO(pdev, &fifo_count, size - pos);
+  if (result == ICM_20948_Stat_FIFOIncompleteData)
+    return inv_icm20948_resync_FIFO(pdev, result);
+  if (result != ICM_20948_Stat_Ok)
+    return result;
+  fifo_count -= size - pos; // Decrement the count
+
+  while (pos < size)
   {
-    if (fifo_count < icm_20948_DMP_Raw_Accel_Bytes) // Check if we need to read the FIFO count again
-    {
-      result = ICM_20948_get_FIFO_count(pdev, &fifo_count);
-      if (result != ICM_20948_Stat_Ok)
-        return result;
-    }
-    if (fifo_count < icm_20948_DMP_Raw_Accel_Bytes)
-      return ICM_20948_Stat_FIFOIncompleteData; // Bail if not enough data is available
-    result = ICM_20948_read_FIFO(pdev, &fifoBytes[0], icm_20948_DMP_Raw_Accel_Bytes);
+    uint16_t burst = size - pos;
+    if (burst > ICM_20948_FIFO_MAX_BURST)
+      burst = ICM_20948_FIFO_MAX_BURST;
+    result = ICM_20948_read_FIFO(pdev, &packet[pos], (uint8_t)burst);
     if (result != ICM_20948_Stat_Ok)
       return result;
+    pos += burst;
+  }
+
+  *len = size;
+
+  if (fifo_count > 0) // Check if there is still data waiting to be read
+    return ICM_20948_Stat_FIFOMoreDataAvail;
+
+  return result;
+}
+
+ICM_20948_Status_e inv_icm20948_check_dmp_header(uint16_t data_out_ctl1, uint16_t header)
+{
+  if ((data_out_ctl1 != 0) && ((header & ~(data_out_ctl1 | DMP_header_bitmap_Header2 | icm_20948_DMP_Header_Step_Indicator)) != 0))
+    return ICM_20948_Stat_UnrecognisedDMPHeader; // An output we did not enable
+  return ICM_20948_Stat_Ok;
+}
+
+ICM_20948_Status_e inv_icm20948_check_dmp_header2(uint16_t header, uint16_t header2)
+{
+  if ((header & DMP_header_bitmap_Header2) > 0)
+  {
+    if ((header2 == 0) || ((header2 & ~icm_20948_DMP_Header2_Known) != 0))
+      return ICM_20948_Stat_UnrecognisedDMPHeader2;
+  }
+  else
+  {
+    header2 = 0;
+  }
+
+  if (((header & ~(DMP_header_bitmap_Header2 | icm_20948_DMP_Header_Step_Indicator)) == 0) && (header2 == 0))
+    return ICM_20948_Stat_UnrecognisedDMPHeader; // A packet with no data: not something the DMP sends
+  return ICM_20948_Stat_Ok;
+}
+
+ICM_20948_Status_e inv_icm20948_decode_dmp_packet(const uint8_t *packet, uint16_t len, icm_20948_DMP_data_t *data)
+{
+  if ((packet == NULL) || (data == NULL) || (len < (icm_20948_DMP_Header_Bytes + icm_20948_DMP_Footer_Bytes)))
+    return ICM_20948_Stat_ParamErr;
+
+  uint16_t header = (((uint16_t)packet[0]) << 8) | packet[1];
+  uint16_t header2 = 0;
+  uint16_t pos = icm_20948_DMP_Header_Bytes;
+  if ((header & DMP_header_bitmap_Header2) > 0)
+  {
+    if (len < (icm_20948_DMP_Header_Bytes + icm_20948_DMP_Header2_Bytes + icm_20948_DMP_Footer_Bytes))
+      return ICM_20948_Stat_FIFOIncompleteData;
+    header2 = (((uint16_t)packet[pos]) << 8) | packet[pos + 1];
+    pos += icm_20948_DMP_Header2_Bytes;
+  }
+  if (inv_icm20948_dmp_packet_size(header, header2, NULL) != len)
+    return ICM_20948_Stat_FIFOIncompleteData; // The length does not match the headers
+
+  data->header = header;   // Store the header in data->header
+  data->header2 = header2; // Store the header2 in data->header2
+
+  if ((header & DMP_header_bitmap_Accel) > 0) // case DMP_header_bitmap_Accel:
+  {
     for (int i = 0; i < icm_20948_DMP_Raw_Accel_Bytes; i++)
     {
-      data->Raw_Accel.Bytes[DMP_PQuat6_Byte_Ordering[i]] = fifoBytes[i]; // Correct the byte order (map big endian to little endian)
+      data->Raw_Accel.Bytes[DMP_PQuat6_Byte_Ordering[i]] = packet[pos + i]; // Correct the byte order (map big endian to little endian)
     }
-    fifo_count -= icm_20948_DMP_Raw_Accel_Bytes; // Decrement the count
+    pos += icm_20948_DMP_Raw_Accel_Bytes;
   }
 
-  if ((data->header & DMP_header_bitmap_Gyro) > 0) // case DMP_header_bitmap_Gyro:
+  if ((header & DMP_header_bitmap_Gyro) > 0) // case DMP_header_bitmap_Gyro:
   {
-    if (fifo_count < (icm_20948_DMP_Raw_Gyro_Bytes + icm_20948_DMP_Gyro_Bias_Bytes)) // Check if we need to read the FIFO count again
-    {
-      result = ICM_20948_get_FIFO_count(pdev, &fifo_count);
-      if (result != ICM_20948_Stat_Ok)
-        return result;
-    }
-    if (fifo_count < (icm_20948_DMP_Raw_Gyro_Bytes + icm_20948_DMP_Gyro_Bias_Bytes))
-      return ICM_20948_Stat_FIFOIncompleteData; // Bail if not enough data is available
-    result = ICM_20948_read_FIFO(pdev, &fifoBytes[0], (icm_20948_DMP_Raw_Gyro_Bytes + icm_20948_DMP_Gyro_Bias_Bytes));
-    if (result != ICM_20948_Stat_Ok)
-      return result;
     for (int i = 0; i < (icm_20948_DMP_Raw_Gyro_Bytes + icm_20948_DMP_Gyro_Bias_Bytes); i++)
     {
-      data->Raw_Gyro.Bytes[DMP_Raw_Gyro_Byte_Ordering[i]] = fifoBytes[i]; // Correct the byte order (map big endian to little endian)
+      data->Raw_Gyro.Bytes[DMP_Raw_Gyro_Byte_Ordering[i]] = packet[pos + i]; // Correct the byte order (map big endian to little endian)
     }
-    fifo_count -= (icm_20948_DMP_Raw_Gyro_Bytes + icm_20948_DMP_Gyro_Bias_Bytes); // Decrement the count
+    pos += (icm_20948_DMP_Raw_Gyro_Bytes + icm_20948_DMP_Gyro_Bias_Bytes);
   }
 
-  if ((data->header & DMP_header_bitmap_Compass) > 0) // case DMP_header_bitmap_Compass:
+  if ((header & DMP_header_bitmap_Compass) > 0) // case DMP_header_bitmap_Compass:
   {
-    if (fifo_count < icm_20948_DMP_Compass_Bytes) // Check if we need to read the FIFO count again
-    {
-      result = ICM_20948_get_FIFO_count(pdev, &fifo_count);
-      if (result != ICM_20948_Stat_Ok)
-        return result;
-    }
-    if (fifo_count < icm_20948_DMP_Compass_Bytes)
-      return ICM_20948_Stat_FIFOIncompleteData; // Bail if not enough data is available
-    result = ICM_20948_read_FIFO(pdev, &fifoBytes[0], icm_20948_DMP_Compass_Bytes);
-    if (result != ICM_20948_Stat_Ok)
-      return result;
     for (int i = 0; i < icm_20948_DMP_Compass_Bytes; i++)
     {
-      data->Compass.Bytes[DMP_PQuat6_Byte_Ordering[i]] = fifoBytes[i]; // Correct the byte order (map big endian to little endian)
+      data->Compass.Bytes[DMP_PQuat6_Byte_Ordering[i]] = packet[pos + i]; // Correct the byte order (map big endian to little endian)
     }
-    fifo_count -= icm_20948_DMP_Compass_Bytes; // Decrement the count
+    pos += icm_20948_DMP_Compass_Bytes;
   }
 
-  if ((data->header & DMP_header_bitmap_ALS) > 0) // case DMP_header_bitmap_ALS:
+  if ((header & DMP_header_bitmap_ALS) > 0) // case DMP_header_bitmap_ALS:
   {
-    if (fifo_count < icm_20948_DMP_ALS_Bytes) // Check if we need to read the FIFO count again
-    {
-      result = ICM_20948_get_FIFO_count(pdev, &fifo_count);
-      if (result != ICM_20948_Stat_Ok)
-        return result;
-    }
-    if (fifo_count < icm_20948_DMP_ALS_Bytes)
-      return ICM_20948_Stat_FIFOIncompleteData; // Bail if not enough data is available
-    result = ICM_20948_read_FIFO(pdev, &fifoBytes[0], icm_20948_DMP_ALS_Bytes);
-    if (result != ICM_20948_Stat_Ok)
-      return result;
     for (int i = 0; i < icm_20948_DMP_ALS_Bytes; i++)
     {
-      data->ALS[i] = fifoBytes[i];
+      data->ALS[i] = packet[pos + i];
     }
-    fifo_count -= icm_20948_DMP_ALS_Bytes; // Decrement the count
+    pos += icm_20948_DMP_ALS_Bytes;
   }
 
-  if ((data->header & DMP_header_bitmap_Quat6) > 0) // case DMP_header_bitmap_Quat6:
+  if ((header & DMP_header_bitmap_Quat6) > 0) // case DMP_header_bitmap_Quat6:
   {
-    if (fifo_count < icm_20948_DMP_Quat6_Bytes) // Check if we need to read the FIFO count again
-    {
-      result = ICM_20948_get_FIFO_count(pdev, &fifo_count);
-      if (result != ICM_20948_Stat_Ok)
-        return result;
-    }
-    if (fifo_count < icm_20948_DMP_Quat6_Bytes)
-      return ICM_20948_Stat_FIFOIncompleteData; // Bail if not enough data is available
-    result = ICM_20948_read_FIFO(pdev, &fifoBytes[0], icm_20948_DMP_Quat6_Bytes);
-    if (result != ICM_20948_Stat_Ok)
-      return result;
     for (int i = 0; i < icm_20948_DMP_Quat6_Bytes; i++)
     {
-      data->Quat6.Bytes[DMP_Quat6_Byte_Ordering[i]] = fifoBytes[i]; // Correct the byte order (map big endian to little endian)
+      data->Quat6.Bytes[DMP_Quat6_Byte_Ordering[i]] = packet[pos + i]; // Correct the byte order (map big endian to little endian)
     }
-    fifo_count -= icm_20948_DMP_Quat6_Bytes; // Decrement the count
+    pos += icm_20948_DMP_Quat6_Bytes;
   }
 
-  if ((data->header & DMP_header_bitmap_Quat9) > 0) // case DMP_header_bitmap_Quat9:
+  if ((header & DMP_header_bitmap_Quat9) > 0) // case DMP_header_bitmap_Quat9:
   {
-    if (fifo_count < icm_20948_DMP_Quat9_Bytes) // Check if we need to read the FIFO count again
-    {
-      result = ICM_20948_get_FIFO_count(pdev, &fifo_count);
-      if (result != ICM_20948_Stat_Ok)
-        return result;
-    }
-    if (fifo_count < icm_20948_DMP_Quat9_Bytes)
-      return ICM_20948_Stat_FIFOIncompleteData; // Bail if not enough data is available
-    result = ICM_20948_read_FIFO(pdev, &fifoBytes[0], icm_20948_DMP_Quat9_Bytes);
-    if (result != ICM_20948_Stat_Ok)
-      return result;
     for (int i = 0; i < icm_20948_DMP_Quat9_Bytes; i++)
     {
-      data->Quat9.Bytes[DMP_Quat9_Byte_Ordering[i]] = fifoBytes[i]; // Correct the byte order (map big endian to little endian)
+      data->Quat9.Bytes[DMP_Quat9_Byte_Ordering[i]] = packet[pos + i]; // Correct the byte order (map big endian to little endian)
     }
-    fifo_count -= icm_20948_DMP_Quat9_Bytes; // Decrement the count
+    pos += icm_20948_DMP_Quat9_Bytes;
   }
 
-  if ((data->header & DMP_header_bitmap_PQuat6) > 0) // case DMP_header_bitmap_PQuat6:
+  if ((header & DMP_header_bitmap_PQuat6) > 0) // case DMP_header_bitmap_PQuat6:
   {
-    if (fifo_count < icm_20948_DMP_PQuat6_Bytes) // Check if we need to read the FIFO count again
-    {
-      result = ICM_20948_get_FIFO_count(pdev, &fifo_count);
-      if (result != ICM_20948_Stat_Ok)
-        return result;
-    }
-    if (fifo_count < icm_20948_DMP_PQuat6_Bytes)
-      return ICM_20948_Stat_FIFOIncompleteData; // Bail if not enough data is available
-    result = ICM_20948_read_FIFO(pdev, &fifoBytes[0], icm_20948_DMP_PQuat6_Bytes);
-    if (result != ICM_20948_Stat_Ok)
-      return result;
     for (int i = 0; i < icm_20948_DMP_PQuat6_Bytes; i++)
     {
-      data->PQuat6.Bytes[DMP_PQuat6_Byte_Ordering[i]] = fifoBytes[i]; // Correct the byte order (map big endian to little endian)
+      data->PQuat6.Bytes[DMP_PQuat6_Byte_Ordering[i]] = packet[pos + i]; // Correct the byte order (map big endian to little endian)
     }
-    fifo_count -= icm_20948_DMP_PQuat6_Bytes; // Decrement the count
+    pos += icm_20948_DMP_PQuat6_Bytes;
   }
 
-  if ((data->header & DMP_header_bitmap_Geomag) > 0) // case DMP_header_bitmap_Geomag:
+  if ((header & DMP_header_bitmap_Geomag) > 0) // case DMP_header_bitmap_Geomag:
   {
-    if (fifo_count < icm_20948_DMP_Geomag_Bytes) // Check if we need to read the FIFO count again
-    {
-      result = ICM_20948_get_FIFO_count(pdev, &fifo_count);
-      if (result != ICM_20948_Stat_Ok)
-        return result;
-    }
-    if (fifo_count < icm_20948_DMP_Geomag_Bytes)
-      return ICM_20948_Stat_FIFOIncompleteData; // Bail if not enough data is available
-    result = ICM_20948_read_FIFO(pdev, &fifoBytes[0], icm_20948_DMP_Geomag_Bytes);
-    if (result != ICM_20948_Stat_Ok)
-      return result;
     for (int i = 0; i < icm_20948_DMP_Geomag_Bytes; i++)
     {
-      data->Geomag.Bytes[DMP_Quat9_Byte_Ordering[i]] = fifoBytes[i]; // Correct the byte order (map big endian to little endian)
+      data->Geomag.Bytes[DMP_Quat9_Byte_Ordering[i]] = packet[pos + i]; // Correct the byte order (map big endian to little endian)
     }
-    fifo_count -= icm_20948_DMP_Geomag_Bytes; // Decrement the count
+    pos += icm_20948_DMP_Geomag_Bytes;
   }
 
-  if ((data->header & DMP_header_bitmap_Pressure) > 0) // case DMP_header_bitmap_Pressure:
+  if ((header & DMP_header_bitmap_Pressure) > 0) // case DMP_header_bitmap_Pressure:
   {
-    if (fifo_count < icm_20948_DMP_Pressure_Bytes) // Check if we need to read the FIFO count again
-    {
-      result = ICM_20948_get_FIFO_count(pdev, &fifo_count);
-      if (result != ICM_20948_Stat_Ok)
-        return result;
-    }
-    if (fifo_count < icm_20948_DMP_Pressure_Bytes)
-      return ICM_20948_Stat_FIFOIncompleteData; // Bail if not enough data is available
-    result = ICM_20948_read_FIFO(pdev, &fifoBytes[0], icm_20948_DMP_Pressure_Bytes);
-    if (result != ICM_20948_Stat_Ok)
-      return result;
     for (int i = 0; i < icm_20948_DMP_Pressure_Bytes; i++)
     {
-      data->Pressure[i] = fifoBytes[i];
+      data->Pressure[i] = packet[pos + i];
     }
-    fifo_count -= icm_20948_DMP_Pressure_Bytes; // Decrement the count
+    pos += icm_20948_DMP_Pressure_Bytes;
   }
 
-  if ((data->header & DMP_header_bitmap_Gyro_Calibr) > 0) // case DMP_header_bitmap_Gyro_Calibr:
-  {
-    // lcm20948MPUFifoControl.c suggests icm_20948_DMP_Gyro_Calibr_Bytes is not supported
-    // and looking at DMP frames which have the Gyro_Calibr bit set, that certainly seems to be true.
-    // So, we'll skip this...:
-    /*
-			if (fifo_count < icm_20948_DMP_Gyro_Calibr_Bytes) // Check if we need to read the FIFO count again
-			{
-					result = ICM_20948_get_FIFO_count(pdev, &fifo_count);
-					if (result != ICM_20948_Stat_Ok)
-							return result;
-			}
-			if (fifo_count < icm_20948_DMP_Gyro_Calibr_Bytes)
-					return ICM_20948_Stat_FIFOIncompleteData; // Bail if not enough data is available
-			result = ICM_20948_read_FIFO(pdev, &fifoBytes[0], icm_20948_DMP_Gyro_Calibr_Bytes);
-			if (result != ICM_20948_Stat_Ok)
-					return result;
-			for (int i = 0; i < icm_20948_DMP_Gyro_Calibr_Bytes; i++)
-			{
-					data->Gyro_Calibr.Bytes[DMP_Quat6_Byte_Ordering[i]] = fifoBytes[i]; // Correct the byte order (map big endian to little endian)
-			}
-			fifo_count -= icm_20948_DMP_Gyro_Calibr_Bytes; // Decrement the count
-			*/
-  }
+  // lcm20948MPUFifoControl.c suggests icm_20948_DMP_Gyro_Calibr_Bytes is not supported
+  // and looking at DMP frames which have the Gyro_Calibr bit set, that certainly seems to be true.
+  // So, we skip DMP_header_bitmap_Gyro_Calibr (and inv_icm20948_dmp_packet_size does not count it)
 
-  if ((data->header & DMP_header_bitmap_Compass_Calibr) > 0) // case DMP_header_bitmap_Compass_Calibr:
+  if ((header & DMP_header_bitmap_Compass_Calibr) > 0) // case DMP_header_bitmap_Compass_Calibr:
   {
-    if (fifo_count < icm_20948_DMP_Compass_Calibr_Bytes) // Check if we need to read the FIFO count again
-    {
-      result = ICM_20948_get_FIFO_count(pdev, &fifo_count);
-      if (result != ICM_20948_Stat_Ok)
-        return result;
-    }
-    if (fifo_count < icm_20948_DMP_Compass_Calibr_Bytes)
-      return ICM_20948_Stat_FIFOIncompleteData; // Bail if not enough data is available
-    result = ICM_20948_read_FIFO(pdev, &fifoBytes[0], icm_20948_DMP_Compass_Calibr_Bytes);
-    if (result != ICM_20948_Stat_Ok)
-      return result;
     for (int i = 0; i < icm_20948_DMP_Compass_Calibr_Bytes; i++)
     {
-      data->Compass_Calibr.Bytes[DMP_Quat6_Byte_Ordering[i]] = fifoBytes[i]; // Correct the byte order (map big endian to little endian)
+      data->Compass_Calibr.Bytes[DMP_Quat6_Byte_Ordering[i]] = packet[pos + i]; // Correct the byte order (map big endian to little endian)
     }
-    fifo_count -= icm_20948_DMP_Compass_Calibr_Bytes; // Decrement the count
+    pos += icm_20948_DMP_Compass_Calibr_Bytes;
   }
 
-  if ((data->header & DMP_header_bitmap_Step_Detector) > 0) // case DMP_header_bitmap_Step_Detector:
+  if ((header & DMP_header_bitmap_Step_Detector) > 0) // case DMP_header_bitmap_Step_Detector:
   {
-    if (fifo_count < icm_20948_DMP_Step_Detector_Bytes) // Check if we need to read the FIFO count again
-    {
-      result = ICM_20948_get_FIFO_count(pdev, &fifo_count);
-      if (result != ICM_20948_Stat_Ok)
-        return result;
-    }
-    if (fifo_count < icm_20948_DMP_Step_Detector_Bytes)
-      return ICM_20948_Stat_FIFOIncompleteData; // Bail if not enough data is available
-    result = ICM_20948_read_FIFO(pdev, &fifoBytes[0], icm_20948_DMP_Step_Detector_Bytes);
-    if (result != ICM_20948_Stat_Ok)
-      return result;
     uint32_t aWord = 0;
     for (int i = 0; i < icm_20948_DMP_Step_Detector_Bytes; i++)
     {
-      aWord |= ((uint32_t)fifoBytes[i]) << (24 - (i * 8));
+      aWord |= ((uint32_t)packet[pos + i]) << (24 - (i * 8));
     }
     data->Pedometer_Timestamp = aWord;
-    fifo_count -= icm_20948_DMP_Step_Detector_Bytes; // Decrement the count
+    pos += icm_20948_DMP_Step_Detector_Bytes;
   }
 
   // Now check for header2 features
 
-  if ((data->header2 & DMP_header2_bitmap_Accel_Accuracy) > 0) // case DMP_header2_bitmap_Accel_Accuracy:
+  if ((header2 & DMP_header2_bitmap_Accel_Accuracy) > 0) // case DMP_header2_bitmap_Accel_Accuracy:
   {
-    if (fifo_count < icm_20948_DMP_Accel_Accuracy_Bytes) // Check if we need to read the FIFO count again
-    {
-      result = ICM_20948_get_FIFO_count(pdev, &fifo_count);
-      if (result != ICM_20948_Stat_Ok)
-        return result;
-    }
-    if (fifo_count < icm_20948_DMP_Accel_Accuracy_Bytes)
-      return ICM_20948_Stat_FIFOIncompleteData; // Bail if not enough data is available
-    aShort = 0;
-    result = ICM_20948_read_FIFO(pdev, &fifoBytes[0], icm_20948_DMP_Accel_Accuracy_Bytes);
-    if (result != ICM_20948_Stat_Ok)
-      return result;
-    for (int i = 0; i < icm_20948_DMP_Accel_Accuracy_Bytes; i++)
-    {
-      aShort |= ((uint16_t)fifoBytes[i]) << (8 - (i * 8));
-    }
-    data->Accel_Accuracy = aShort;
-    fifo_count -= icm_20948_DMP_Accel_Accuracy_Bytes; // Decrement the count
+    data->Accel_Accuracy = (((uint16_t)packet[pos]) << 8) | packet[pos + 1];
+    pos += icm_20948_DMP_Accel_Accuracy_Bytes;
   }
 
-  if ((data->header2 & DMP_header2_bitmap_Gyro_Accuracy) > 0) // case DMP_header2_bitmap_Gyro_Accuracy:
+  if ((header2 & DMP_header2_bitmap_Gyro_Accuracy) > 0) // case DMP_header2_bitmap_Gyro_Accuracy:
   {
-    if (fifo_count < icm_20948_DMP_Gyro_Accuracy_Bytes) // Check if we need to read the FIFO count again
-    {
-      result = ICM_20948_get_FIFO_count(pdev, &fifo_count);
-      if (result != ICM_20948_Stat_Ok)
-        return result;
-    }
-    if (fifo_count < icm_20948_DMP_Gyro_Accuracy_Bytes)
-      return ICM_20948_Stat_FIFOIncompleteData; // Bail if not enough data is available
-    aShort = 0;
-    result = ICM_20948_read_FIFO(pdev, &fifoBytes[0], icm_20948_DMP_Gyro_Accuracy_Bytes);
-    if (result != ICM_20948_Stat_Ok)
-      return result;
-    for (int i = 0; i < icm_20948_DMP_Gyro_Accuracy_Bytes; i++)
-    {
-      aShort |= ((uint16_t)fifoBytes[i]) << (8 - (i * 8));
-    }
-    data->Gyro_Accuracy = aShort;
-    fifo_count -= icm_20948_DMP_Gyro_Accuracy_Bytes; // Decrement the count
+    data->Gyro_Accuracy = (((uint16_t)packet[pos]) << 8) | packet[pos + 1];
+    pos += icm_20948_DMP_Gyro_Accuracy_Bytes;
   }
 
-  if ((data->header2 & DMP_header2_bitmap_Compass_Accuracy) > 0) // case DMP_header2_bitmap_Compass_Accuracy:
+  if ((header2 & DMP_header2_bitmap_Compass_Accuracy) > 0) // case DMP_header2_bitmap_Compass_Accuracy:
   {
-    if (fifo_count < icm_20948_DMP_Compass_Accuracy_Bytes) // Check if we need to read the FIFO count again
+    data->Compass_Accuracy = (((uint16_t)packet[pos]) << 8) | packet[pos + 1];
+    pos += icm_20948_DMP_Compass_Accuracy_Bytes;
+  }
+
+  // lcm20948MPUFifoControl.c suggests icm_20948_DMP_Fsync_Detection_Bytes is not supported.
+  // So, we skip DMP_header2_bitmap_Fsync just in case (and inv_icm20948_dmp_packet_size does not count it)
+
+  if ((header2 & DMP_header2_bitmap_Pickup) > 0) // case DMP_header2_bitmap_Pickup:
+  {
+    data->Pickup = (((uint16_t)packet[pos]) << 8) | packet[pos + 1];
+    pos += icm_20948_DMP_Pickup_Bytes;
+  }
+
+  if ((header2 & DMP_header2_bitmap_Activity_Recog) > 0) // case DMP_header2_bitmap_Activity_Recog:
+  {
+    for (int i = 0; i < icm_20948_DMP_Activity_Recognition_Bytes; i++)
     {
-      result = ICM_20948_get_FIFO_count(pdev, &fifo_count);
-      if (result != ICM_20948_Stat_Ok)
-        return result;
+      data->Activity_Recognition.Bytes[DMP_Activity_Recognition_Byte_Ordering[i]] = packet[pos + i];
     }
-    if (fifo_count < icm_20948_DMP_Compass_Accuracy_Bytes)
-      return ICM_20948_Stat_FIFOIncompleteData; // Bail if not enough data is available
-    aShort = 0;
-    result = ICM_20948_read_FIFO(pdev, &fifoBytes[0], icm_20948_DMP_Compass_Accuracy_Bytes);
-    if (result != ICM_20948_Stat_Ok)
-      return result;
-    for (int i = 0; i < icm_20948_DMP_Compass_Accuracy_Bytes; i++)
-    {
-      aShort |= ((uint16_t)fifoBytes[i]) << (8 - (i * 8));
-    }
-    data->Compass_Accuracy = aShort;
-    fifo_count -= icm_20948_DMP_Compass_Accuracy_Bytes; // Decrement the count
-  }
-
-  if ((data->header2 & DMP_header2_bitmap_Fsync) > 0) // case DMP_header2_bitmap_Fsync:
-  {
-    // lcm20948MPUFifoControl.c suggests icm_20948_DMP_Fsync_Detection_Bytes is not supported.
-    // So, we'll skip this just in case...:
-    /*
-			if (fifo_count < icm_20948_DMP_Fsync_Detection_Bytes) // Check if we need to read the FIFO count again
-			{
-					result = ICM_20948_get_FIFO_count(pdev, &fifo_count);
-					if (result != ICM_20948_Stat_Ok)
-							return result;
-			}
-			if (fifo_count < icm_20948_DMP_Fsync_Detection_Bytes)
-					return ICM_20948_Stat_FIFOIncompleteData; // Bail if not enough data is available
-			aShort = 0;
-			result = ICM_20948_read_FIFO(pdev, &fifoBytes[0], icm_20948_DMP_Fsync_Detection_Bytes);
-			if (result != ICM_20948_Stat_Ok)
-					return result;
-			for (int i = 0; i < icm_20948_DMP_Fsync_Detection_Bytes; i++)
-			{
-					aShort |= ((uint16_t)fifoBytes[i]) << (8 - (i * 8));
-			}
-			data->Fsync_Delay_Time = aShort;
-			fifo_count -= icm_20948_DMP_Fsync_Detection_Bytes; // Decrement the count
-			*/
-  }
-
-  if ((data->header2 & DMP_header2_bitmap_Pickup) > 0) // case DMP_header2_bitmap_Pickup:
-  {
-    if (fifo_count < icm_20948_DMP_Pickup_Bytes) // Check if we need to read the FIFO count again
-    {
-      result = ICM_20948_get_FIFO_count(pdev, &fifo_count);
-      if (result != ICM_20948_Stat_Ok)
-        return result;
-    }
-    if (fifo_count < icm_20948_DMP_Pickup_Bytes)
-      return ICM_20948_Stat_FIFOIncompleteData; // Bail if not enough data is available
-    aShort = 0;
-    result = ICM_20948_read_FIFO(pdev, &fifoBytes[0], icm_20948_DMP_Pickup_Bytes);
-    if (result != ICM_20948_Stat_Ok)
-      return result;
-    for (int i = 0; i < icm_20948_DMP_Pickup_Bytes; i++)
+    data->Activity_Recognition.Data.Reserved[0] = 0;
+    data->Activity_Recognition.Data.Reserved[1] = 0;
+    pos += icm_20948_DMP_Activity_Recognition_Bytes;
+  }
+
+  if ((header2 & DMP_header2_bitmap_Secondary_On_Off) > 0) // case DMP_header2_bitmap_Secondary_On_Off:
+  {
+    for (int i = 0; i < icm_20948_DMP_Secondary_On_Off_Bytes; i++)
     {
-      aShort |= ((uint16_t)fifoBytes[i]) << (8 - (i * 8));
+      data->Secondary_On_Off.Bytes[DMP_Secondary_On_Off_Byte_Ordering[i]] = packet[pos + i];
     }
-    data->Pickup = aShort;
-    fifo_count -= icm_20948_DMP_Pickup_Bytes; // Decrement the count
+    pos += icm_20948_DMP_Secondary_On_Off_Bytes;
+  }
+
+  // Finally, extract the footer (gyro count)
+  data->Footer = (((uint16_t)packet[pos]) << 8) | packet[pos + 1];
+
+  return ICM_20948_Stat_Ok;
+}
+
+ICM_20948_Status_e inv_icm20948_set_dmp_batch(ICM_20948_Device_t *pdev, bool enable, uint16_t mask, uint32_t threshold)
+{
+  ICM_20948_Status_e result = ICM_20948_Stat_Ok;
+
+  if (pdev->_dmp_firmware_available == false)
+    return ICM_20948_Stat_DMPNotSupported;
+
+  if (enable && ((mask == 0) || (threshold == 0)))
+    return ICM_20948_Stat_ParamErr;
+
+  result = ICM_20948_sleep(pdev, false); // Make sure chip is awake
+  if (result != ICM_20948_Stat_Ok)
+  {
+    return result;
   }
 
-  if ((data->header2 & DMP_header2_bitmap_Activity_Recog) > 0) // case DMP_header2_bitmap_Activity_Recog:
+  result = ICM_20948_low_power(pdev, false); // Make sure chip is not in low power state
+  if (result != ICM_20948_Stat_Ok)
   {
-    if (fifo_count < icm_20948_DMP_Activity_Recognition_Bytes) // Check if we need to read the FIFO count again
+    return result;
+  }
+
+  unsigned char reg[4];
+  if (enable)
+  {
+    reg[0] = (unsigned char)(threshold >> 24);
+    reg[1] = (unsigned char)((threshold >> 16) & 0xff);
+    reg[2] = (unsigned char)((threshold >> 8) & 0xff);
+    reg[3] = (unsigned char)(threshold & 0xff);
+    result = inv_icm20948_write_mems(pdev, BM_BATCH_THLD, 4, (const unsigned char *)&reg);
+    if (result != ICM_20948_Stat_Ok)
     {
-      result = ICM_20948_get_FIFO_count(pdev, &fifo_count);
-      if (result != ICM_20948_Stat_Ok)
-        return result;
+      return result;
     }
-    if (fifo_count < icm_20948_DMP_Activity_Recognition_Bytes)
-      return ICM_20948_Stat_FIFOIncompleteData; // Bail if not enough data is available
-    result = ICM_20948_read_FIFO(pdev, &fifoBytes[0], icm_20948_DMP_Activity_Recognition_Bytes);
+
+    reg[0] = (unsigned char)(mask >> 8);
+    reg[1] = (unsigned char)(mask & 0xff);
+    result = inv_icm20948_write_mems(pdev, BM_BATCH_MASK, 2, (const unsigned char *)&reg);
     if (result != ICM_20948_Stat_Ok)
-      return result;
-    for (int i = 0; i < icm_20948_DMP_Activity_Recognition_Bytes; i++)
     {
-      data->Activity_Recognition.Bytes[DMP_Activity_Recognition_Byte_Ordering[i]] = fifoBytes[i];
+      return result;
     }
-    fifo_count -= icm_20948_DMP_Activity_Recognition_Bytes; // Decrement the count
   }
 
-  if ((data->header2 & DMP_header2_bitmap_Secondary_On_Off) > 0) // case DMP_header2_bitmap_Secondary_On_Off:
+  // Start the batch from zero
+  reg[0] = 0;
+  reg[1] = 0;
+  reg[2] = 0;
+  reg[3] = 0;
+  result = inv_icm20948_write_mems(pdev, BM_BATCH_CNTR, 4, (const unsigned char *)&reg);
+  if (result != ICM_20948_Stat_Ok)
   {
-    if (fifo_count < icm_20948_DMP_Secondary_On_Off_Bytes) // Check if we need to read the FIFO count again
+    return result;
+  }
+
+  // Set or clear the batch mode enable bit in DATA_OUT_CTL2, keeping the accuracy bits
+  uint16_t ctl2 = pdev->_dataOutCtl2;
+  if (enable)
+    ctl2 |= DMP_Data_Output_Control_2_Batch_Mode_Enable;
+  else
+    ctl2 &= ~DMP_Data_Output_Control_2_Batch_Mode_Enable;
+  reg[0] = (unsigned char)(ctl2 >> 8);
+  reg[1] = (unsigned char)(ctl2 & 0xff);
+  pdev->_dataOutCtl2 = ctl2; // Diagnostics
+  result = inv_icm20948_write_mems(pdev, DATA_OUT_CTL2, 2, (const unsigned char *)&reg);
+  if (result != ICM_20948_Stat_Ok)
+  {
+    return result;
+  }
+
+  result = ICM_20948_low_power(pdev, true); // Put chip into low power state
+  return result;
+}
+
+ICM_20948_Status_e inv_icm20948_get_dmp_batch_count(ICM_20948_Device_t *pdev, uint32_t *count)
+{
+  ICM_20948_Status_e result = ICM_20948_Stat_Ok;
+
+  if (pdev->_dmp_firmware_available == false)
+    return ICM_20948_Stat_DMPNotSupported;
+
+  unsigned char reg[4];
+  result = inv_icm20948_read_mems(pdev, BM_BATCH_CNTR, 4, (unsigned char *)&reg);
+  if (result != ICM_20948_Stat_Ok)
+  {
+    return result;
+  }
+
+  *count = (((uint32_t)reg[0]) << 24) | (((uint32_t)reg[1]) << 16) | (((uint32_t)reg[2]) << 8) | (uint32_t)reg[3];
+  return result;
+}
+
+uint32_t inv_icm20948_dmp_batch_threshold(uint32_t window_ms, float sample_rate_hz)
+{
+  if (sample_rate_hz <= 0.0f)
+    return 0;
+  float samples = (((float)window_ms) * sample_rate_hz / 1000.0f) + 0.5f;
+  if (samples < 1.0f)
+    return 1;
+  if (samples >= 4294967295.0f)
+    return 0xFFFFFFFF;
+  return (uint32_t)samples;
+}
+
+ICM_20948_Status_e inv_icm20948_set_dmp_fifo_watermark(ICM_20948_Device_t *pdev, uint16_t bytes)
+{
+  ICM_20948_Status_e result = ICM_20948_Stat_Ok;
+
+  if (pdev->_dmp_firmware_available == false)
+    return ICM_20948_Stat_DMPNotSupported;
+
+  if ((bytes == 0) || (bytes > CFG_FIFO_SIZE))
+    return ICM_20948_Stat_ParamErr;
+
+  unsigned char reg[2];
+  reg[0] = (unsigned char)(bytes >> 8);
+  reg[1] = (unsigned char)(bytes & 0xff);
+  result = inv_icm20948_write_mems(pdev, FIFO_WATERMARK, 2, (const unsigned char *)&reg);
+  return result;
+}
+
+ICM_20948_Status_e inv_icm20948_set_dmp_compass_cal(ICM_20948_Device_t *pdev, const int32_t mtx[9], const int32_t bias[3])
+{
+  ICM_20948_Status_e result = ICM_20948_Stat_Ok;
+
+  if (pdev->_dmp_firmware_available == false)
+    return ICM_20948_Stat_DMPNotSupported;
+
+  result = inv_icm20948_write_mems_int32(pdev, CPASS_MTX_00, 9, mtx); // CPASS_MTX_00 to CPASS_MTX_22 are consecutive
+  if (result != ICM_20948_Stat_Ok)
+  {
+    return result;
+  }
+
+  result = inv_icm20948_write_mems_int32(pdev, CPASS_BIAS_X, 3, bias);
+  return result;
+}
+
+ICM_20948_Status_e ICM_20948_mount_matrix(ICM_20948_Mount_e mount, int32_t b2s[9])
+{
+  if ((mount < ICM_20948_Mount_Xp_Yp) || (mount >= ICM_20948_Mount_NUM))
+    return ICM_20948_Stat_ParamErr;
+
+  // The body axis of chip x (0 = +x, 1 = -x, 2 = +y ... 5 = -z), then of chip y: one of the four not parallel to chip x
+  uint8_t ax = (uint8_t)mount / 4;
+  uint8_t ay = (uint8_t)mount % 4;
+  if (ay >= ((ax / 2) * 2))
+    ay += 2;
+
+  int8_t x[3] = {0, 0, 0};
+  int8_t y[3] = {0, 0, 0};
+  x[ax / 2] = (ax & 1) ? -1 : 1;
+  y[ay / 2] = (ay & 1) ? -1 : 1;
+  int8_t z[3] = {(int8_t)((x[1] * y[2]) - (x[2] * y[1])), (int8_t)((x[2] * y[0]) - (x[0] * y[2])), (int8_t)((x[0] * y[1]) - (x[1] * y[0]))};
+
+  for (uint8_t i = 0; i < 3; i++) // The columns are the chip axes
+  {
+    b2s[(i * 3) + 0] = (int32_t)x[i] * ICM_20948_Q30(1.0);
+    b2s[(i * 3) + 1] = (int32_t)y[i] * ICM_20948_Q30(1.0);
+    b2s[(i * 3) + 2] = (int32_t)z[i] * ICM_20948_Q30(1.0);
+  }
+  return ICM_20948_Stat_Ok;
+}
+
+ICM_20948_Status_e ICM_20948_mount_check(const int32_t b2s[9])
+{
+  const int64_t one = (int64_t)1 << 60;
+  const int64_t tolerance = (int64_t)1 << 48; // 2^-12: a few digits of each entry
+
+  for (uint8_t i = 0; i < 3; i++) // The rows must be orthonormal
+  {
+    for (uint8_t j = i; j < 3; j++)
     {
-      result = ICM_20948_get_FIFO_count(pdev, &fifo_count);
-      if (result != ICM_20948_Stat_Ok)
-        return result;
+      int64_t dot = 0;
+      for (uint8_t k = 0; k < 3; k++)
+        dot += (int64_t)b2s[(i * 3) + k] * b2s[(j * 3) + k];
+      if (i == j)
+        dot -= one;
+      if ((dot > tolerance) || (dot < -tolerance))
+        return ICM_20948_Stat_ParamErr;
     }
-    if (fifo_count < icm_20948_DMP_Secondary_On_Off_Bytes)
-      return ICM_20948_Stat_FIFOIncompleteData; // Bail if not enough data is available
-    result = ICM_20948_read_FIFO(pdev, &fifoBytes[0], icm_20948_DMP_Secondary_On_Off_Bytes);
-    if (result != ICM_20948_Stat_Ok)
-      return result;
-    for (int i = 0; i < icm_20948_DMP_Secondary_On_Off_Bytes; i++)
+  }
+
+  // ... and row 0 x row 1 must be row 2, not -row 2 (a reflection)
+  int64_t det = 0;
+  for (uint8_t k = 0; k < 3; k++)
+  {
+    uint8_t k1 = (k + 1) % 3;
+    uint8_t k2 = (k + 2) % 3;
+    int64_t cross = ((int64_t)b2s[k1] * b2s[3 + k2]) - ((int64_t)b2s[k2] * b2s[3 + k1]);
+    det += (int64_t)ICM_20948_fixed_round(cross, 30) * b2s[6 + k];
+  }
+  if (det <= 0)
+    return ICM_20948_Stat_ParamErr;
+
+  return ICM_20948_Stat_Ok;
+}
+
+void ICM_20948_mount_compass(const int32_t b2s[9], int32_t cpass[9])
+{
+  // The AK09916 axes are (x, -y, -z) in the chip frame: negate columns 1 and 2 and scale
+  for (uint8_t i = 0; i < 9; i++)
+  {
+    int32_t v = ICM_20948_fixed_round((int64_t)b2s[i] * ICM_20948_CPASS_UT_PER_LSB_Q30, 30);
+    cpass[i] = ((i % 3) == 0) ? v : -v;
+  }
+}
+
+ICM_20948_Status_e inv_icm20948_set_dmp_mount(ICM_20948_Device_t *pdev, const int32_t b2s[9])
+{
+  ICM_20948_Status_e result = ICM_20948_Stat_Ok;
+
+  if (pdev->_dmp_firmware_available == false)
+    return ICM_20948_Stat_DMPNotSupported;
+
+  result = ICM_20948_mount_check(b2s);
+  if (result != ICM_20948_Stat_Ok)
+  {
+    return result;
+  }
+
+  result = inv_icm20948_write_mems_int32(pdev, B2S_MTX_00, 9, b2s); // B2S_MTX_00 to B2S_MTX_22 are consecutive
+  if (result != ICM_20948_Stat_Ok)
+  {
+    return result;
+  }
+
+  int32_t cpass[9];
+  ICM_20948_mount_compass(b2s, cpass);
+  result = inv_icm20948_write_mems_int32(pdev, CPASS_MTX_00, 9, cpass);
+  return result;
+}
+
+ICM_20948_Status_e inv_icm20948_get_dmp_mount(ICM_20948_Device_t *pdev, int32_t b2s[9])
+{
+  if (pdev->_dmp_firmware_available == false)
+    return ICM_20948_Stat_DMPNotSupported;
+
+  return inv_icm20948_read_mems_int32(pdev, B2S_MTX_00, 9, b2s);
+}
+
+// The DMP memory holding each group of three biases (X, Y and Z are consecutive), in blob order
+static const unsigned short ICM_20948_bias_blob_regs[3] = {GYRO_BIAS_X, ACCEL_BIAS_X, CPASS_BIAS_X};
+
+uint16_t ICM_20948_fletcher16(const uint8_t *data, uint16_t len)
+{
+  uint16_t sum1 = 0;
+  uint16_t sum2 = 0;
+  for (uint16_t i = 0; i < len; i++)
+  {
+    sum1 = (sum1 + data[i]) % 255;
+    sum2 = (sum2 + sum1) % 255;
+  }
+  return (uint16_t)((sum2 << 8) | sum1);
+}
+
+static uint16_t ICM_20948_bias_blob_checksum(const uint8_t *blob) // Of everything before the checksum
+{
+  return ICM_20948_fletcher16(blob, ICM_20948_BIAS_BLOB_BYTES - 2);
+}
+
+ICM_20948_Status_e ICM_20948_bias_blob_decode(const uint8_t *blob, int32_t bias[9])
+{
+  if ((blob[0] != ICM_20948_BIAS_BLOB_VERSION) || (blob[1] != 9))
+    return ICM_20948_Stat_ParamErr;
+
+  uint16_t checksum = ((uint16_t)blob[ICM_20948_BIAS_BLOB_BYTES - 2] << 8) | blob[ICM_20948_BIAS_BLOB_BYTES - 1];
+  if (checksum != ICM_20948_bias_blob_checksum(blob))
+    return ICM_20948_Stat_ParamErr;
+
+  if (bias != NULL)
+  {
+    for (uint8_t i = 0; i < 9; i++)
     {
-      data->Secondary_On_Off.Bytes[DMP_Secondary_On_Off_Byte_Ordering[i]] = fifoBytes[i];
+      const uint8_t *b = &blob[2 + (i * 4)];
+      bias[i] = (int32_t)(((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3]);
     }
-    fifo_count -= icm_20948_DMP_Secondary_On_Off_Bytes; // Decrement the count
   }
+  return ICM_20948_Stat_Ok;
+}
 
-  // Finally, extract the footer (gyro count)
-  if (fifo_count < icm_20948_DMP_Footer_Bytes) // Check if we need to read the FIFO count again
+ICM_20948_Status_e inv_icm20948_get_dmp_biases(ICM_20948_Device_t *pdev, uint8_t *blob)
+{
+  ICM_20948_Status_e result = ICM_20948_Stat_Ok;
+
+  if (pdev->_dmp_firmware_available == false)
+    return ICM_20948_Stat_DMPNotSupported;
+
+  result = ICM_20948_sleep(pdev, false); // Make sure chip is awake
+  if (result != ICM_20948_Stat_Ok)
   {
-    result = ICM_20948_get_FIFO_count(pdev, &fifo_count);
+    return result;
+  }
+
+  result = ICM_20948_low_power(pdev, false); // Make sure chip is not in low power state
+  if (result != ICM_20948_Stat_Ok)
+  {
+    return result;
+  }
+
+  // The blob holds the biases as the DMP does, so each group is read straight into it
+  blob[0] = ICM_20948_BIAS_BLOB_VERSION;
+  blob[1] = 9;
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    result = inv_icm20948_read_mems(pdev, ICM_20948_bias_blob_regs[i], 12, &blob[2 + (i * 12)]);
     if (result != ICM_20948_Stat_Ok)
+    {
       return result;
+    }
   }
-  if (fifo_count < icm_20948_DMP_Footer_Bytes)
-    return ICM_20948_Stat_FIFOIncompleteData; // Bail if not enough data is available
-  aShort = 0;
-  result = ICM_20948_read_FIFO(pdev, &fifoBytes[0], icm_20948_DMP_Footer_Bytes);
+
+  uint16_t checksum = ICM_20948_bias_blob_checksum(blob);
+  blob[ICM_20948_BIAS_BLOB_BYTES - 2] = (uint8_t)(checksum >> 8);
+  blob[ICM_20948_BIAS_BLOB_BYTES - 1] = (uint8_t)(checksum & 0xff);
+  return result;
+}
+
+ICM_20948_Status_e inv_icm20948_set_dmp_biases(ICM_20948_Device_t *pdev, const uint8_t *blob)
+{
+  ICM_20948_Status_e result = ICM_20948_Stat_Ok;
+
+  if (pdev->_dmp_firmware_available == false)
+    return ICM_20948_Stat_DMPNotSupported;
+
+  result = ICM_20948_bias_blob_decode(blob, NULL);
   if (result != ICM_20948_Stat_Ok)
+  {
     return result;
-  for (int i = 0; i < icm_20948_DMP_Footer_Bytes; i++)
+  }
+
+  result = ICM_20948_sleep(pdev, false); // Make sure chip is awake
+  if (result != ICM_20948_Stat_Ok)
   {
-    aShort |= ((uint16_t)fifoBytes[i]) << (8 - (i * 8));
+    return result;
   }
-  data->Footer = aShort;
-  fifo_count -= icm_20948_DMP_Footer_Bytes; // Decrement the count
 
-  if (fifo_count > 0) // Check if there is still data waiting to be read
-    return ICM_20948_Stat_FIFOMoreDataAvail;
+  result = ICM_20948_low_power(pdev, false); // Make sure chip is not in low power state
+  if (result != ICM_20948_Stat_Ok)
+  {
+    return result;
+  }
 
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    result = inv_icm20948_write_mems(pdev, ICM_20948_bias_blob_regs[i], 12, &blob[2 + (i * 12)]);
+    if (result != ICM_20948_Stat_Ok)
+    {
+      return result;
+    }
+  }
   return result;
 }
 
+ICM_20948_Status_e inv_icm20948_set_dmp_gyro_bias(ICM_20948_Device_t *pdev, const int32_t bias[3])
+{
+  if (pdev->_dmp_firmware_available == false)
+    return ICM_20948_Stat_DMPNotSupported;
+
+  return inv_icm20948_write_mems_int32(pdev, GYRO_BIAS_X, 3, bias);
+}
+
 static uint8_t sensor_type_2_android_sensor(enum inv_icm20948_sensor sensor)
 {
   switch (sensor)
@@ -2421,6 +3145,135 @@ static uint8_t sensor_type_2_android_sensor(enum inv_icm20948_sensor sensor)
   }
 }
 
+uint16_t inv_icm20948_sensor_to_control_bits(enum inv_icm20948_sensor sensor)
+{
+  uint8_t androidSensor = sensor_type_2_android_sensor(sensor); // Convert sensor from enum inv_icm20948_sensor to Android numbering
+
+  if (androidSensor >= ANDROID_SENSOR_NUM_MAX)
+    return 0xFFFF; // Not supported
+
+  return inv_androidSensor_to_control_bits[androidSensor];
+}
+
+uint16_t inv_icm20948_control_bits_to_header2(uint16_t control_bits)
+{
+  uint16_t delta2 = 0;
+  if ((control_bits & DMP_Data_Output_Control_1_Accel) > 0)
+  {
+    delta2 |= DMP_Data_Output_Control_2_Accel_Accuracy;
+  }
+  if (((control_bits & DMP_Data_Output_Control_1_Gyro_Calibr) > 0) || ((control_bits & DMP_Data_Output_Control_1_Gyro) > 0))
+  {
+    delta2 |= DMP_Data_Output_Control_2_Gyro_Accuracy;
+  }
+  if (((control_bits & DMP_Data_Output_Control_1_Compass_Calibr) > 0) || ((control_bits & DMP_Data_Output_Control_1_Compass) > 0) || ((control_bits & DMP_Data_Output_Control_1_Quat9) > 0) || ((control_bits & DMP_Data_Output_Control_1_Geomag) > 0))
+  {
+    delta2 |= DMP_Data_Output_Control_2_Compass_Accuracy;
+  }
+  // TO DO: Add DMP_Data_Output_Control_2_Pickup etc. if required
+  return delta2;
+}
+
+uint16_t inv_icm20948_dmp_packet_size(uint16_t header, uint16_t header2, uint8_t *reads)
+{
+  // This follows inv_icm20948_read_dmp_data: it skips the same fields
+  uint16_t size = icm_20948_DMP_Header_Bytes + icm_20948_DMP_Footer_Bytes;
+
+  if ((header & DMP_header_bitmap_Header2) > 0)
+  {
+    size += icm_20948_DMP_Header2_Bytes;
+  }
+  else
+  {
+    header2 = 0; // No header2, so none of its fields
+  }
+
+  if ((header & DMP_header_bitmap_Accel) > 0)
+  {
+    size += icm_20948_DMP_Raw_Accel_Bytes;
+  }
+  if ((header & DMP_header_bitmap_Gyro) > 0)
+  {
+    size += icm_20948_DMP_Raw_Gyro_Bytes + icm_20948_DMP_Gyro_Bias_Bytes;
+  }
+  if ((header & DMP_header_bitmap_Compass) > 0)
+  {
+    size += icm_20948_DMP_Compass_Bytes;
+  }
+  if ((header & DMP_header_bitmap_ALS) > 0)
+  {
+    size += icm_20948_DMP_ALS_Bytes;
+  }
+  if ((header & DMP_header_bitmap_Quat6) > 0)
+  {
+    size += icm_20948_DMP_Quat6_Bytes;
+  }
+  if ((header & DMP_header_bitmap_Quat9) > 0)
+  {
+    size += icm_20948_DMP_Quat9_Bytes;
+  }
+  if ((header & DMP_header_bitmap_PQuat6) > 0)
+  {
+    size += icm_20948_DMP_PQuat6_Bytes;
+  }
+  if ((header & DMP_header_bitmap_Geomag) > 0)
+  {
+    size += icm_20948_DMP_Geomag_Bytes;
+  }
+  if ((header & DMP_header_bitmap_Pressure) > 0)
+  {
+    size += icm_20948_DMP_Pressure_Bytes;
+  }
+  // Gyro_Calibr is not read (see inv_icm20948_read_dmp_data)
+  if ((header & DMP_header_bitmap_Compass_Calibr) > 0)
+  {
+    size += icm_20948_DMP_Compass_Calibr_Bytes;
+  }
+  if ((header & DMP_header_bitmap_Step_Detector) > 0)
+  {
+    size += icm_20948_DMP_Step_Detector_Bytes;
+  }
+
+  if ((header2 & DMP_header2_bitmap_Accel_Accuracy) > 0)
+  {
+    size += icm_20948_DMP_Accel_Accuracy_Bytes;
+  }
+  if ((header2 & DMP_header2_bitmap_Gyro_Accuracy) > 0)
+  {
+    size += icm_20948_DMP_Gyro_Accuracy_Bytes;
+  }
+  if ((header2 & DMP_header2_bitmap_Compass_Accuracy) > 0)
+  {
+    size += icm_20948_DMP_Compass_Accuracy_Bytes;
+  }
+  // Fsync is not read (see inv_icm20948_read_dmp_data)
+  if ((header2 & DMP_header2_bitmap_Pickup) > 0)
+  {
+    size += icm_20948_DMP_Pickup_Bytes;
+  }
+  if ((header2 & DMP_header2_bitmap_Activity_Recog) > 0)
+  {
+    size += icm_20948_DMP_Activity_Recognition_Bytes;
+  }
+  if ((header2 & DMP_header2_bitmap_Secondary_On_Off) > 0)
+  {
+    size += icm_20948_DMP_Secondary_On_Off_Bytes;
+  }
+
+  if (reads != NULL) // The header, the header2, then the rest in bursts
+  {
+    uint16_t rest = size - icm_20948_DMP_Header_Bytes;
+    *reads = 1;
+    if ((header & DMP_header_bitmap_Header2) > 0)
+    {
+      rest -= icm_20948_DMP_Header2_Bytes;
+      (*reads)++;
+    }
+    *reads += (uint8_t)((rest + ICM_20948_FIFO_MAX_BURST - 1) / ICM_20948_FIFO_MAX_BURST);
+  }
+  return size;
+}
+
 enum inv_icm20948_sensor inv_icm20948_sensor_android_2_sensor_type(int sensor)
 {
   switch (sensor)
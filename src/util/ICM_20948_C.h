@@ -28,6 +28,19 @@ extern int memcmp(const void *, const void *, size_t); // Avoid compiler warning
 // Note: you must have 14290/14301 Bytes of program memory available to store the DMP firmware!
 //#define ICM_20948_USE_DMP // Uncomment this line to enable DMP support. You can of course use ICM_20948_USE_DMP as a compiler flag too
 
+// Define to count bus traffic: transactions, bytes, bank switches and time, bucketed by API call (see ICM_20948_get_bus_stats)
+// This changes the size of ICM_20948_Device_t, so it must be defined here or as a global compiler flag - not in a single file
+//#define ICM_20948_USE_BUS_STATS // Uncomment this line to enable the bus statistics. You can of course use ICM_20948_USE_BUS_STATS as a compiler flag too
+
+// The DMP FIFO parser reads each packet in bursts of up to this many bytes. 32 suits the Wire buffer on AVR. Larger is faster on buses that allow it
+#ifndef ICM_20948_FIFO_MAX_BURST
+#define ICM_20948_FIFO_MAX_BURST 32
+#endif
+// How many times the parser re-reads the FIFO count while waiting for the rest of a packet before giving up
+#ifndef ICM_20948_FIFO_POLLS
+#define ICM_20948_FIFO_POLLS 4
+#endif
+
 // There are two versions of the InvenSense DMP firmware for the ICM20948 - with slightly different sizes
 #define DMP_CODE_SIZE 14301 /* eMD-SmartMotion-ICM20948-1.1.0-MP */
 //#define DMP_CODE_SIZE 14290 /* ICM20948_eMD_nucleo_1.0 */
@@ -45,6 +58,8 @@ extern int memcmp(const void *, const void *, size_t); // Avoid compiler warning
 #define INV_MAX_SERIAL_READ 16
 /** @brief Max size that can be written across I2C or SPI data lines */
 #define INV_MAX_SERIAL_WRITE 16
+/** @brief Max number of 32-bit values inv_icm20948_write_mems_int32 / _read_mems_int32 transfer at once (a 3x3 matrix) */
+#define ICM_20948_MEMS_INT32_MAX 9
 
   typedef enum
   {
@@ -64,6 +79,8 @@ extern int memcmp(const void *, const void *, size_t); // Avoid compiler warning
     ICM_20948_Stat_UnrecognisedDMPHeader,
     ICM_20948_Stat_UnrecognisedDMPHeader2,
     ICM_20948_Stat_InvalDMPRegister, // Invalid DMP Register
+    ICM_20948_Stat_QueueFull,        // The sample queue was full and the sample was dropped
+    ICM_20948_Stat_BusBusy,          // A transfer was in progress or a bank other than 0 was selected, so the sample queue producer did not read and the sample was dropped
 
     ICM_20948_Stat_NUM,
     ICM_20948_Stat_Unknown,
@@ -155,12 +172,130 @@ extern int memcmp(const void *, const void *, size_t); // Avoid compiler warning
     uint8_t magStat2;
   } ICM_20948_AGMT_t;
 
+  typedef struct
+  {
+    float acc;     // mg per LSB
+    float gyr;     // dps per LSB
+    float mag;     // uT per LSB
+    float tmp;     // degC per LSB
+    float tmp_off; // degC at a reading of 0
+    ICM_20948_fss_t fss; // The full-scale settings the factors are for
+  } ICM_20948_Scale_t; // Unit conversion factors, precomputed so that scaling is one multiply per axis
+
+  typedef struct
+  {
+    struct
+    {
+      float x;
+      float y;
+      float z;
+    } acc; // mg
+    struct
+    {
+      float x;
+      float y;
+      float z;
+    } gyr; // dps
+    struct
+    {
+      float x;
+      float y;
+      float z;
+    } mag;     // uT
+    float tmp; // degC
+  } ICM_20948_AGMT_Scaled_t;
+
+  typedef struct
+  {
+    struct
+    {
+      int32_t x;
+      int32_t y;
+      int32_t z;
+    } acc; // mg, Q16.16
+    struct
+    {
+      int32_t x;
+      int32_t y;
+      int32_t z;
+    } gyr; // mdps
+    struct
+    {
+      int32_t x;
+      int32_t y;
+      int32_t z;
+    } mag;       // nT
+    int32_t tmp; // centi-degC
+  } ICM_20948_AGMT_Fixed_t; // Integer units for targets without an FPU
+
+  typedef struct
+  {
+    uint32_t timestamp; // Time of the data-ready event, as supplied by the caller (e.g. micros() captured in the ISR)
+    ICM_20948_AGMT_t agmt;
+  } ICM_20948_Sample_t;
+
+// The queue indices must be loaded and stored atomically by the target. On AVR that means a single byte.
+#if defined(__AVR__)
+  typedef uint8_t ICM_20948_queue_index_t;
+#else
+  typedef uint32_t ICM_20948_queue_index_t;
+#endif
+
+#if defined(__GNUC__)
+#define ICM_20948_QUEUE_BARRIER() __sync_synchronize() // Make sure the sample is visible before the index that publishes it
+#else
+#define ICM_20948_QUEUE_BARRIER()
+#endif
+
+  // A lock-free single-producer / single-consumer queue of timestamped samples.
+  // The producer (INT ISR or a high-priority task) only writes _head, the consumer (the application) only writes _tail.
+  // The indices are free-running and wrap naturally, so the capacity must be a power of two (and at most 128 on AVR).
+  typedef struct
+  {
+    ICM_20948_Sample_t *_buffer;            // Storage provided by the user: capacity samples
+    ICM_20948_queue_index_t _mask;          // capacity - 1
+    volatile ICM_20948_queue_index_t _head; // Written by the producer only
+    volatile ICM_20948_queue_index_t _tail; // Written by the consumer only
+    volatile uint32_t _dropped;             // Written by the producer only: samples lost because the queue was full or the bus was busy
+  } ICM_20948_Sample_Queue_t;
+
+  typedef enum
+  {
+    ICM_20948_Bus_Ctx_Other = 0,     // Traffic not caused by one of the calls below
+    ICM_20948_Bus_Ctx_GetAGMT,       // getAGMT
+    ICM_20948_Bus_Ctx_ReadDMPData,   // readDMPdataFromFIFO
+    ICM_20948_Bus_Ctx_InitializeDMP, // initializeDMP
+    ICM_20948_Bus_Ctx_NUM
+  } ICM_20948_Bus_Ctx_e; // Buckets for the bus statistics
+
+  typedef struct
+  {
+    uint32_t reads;          // Read transactions
+    uint32_t writes;         // Write transactions (including bank switches)
+    uint32_t bytes_read;     // Data bytes read
+    uint32_t bytes_written;  // Data bytes written
+    uint32_t bank_switches;  // REG_BANK_SEL writes
+    uint32_t bank_redundant; // ICM_20948_set_bank calls that were skipped because the bank was already selected
+    uint32_t time_us;        // Time spent in the serif. Only counted if a clock has been set with ICM_20948_set_bus_stats_clock
+  } ICM_20948_Bus_Stats_t;
+
+  typedef void (*ICM_20948_Serif_Done_t)(ICM_20948_Status_e status, void *context); // Completion callback for the asynchronous serif functions
+
   typedef struct
   {
     ICM_20948_Status_e (*write)(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user);
     ICM_20948_Status_e (*read)(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user);
     // void				(*delay)(uint32_t ms);
     void *user;
+    // Optional asynchronous (e.g. DMA) transfers. Leave these NULL if the bus does not support them.
+    // Return ICM_20948_Stat_Ok once the transfer has been started, then call done(status, context) when it completes (this may be from an interrupt).
+    // If the transfer could not be started, return the error and do not call done.
+    // pdata must stay valid until done has been called, and no other transfer may be started in the meantime.
+    // ICM_20948_get_agmt and ICM_20948_read_FIFO send their data bursts through read_async when it is set, and spin until done:
+    // they still block for the whole transfer, so nothing overlaps with it. To do other work meanwhile, use ICM_20948_get_agmt_async
+    // (then ICM_20948_decode_agmt) or ICM_20948_read_FIFO_async instead.
+    ICM_20948_Status_e (*write_async)(uint8_t regaddr, uint8_t *pdata, uint32_t len, ICM_20948_Serif_Done_t done, void *context, void *user);
+    ICM_20948_Status_e (*read_async)(uint8_t regaddr, uint8_t *pdata, uint32_t len, ICM_20948_Serif_Done_t done, void *context, void *user);
   } ICM_20948_Serif_t;                      // This is the vtable of serial interface functions
   extern const ICM_20948_Serif_t NullSerif; // Here is a default for initialization (NULL)
 
@@ -169,21 +304,42 @@ extern int memcmp(const void *, const void *, size_t); // Avoid compiler warning
     const ICM_20948_Serif_t *_serif; // Pointer to the assigned Serif (Serial Interface) vtable
     bool _dmp_firmware_available;    // Indicates if the DMP firmware has been included. It
     bool _firmware_loaded;           // Indicates if DMP has been loaded
-    uint8_t _last_bank;              // Keep track of which bank was selected last - to avoid unnecessary writes
+    volatile uint8_t _last_bank;     // Keep track of which bank was selected last - to avoid unnecessary writes. 255 while a switch is in progress
     uint8_t _last_mems_bank;         // Keep track of which bank was selected last - to avoid unnecessary writes
     int32_t _gyroSF;                 // Use this to record the GyroSF, calculated by inv_icm20948_set_gyro_sf
     int8_t _gyroSFpll;
+    ICM_20948_fss_t _fss;             // The full scale last written by ICM_20948_set_full_scale or read by ICM_20948_get_agmt
+    volatile bool _bus_busy;          // A transfer is in progress: ICM_20948_queue_agmt will not start one of its own
+    ICM_20948_Serif_Done_t _async_done; // The caller's completion for the asynchronous transfer in progress
+    void *_async_context;
     uint32_t _enabled_Android_0;      // Keep track of which Android sensors are enabled: 0-31
     uint32_t _enabled_Android_1;      // Keep track of which Android sensors are enabled: 32-
     uint32_t _enabled_Android_intr_0; // Keep track of which Android sensor interrupts are enabled: 0-31
     uint32_t _enabled_Android_intr_1; // Keep track of which Android sensor interrupts are enabled: 32-
     uint16_t _dataOutCtl1;            // Diagnostics: record the setting of DATA_OUT_CTL1
+    uint16_t _dataOutCtl1_fifo;       // The outputs that may be in the FIFO: DATA_OUT_CTL1 now and since the FIFO was last reset. Headers are checked against this
     uint16_t _dataOutCtl2;            // Diagnostics: record the setting of DATA_OUT_CTL2
     uint16_t _dataRdyStatus;          // Diagnostics: record the setting of DATA_RDY_STATUS
     uint16_t _motionEventCtl;         // Diagnostics: record the setting of MOTION_EVENT_CTL
     uint16_t _dataIntrCtl;            // Diagnostics: record the setting of DATA_INTR_CTL
+#if defined(ICM_20948_USE_BUS_STATS)
+    ICM_20948_Bus_Stats_t _bus_stats[ICM_20948_Bus_Ctx_NUM]; // Bus statistics for each bucket
+    uint8_t _bus_ctx;                                         // The bucket traffic is currently counted against (ICM_20948_Bus_Ctx_e)
+    uint32_t (*_bus_clock)(void);                             // Microsecond clock used for time_us. NULL if time is not measured
+#endif
   } ICM_20948_Device_t;               // Definition of device struct type
 
+// Count the bus traffic in the enclosed code against a bucket. Use the pair in the same scope. These compile to nothing without ICM_20948_USE_BUS_STATS
+#if defined(ICM_20948_USE_BUS_STATS)
+#define ICM_20948_BUS_CTX_ENTER(pdev, ctx)         \
+  uint8_t _icm_20948_prev_bus_ctx = (pdev)->_bus_ctx; \
+  (pdev)->_bus_ctx = (uint8_t)(ctx)
+#define ICM_20948_BUS_CTX_LEAVE(pdev) (pdev)->_bus_ctx = _icm_20948_prev_bus_ctx
+#else
+#define ICM_20948_BUS_CTX_ENTER(pdev, ctx)
+#define ICM_20948_BUS_CTX_LEAVE(pdev)
+#endif
+
   // ICM_20948_Status_e ICM_20948_Startup( ICM_20948_Device_t* pdev ); // For the time being this performs a standardized startup routine
 
   ICM_20948_Status_e ICM_20948_link_serif(ICM_20948_Device_t *pdev, const ICM_20948_Serif_t *s); // Links a SERIF structure to the device
@@ -192,6 +348,16 @@ extern int memcmp(const void *, const void *, size_t); // Avoid compiler warning
   ICM_20948_Status_e ICM_20948_execute_r(ICM_20948_Device_t *pdev, uint8_t regaddr, uint8_t *pdata, uint32_t len); // Executes a R or W witht he serif vt as long as the pointers are not null
   ICM_20948_Status_e ICM_20948_execute_w(ICM_20948_Device_t *pdev, uint8_t regaddr, uint8_t *pdata, uint32_t len);
 
+  // Asynchronous versions. These use read_async / write_async when the serif provides them, otherwise they fall back to the blocking
+  // read / write and call done before returning. Either way done is called if (and only if) ICM_20948_Stat_Ok is returned.
+  ICM_20948_Status_e ICM_20948_execute_r_async(ICM_20948_Device_t *pdev, uint8_t regaddr, uint8_t *pdata, uint32_t len, ICM_20948_Serif_Done_t done, void *context);
+  ICM_20948_Status_e ICM_20948_execute_w_async(ICM_20948_Device_t *pdev, uint8_t regaddr, uint8_t *pdata, uint32_t len, ICM_20948_Serif_Done_t done, void *context);
+
+  // Bus statistics. These return ICM_20948_Stat_NotImpl unless ICM_20948_USE_BUS_STATS is defined
+  ICM_20948_Status_e ICM_20948_reset_bus_stats(ICM_20948_Device_t *pdev);                                              // Zero all of the buckets and count against ICM_20948_Bus_Ctx_Other
+  ICM_20948_Status_e ICM_20948_set_bus_stats_clock(ICM_20948_Device_t *pdev, uint32_t (*clock_us)(void));              // Provide a microsecond clock to measure the time spent on the bus
+  ICM_20948_Status_e ICM_20948_get_bus_stats(ICM_20948_Device_t *pdev, ICM_20948_Bus_Ctx_e ctx, ICM_20948_Bus_Stats_t *stats); // Copy one bucket
+
   // Single-shot I2C on Master IF
   ICM_20948_Status_e ICM_20948_i2c_controller_periph4_txn(ICM_20948_Device_t *pdev, uint8_t addr, uint8_t reg, uint8_t *data, uint8_t len, bool Rw, bool send_reg_addr);
   ICM_20948_Status_e ICM_20948_i2c_master_single_w(ICM_20948_Device_t *pdev, uint8_t addr, uint8_t reg, uint8_t *data);
@@ -228,7 +394,48 @@ extern int memcmp(const void *, const void *, size_t); // Avoid compiler warning
   ICM_20948_Status_e ICM_20948_i2c_controller_configure_peripheral(ICM_20948_Device_t *pdev, uint8_t peripheral, uint8_t addr, uint8_t reg, uint8_t len, bool Rw, bool enable, bool data_only, bool grp, bool swap, uint8_t dataOut);
 
   // Higher Level
-  ICM_20948_Status_e ICM_20948_get_agmt(ICM_20948_Device_t *pdev, ICM_20948_AGMT_t *p);
+  ICM_20948_Status_e ICM_20948_get_agmt(ICM_20948_Device_t *pdev, ICM_20948_AGMT_t *p); // Blocks until the data is in, even through read_async. See ICM_20948_get_agmt_async
+
+  // Asynchronous AGMT read: start the burst read of ICM_20948_AGMT_RAW_BYTES into buff, then call ICM_20948_decode_agmt from (or after) done.
+  // The full-scale settings are not read back asynchronously: pass pdev->_fss to the decoder. ICM_20948_get_agmt and ICM_20948_set_full_scale
+  // keep it up to date; it is wrong if ACCEL_CONFIG or GYRO_CONFIG_1 have been written some other way since.
+#define ICM_20948_AGMT_RAW_BYTES (14 + 9) // Accel, gyro, temp, and 9 bytes of mag
+  ICM_20948_Status_e ICM_20948_get_agmt_async(ICM_20948_Device_t *pdev, uint8_t *buff, ICM_20948_Serif_Done_t done, void *context);
+  void ICM_20948_decode_agmt(const uint8_t *buff, ICM_20948_fss_t fss, ICM_20948_AGMT_t *pagmt);
+
+  // Unit conversion. Compute the factors once per full-scale change, then scale each sample with one multiply per axis.
+  // To convert a block of samples, call ICM_20948_scale_agmt in a loop: a batch converter into structure-of-arrays buffers
+  // (scalar, SSE2 and NEON) was tried and dropped, as none of its versions beat this loop repeatably on a desktop CPU.
+  void ICM_20948_scale_init(ICM_20948_Scale_t *scale, ICM_20948_fss_t fss);
+  void ICM_20948_scale_agmt(const ICM_20948_Scale_t *scale, const ICM_20948_AGMT_t *agmt, ICM_20948_AGMT_Scaled_t *scaled); // Uses the factors as they are: agmt->fss is not checked
+
+  // Fixed-point unit conversion: integer multiplies and shifts only, so no float code is linked in.
+  // Errors against the exact conversion (using the same sensitivities as the float accessors):
+  //   acc: exact (mg per LSB is 1000 / 16384 << fs_sel, a power of two times 1000)
+  //   gyr: at most 0.75 mdps
+  //   mag: exact (0.15 uT = 150 nT per LSB)
+  //   tmp: at most 0.75 centi-degC
+  //   quat: q0 within 1 LSB of Q30, given q1-q3
+  int32_t ICM_20948_fixed_acc_mg_q16(int16_t raw, uint8_t fs_sel); // fs_sel is ACCEL_FS_SEL (ICM_20948_fss_t::a)
+  int32_t ICM_20948_fixed_gyr_mdps(int16_t raw, uint8_t fs_sel);   // fs_sel is GYRO_FS_SEL (ICM_20948_fss_t::g)
+  int32_t ICM_20948_fixed_mag_nt(int16_t raw);
+  int32_t ICM_20948_fixed_tmp_cdegc(int16_t raw);
+  void ICM_20948_fixed_agmt(const ICM_20948_AGMT_t *agmt, ICM_20948_AGMT_Fixed_t *fixed); // Uses agmt->fss
+  uint32_t ICM_20948_fixed_sqrt(uint64_t x); // Integer square root, rounded to nearest
+  int32_t ICM_20948_fixed_round(int64_t v, uint8_t n); // v / 2^n rounded to nearest (half up), e.g. a Q60 product back to Q30. n must be 1 to 62
+  int32_t ICM_20948_fixed_quat_q0(int32_t q1, int32_t q2, int32_t q3); // The DMP sends Q1-Q3 of a unit quaternion in Q30. Returns Q0 = sqrt(1 - Q1^2 - Q2^2 - Q3^2) in Q30 (0 if they overshoot)
+
+  // Sample queue
+  ICM_20948_Status_e ICM_20948_queue_init(ICM_20948_Sample_Queue_t *q, ICM_20948_Sample_t *buffer, uint32_t capacity); // capacity must be a power of two
+  ICM_20948_Status_e ICM_20948_queue_push(ICM_20948_Sample_Queue_t *q, const ICM_20948_Sample_t *sample);             // Producer side. Returns ICM_20948_Stat_QueueFull (and counts a drop) if there is no room
+  ICM_20948_Status_e ICM_20948_queue_pop(ICM_20948_Sample_Queue_t *q, ICM_20948_Sample_t *sample);                    // Consumer side. Returns ICM_20948_Stat_NoData if the queue is empty
+  uint32_t ICM_20948_queue_count(ICM_20948_Sample_Queue_t *q);                                                        // Number of samples waiting. Safe to call from either side
+  ICM_20948_Status_e ICM_20948_queue_agmt(ICM_20948_Device_t *pdev, ICM_20948_Sample_Queue_t *q, uint32_t timestamp); // Deferred read: burst-read the AGMT data straight into the next free slot and publish it
+
+  // ICM_20948_queue_agmt is one bank 0 burst read, tagged with the cached full scale (pdev->_fss). It never selects a bank, so it cannot
+  // leave the bank the application is using changed under it: if a transfer is in progress or another bank is selected it returns
+  // ICM_20948_Stat_BusBusy (and counts a drop) without touching the bus. ICM_20948_get_agmt leaves bank 0 selected.
+  // This is safe against an ISR, which the application can't preempt. A producer thread must own the device: no other thread may use it meanwhile.
 
   // FIFO
 
@@ -236,7 +443,8 @@ extern int memcmp(const void *, const void *, size_t); // Avoid compiler warning
   ICM_20948_Status_e ICM_20948_reset_FIFO(ICM_20948_Device_t *pdev);
   ICM_20948_Status_e ICM_20948_set_FIFO_mode(ICM_20948_Device_t *pdev, bool snapshot);
   ICM_20948_Status_e ICM_20948_get_FIFO_count(ICM_20948_Device_t *pdev, uint16_t *count);
-  ICM_20948_Status_e ICM_20948_read_FIFO(ICM_20948_Device_t *pdev, uint8_t *data, uint8_t len);
+  ICM_20948_Status_e ICM_20948_read_FIFO(ICM_20948_Device_t *pdev, uint8_t *data, uint8_t len); // Blocks until the data is in, even through read_async. See ICM_20948_read_FIFO_async
+  ICM_20948_Status_e ICM_20948_read_FIFO_async(ICM_20948_Device_t *pdev, uint8_t *data, uint32_t len, ICM_20948_Serif_Done_t done, void *context); // Drain len bytes in one transfer. See ICM_20948_execute_r_async
 
   // DMP
 
@@ -268,16 +476,95 @@ extern int memcmp(const void *, const void *, size_t); // Avoid compiler warning
 	*  @return     0 if successful.
 	*/
   ICM_20948_Status_e inv_icm20948_read_mems(ICM_20948_Device_t *pdev, unsigned short reg, unsigned int length, unsigned char *data);
+  ICM_20948_Status_e inv_icm20948_write_mems_int32(ICM_20948_Device_t *pdev, unsigned short reg, uint8_t count, const int32_t *values); // Write count (up to ICM_20948_MEMS_INT32_MAX) consecutive 32-bit values in one burst
+  ICM_20948_Status_e inv_icm20948_read_mems_int32(ICM_20948_Device_t *pdev, unsigned short reg, uint8_t count, int32_t *values);
 
   ICM_20948_Status_e inv_icm20948_set_dmp_sensor_period(ICM_20948_Device_t *pdev, enum DMP_ODR_Registers odr_reg, uint16_t interval);
   ICM_20948_Status_e inv_icm20948_enable_dmp_sensor(ICM_20948_Device_t *pdev, enum inv_icm20948_sensor sensor, int state);     // State is actually boolean
   ICM_20948_Status_e inv_icm20948_enable_dmp_sensor_int(ICM_20948_Device_t *pdev, enum inv_icm20948_sensor sensor, int state); // State is actually boolean
   static uint8_t sensor_type_2_android_sensor(enum inv_icm20948_sensor sensor);
   enum inv_icm20948_sensor inv_icm20948_sensor_android_2_sensor_type(int sensor);
+  uint16_t inv_icm20948_sensor_to_control_bits(enum inv_icm20948_sensor sensor); // The DATA_OUT_CTL1 bits for a sensor. 0xFFFF if it is not supported
+  uint16_t inv_icm20948_control_bits_to_header2(uint16_t control_bits);             // The DATA_OUT_CTL2 (accuracy) bits inv_icm20948_enable_dmp_sensor sets for those DATA_OUT_CTL1 bits
+  uint16_t inv_icm20948_dmp_packet_size(uint16_t header, uint16_t header2, uint8_t *reads); // Bytes in a DMP FIFO packet, including header(s) and footer. reads (optional) returns how many FIFO_R_W reads inv_icm20948_read_dmp_data makes for it
 
+  // Read one packet from the FIFO. The header(s) are checked first: if they are corrupt, or the rest of the packet does not arrive,
+  // the FIFO is reset so the next call starts on a packet boundary (ICM_20948_Stat_UnrecognisedDMPHeader/2 or ICM_20948_Stat_FIFOIncompleteData)
   ICM_20948_Status_e inv_icm20948_read_dmp_data(ICM_20948_Device_t *pdev, icm_20948_DMP_data_t *data);
+  ICM_20948_Status_e inv_icm20948_read_dmp_frame(ICM_20948_Device_t *pdev, uint8_t *packet, uint16_t space, uint16_t *len); // Read one packet as it is, without decoding it (see ICM_20948_Frame.h). space must be at least icm_20948_DMP_Maximum_Packet_Bytes
+  ICM_20948_Status_e inv_icm20948_decode_dmp_packet(const uint8_t *packet, uint16_t len, icm_20948_DMP_data_t *data);    // Decode a whole packet (headers to footer) that has already been read
+  ICM_20948_Status_e inv_icm20948_check_dmp_header(uint16_t data_out_ctl1, uint16_t header);                            // Is the header possible with these DATA_OUT_CTL1 outputs? (0 = unknown: any data bits)
+  ICM_20948_Status_e inv_icm20948_check_dmp_header2(uint16_t header, uint16_t header2);                                  // Is the header2 (if the header says there is one) valid, and does the packet hold any data?
   ICM_20948_Status_e inv_icm20948_set_gyro_sf(ICM_20948_Device_t *pdev, unsigned char div, int gyro_level);
 
+  // Batch mode: the DMP keeps writing packets to the FIFO but only interrupts once BM_BATCH_CNTR reaches the threshold.
+  // The counter counts the samples of the sensors in mask (DMP_Data_ready_Gyro, DMP_Data_ready_Accel, DMP_Data_ready_Secondary_Compass).
+  // Disable the per-sensor interrupts (inv_icm20948_enable_dmp_sensor_int) so the host can sleep until the batch is ready
+  ICM_20948_Status_e inv_icm20948_set_dmp_batch(ICM_20948_Device_t *pdev, bool enable, uint16_t mask, uint32_t threshold);
+  ICM_20948_Status_e inv_icm20948_get_dmp_batch_count(ICM_20948_Device_t *pdev, uint32_t *count);
+  uint32_t inv_icm20948_dmp_batch_threshold(uint32_t window_ms, float sample_rate_hz); // The threshold for a time window, given the rate of the counted sensor (e.g. 1125 / (1 + GYRO_SMPLRT_DIV))
+  ICM_20948_Status_e inv_icm20948_set_dmp_fifo_watermark(ICM_20948_Device_t *pdev, uint16_t bytes); // The DMP also interrupts when the FIFO holds more than this. Default is 800 (about 80% of the FIFO)
+
+  // Compass calibration: the DMP computes CPASS_MTX * raw - CPASS_BIAS. mtx is CPASS_MTX_00 to _22 (uT per LSB, Q30, including the
+  // mounting), bias is CPASS_BIAS_X to _Z (uT, Q16). ICM_20948_magcal_to_dmp (ICM_20948_MagCal.h) makes both from a fitted calibration
+  ICM_20948_Status_e inv_icm20948_set_dmp_compass_cal(ICM_20948_Device_t *pdev, const int32_t mtx[9], const int32_t bias[3]);
+
+  // Mounting. B2S_MTX is the rotation from the chip axes to the body (board) axes, row-major in Q30: body = B2S_MTX * chip.
+  // CPASS_MTX takes the AK09916 axes to the same frame and scales them to uT: B2S_MTX * (x, -y, -z) * 0.15uT per LSB.
+  // inv_icm20948_set_dmp_mount writes both (one burst each), so set the mounting before any compass calibration.
+  // ICM_20948_mount_matrix gives B2S_MTX for the 24 axis-aligned mountings. Other rotations can be written with ICM_20948_Q30,
+  // which the compiler evaluates when the values are constant:
+  //   static const int32_t tilted[9] = {ICM_20948_Q30(0.8660254), ICM_20948_Q30(-0.5), 0, ICM_20948_Q30(0.5), ICM_20948_Q30(0.8660254), 0, 0, 0, ICM_20948_Q30(1.0)};
+#define ICM_20948_Q30(x) ((int32_t)(((x) * 1073741824.0) + (((x) >= 0) ? 0.5 : -0.5))) // -2.0 < x < 2.0
+#define ICM_20948_CPASS_UT_PER_LSB_Q30 0x09999999                                       // 0.15uT per AK09916 LSB (the InvenSense value)
+
+  typedef enum // Where the chip's x and y axes point on the body
+  {
+    ICM_20948_Mount_Xp_Yp = 0, // The chip axes are the body axes
+    ICM_20948_Mount_Xp_Yn, // Upside down: turned 180 degrees about x
+    ICM_20948_Mount_Xp_Zp,
+    ICM_20948_Mount_Xp_Zn,
+    ICM_20948_Mount_Xn_Yp,
+    ICM_20948_Mount_Xn_Yn, // Turned 180 degrees about z
+    ICM_20948_Mount_Xn_Zp,
+    ICM_20948_Mount_Xn_Zn,
+    ICM_20948_Mount_Yp_Xp,
+    ICM_20948_Mount_Yp_Xn, // Turned 90 degrees about z (chip x along body +y)
+    ICM_20948_Mount_Yp_Zp,
+    ICM_20948_Mount_Yp_Zn,
+    ICM_20948_Mount_Yn_Xp, // Turned -90 degrees about z
+    ICM_20948_Mount_Yn_Xn,
+    ICM_20948_Mount_Yn_Zp,
+    ICM_20948_Mount_Yn_Zn,
+    ICM_20948_Mount_Zp_Xp,
+    ICM_20948_Mount_Zp_Xn,
+    ICM_20948_Mount_Zp_Yp,
+    ICM_20948_Mount_Zp_Yn,
+    ICM_20948_Mount_Zn_Xp,
+    ICM_20948_Mount_Zn_Xn,
+    ICM_20948_Mount_Zn_Yp,
+    ICM_20948_Mount_Zn_Yn,
+    ICM_20948_Mount_NUM
+  } ICM_20948_Mount_e;
+
+  ICM_20948_Status_e ICM_20948_mount_matrix(ICM_20948_Mount_e mount, int32_t b2s[9]);     // ICM_20948_Stat_ParamErr if mount is not valid
+  ICM_20948_Status_e ICM_20948_mount_check(const int32_t b2s[9]);                          // ICM_20948_Stat_ParamErr unless b2s is a rotation (orthonormal, determinant +1)
+  void ICM_20948_mount_compass(const int32_t b2s[9], int32_t cpass[9]);                    // CPASS_MTX for a mounting
+  ICM_20948_Status_e inv_icm20948_set_dmp_mount(ICM_20948_Device_t *pdev, const int32_t b2s[9]); // B2S_MTX and CPASS_MTX. ICM_20948_Stat_ParamErr if b2s is not a rotation
+  ICM_20948_Status_e inv_icm20948_get_dmp_mount(ICM_20948_Device_t *pdev, int32_t b2s[9]);       // Read B2S_MTX back
+
+  // Bias save and restore. The DMP learns the gyro, accel and compass biases as it runs, and starts again from zero after a power cycle.
+  // Read them into a blob (to keep in non-volatile memory) and write it back after initializeDMP, before the DMP is enabled.
+  // The blob is a version byte, a count byte, the nine 32-bit biases as the DMP holds them (big-endian: GYRO_BIAS_X to _Z, ACCEL_BIAS_X
+  // to _Z, CPASS_BIAS_X to _Z) and a Fletcher-16 checksum. The accel biases are for the +/- 4g that initializeDMP configures
+#define ICM_20948_BIAS_BLOB_VERSION 1
+#define ICM_20948_BIAS_BLOB_BYTES (2 + (9 * 4) + 2)
+  ICM_20948_Status_e inv_icm20948_get_dmp_biases(ICM_20948_Device_t *pdev, uint8_t *blob);       // blob is ICM_20948_BIAS_BLOB_BYTES
+  ICM_20948_Status_e inv_icm20948_set_dmp_biases(ICM_20948_Device_t *pdev, const uint8_t *blob); // ICM_20948_Stat_ParamErr if the blob is not valid
+  ICM_20948_Status_e ICM_20948_bias_blob_decode(const uint8_t *blob, int32_t bias[9]);          // Check a blob and return its biases (gyro, accel, compass, each X to Z)
+  uint16_t ICM_20948_fletcher16(const uint8_t *data, uint16_t len);                             // The checksum used by the blobs
+  ICM_20948_Status_e inv_icm20948_set_dmp_gyro_bias(ICM_20948_Device_t *pdev, const int32_t bias[3]); // GYRO_BIAS_X..Z (e.g. from ICM_20948_tempcomp_to_dmp)
+
   // ToDo:
 
   /*
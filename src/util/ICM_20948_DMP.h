@@ -52,7 +52,7 @@ extern "C"
 // batch mode
 #define BM_BATCH_CNTR (27 * 16) // 32-bit: Batch counter
 #define BM_BATCH_THLD (19 * 16 + 12) // 32-bit: Batch mode threshold
-#define BM_BATCH_MASK (21 * 16 + 14) // 16-bit
+#define BM_BATCH_MASK (21 * 16 + 14) // 16-bit: Which sensor samples the batch counter counts. Uses the DATA_RDY_STATUS bits (DMP_Data_ready_Gyro etc.)
 
 // sensor output data rate: all 16-bit
 #define ODR_ACCEL (11 * 16 + 14) // ODR_ACCEL Register for accel ODR
@@ -532,7 +532,10 @@ extern "C"
 #define icm_20948_DMP_Activity_Recognition_Bytes 6
 #define icm_20948_DMP_Secondary_On_Off_Bytes 2
 #define icm_20948_DMP_Footer_Bytes 2
-#define icm_20948_DMP_Maximum_Bytes 14 // The most bytes we will attempt to read from the FIFO in one go
+#define icm_20948_DMP_Maximum_Bytes 14 // The largest single field
+#define icm_20948_DMP_Maximum_Packet_Bytes 122 // Every header and header2 field the parser reads, plus the headers and the footer
+#define icm_20948_DMP_Header_Step_Indicator 0x0007 // The pedometer step indicator bits (DATA_OUT_CTL1 bits 2:0) which can appear in the header but carry no data
+#define icm_20948_DMP_Header2_Known (DMP_header2_bitmap_Secondary_On_Off | DMP_header2_bitmap_Activity_Recog | DMP_header2_bitmap_Pickup | DMP_header2_bitmap_Fsync | DMP_header2_bitmap_Compass_Accuracy | DMP_header2_bitmap_Gyro_Accuracy | DMP_header2_bitmap_Accel_Accuracy)
 
   typedef struct
   {
@@ -660,13 +663,16 @@ extern "C"
     // Bike: 0x08
     // Tilt: 0x10
     // Still: 0x20
+    // The two reserved bytes put Timestamp at byte 4 on every platform: left implicit, the compiler pads it there on
+    // 32-bit targets (but not on AVR) and the six bytes from the FIFO missed half of it.
     union
     {
-      uint8_t Bytes[icm_20948_DMP_Activity_Recognition_Bytes];
+      uint8_t Bytes[icm_20948_DMP_Activity_Recognition_Bytes + 2]; // Including the reserved bytes
       struct
       {
         icm_20948_DMP_Activity_t State_Start;
         icm_20948_DMP_Activity_t State_End;
+        uint8_t Reserved[2];
         uint32_t Timestamp;
       } Data;
     } Activity_Recognition;
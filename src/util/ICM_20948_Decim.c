@@ -0,0 +1,205 @@
+#include "ICM_20948_Decim.h"
+
+#include <math.h> // sinf, cosf, floorf
+
+#define DECIM_PI 3.14159265f
+
+static ICM_20948_Status_e ICM_20948_decim_check(uint8_t up, uint16_t down, uint8_t taps)
+{
+  if ((up == 0) || (up > ICM_20948_DECIM_MAX_UP) || (down < up))
+    return ICM_20948_Stat_ParamErr;
+  if ((taps < 2) || (taps > ICM_20948_DECIM_MAX_TAPS))
+    return ICM_20948_Stat_ParamErr;
+  return ICM_20948_Stat_Ok;
+}
+
+// Tap k of branch p: point p + (k * up) of the up * taps point prototype, which runs at up times the input rate
+static float ICM_20948_decim_tap(uint8_t up, uint16_t down, uint8_t taps, uint8_t p, uint8_t k)
+{
+  uint16_t len = (uint16_t)up * taps;
+  uint16_t n = p + ((uint16_t)k * up);
+  float fc = (ICM_20948_DECIM_CUTOFF * 0.5f) / (float)down; // Cycles per prototype point
+  float t = (float)n - ((float)(len - 1) * 0.5f);
+  float sinc = (t == 0.0f) ? (2.0f * fc) : (sinf(2.0f * DECIM_PI * fc * t) / (DECIM_PI * t));
+  float window = 0.54f - (0.46f * cosf((2.0f * DECIM_PI * (float)n) / (float)(len - 1)));
+  return sinc * window;
+}
+
+static float ICM_20948_decim_branch_sum(uint8_t up, uint16_t down, uint8_t taps, uint8_t p)
+{
+  float sum = 0.0f;
+  for (uint8_t k = 0; k < taps; k++)
+    sum += ICM_20948_decim_tap(up, down, taps, p, k);
+  return sum;
+}
+
+// After an output from branch phase: the branch of the next one, and how many inputs come before it
+static void ICM_20948_decim_advance(uint8_t up, uint16_t down, uint8_t *phase, uint16_t *skip)
+{
+  uint32_t next = (uint32_t)*phase + down;
+  *phase = (uint8_t)(next % up);
+  *skip = (uint16_t)((next / up) - 1); // down >= up, so at least one input
+}
+
+ICM_20948_Status_e ICM_20948_decim_init(ICM_20948_Decim_t *d, uint8_t up, uint16_t down, uint8_t taps)
+{
+  ICM_20948_Status_e result = ICM_20948_decim_check(up, down, taps);
+  if (result != ICM_20948_Stat_Ok)
+    return result;
+
+  for (uint8_t p = 0; p < up; p++)
+  {
+    float sum = ICM_20948_decim_branch_sum(up, down, taps, p);
+    for (uint8_t k = 0; k < taps; k++)
+      d->h[p][k] = ICM_20948_decim_tap(up, down, taps, p, k) / sum;
+  }
+  d->up = up;
+  d->down = down;
+  d->taps = taps;
+  d->head = 0;
+  d->phase = 0;
+  d->skip = 0;
+  d->primed = false;
+  return result;
+}
+
+bool ICM_20948_decim_update(ICM_20948_Decim_t *d, const ICM_20948_AGMT_Scaled_t *in, ICM_20948_AGMT_Scaled_t *out)
+{
+  const float v[ICM_20948_DECIM_CHANNELS] = {in->acc.x, in->acc.y, in->acc.z, in->gyr.x, in->gyr.y, in->gyr.z};
+
+  if (!d->primed)
+  {
+    for (uint8_t c = 0; c < ICM_20948_DECIM_CHANNELS; c++)
+      for (uint8_t k = 0; k < d->taps; k++)
+        d->x[c][k] = v[c];
+    d->primed = true;
+  }
+  for (uint8_t c = 0; c < ICM_20948_DECIM_CHANNELS; c++)
+    d->x[c][d->head] = v[c];
+  uint8_t newest = d->head;
+  d->head = (d->head + 1 == d->taps) ? 0 : (d->head + 1);
+
+  if (d->skip > 0)
+  {
+    d->skip--;
+    return false;
+  }
+
+  // Tap k is for the input k samples ago: from the newest back to the start of the ring, then from its end
+  float y[ICM_20948_DECIM_CHANNELS];
+  const float *h = d->h[d->phase];
+  for (uint8_t c = 0; c < ICM_20948_DECIM_CHANNELS; c++)
+  {
+    const float *x = d->x[c];
+    float acc = 0.0f;
+    uint8_t k = 0;
+    for (int16_t j = newest; j >= 0; j--)
+      acc += h[k++] * x[j];
+    for (int16_t j = d->taps - 1; j > newest; j--)
+      acc += h[k++] * x[j];
+    y[c] = acc;
+  }
+  ICM_20948_decim_advance(d->up, d->down, &d->phase, &d->skip);
+
+  *out = *in;
+  out->acc.x = y[0];
+  out->acc.y = y[1];
+  out->acc.z = y[2];
+  out->gyr.x = y[3];
+  out->gyr.y = y[4];
+  out->gyr.z = y[5];
+  return true;
+}
+
+ICM_20948_Status_e ICM_20948_decim_q15_init(ICM_20948_Decim_Q15_t *d, uint8_t up, uint16_t down, uint8_t taps)
+{
+  ICM_20948_Status_e result = ICM_20948_decim_check(up, down, taps);
+  if (result != ICM_20948_Stat_Ok)
+    return result;
+
+  for (uint8_t p = 0; p < up; p++)
+  {
+    // Round each tap, then put what rounding lost into the largest so that the branch sums to exactly 32768
+    float sum = ICM_20948_decim_branch_sum(up, down, taps, p);
+    int32_t total = 0;
+    uint8_t largest = 0;
+    for (uint8_t k = 0; k < taps; k++)
+    {
+      int32_t q = (int32_t)floorf(((ICM_20948_decim_tap(up, down, taps, p, k) / sum) * 32768.0f) + 0.5f);
+      if (q > 32767)
+        q = 32767;
+      d->h[p][k] = (int16_t)q;
+      total += q;
+      if (q > d->h[p][largest])
+        largest = k;
+    }
+    int32_t q = d->h[p][largest] + (32768 - total);
+    d->h[p][largest] = (int16_t)((q > 32767) ? 32767 : q);
+
+    // ICM_20948_decim_q15_update accumulates in 32 bits: the magnitudes must sum to less than 2 (65536 in Q15).
+    // That holds up to 32 taps; a larger ICM_20948_DECIM_MAX_TAPS can exceed it when down is close to up
+    int32_t magnitude = 0;
+    for (uint8_t k = 0; k < taps; k++)
+      magnitude += (d->h[p][k] < 0) ? -d->h[p][k] : d->h[p][k];
+    if (magnitude >= 65536)
+      return ICM_20948_Stat_ParamErr;
+  }
+  d->up = up;
+  d->down = down;
+  d->taps = taps;
+  d->head = 0;
+  d->phase = 0;
+  d->skip = 0;
+  d->primed = false;
+  return result;
+}
+
+bool ICM_20948_decim_q15_update(ICM_20948_Decim_Q15_t *d, const ICM_20948_AGMT_t *in, ICM_20948_AGMT_t *out)
+{
+  const int16_t v[ICM_20948_DECIM_CHANNELS] = {in->acc.axes.x, in->acc.axes.y, in->acc.axes.z, in->gyr.axes.x, in->gyr.axes.y, in->gyr.axes.z};
+
+  if ((!d->primed) || (in->fss.a != d->fss.a) || (in->fss.g != d->fss.g)) // The history must all be at one full scale
+  {
+    for (uint8_t c = 0; c < ICM_20948_DECIM_CHANNELS; c++)
+      for (uint8_t k = 0; k < d->taps; k++)
+        d->x[c][k] = v[c];
+    d->fss = in->fss;
+    d->primed = true;
+  }
+  for (uint8_t c = 0; c < ICM_20948_DECIM_CHANNELS; c++)
+    d->x[c][d->head] = v[c];
+  uint8_t newest = d->head;
+  d->head = (d->head + 1 == d->taps) ? 0 : (d->head + 1);
+
+  if (d->skip > 0)
+  {
+    d->skip--;
+    return false;
+  }
+
+  // The magnitudes of the taps sum to less than 65536 (checked by ICM_20948_decim_q15_init), so 32 bits cannot overflow
+  int16_t y[ICM_20948_DECIM_CHANNELS];
+  const int16_t *h = d->h[d->phase];
+  for (uint8_t c = 0; c < ICM_20948_DECIM_CHANNELS; c++)
+  {
+    const int16_t *x = d->x[c];
+    int32_t acc = 0;
+    uint8_t k = 0;
+    for (int16_t j = newest; j >= 0; j--)
+      acc += (int32_t)h[k++] * x[j];
+    for (int16_t j = d->taps - 1; j > newest; j--)
+      acc += (int32_t)h[k++] * x[j];
+    acc = ICM_20948_fixed_round(acc, 15);
+    y[c] = (int16_t)((acc > 32767) ? 32767 : ((acc < -32768) ? -32768 : acc));
+  }
+  ICM_20948_decim_advance(d->up, d->down, &d->phase, &d->skip);
+
+  *out = *in;
+  out->acc.axes.x = y[0];
+  out->acc.axes.y = y[1];
+  out->acc.axes.z = y[2];
+  out->gyr.axes.x = y[3];
+  out->gyr.axes.y = y[4];
+  out->gyr.axes.z = y[5];
+  return true;
+}
@@ -0,0 +1,94 @@
+/*
+
+Decimation with an anti-alias filter
+
+Reading at the full 1125Hz ODR for vibration analysis while the control loop wants 100Hz: the on-chip DLPF
+(setDLPFcfg) filters for the rate that is read, so the slower stream has to be made from the fast one. A decimation
+stage low-pass filters the accel and gyro channels and keeps one sample in down / up: up = 1 for a whole ratio, or
+e.g. 4 / 45 for 1125Hz to 100Hz. It is a polyphase FIR: each output is one branch of taps values times the last taps
+inputs, and the other inputs are only stored, so no sample costs more than one output.
+
+Stages take and give the same type, so one input stream can give several rates: feed a stage's output to the next
+(a cascade is also cheaper than one long filter for a large ratio):
+
+  ICM_20948_Decim_Q15_t to225, to100;
+  ICM_20948_AGMT_t agmt225, agmt100;
+  ICM_20948_decim_q15_init(&to225, 1, 5, 32);  // 1125Hz to 225Hz
+  ICM_20948_decim_q15_init(&to100, 4, 9, 32);  // 225Hz to 100Hz
+  ...
+  myICM.getAGMT(); // 1125Hz: use myICM.agmt as it is for the fast stream
+  if (ICM_20948_decim_q15_update(&to225, &myICM.agmt, &agmt225))
+    if (ICM_20948_decim_q15_update(&to100, &agmt225, &agmt100))
+      control(&agmt100); // 100Hz
+
+ICM_20948_Decim_t is the same filter in float, on ICM_20948_AGMT_Scaled_t (getScaledAGMT). ICM_20948_Decim_Q15_t
+works on the raw ICM_20948_AGMT_t with Q15 coefficients and an integer multiply-accumulate per tap; its history
+restarts when the full scale changes. In both, the magnetometer and temperature are passed through from the latest
+input, and the first input fills the history so that there is no start-up transient.
+
+The filter is a Hamming-windowed sinc of up * taps points with its -6dB point at ICM_20948_DECIM_CUTOFF of the output
+Nyquist frequency, designed by the init function (in float, for both types). Each branch has a gain of exactly 1.
+More taps give a sharper cut-off: the transition band is about 3.3 * down / (up * taps) of the output rate. The delay is
+(up * taps - 1) / (2 * up) input samples.
+
+*/
+
+#ifndef _ICM_20948_DECIM_H_
+#define _ICM_20948_DECIM_H_
+
+#include "ICM_20948_C.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+
+#ifndef ICM_20948_DECIM_MAX_TAPS
+#define ICM_20948_DECIM_MAX_TAPS 32 // Taps per output. Sets the history each stage holds for each channel
+#endif
+
+#ifndef ICM_20948_DECIM_MAX_UP
+#define ICM_20948_DECIM_MAX_UP 4 // The largest up (the number of filter branches)
+#endif
+
+#define ICM_20948_DECIM_CHANNELS 6  // acc x, y, z, then gyr x, y, z
+#define ICM_20948_DECIM_CUTOFF 0.8f // Of the output Nyquist frequency
+
+  typedef struct
+  {
+    float h[ICM_20948_DECIM_MAX_UP][ICM_20948_DECIM_MAX_TAPS]; // The branches
+    float x[ICM_20948_DECIM_CHANNELS][ICM_20948_DECIM_MAX_TAPS]; // The history: a ring of taps samples
+    uint8_t up;
+    uint16_t down;
+    uint8_t taps;
+    uint8_t head;  // Where the next input goes
+    uint8_t phase; // The branch of the next output
+    uint16_t skip; // Inputs to store before the next output
+    bool primed;   // The history has been filled
+  } ICM_20948_Decim_t;
+
+  typedef struct
+  {
+    int16_t h[ICM_20948_DECIM_MAX_UP][ICM_20948_DECIM_MAX_TAPS]; // Q15
+    int16_t x[ICM_20948_DECIM_CHANNELS][ICM_20948_DECIM_MAX_TAPS];
+    uint8_t up;
+    uint16_t down;
+    uint8_t taps;
+    uint8_t head;
+    uint8_t phase;
+    uint16_t skip;
+    bool primed;
+    ICM_20948_fss_t fss; // Of the samples in the history
+  } ICM_20948_Decim_Q15_t;
+
+  ICM_20948_Status_e ICM_20948_decim_init(ICM_20948_Decim_t *d, uint8_t up, uint16_t down, uint8_t taps); // ICM_20948_Stat_ParamErr unless 1 <= up <= down, up <= ICM_20948_DECIM_MAX_UP and 2 <= taps <= ICM_20948_DECIM_MAX_TAPS
+  bool ICM_20948_decim_update(ICM_20948_Decim_t *d, const ICM_20948_AGMT_Scaled_t *in, ICM_20948_AGMT_Scaled_t *out); // true when out holds a new output
+
+  ICM_20948_Status_e ICM_20948_decim_q15_init(ICM_20948_Decim_Q15_t *d, uint8_t up, uint16_t down, uint8_t taps); // As above, and ICM_20948_Stat_ParamErr if the filter could overflow 32 bits (only possible above 32 taps)
+  bool ICM_20948_decim_q15_update(ICM_20948_Decim_Q15_t *d, const ICM_20948_AGMT_t *in, ICM_20948_AGMT_t *out);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _ICM_20948_DECIM_H_ */
@@ -0,0 +1,353 @@
+#include "ICM_20948_Frame.h"
+
+// The outputs in the order the DMP writes them (and inv_icm20948_decode_dmp_packet reads them). Gyro_Calibr and Fsync are never read, so they take no room
+typedef struct
+{
+  uint16_t header_bit;
+  uint16_t header2_bit;
+  uint8_t bytes;
+} ICM_20948_Frame_Field_t;
+
+static const ICM_20948_Frame_Field_t ICM_20948_frame_fields[] = {
+    {DMP_header_bitmap_Accel, 0, icm_20948_DMP_Raw_Accel_Bytes},
+    {DMP_header_bitmap_Gyro, 0, icm_20948_DMP_Raw_Gyro_Bytes + icm_20948_DMP_Gyro_Bias_Bytes},
+    {DMP_header_bitmap_Compass, 0, icm_20948_DMP_Compass_Bytes},
+    {DMP_header_bitmap_ALS, 0, icm_20948_DMP_ALS_Bytes},
+    {DMP_header_bitmap_Quat6, 0, icm_20948_DMP_Quat6_Bytes},
+    {DMP_header_bitmap_Quat9, 0, icm_20948_DMP_Quat9_Bytes},
+    {DMP_header_bitmap_PQuat6, 0, icm_20948_DMP_PQuat6_Bytes},
+    {DMP_header_bitmap_Geomag, 0, icm_20948_DMP_Geomag_Bytes},
+    {DMP_header_bitmap_Pressure, 0, icm_20948_DMP_Pressure_Bytes},
+    {DMP_header_bitmap_Compass_Calibr, 0, icm_20948_DMP_Compass_Calibr_Bytes},
+    {DMP_header_bitmap_Step_Detector, 0, icm_20948_DMP_Step_Detector_Bytes},
+    {0, DMP_header2_bitmap_Accel_Accuracy, icm_20948_DMP_Accel_Accuracy_Bytes},
+    {0, DMP_header2_bitmap_Gyro_Accuracy, icm_20948_DMP_Gyro_Accuracy_Bytes},
+    {0, DMP_header2_bitmap_Compass_Accuracy, icm_20948_DMP_Compass_Accuracy_Bytes},
+    {0, DMP_header2_bitmap_Pickup, icm_20948_DMP_Pickup_Bytes},
+    {0, DMP_header2_bitmap_Activity_Recog, icm_20948_DMP_Activity_Recognition_Bytes},
+    {0, DMP_header2_bitmap_Secondary_On_Off, icm_20948_DMP_Secondary_On_Off_Bytes},
+};
+
+#define ICM_20948_FRAME_NUM_FIELDS (sizeof(ICM_20948_frame_fields) / sizeof(ICM_20948_frame_fields[0]))
+
+static uint16_t ICM_20948_frame_be16(const uint8_t *p)
+{
+  return (((uint16_t)p[0]) << 8) | p[1];
+}
+
+static uint32_t ICM_20948_frame_be32(const uint8_t *p)
+{
+  return (((uint32_t)p[0]) << 24) | (((uint32_t)p[1]) << 16) | (((uint32_t)p[2]) << 8) | p[3];
+}
+
+uint16_t ICM_20948_frame_header(const uint8_t *frame)
+{
+  return ICM_20948_frame_be16(frame);
+}
+
+uint16_t ICM_20948_frame_header2(const uint8_t *frame)
+{
+  if ((ICM_20948_frame_header(frame) & DMP_header_bitmap_Header2) == 0)
+    return 0;
+  return ICM_20948_frame_be16(&frame[icm_20948_DMP_Header_Bytes]);
+}
+
+uint16_t ICM_20948_frame_size(const uint8_t *frame)
+{
+  return inv_icm20948_dmp_packet_size(ICM_20948_frame_header(frame), ICM_20948_frame_header2(frame), NULL);
+}
+
+uint16_t ICM_20948_frame_footer(const uint8_t *frame)
+{
+  return ICM_20948_frame_be16(&frame[ICM_20948_frame_size(frame) - icm_20948_DMP_Footer_Bytes]);
+}
+
+const uint8_t *ICM_20948_frame_next(const uint8_t *buf, uint16_t len, uint16_t *pos)
+{
+  if ((buf == NULL) || (pos == NULL) || ((uint32_t)*pos + icm_20948_DMP_Header_Bytes > len))
+    return NULL;
+
+  const uint8_t *frame = &buf[*pos];
+  if (((ICM_20948_frame_header(frame) & DMP_header_bitmap_Header2) > 0) && ((uint32_t)*pos + icm_20948_DMP_Header_Bytes + icm_20948_DMP_Header2_Bytes > len))
+    return NULL;
+
+  uint16_t size = ICM_20948_frame_size(frame);
+  if ((uint32_t)*pos + size > len)
+    return NULL;
+
+  *pos += size;
+  return frame;
+}
+
+bool ICM_20948_frame_valid(const uint8_t *frame, uint16_t len)
+{
+  if ((frame == NULL) || (len < icm_20948_DMP_Header_Bytes))
+    return false;
+  uint16_t header = ICM_20948_frame_header(frame);
+  if (((header & DMP_header_bitmap_Header2) > 0) && (len < icm_20948_DMP_Header_Bytes + icm_20948_DMP_Header2_Bytes))
+    return false;
+  if (inv_icm20948_check_dmp_header2(header, ICM_20948_frame_header2(frame)) != ICM_20948_Stat_Ok)
+    return false;
+  return (ICM_20948_frame_size(frame) == len);
+}
+
+const uint8_t *ICM_20948_frame_field(const uint8_t *frame, uint16_t header_bit, uint16_t header2_bit)
+{
+  if ((header_bit == 0) && (header2_bit == 0))
+    return NULL;
+
+  uint16_t header = ICM_20948_frame_header(frame);
+  uint16_t header2 = ICM_20948_frame_header2(frame);
+  uint16_t pos = icm_20948_DMP_Header_Bytes;
+  if ((header & DMP_header_bitmap_Header2) > 0)
+    pos += icm_20948_DMP_Header2_Bytes;
+
+  for (uint8_t i = 0; i < ICM_20948_FRAME_NUM_FIELDS; i++)
+  {
+    const ICM_20948_Frame_Field_t *f = &ICM_20948_frame_fields[i];
+    bool present = ((header & f->header_bit) > 0) || ((header2 & f->header2_bit) > 0);
+    if ((header_bit != 0) ? (f->header_bit == header_bit) : (f->header2_bit == header2_bit))
+      return present ? &frame[pos] : NULL;
+    if (present)
+      pos += f->bytes;
+  }
+  return NULL; // Not an output the frame can hold
+}
+
+static bool ICM_20948_frame_vector16(const uint8_t *frame, uint16_t header_bit, int16_t xyz[3])
+{
+  const uint8_t *p = ICM_20948_frame_field(frame, header_bit, 0);
+  if (p == NULL)
+    return false;
+  for (uint8_t i = 0; i < 3; i++)
+    xyz[i] = (int16_t)ICM_20948_frame_be16(&p[i * 2]);
+  return true;
+}
+
+static bool ICM_20948_frame_vector32(const uint8_t *frame, uint16_t header_bit, int32_t xyz[3], int16_t *accuracy)
+{
+  const uint8_t *p = ICM_20948_frame_field(frame, header_bit, 0);
+  if (p == NULL)
+    return false;
+  for (uint8_t i = 0; i < 3; i++)
+    xyz[i] = (int32_t)ICM_20948_frame_be32(&p[i * 4]);
+  if (accuracy != NULL)
+    *accuracy = (int16_t)ICM_20948_frame_be16(&p[12]);
+  return true;
+}
+
+bool ICM_20948_frame_raw_accel(const uint8_t *frame, int16_t xyz[3])
+{
+  return ICM_20948_frame_vector16(frame, DMP_header_bitmap_Accel, xyz);
+}
+
+bool ICM_20948_frame_raw_gyro(const uint8_t *frame, int16_t xyz[3], int16_t bias[3])
+{
+  const uint8_t *p = ICM_20948_frame_field(frame, DMP_header_bitmap_Gyro, 0);
+  if (p == NULL)
+    return false;
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    xyz[i] = (int16_t)ICM_20948_frame_be16(&p[i * 2]);
+    if (bias != NULL)
+      bias[i] = (int16_t)ICM_20948_frame_be16(&p[icm_20948_DMP_Raw_Gyro_Bytes + (i * 2)]);
+  }
+  return true;
+}
+
+bool ICM_20948_frame_compass(const uint8_t *frame, int16_t xyz[3])
+{
+  return ICM_20948_frame_vector16(frame, DMP_header_bitmap_Compass, xyz);
+}
+
+bool ICM_20948_frame_quat6(const uint8_t *frame, int32_t q[3])
+{
+  return ICM_20948_frame_vector32(frame, DMP_header_bitmap_Quat6, q, NULL);
+}
+
+bool ICM_20948_frame_quat9(const uint8_t *frame, int32_t q[3], int16_t *accuracy)
+{
+  return ICM_20948_frame_vector32(frame, DMP_header_bitmap_Quat9, q, accuracy);
+}
+
+bool ICM_20948_frame_pquat6(const uint8_t *frame, int16_t q[3])
+{
+  return ICM_20948_frame_vector16(frame, DMP_header_bitmap_PQuat6, q);
+}
+
+bool ICM_20948_frame_geomag(const uint8_t *frame, int32_t q[3], int16_t *accuracy)
+{
+  return ICM_20948_frame_vector32(frame, DMP_header_bitmap_Geomag, q, accuracy);
+}
+
+bool ICM_20948_frame_compass_calibr(const uint8_t *frame, int32_t xyz[3])
+{
+  return ICM_20948_frame_vector32(frame, DMP_header_bitmap_Compass_Calibr, xyz, NULL);
+}
+
+bool ICM_20948_frame_step_timestamp(const uint8_t *frame, uint32_t *timestamp)
+{
+  const uint8_t *p = ICM_20948_frame_field(frame, DMP_header_bitmap_Step_Detector, 0);
+  if (p == NULL)
+    return false;
+  *timestamp = ICM_20948_frame_be32(p);
+  return true;
+}
+
+bool ICM_20948_frame_accuracy(const uint8_t *frame, uint16_t header2_bit, uint16_t *accuracy)
+{
+  if ((header2_bit != DMP_header2_bitmap_Accel_Accuracy) && (header2_bit != DMP_header2_bitmap_Gyro_Accuracy) && (header2_bit != DMP_header2_bitmap_Compass_Accuracy))
+    return false;
+  const uint8_t *p = ICM_20948_frame_field(frame, 0, header2_bit);
+  if (p == NULL)
+    return false;
+  *accuracy = ICM_20948_frame_be16(p);
+  return true;
+}
+
+bool ICM_20948_frame_pickup(const uint8_t *frame, uint16_t *pickup)
+{
+  const uint8_t *p = ICM_20948_frame_field(frame, 0, DMP_header2_bitmap_Pickup);
+  if (p == NULL)
+    return false;
+  *pickup = ICM_20948_frame_be16(p);
+  return true;
+}
+
+bool ICM_20948_frame_activity(const uint8_t *frame, icm_20948_DMP_Activity_t *start, icm_20948_DMP_Activity_t *end, uint32_t *timestamp)
+{
+  const uint8_t *p = ICM_20948_frame_field(frame, 0, DMP_header2_bitmap_Activity_Recog);
+  if (p == NULL)
+    return false;
+  union
+  {
+    uint8_t byte;
+    icm_20948_DMP_Activity_t state;
+  } u;
+  u.byte = p[0]; // Byte [0]: State-Start, Byte [1]: State-End, Byte [5:2]: timestamp
+  *start = u.state;
+  u.byte = p[1];
+  *end = u.state;
+  *timestamp = ICM_20948_frame_be32(&p[2]);
+  return true;
+}
+
+bool ICM_20948_frame_secondary_on_off(const uint8_t *frame, icm_20948_DMP_Secondary_On_Off_t *sensors)
+{
+  const uint8_t *p = ICM_20948_frame_field(frame, 0, DMP_header2_bitmap_Secondary_On_Off);
+  if (p == NULL)
+    return false;
+  union
+  {
+    uint16_t word;
+    icm_20948_DMP_Secondary_On_Off_t sensors;
+  } u;
+  u.word = ICM_20948_frame_be16(p);
+  *sensors = u.sensors;
+  return true;
+}
+
+void ICM_20948_frame_drain_init(ICM_20948_Frame_Drain_t *drain, uint8_t *buf, uint16_t cap)
+{
+  drain->buf = buf;
+  drain->cap = cap;
+  drain->len = 0;
+  drain->pos = 0;
+  drain->data_out_ctl1 = 0;
+  drain->resync = false;
+}
+
+ICM_20948_Status_e ICM_20948_frame_drain(ICM_20948_Device_t *pdev, ICM_20948_Frame_Drain_t *drain)
+{
+  ICM_20948_Status_e result = ICM_20948_Stat_Ok;
+
+  if (pdev->_dmp_firmware_available == false)
+    return ICM_20948_Stat_DMPNotSupported;
+
+  if ((drain->buf == NULL) || (drain->cap < icm_20948_DMP_Maximum_Packet_Bytes))
+    return ICM_20948_Stat_ParamErr; // There must be room for at least one whole frame
+
+  if (drain->resync)
+  {
+    result = ICM_20948_reset_FIFO(pdev);
+    if (result != ICM_20948_Stat_Ok)
+      return result;
+    drain->resync = false;
+    drain->len = 0;
+    drain->pos = 0;
+  }
+
+  // Keep the partial frame, if any
+  uint16_t keep = drain->len - drain->pos;
+  for (uint16_t i = 0; i < keep; i++)
+    drain->buf[i] = drain->buf[drain->pos + i];
+  drain->len = keep;
+  drain->pos = 0;
+  drain->data_out_ctl1 = pdev->_dataOutCtl1_fifo; // Including outputs disabled while their packets were queued
+
+  uint16_t fifo_count;
+  result = ICM_20948_get_FIFO_count(pdev, &fifo_count);
+  if (result != ICM_20948_Stat_Ok)
+    return result;
+  if (fifo_count == 0)
+    return ICM_20948_Stat_FIFONoDataAvail;
+
+  uint16_t space = drain->cap - drain->len;
+  if (fifo_count > space)
+    fifo_count = space;
+
+  while (fifo_count > 0)
+  {
+    uint8_t burst = (fifo_count > ICM_20948_FIFO_MAX_BURST) ? ICM_20948_FIFO_MAX_BURST : (uint8_t)fifo_count;
+    result = ICM_20948_read_FIFO(pdev, &drain->buf[drain->len], burst);
+    if (result != ICM_20948_Stat_Ok)
+      return result;
+    drain->len += burst;
+    fifo_count -= burst;
+  }
+
+  return result;
+}
+
+ICM_20948_Status_e ICM_20948_frame_drain_next(ICM_20948_Frame_Drain_t *drain, ICM_20948_Frame_View_t *view)
+{
+  ICM_20948_Status_e result = ICM_20948_Stat_Ok;
+  uint16_t avail = drain->len - drain->pos;
+  const uint8_t *frame = &drain->buf[drain->pos];
+
+  if (avail < icm_20948_DMP_Header_Bytes)
+    return ICM_20948_Stat_FIFONoDataAvail;
+
+  uint16_t header = ICM_20948_frame_header(frame);
+  result = inv_icm20948_check_dmp_header(drain->data_out_ctl1, header);
+  if (result == ICM_20948_Stat_Ok)
+  {
+    uint16_t header2 = 0;
+    if ((header & DMP_header_bitmap_Header2) > 0)
+    {
+      if (avail < (icm_20948_DMP_Header_Bytes + icm_20948_DMP_Header2_Bytes))
+        return ICM_20948_Stat_FIFONoDataAvail;
+      header2 = ICM_20948_frame_header2(frame);
+    }
+    result = inv_icm20948_check_dmp_header2(header, header2);
+    if (result == ICM_20948_Stat_Ok)
+    {
+      uint16_t size = inv_icm20948_dmp_packet_size(header, header2, NULL);
+      if (avail < size)
+        return ICM_20948_Stat_FIFONoDataAvail;
+
+      view->frame = frame;
+      view->header = header;
+      view->header2 = header2;
+      view->size = size;
+      drain->pos += size;
+      return ICM_20948_Stat_Ok;
+    }
+  }
+
+  // Lost sync with the frames: nothing after this point can be trusted
+  drain->len = 0;
+  drain->pos = 0;
+  drain->resync = true;
+  return result;
+}
@@ -0,0 +1,109 @@
+/*
+
+Compact DMP frames
+
+icm_20948_DMP_data_t has room for every output the DMP can send, so it is over 120 bytes even when only Quat6
+is enabled. A frame is the packet exactly as the DMP wrote it to the FIFO: the header, the header2 if present,
+only the outputs that are present (big endian, packed), then the footer. A Quat6 frame is 16 bytes.
+
+inv_icm20948_read_dmp_frame reads one frame; frames can be stored back to back in a byte buffer and walked with
+ICM_20948_frame_next. The accessors find an output from the header bits and return it in native byte order.
+inv_icm20948_decode_dmp_packet still turns a frame into a full icm_20948_DMP_data_t when that is easier.
+
+  uint8_t buf[512];
+  uint16_t used = 0, len;
+  while ((sizeof(buf) - used >= icm_20948_DMP_Maximum_Packet_Bytes) && (inv_icm20948_read_dmp_frame(&dev, &buf[used], sizeof(buf) - used, &len) ... ))
+    used += len;
+  ...
+  int32_t q[3];
+  for (uint16_t pos = 0; (frame = ICM_20948_frame_next(buf, used, &pos)) != NULL;)
+    if (ICM_20948_frame_quat6(frame, q))
+      ...
+
+To avoid even the per-frame reads, drain the FIFO into a buffer in as few bursts as possible and walk it with
+views. A view is a pointer into the buffer plus the frame's headers and size: nothing is copied or decoded until
+an accessor is called on view.frame, and view.frame / view.size can be written straight to storage.
+
+  uint8_t buf[1024];
+  ICM_20948_Frame_Drain_t drain;
+  ICM_20948_Frame_View_t view;
+  ICM_20948_frame_drain_init(&drain, buf, sizeof(buf));
+  ...
+  ICM_20948_frame_drain(&dev, &drain); // Read what the FIFO holds (up to the free space)
+  while (ICM_20948_frame_drain_next(&drain, &view) == ICM_20948_Stat_Ok)
+    if (ICM_20948_frame_quat9(view.frame, q, NULL)) // Only Q1-Q3 are read
+      ...
+
+A frame split across two drains is kept and completed by the next one.
+
+The frame functions below take the frame's size from its headers and do not check it against anything: use them
+only on frames that came from inv_icm20948_read_dmp_frame, ICM_20948_frame_next or ICM_20948_frame_drain_next,
+which have checked that the whole frame is there. For frames from anywhere else (storage, a radio link...) check
+them with ICM_20948_frame_valid first.
+
+*/
+
+#ifndef _ICM_20948_FRAME_H_
+#define _ICM_20948_FRAME_H_
+
+#include "ICM_20948_C.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+
+  uint16_t ICM_20948_frame_header(const uint8_t *frame);
+  uint16_t ICM_20948_frame_header2(const uint8_t *frame); // 0 if the frame has no header2
+  uint16_t ICM_20948_frame_size(const uint8_t *frame);    // Bytes in the frame, including the headers and the footer
+  uint16_t ICM_20948_frame_footer(const uint8_t *frame);
+  const uint8_t *ICM_20948_frame_next(const uint8_t *buf, uint16_t len, uint16_t *pos); // The frame at *pos, stepping *pos past it. NULL at the end or if a frame does not fit
+  bool ICM_20948_frame_valid(const uint8_t *frame, uint16_t len);                       // true if frame holds len bytes and is exactly one frame with headers the parsers accept
+
+  // Find an output by its DMP_header_bitmap_ bit, or by its DMP_header2_bitmap_ bit (with header_bit 0). NULL if it is not in the frame
+  const uint8_t *ICM_20948_frame_field(const uint8_t *frame, uint16_t header_bit, uint16_t header2_bit);
+
+  // Typed accessors. Each returns false, leaving the outputs alone, if the frame does not hold that data
+  bool ICM_20948_frame_raw_accel(const uint8_t *frame, int16_t xyz[3]);
+  bool ICM_20948_frame_raw_gyro(const uint8_t *frame, int16_t xyz[3], int16_t bias[3]); // bias may be NULL
+  bool ICM_20948_frame_compass(const uint8_t *frame, int16_t xyz[3]);
+  bool ICM_20948_frame_quat6(const uint8_t *frame, int32_t q[3]);                    // Q1-Q3 scaled by 2^30
+  bool ICM_20948_frame_quat9(const uint8_t *frame, int32_t q[3], int16_t *accuracy); // accuracy may be NULL
+  bool ICM_20948_frame_pquat6(const uint8_t *frame, int16_t q[3]);
+  bool ICM_20948_frame_geomag(const uint8_t *frame, int32_t q[3], int16_t *accuracy); // accuracy may be NULL
+  bool ICM_20948_frame_compass_calibr(const uint8_t *frame, int32_t xyz[3]);        // uT scaled by 2^16
+  bool ICM_20948_frame_step_timestamp(const uint8_t *frame, uint32_t *timestamp);
+  bool ICM_20948_frame_accuracy(const uint8_t *frame, uint16_t header2_bit, uint16_t *accuracy); // DMP_header2_bitmap_Accel_Accuracy, _Gyro_Accuracy or _Compass_Accuracy
+  bool ICM_20948_frame_pickup(const uint8_t *frame, uint16_t *pickup);
+  bool ICM_20948_frame_activity(const uint8_t *frame, icm_20948_DMP_Activity_t *start, icm_20948_DMP_Activity_t *end, uint32_t *timestamp);
+  bool ICM_20948_frame_secondary_on_off(const uint8_t *frame, icm_20948_DMP_Secondary_On_Off_t *sensors);
+
+  typedef struct
+  {
+    const uint8_t *frame; // Into the drain buffer. Valid until the next ICM_20948_frame_drain
+    uint16_t header;
+    uint16_t header2;
+    uint16_t size;
+  } ICM_20948_Frame_View_t;
+
+  typedef struct
+  {
+    uint8_t *buf;
+    uint16_t cap;
+    uint16_t len;          // Bytes in buf
+    uint16_t pos;          // The next frame
+    uint16_t data_out_ctl1; // The outputs that could be in the FIFO when the buffer was filled (_dataOutCtl1_fifo), to check the headers against
+    bool resync;           // A corrupt header was found: reset the FIFO at the next drain
+  } ICM_20948_Frame_Drain_t;
+
+  void ICM_20948_frame_drain_init(ICM_20948_Frame_Drain_t *drain, uint8_t *buf, uint16_t cap);
+  ICM_20948_Status_e ICM_20948_frame_drain(ICM_20948_Device_t *pdev, ICM_20948_Frame_Drain_t *drain); // Move any partial frame to the start of the buffer, then fill the rest from the FIFO
+  // The next whole frame: ICM_20948_Stat_Ok, ICM_20948_Stat_FIFONoDataAvail when more must be drained, or
+  // ICM_20948_Stat_UnrecognisedDMPHeader/2 if the data is corrupt (the buffer is dropped and the FIFO reset at the next drain)
+  ICM_20948_Status_e ICM_20948_frame_drain_next(ICM_20948_Frame_Drain_t *drain, ICM_20948_Frame_View_t *view);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _ICM_20948_FRAME_H_ */
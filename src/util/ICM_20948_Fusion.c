@@ -0,0 +1,208 @@
+#include "ICM_20948_Fusion.h"
+
+#include <math.h> // sqrtf
+
+#define FUSION_DEG_TO_RAD 0.0174532925f
+#define FUSION_GYR_H_Q46 6140831381969LL // (pi / 180) * 10 / 2 in Q46: divided by 10 * LSB/dps and the rate, half the angle of one LSB per update
+
+// The gyro sensitivity of each GYRO_FS_SEL, in LSB per dps times 10
+static const uint16_t ICM_20948_fusion_gyr_lsb_per_dps_x10[4] = {1310, 655, 328, 164};
+
+// Float
+
+void ICM_20948_fusion_init(ICM_20948_Fusion_t *f, float rate_hz, float kp, float ki)
+{
+  ICM_20948_Scale_t scale;
+  f->q.w = 1.0f;
+  f->q.x = 0.0f;
+  f->q.y = 0.0f;
+  f->q.z = 0.0f;
+  f->ix = 0.0f;
+  f->iy = 0.0f;
+  f->iz = 0.0f;
+  f->kp = kp;
+  f->ki = ki;
+  f->dt = 1.0f / rate_hz;
+  f->fss.a = 0;
+  f->fss.g = 0;
+  f->fss.reserved_0 = 0;
+  ICM_20948_scale_init(&scale, f->fss);
+  f->gyr = scale.gyr * FUSION_DEG_TO_RAD;
+}
+
+void ICM_20948_fusion_update(ICM_20948_Fusion_t *f, const ICM_20948_AGMT_t *agmt, bool use_mag)
+{
+  if (agmt->fss.g != f->fss.g)
+  {
+    ICM_20948_Scale_t scale;
+    ICM_20948_scale_init(&scale, agmt->fss);
+    f->fss = agmt->fss;
+    f->gyr = scale.gyr * FUSION_DEG_TO_RAD;
+  }
+
+  float gx = (float)agmt->gyr.axes.x * f->gyr;
+  float gy = (float)agmt->gyr.axes.y * f->gyr;
+  float gz = (float)agmt->gyr.axes.z * f->gyr;
+  float ex = 0.0f, ey = 0.0f, ez = 0.0f; // The error: measured direction x estimated direction
+
+  float ax = (float)agmt->acc.axes.x;
+  float ay = (float)agmt->acc.axes.y;
+  float az = (float)agmt->acc.axes.z;
+  float norm = (ax * ax) + (ay * ay) + (az * az);
+  if (norm > 0.0f)
+  {
+    float m[3][3];
+    ICM_20948_quat_to_matrix(&f->q, m);
+
+    norm = 1.0f / sqrtf(norm);
+    ax *= norm;
+    ay *= norm;
+    az *= norm;
+    ex = (ay * m[2][2]) - (az * m[2][1]); // The bottom row of m is the estimated direction of gravity
+    ey = (az * m[2][0]) - (ax * m[2][2]);
+    ez = (ax * m[2][1]) - (ay * m[2][0]);
+
+    float mx = (float)agmt->mag.axes.x;
+    float my = -(float)agmt->mag.axes.y; // AK09916 to accel / gyro axes
+    float mz = -(float)agmt->mag.axes.z;
+    norm = (mx * mx) + (my * my) + (mz * mz);
+    if (use_mag && (norm > 0.0f))
+    {
+      norm = 1.0f / sqrtf(norm);
+      mx *= norm;
+      my *= norm;
+      mz *= norm;
+
+      // The field in the world frame, turned to north (b has no east part), then back into the sensor frame
+      float hx = (m[0][0] * mx) + (m[0][1] * my) + (m[0][2] * mz);
+      float hy = (m[1][0] * mx) + (m[1][1] * my) + (m[1][2] * mz);
+      float bz = (m[2][0] * mx) + (m[2][1] * my) + (m[2][2] * mz);
+      float bx = sqrtf((hx * hx) + (hy * hy));
+      float wx = (m[0][0] * bx) + (m[2][0] * bz);
+      float wy = (m[0][1] * bx) + (m[2][1] * bz);
+      float wz = (m[0][2] * bx) + (m[2][2] * bz);
+      ex += (my * wz) - (mz * wy);
+      ey += (mz * wx) - (mx * wz);
+      ez += (mx * wy) - (my * wx);
+    }
+
+    f->ix += f->ki * ex * f->dt;
+    f->iy += f->ki * ey * f->dt;
+    f->iz += f->ki * ez * f->dt;
+    gx += (f->kp * ex) + f->ix;
+    gy += (f->kp * ey) + f->iy;
+    gz += (f->kp * ez) + f->iz;
+  }
+
+  // q += q * (0, g) * dt / 2
+  float hdt = 0.5f * f->dt;
+  gx *= hdt;
+  gy *= hdt;
+  gz *= hdt;
+  ICM_20948_Quat_t q = f->q;
+  f->q.w = q.w - (q.x * gx) - (q.y * gy) - (q.z * gz);
+  f->q.x = q.x + (q.w * gx) + (q.y * gz) - (q.z * gy);
+  f->q.y = q.y + (q.w * gy) - (q.x * gz) + (q.z * gx);
+  f->q.z = q.z + (q.w * gz) + (q.x * gy) - (q.y * gx);
+  ICM_20948_quat_normalize(&f->q);
+}
+
+// Fixed point
+
+#define FUSION_MUL(a, b) ((int64_t)(a) * (int64_t)(b))
+
+// Scale a raw vector to unit length in Q30. false if it is all zero
+static bool ICM_20948_fusion_q30_unit(int32_t x, int32_t y, int32_t z, int32_t u[3])
+{
+  uint64_t sum = (uint64_t)FUSION_MUL(x, x) + (uint64_t)FUSION_MUL(y, y) + (uint64_t)FUSION_MUL(z, z);
+  if (sum == 0)
+  {
+    return false;
+  }
+  int64_t inv = (((int64_t)1) << 45) / (int64_t)ICM_20948_fixed_sqrt(sum); // Q45 / norm: one division for all three
+  u[0] = ICM_20948_fixed_round(x * inv, 15);
+  u[1] = ICM_20948_fixed_round(y * inv, 15);
+  u[2] = ICM_20948_fixed_round(z * inv, 15);
+  return true;
+}
+
+void ICM_20948_fusion_q30_init(ICM_20948_Fusion_Q30_t *f, uint16_t rate_hz, int32_t kp_q16, int32_t ki_q16)
+{
+  if (rate_hz == 0)
+  {
+    rate_hz = 1;
+  }
+  f->q.w = ((int32_t)1) << 30;
+  f->q.x = 0;
+  f->q.y = 0;
+  f->q.z = 0;
+  f->ix = 0;
+  f->iy = 0;
+  f->iz = 0;
+  f->kp_h = (int32_t)((((int64_t)kp_q16) << 13) / rate_hz);                        // kp / rate / 2: Q16 to Q30 is << 14
+  f->ki_h = (int32_t)((((int64_t)ki_q16) << 13) / ((int64_t)rate_hz * rate_hz)); // ki / rate^2 / 2
+  for (uint8_t i = 0; i < 4; i++)
+  {
+    f->gyr_h[i] = FUSION_GYR_H_Q46 / ((int64_t)ICM_20948_fusion_gyr_lsb_per_dps_x10[i] * rate_hz);
+  }
+}
+
+void ICM_20948_fusion_q30_update(ICM_20948_Fusion_Q30_t *f, const ICM_20948_AGMT_t *agmt, bool use_mag)
+{
+  // Half the angle turned this update (Q30): the gyro, then the correction
+  int64_t k = f->gyr_h[agmt->fss.g];
+  int32_t dx = ICM_20948_fixed_round(agmt->gyr.axes.x * k, 16);
+  int32_t dy = ICM_20948_fixed_round(agmt->gyr.axes.y * k, 16);
+  int32_t dz = ICM_20948_fixed_round(agmt->gyr.axes.z * k, 16);
+
+  int32_t a[3];
+  if (ICM_20948_fusion_q30_unit(agmt->acc.axes.x, agmt->acc.axes.y, agmt->acc.axes.z, a))
+  {
+    int32_t m[3][3];
+    ICM_20948_quat_q30_to_matrix(&f->q, m);
+
+    int64_t ex = FUSION_MUL(a[1], m[2][2]) - FUSION_MUL(a[2], m[2][1]); // Q60
+    int64_t ey = FUSION_MUL(a[2], m[2][0]) - FUSION_MUL(a[0], m[2][2]);
+    int64_t ez = FUSION_MUL(a[0], m[2][1]) - FUSION_MUL(a[1], m[2][0]);
+
+    int32_t b[3];
+    if (use_mag && ICM_20948_fusion_q30_unit(agmt->mag.axes.x, -(int32_t)agmt->mag.axes.y, -(int32_t)agmt->mag.axes.z, b))
+    {
+      int32_t hx = ICM_20948_fixed_round(FUSION_MUL(m[0][0], b[0]) + FUSION_MUL(m[0][1], b[1]) + FUSION_MUL(m[0][2], b[2]), 30);
+      int32_t hy = ICM_20948_fixed_round(FUSION_MUL(m[1][0], b[0]) + FUSION_MUL(m[1][1], b[1]) + FUSION_MUL(m[1][2], b[2]), 30);
+      int32_t bz = ICM_20948_fixed_round(FUSION_MUL(m[2][0], b[0]) + FUSION_MUL(m[2][1], b[1]) + FUSION_MUL(m[2][2], b[2]), 30);
+      int32_t bx = (int32_t)ICM_20948_fixed_sqrt((uint64_t)FUSION_MUL(hx, hx) + (uint64_t)FUSION_MUL(hy, hy));
+      int32_t wx = ICM_20948_fixed_round(FUSION_MUL(m[0][0], bx) + FUSION_MUL(m[2][0], bz), 30);
+      int32_t wy = ICM_20948_fixed_round(FUSION_MUL(m[0][1], bx) + FUSION_MUL(m[2][1], bz), 30);
+      int32_t wz = ICM_20948_fixed_round(FUSION_MUL(m[0][2], bx) + FUSION_MUL(m[2][2], bz), 30);
+      ex += FUSION_MUL(b[1], wz) - FUSION_MUL(b[2], wy);
+      ey += FUSION_MUL(b[2], wx) - FUSION_MUL(b[0], wz);
+      ez += FUSION_MUL(b[0], wy) - FUSION_MUL(b[1], wx);
+    }
+
+    int32_t ex30 = ICM_20948_fixed_round(ex, 30);
+    int32_t ey30 = ICM_20948_fixed_round(ey, 30);
+    int32_t ez30 = ICM_20948_fixed_round(ez, 30);
+    f->ix += FUSION_MUL(f->ki_h, ex30);
+    f->iy += FUSION_MUL(f->ki_h, ey30);
+    f->iz += FUSION_MUL(f->ki_h, ez30);
+    dx += ICM_20948_fixed_round(FUSION_MUL(f->kp_h, ex30) + f->ix, 30);
+    dy += ICM_20948_fixed_round(FUSION_MUL(f->kp_h, ey30) + f->iy, 30);
+    dz += ICM_20948_fixed_round(FUSION_MUL(f->kp_h, ez30) + f->iz, 30);
+  }
+
+  // q += q * (0, d)
+  ICM_20948_Quat_Q30_t q = f->q;
+  f->q.w = q.w - ICM_20948_fixed_round(FUSION_MUL(q.x, dx) + FUSION_MUL(q.y, dy) + FUSION_MUL(q.z, dz), 30);
+  f->q.x = q.x + ICM_20948_fixed_round(FUSION_MUL(q.w, dx) + FUSION_MUL(q.y, dz) - FUSION_MUL(q.z, dy), 30);
+  f->q.y = q.y + ICM_20948_fixed_round(FUSION_MUL(q.w, dy) - FUSION_MUL(q.x, dz) + FUSION_MUL(q.z, dx), 30);
+  f->q.z = q.z + ICM_20948_fixed_round(FUSION_MUL(q.w, dz) + FUSION_MUL(q.x, dy) - FUSION_MUL(q.y, dx), 30);
+
+  // Renormalize with one Newton step for 1 / sqrt(n) from 1: the norm only moves by about h^2 per update, so this is exact to well under an LSB
+  int64_t n = FUSION_MUL(f->q.w, f->q.w) + FUSION_MUL(f->q.x, f->q.x) + FUSION_MUL(f->q.y, f->q.y) + FUSION_MUL(f->q.z, f->q.z); // Q60
+  int32_t inv = ICM_20948_fixed_round((3 * (((int64_t)1) << 60)) - n, 31);                                                        // (3 - n) / 2, Q30
+  f->q.w = ICM_20948_fixed_round(FUSION_MUL(f->q.w, inv), 30);
+  f->q.x = ICM_20948_fixed_round(FUSION_MUL(f->q.x, inv), 30);
+  f->q.y = ICM_20948_fixed_round(FUSION_MUL(f->q.y, inv), 30);
+  f->q.z = ICM_20948_fixed_round(FUSION_MUL(f->q.z, inv), 30);
+}
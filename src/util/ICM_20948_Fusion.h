@@ -0,0 +1,77 @@
+/*
+
+Sensor fusion on the host, for builds without the DMP
+
+Without ICM_20948_USE_DMP there is no orientation output. ICM_20948_Fusion_t is a Mahony filter that turns
+ICM_20948_AGMT_t samples into a quaternion: the gyro is integrated, and the accelerometer (and, optionally, the
+magnetometer) pull the estimate back with a proportional-integral correction. Call the update once per sample at
+the rate given to the init function (e.g. 1125 / (1 + gyro sample rate divider) Hz).
+
+  ICM_20948_Fusion_t fusion;
+  ICM_20948_fusion_init(&fusion, 100.0f, ICM_20948_FUSION_KP, ICM_20948_FUSION_KI);
+  ...
+  myICM.getAGMT();
+  ICM_20948_fusion_update(&fusion, &myICM.agmt, true); // 9-axis. false ignores the magnetometer (6-axis: yaw drifts)
+  ICM_20948_quat_to_euler(&fusion.q, &euler);
+
+ICM_20948_Fusion_Q30_t is the same filter in integer arithmetic (Q30, see ICM_20948_Quat.h) for targets without an
+FPU. Neither allocates memory, and each update does a fixed amount of work for the chosen 6- or 9-axis mode (an
+all-zero accelerometer or magnetometer reading skips its correction).
+
+The quaternion has the same convention as the DMP outputs: it rotates sensor-frame vectors to the world frame
+(x north, z up when the magnetometer is used). The AK09916 y and z axes are flipped to match the accel and gyro.
+The magnetometer is not calibrated here: hard-iron offsets should be removed from agmt.mag first.
+
+*/
+
+#ifndef _ICM_20948_FUSION_H_
+#define _ICM_20948_FUSION_H_
+
+#include "ICM_20948_C.h"
+#include "ICM_20948_Quat.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+
+#define ICM_20948_FUSION_KP 1.0f // Proportional gain: how fast the accelerometer and magnetometer correct the gyro (rad/s per unit of error)
+#define ICM_20948_FUSION_KI 0.0f // Integral gain: learns a gyro bias. 0 disables it
+#define ICM_20948_FUSION_KP_Q16 65536L
+#define ICM_20948_FUSION_KI_Q16 0L
+
+  typedef struct
+  {
+    ICM_20948_Quat_t q; // The orientation
+    float ix;           // The integral of the error (rad/s)
+    float iy;
+    float iz;
+    float kp;
+    float ki;
+    float dt; // Seconds per update
+    ICM_20948_fss_t fss;
+    float gyr; // rad/s per LSB for fss
+  } ICM_20948_Fusion_t;
+
+  typedef struct
+  {
+    ICM_20948_Quat_Q30_t q; // The orientation
+    int64_t ix;             // The integral of the error, as half the angle it turns per update (Q60, so small errors still add up)
+    int64_t iy;
+    int64_t iz;
+    int32_t kp_h;      // Kp * dt / 2, Q30
+    int32_t ki_h;      // Ki * dt * dt / 2, Q30
+    int64_t gyr_h[4];  // Half the angle (radians) one gyro LSB turns per update, Q46. Indexed by GYRO_FS_SEL
+  } ICM_20948_Fusion_Q30_t;
+
+  void ICM_20948_fusion_init(ICM_20948_Fusion_t *f, float rate_hz, float kp, float ki);
+  void ICM_20948_fusion_update(ICM_20948_Fusion_t *f, const ICM_20948_AGMT_t *agmt, bool use_mag);
+
+  void ICM_20948_fusion_q30_init(ICM_20948_Fusion_Q30_t *f, uint16_t rate_hz, int32_t kp_q16, int32_t ki_q16); // The gains in Q16.16
+  void ICM_20948_fusion_q30_update(ICM_20948_Fusion_Q30_t *f, const ICM_20948_AGMT_t *agmt, bool use_mag);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _ICM_20948_FUSION_H_ */
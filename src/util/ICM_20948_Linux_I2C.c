@@ -0,0 +1,173 @@
+#include "ICM_20948_Linux_I2C.h"
+
+#if defined(__linux__) && !defined(ARDUINO)
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+// Issue the messages in one ioctl. If a bank select is being held back it is prepended as an extra message
+static ICM_20948_Status_e ICM_20948_linux_i2c_transfer(ICM_20948_Linux_I2C_t *bus, struct i2c_msg *msgs, uint32_t nmsgs)
+{
+  struct i2c_msg all[3];
+  uint8_t banksel[2];
+  uint32_t n = 0;
+
+  if (bus->bank_pending)
+  {
+    banksel[0] = REG_BANK_SEL;
+    banksel[1] = bus->bank_value;
+    all[n].addr = bus->addr;
+    all[n].flags = 0;
+    all[n].len = 2;
+    all[n].buf = banksel;
+    n++;
+  }
+  for (uint32_t i = 0; i < nmsgs; i++)
+  {
+    all[n++] = msgs[i];
+  }
+
+  struct i2c_rdwr_ioctl_data xfer;
+  xfer.msgs = all;
+  xfer.nmsgs = n;
+
+  bus->syscalls++;
+  if (ioctl(bus->fd, I2C_RDWR, &xfer) < 0)
+  {
+    return ICM_20948_Stat_Err; // Leave bank_pending set so the bank select is retried with the next transaction
+  }
+
+  bus->bank_pending = false;
+  return ICM_20948_Stat_Ok;
+}
+
+ICM_20948_Status_e ICM_20948_linux_i2c_open(ICM_20948_Linux_I2C_t *bus, const char *path, uint8_t addr)
+{
+  if (bus == NULL)
+  {
+    return ICM_20948_Stat_ParamErr;
+  }
+
+  memset(bus, 0, sizeof(ICM_20948_Linux_I2C_t));
+  bus->fd = -1; // Not open: never close(0) after a failure
+  if (path == NULL)
+  {
+    return ICM_20948_Stat_ParamErr;
+  }
+  bus->addr = addr;
+  bus->fd = open(path, O_RDWR);
+  if (bus->fd < 0)
+  {
+    return ICM_20948_Stat_Err;
+  }
+
+  unsigned long funcs = 0;
+  if ((ioctl(bus->fd, I2C_FUNCS, &funcs) < 0) || ((funcs & I2C_FUNC_I2C) == 0)) // I2C_RDWR needs a plain-I2C capable adapter
+  {
+    ICM_20948_linux_i2c_close(bus);
+    return ICM_20948_Stat_NotImpl;
+  }
+
+  return ICM_20948_Stat_Ok;
+}
+
+void ICM_20948_linux_i2c_close(ICM_20948_Linux_I2C_t *bus)
+{
+  if ((bus != NULL) && (bus->fd >= 0))
+  {
+    close(bus->fd);
+    bus->fd = -1;
+  }
+}
+
+void ICM_20948_linux_i2c_serif(ICM_20948_Linux_I2C_t *bus, ICM_20948_Serif_t *serif)
+{
+  serif->write = ICM_20948_linux_i2c_write;
+  serif->read = ICM_20948_linux_i2c_read;
+  serif->user = (void *)bus;
+  serif->write_async = NULL;
+  serif->read_async = NULL;
+}
+
+ICM_20948_Status_e ICM_20948_linux_i2c_flush(ICM_20948_Linux_I2C_t *bus)
+{
+  if (!bus->bank_pending)
+  {
+    return ICM_20948_Stat_Ok;
+  }
+  return ICM_20948_linux_i2c_transfer(bus, NULL, 0);
+}
+
+void ICM_20948_linux_i2c_reset_counters(ICM_20948_Linux_I2C_t *bus)
+{
+  bus->transactions = 0;
+  bus->syscalls = 0;
+  bus->bytes = 0;
+}
+
+ICM_20948_Status_e ICM_20948_linux_i2c_write(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user)
+{
+  ICM_20948_Linux_I2C_t *bus = (ICM_20948_Linux_I2C_t *)user;
+  if ((bus == NULL) || ((pdata == NULL) && (len > 0)) || (len > ICM_20948_LINUX_I2C_MAX_WRITE))
+  {
+    return ICM_20948_Stat_ParamErr;
+  }
+
+  bus->transactions++;
+  bus->bytes += len;
+
+  if ((regaddr == REG_BANK_SEL) && (len == 1))
+  {
+    // Hold the bank select back. It only matters to the next access, so send it along with that one.
+    // Ok only means it has been queued: if it fails, that access fails with it (see ICM_20948_Linux_I2C.h)
+    bus->bank_pending = true;
+    bus->bank_value = *pdata;
+    return ICM_20948_Stat_Ok;
+  }
+
+  uint8_t buf[1 + ICM_20948_LINUX_I2C_MAX_WRITE];
+  buf[0] = regaddr;
+  if (len > 0)
+  {
+    memcpy(&buf[1], pdata, len);
+  }
+
+  struct i2c_msg msg;
+  msg.addr = bus->addr;
+  msg.flags = 0;
+  msg.len = (uint16_t)(len + 1);
+  msg.buf = buf;
+
+  return ICM_20948_linux_i2c_transfer(bus, &msg, 1);
+}
+
+ICM_20948_Status_e ICM_20948_linux_i2c_read(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user)
+{
+  ICM_20948_Linux_I2C_t *bus = (ICM_20948_Linux_I2C_t *)user;
+  if ((bus == NULL) || (pdata == NULL) || (len == 0) || (len > 0xFFFF)) // i2c_msg.len is 16 bits
+  {
+    return ICM_20948_Stat_ParamErr;
+  }
+
+  bus->transactions++;
+  bus->bytes += len;
+
+  // Register pointer write and data read as one combined (repeated start) transaction
+  struct i2c_msg msgs[2];
+  msgs[0].addr = bus->addr;
+  msgs[0].flags = 0;
+  msgs[0].len = 1;
+  msgs[0].buf = &regaddr;
+  msgs[1].addr = bus->addr;
+  msgs[1].flags = I2C_M_RD;
+  msgs[1].len = (uint16_t)len;
+  msgs[1].buf = pdata;
+
+  return ICM_20948_linux_i2c_transfer(bus, msgs, 2);
+}
+
+#endif /* __linux__ && !ARDUINO */
@@ -0,0 +1,69 @@
+/*
+
+A Linux i2c-dev serif for the C interface (ICM_20948_C.h)
+
+Each serif call is a single ioctl(I2C_RDWR): the register pointer write and the data read go out as one
+combined (repeated-start) transaction. Writes to REG_BANK_SEL are held back and sent as an extra message
+at the front of the next transaction, so a bank change plus a burst read still costs one syscall.
+
+So a REG_BANK_SEL write returns ICM_20948_Stat_Ok without touching the bus, and a failure to select the bank is
+reported by the next read or write instead. That access is never done in the wrong bank: it is in the same ioctl, so it
+fails too, and the bank select is retried with the one after it. Call ICM_20948_linux_i2c_flush for the status of
+the bank select itself.
+
+  ICM_20948_Linux_I2C_t bus;
+  ICM_20948_Serif_t serif;
+  ICM_20948_Device_t dev = {0};
+
+  ICM_20948_linux_i2c_open(&bus, "/dev/i2c-1", ICM_20948_I2C_ADDR_AD1);
+  ICM_20948_linux_i2c_serif(&bus, &serif);
+  dev._last_bank = 255; // Invalid, so the first ICM_20948_set_bank always writes
+  dev._last_mems_bank = 255;
+  ICM_20948_link_serif(&dev, &serif);
+
+Only built on Linux, and never as part of an Arduino sketch.
+
+*/
+
+#ifndef _ICM_20948_LINUX_I2C_H_
+#define _ICM_20948_LINUX_I2C_H_
+
+#include "ICM_20948_C.h"
+
+#if defined(__linux__) && !defined(ARDUINO)
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+
+#define ICM_20948_LINUX_I2C_MAX_WRITE 256 // Largest single register write. The driver never writes more than INV_MAX_SERIAL_WRITE at once
+
+  typedef struct
+  {
+    int fd;                // File descriptor of the /dev/i2c-N adapter
+    uint16_t addr;         // 7-bit address of the ICM-20948
+    bool bank_pending;     // A REG_BANK_SEL write is waiting to go out with the next transaction
+    uint8_t bank_value;    // The value for that write
+    uint32_t transactions; // Number of serif read/write calls
+    uint32_t syscalls;     // Number of ioctl calls. syscalls / samples gives the syscalls per sample
+    uint32_t bytes;        // Number of register data bytes transferred (excluding addresses)
+  } ICM_20948_Linux_I2C_t;
+
+  ICM_20948_Status_e ICM_20948_linux_i2c_open(ICM_20948_Linux_I2C_t *bus, const char *path, uint8_t addr); // Open the adapter, e.g. "/dev/i2c-1"
+  void ICM_20948_linux_i2c_close(ICM_20948_Linux_I2C_t *bus);
+  void ICM_20948_linux_i2c_serif(ICM_20948_Linux_I2C_t *bus, ICM_20948_Serif_t *serif); // Fill in a serif that uses this bus
+  ICM_20948_Status_e ICM_20948_linux_i2c_flush(ICM_20948_Linux_I2C_t *bus);            // Send a held-back bank select now (e.g. before handing the bus to someone else)
+  void ICM_20948_linux_i2c_reset_counters(ICM_20948_Linux_I2C_t *bus);
+
+  // The serif functions themselves. user must point to an ICM_20948_Linux_I2C_t
+  ICM_20948_Status_e ICM_20948_linux_i2c_write(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user);
+  ICM_20948_Status_e ICM_20948_linux_i2c_read(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __linux__ && !ARDUINO */
+
+#endif /* _ICM_20948_LINUX_I2C_H_ */
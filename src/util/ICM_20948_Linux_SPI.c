@@ -0,0 +1,247 @@
+#include "ICM_20948_Linux_SPI.h"
+
+#if defined(__linux__) && !defined(ARDUINO)
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+
+// Issue the transfers as one message. If a bank select is being held back it is prepended as an extra transfer with its own chip-select
+static ICM_20948_Status_e ICM_20948_linux_spi_transfer(ICM_20948_Linux_SPI_t *bus, const struct spi_ioc_transfer *xfers, uint32_t nxfers)
+{
+  struct spi_ioc_transfer all[3];
+  uint8_t banksel[2];
+  uint32_t n = 0;
+
+  memset(all, 0, sizeof(all));
+
+  if (bus->bank_pending)
+  {
+    banksel[0] = REG_BANK_SEL & 0x7F;
+    banksel[1] = bus->bank_value;
+    all[n].tx_buf = (unsigned long)banksel;
+    all[n].len = 2;
+    all[n].speed_hz = bus->speed_hz;
+    all[n].bits_per_word = 8;
+    all[n].cs_change = 1; // Release chip-select so the bank select is a transaction of its own
+    n++;
+  }
+  for (uint32_t i = 0; i < nxfers; i++)
+  {
+    all[n] = xfers[i];
+    all[n].speed_hz = bus->speed_hz;
+    all[n].bits_per_word = 8;
+    n++;
+  }
+
+  bus->syscalls++;
+  if (ioctl(bus->fd, SPI_IOC_MESSAGE(n), all) < 0)
+  {
+    return ICM_20948_Stat_Err; // Leave bank_pending set so the bank select is retried with the next message
+  }
+
+  bus->bank_pending = false;
+  return ICM_20948_Stat_Ok;
+}
+
+ICM_20948_Status_e ICM_20948_linux_spi_open(ICM_20948_Linux_SPI_t *bus, const char *path, uint32_t speed_hz)
+{
+  if (bus == NULL)
+  {
+    return ICM_20948_Stat_ParamErr;
+  }
+
+  memset(bus, 0, sizeof(ICM_20948_Linux_SPI_t));
+  bus->fd = -1; // Not open: never close(0) after a failure
+  if (path == NULL)
+  {
+    return ICM_20948_Stat_ParamErr;
+  }
+  bus->fd = open(path, O_RDWR);
+  if (bus->fd < 0)
+  {
+    return ICM_20948_Stat_Err;
+  }
+
+  uint8_t mode = SPI_MODE_0;
+  uint8_t bits = 8;
+  uint8_t lsb_first = 0;
+  if ((ioctl(bus->fd, SPI_IOC_WR_MODE, &mode) < 0) || (ioctl(bus->fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0) || (ioctl(bus->fd, SPI_IOC_WR_LSB_FIRST, &lsb_first) < 0))
+  {
+    ICM_20948_linux_spi_close(bus);
+    return ICM_20948_Stat_Err;
+  }
+
+  ICM_20948_Status_e retval = ICM_20948_linux_spi_set_speed(bus, speed_hz);
+  if (retval != ICM_20948_Stat_Ok)
+  {
+    ICM_20948_linux_spi_close(bus);
+  }
+  return retval;
+}
+
+void ICM_20948_linux_spi_close(ICM_20948_Linux_SPI_t *bus)
+{
+  if ((bus != NULL) && (bus->fd >= 0))
+  {
+    close(bus->fd);
+    bus->fd = -1;
+  }
+}
+
+void ICM_20948_linux_spi_serif(ICM_20948_Linux_SPI_t *bus, ICM_20948_Serif_t *serif)
+{
+  serif->write = ICM_20948_linux_spi_write;
+  serif->read = ICM_20948_linux_spi_read;
+  serif->user = (void *)bus;
+  serif->write_async = NULL;
+  serif->read_async = NULL;
+}
+
+ICM_20948_Status_e ICM_20948_linux_spi_set_speed(ICM_20948_Linux_SPI_t *bus, uint32_t speed_hz)
+{
+  if (speed_hz == 0)
+  {
+    return ICM_20948_Stat_ParamErr;
+  }
+  if (speed_hz > ICM_20948_LINUX_SPI_MAX_SPEED)
+  {
+    speed_hz = ICM_20948_LINUX_SPI_MAX_SPEED; // Limit SPI frequency to 7MHz
+  }
+
+  // The speed is also set per transfer, but setting the default lets the controller driver validate it now
+  if (ioctl(bus->fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed_hz) < 0)
+  {
+    return ICM_20948_Stat_Err;
+  }
+  bus->speed_hz = speed_hz;
+  return ICM_20948_Stat_Ok;
+}
+
+ICM_20948_Status_e ICM_20948_linux_spi_ramp_speed(ICM_20948_Device_t *pdev, ICM_20948_Linux_SPI_t *bus, uint32_t max_hz)
+{
+  const uint32_t steps[] = {1000000, 2000000, 3000000, 4000000, 5000000, 6000000, 7000000};
+
+  if (max_hz > ICM_20948_LINUX_SPI_MAX_SPEED)
+  {
+    max_hz = ICM_20948_LINUX_SPI_MAX_SPEED;
+  }
+
+  // Make sure we can talk to the device at the starting speed before going any faster
+  ICM_20948_Status_e retval = ICM_20948_check_id(pdev);
+  if (retval != ICM_20948_Stat_Ok)
+  {
+    return retval;
+  }
+
+  for (uint32_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++)
+  {
+    uint32_t step_hz = (steps[i] < max_hz) ? steps[i] : max_hz; // So the last step is max_hz itself, e.g. 6.5MHz
+    if (step_hz <= bus->speed_hz)
+    {
+      continue;
+    }
+
+    uint32_t good_hz = bus->speed_hz;
+    retval = ICM_20948_linux_spi_set_speed(bus, step_hz);
+    for (uint32_t check = 0; (retval == ICM_20948_Stat_Ok) && (check < ICM_20948_LINUX_SPI_RAMP_CHECKS); check++)
+    {
+      retval = ICM_20948_check_id(pdev);
+    }
+    if (retval != ICM_20948_Stat_Ok)
+    {
+      return ICM_20948_linux_spi_set_speed(bus, good_hz); // Back off to the last speed that worked
+    }
+  }
+
+  return ICM_20948_Stat_Ok;
+}
+
+ICM_20948_Status_e ICM_20948_linux_spi_flush(ICM_20948_Linux_SPI_t *bus)
+{
+  if (!bus->bank_pending)
+  {
+    return ICM_20948_Stat_Ok;
+  }
+  return ICM_20948_linux_spi_transfer(bus, NULL, 0);
+}
+
+void ICM_20948_linux_spi_reset_counters(ICM_20948_Linux_SPI_t *bus)
+{
+  bus->transactions = 0;
+  bus->syscalls = 0;
+  bus->bytes = 0;
+}
+
+ICM_20948_Status_e ICM_20948_linux_spi_drain_FIFO(ICM_20948_Device_t *pdev, uint8_t *data, uint32_t len)
+{
+  if ((pdev == NULL) || (pdev->_serif->read_async != NULL)) // With read_async, ICM_20948_read_FIFO_async would return before the data is in
+  {
+    return ICM_20948_Stat_ParamErr;
+  }
+
+  ICM_20948_Status_e retval = ICM_20948_Stat_Ok;
+  for (uint32_t pos = 0; (retval == ICM_20948_Stat_Ok) && (pos < len); pos += ICM_20948_LINUX_SPI_MAX_DRAIN)
+  {
+    uint32_t burst = ((len - pos) > ICM_20948_LINUX_SPI_MAX_DRAIN) ? ICM_20948_LINUX_SPI_MAX_DRAIN : (len - pos);
+    retval = ICM_20948_read_FIFO_async(pdev, &data[pos], burst, NULL, NULL); // Without read_async this is one blocking serif read of any length
+  }
+  return retval;
+}
+
+ICM_20948_Status_e ICM_20948_linux_spi_write(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user)
+{
+  ICM_20948_Linux_SPI_t *bus = (ICM_20948_Linux_SPI_t *)user;
+  if ((bus == NULL) || ((pdata == NULL) && (len > 0)))
+  {
+    return ICM_20948_Stat_ParamErr;
+  }
+
+  bus->transactions++;
+  bus->bytes += len;
+
+  if ((regaddr == REG_BANK_SEL) && (len == 1))
+  {
+    // Hold the bank select back. It only matters to the next access, so send it along with that one
+    bus->bank_pending = true;
+    bus->bank_value = *pdata;
+    return ICM_20948_Stat_Ok;
+  }
+
+  uint8_t addr = regaddr & 0x7F; // Clear the read bit
+  struct spi_ioc_transfer xfers[2];
+  memset(xfers, 0, sizeof(xfers));
+  xfers[0].tx_buf = (unsigned long)&addr;
+  xfers[0].len = 1;
+  xfers[1].tx_buf = (unsigned long)pdata;
+  xfers[1].len = len;
+
+  return ICM_20948_linux_spi_transfer(bus, xfers, (len > 0) ? 2 : 1);
+}
+
+ICM_20948_Status_e ICM_20948_linux_spi_read(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user)
+{
+  ICM_20948_Linux_SPI_t *bus = (ICM_20948_Linux_SPI_t *)user;
+  if ((bus == NULL) || (pdata == NULL) || (len == 0))
+  {
+    return ICM_20948_Stat_ParamErr;
+  }
+
+  bus->transactions++;
+  bus->bytes += len;
+
+  // Address byte then the data, within one chip-select. The data is clocked straight into pdata
+  uint8_t addr = regaddr | 0x80; // Set the read bit
+  struct spi_ioc_transfer xfers[2];
+  memset(xfers, 0, sizeof(xfers));
+  xfers[0].tx_buf = (unsigned long)&addr;
+  xfers[0].len = 1;
+  xfers[1].rx_buf = (unsigned long)pdata;
+  xfers[1].len = len;
+
+  return ICM_20948_linux_spi_transfer(bus, xfers, 2);
+}
+
+#endif /* __linux__ && !ARDUINO */
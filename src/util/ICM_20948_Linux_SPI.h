@@ -0,0 +1,76 @@
+/*
+
+A Linux spidev serif for the C interface (ICM_20948_C.h)
+
+Each serif call is a single SPI_IOC_MESSAGE ioctl. The address byte and the data are separate transfers
+within one chip-select, so burst reads land directly in the caller's buffer.
+Writes to REG_BANK_SEL are held back and sent as an extra transfer (with its own chip-select) at the front
+of the next message, so a bank change plus a burst read is still one syscall.
+
+ICM_20948_read_FIFO takes at most 255 bytes, and the DMP parser reads in ICM_20948_FIFO_MAX_BURST pieces (32 by
+default), so a 512 byte drain through them is 16 syscalls. ICM_20948_linux_spi_drain_FIFO reads any length in one
+syscall per ICM_20948_LINUX_SPI_MAX_DRAIN bytes, i.e. all of a full FIFO in two.
+
+  ICM_20948_Linux_SPI_t bus;
+  ICM_20948_Serif_t serif;
+  ICM_20948_Device_t dev = {0};
+
+  ICM_20948_linux_spi_open(&bus, "/dev/spidev0.0", 1000000);
+  ICM_20948_linux_spi_serif(&bus, &serif);
+  dev._last_bank = 255; // Invalid, so the first ICM_20948_set_bank always writes
+  dev._last_mems_bank = 255;
+  ICM_20948_link_serif(&dev, &serif);
+  ICM_20948_linux_spi_ramp_speed(&dev, &bus, ICM_20948_LINUX_SPI_MAX_SPEED); // Find the fastest clock the wiring supports
+
+Only built on Linux, and never as part of an Arduino sketch.
+
+*/
+
+#ifndef _ICM_20948_LINUX_SPI_H_
+#define _ICM_20948_LINUX_SPI_H_
+
+#include "ICM_20948_C.h"
+
+#if defined(__linux__) && !defined(ARDUINO)
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+
+#define ICM_20948_LINUX_SPI_MAX_SPEED 7000000 // The ICM-20948 SPI clock limit
+#define ICM_20948_LINUX_SPI_RAMP_CHECKS 8      // Number of WHO_AM_I reads that must succeed at each step of the speed ramp
+#define ICM_20948_LINUX_SPI_BUFSIZ 4096        // spidev's default "bufsiz" module parameter: the most bytes one message may carry
+#define ICM_20948_LINUX_SPI_MAX_DRAIN (ICM_20948_LINUX_SPI_BUFSIZ - 3) // Less the address byte and a held-back bank select
+
+  typedef struct
+  {
+    int fd;                // File descriptor of the /dev/spidevB.C device
+    uint32_t speed_hz;     // SCLK used for every transfer
+    bool bank_pending;     // A REG_BANK_SEL write is waiting to go out with the next message
+    uint8_t bank_value;    // The value for that write
+    uint32_t transactions; // Number of serif read/write calls
+    uint32_t syscalls;     // Number of ioctl calls. syscalls / samples gives the syscalls per sample
+    uint32_t bytes;        // Number of register data bytes transferred (excluding address bytes)
+  } ICM_20948_Linux_SPI_t;
+
+  ICM_20948_Status_e ICM_20948_linux_spi_open(ICM_20948_Linux_SPI_t *bus, const char *path, uint32_t speed_hz); // Open and configure (mode 0, MSB first). speed_hz is limited to 7MHz
+  void ICM_20948_linux_spi_close(ICM_20948_Linux_SPI_t *bus);
+  void ICM_20948_linux_spi_serif(ICM_20948_Linux_SPI_t *bus, ICM_20948_Serif_t *serif); // Fill in a serif that uses this bus
+  ICM_20948_Status_e ICM_20948_linux_spi_set_speed(ICM_20948_Linux_SPI_t *bus, uint32_t speed_hz);
+  ICM_20948_Status_e ICM_20948_linux_spi_ramp_speed(ICM_20948_Device_t *pdev, ICM_20948_Linux_SPI_t *bus, uint32_t max_hz); // Step the clock up in 1MHz steps and then to max_hz itself, keeping the fastest speed at which WHO_AM_I reads back reliably
+  ICM_20948_Status_e ICM_20948_linux_spi_flush(ICM_20948_Linux_SPI_t *bus);                                              // Send a held-back bank select now
+  void ICM_20948_linux_spi_reset_counters(ICM_20948_Linux_SPI_t *bus);
+  ICM_20948_Status_e ICM_20948_linux_spi_drain_FIFO(ICM_20948_Device_t *pdev, uint8_t *data, uint32_t len); // Read len bytes of the FIFO, ICM_20948_LINUX_SPI_MAX_DRAIN bytes per syscall. pdev must be on a serif without read_async, as this one is
+
+  // The serif functions themselves. user must point to an ICM_20948_Linux_SPI_t
+  ICM_20948_Status_e ICM_20948_linux_spi_write(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user);
+  ICM_20948_Status_e ICM_20948_linux_spi_read(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __linux__ && !ARDUINO */
+
+#endif /* _ICM_20948_LINUX_SPI_H_ */
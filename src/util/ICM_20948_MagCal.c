@@ -0,0 +1,335 @@
+#include "ICM_20948_MagCal.h"
+
+#include <math.h> // sqrt, pow
+
+#define MAGCAL_UT_PER_LSB 0.15
+#define MAGCAL_MIN_PIVOT 1e-9 // Relative to the largest diagonal element: smaller pivots mean the fit is not constrained
+#define MAGCAL_JACOBI_SWEEPS 8
+
+// The fit is of the quadric a x^2 + b y^2 + c z^2 + 2d xy + 2e xz + 2f yz + 2g x + 2h y + 2i z + j = 0 with
+// a + b + c = 1, which makes it linear in (a, b, d, e, f, g, h, i, j): each term below times its coefficient, summed,
+// equals -z^2. Both sides are polynomials in x, y and z, so the least squares normal equations only need the moments.
+typedef struct
+{
+  int8_t c; // Coefficient (0 = unused)
+  uint8_t p; // Powers of x, y and z
+  uint8_t q;
+  uint8_t r;
+} ICM_20948_MagCal_Term_t;
+
+#define MAGCAL_UNKNOWNS 9
+
+static const ICM_20948_MagCal_Term_t ICM_20948_magcal_terms[MAGCAL_UNKNOWNS + 1][2] = {
+    {{1, 2, 0, 0}, {-1, 0, 0, 2}}, // a: x^2 - z^2
+    {{1, 0, 2, 0}, {-1, 0, 0, 2}}, // b: y^2 - z^2
+    {{2, 1, 1, 0}, {0, 0, 0, 0}},  // d
+    {{2, 1, 0, 1}, {0, 0, 0, 0}},  // e
+    {{2, 0, 1, 1}, {0, 0, 0, 0}},  // f
+    {{2, 1, 0, 0}, {0, 0, 0, 0}},  // g
+    {{2, 0, 1, 0}, {0, 0, 0, 0}},  // h
+    {{2, 0, 0, 1}, {0, 0, 0, 0}},  // i
+    {{1, 0, 0, 0}, {0, 0, 0, 0}},  // j
+    {{-1, 0, 0, 2}, {0, 0, 0, 0}}, // The right hand side: -z^2
+};
+
+// Index of the moment of x^p y^q z^r: ordered by degree, then by q + r, then by r (the order ICM_20948_magcal_update adds them in)
+static uint8_t ICM_20948_magcal_moment(uint8_t p, uint8_t q, uint8_t r)
+{
+  uint8_t d = p + q + r;
+  uint8_t s = q + r;
+  return (uint8_t)(((d * (d + 1) * (d + 2)) / 6) + ((s * (s + 1)) / 2) + r);
+}
+
+// The sum over the samples of term m times term n
+static double ICM_20948_magcal_product(const double *s, uint8_t m, uint8_t n)
+{
+  double sum = 0.0;
+  for (uint8_t i = 0; i < 2; i++)
+  {
+    const ICM_20948_MagCal_Term_t *a = &ICM_20948_magcal_terms[m][i];
+    for (uint8_t j = 0; j < 2; j++)
+    {
+      const ICM_20948_MagCal_Term_t *b = &ICM_20948_magcal_terms[n][j];
+      if ((a->c != 0) && (b->c != 0))
+        sum += (double)(a->c * b->c) * s[ICM_20948_magcal_moment(a->p + b->p, a->q + b->q, a->r + b->r)];
+    }
+  }
+  return sum;
+}
+
+static int32_t ICM_20948_magcal_round(double v, double limit)
+{
+  if (v > limit)
+    v = limit;
+  if (v < -limit)
+    v = -limit;
+  return (int32_t)((v >= 0.0) ? (v + 0.5) : (v - 0.5));
+}
+
+void ICM_20948_magcal_init(ICM_20948_MagCal_t *cal)
+{
+  for (uint8_t i = 0; i < ICM_20948_MAGCAL_MOMENTS; i++)
+    cal->s[i] = 0.0;
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    cal->ref[i] = 0;
+    cal->last[i] = 0;
+  }
+  cal->samples = 0;
+}
+
+bool ICM_20948_magcal_update(ICM_20948_MagCal_t *cal, const ICM_20948_axis3named_t *mag)
+{
+  const int16_t *m = mag->raw.i16bit;
+
+  if ((m[0] == 0) && (m[1] == 0) && (m[2] == 0)) // No reading
+    return false;
+
+  if (cal->samples == 0)
+  {
+    for (uint8_t i = 0; i < 3; i++)
+      cal->ref[i] = m[i];
+  }
+  else
+  {
+    int32_t step = 0;
+    for (uint8_t i = 0; i < 3; i++)
+    {
+      int32_t d = (int32_t)m[i] - cal->last[i];
+      step += d * d;
+    }
+    if (step < (ICM_20948_MAGCAL_MIN_STEP * ICM_20948_MAGCAL_MIN_STEP))
+      return false;
+  }
+  for (uint8_t i = 0; i < 3; i++)
+    cal->last[i] = m[i];
+
+  double x[5], y[5], z[5]; // Powers 0 to 4
+  x[0] = 1.0;
+  y[0] = 1.0;
+  z[0] = 1.0;
+  x[1] = (double)((int32_t)m[0] - cal->ref[0]) / ICM_20948_MAGCAL_SCALE;
+  y[1] = (double)((int32_t)m[1] - cal->ref[1]) / ICM_20948_MAGCAL_SCALE;
+  z[1] = (double)((int32_t)m[2] - cal->ref[2]) / ICM_20948_MAGCAL_SCALE;
+  for (uint8_t i = 2; i < 5; i++)
+  {
+    x[i] = x[i - 1] * x[1];
+    y[i] = y[i - 1] * y[1];
+    z[i] = z[i - 1] * z[1];
+  }
+
+  uint8_t k = 0;
+  for (uint8_t d = 0; d < 5; d++)
+  {
+    for (uint8_t s = 0; s <= d; s++)
+    {
+      double xp = x[d - s];
+      for (uint8_t r = 0; r <= s; r++)
+        cal->s[k++] += xp * y[s - r] * z[r];
+    }
+  }
+
+  cal->samples++;
+  return true;
+}
+
+ICM_20948_Status_e ICM_20948_magcal_solve(const ICM_20948_MagCal_t *cal, ICM_20948_MagCal_Result_t *result)
+{
+  if (cal->samples < ICM_20948_MAGCAL_MIN_SAMPLES)
+    return ICM_20948_Stat_NoData;
+
+  // The normal equations, augmented with the right hand side
+  double g[MAGCAL_UNKNOWNS][MAGCAL_UNKNOWNS + 1];
+  double largest = 0.0;
+  for (uint8_t i = 0; i < MAGCAL_UNKNOWNS; i++)
+  {
+    for (uint8_t j = i; j < MAGCAL_UNKNOWNS; j++)
+    {
+      g[i][j] = ICM_20948_magcal_product(cal->s, i, j);
+      g[j][i] = g[i][j];
+    }
+    g[i][MAGCAL_UNKNOWNS] = ICM_20948_magcal_product(cal->s, i, MAGCAL_UNKNOWNS);
+    if (g[i][i] > largest)
+      largest = g[i][i];
+  }
+
+  // Gaussian elimination with partial pivoting
+  for (uint8_t col = 0; col < MAGCAL_UNKNOWNS; col++)
+  {
+    uint8_t pivot = col;
+    for (uint8_t row = col + 1; row < MAGCAL_UNKNOWNS; row++)
+    {
+      if (fabs(g[row][col]) > fabs(g[pivot][col]))
+        pivot = row;
+    }
+    if (fabs(g[pivot][col]) <= (MAGCAL_MIN_PIVOT * largest))
+      return ICM_20948_Stat_Err;
+    if (pivot != col)
+    {
+      for (uint8_t j = col; j <= MAGCAL_UNKNOWNS; j++)
+      {
+        double t = g[col][j];
+        g[col][j] = g[pivot][j];
+        g[pivot][j] = t;
+      }
+    }
+    for (uint8_t row = col + 1; row < MAGCAL_UNKNOWNS; row++)
+    {
+      double f = g[row][col] / g[col][col];
+      for (uint8_t j = col; j <= MAGCAL_UNKNOWNS; j++)
+        g[row][j] -= f * g[col][j];
+    }
+  }
+  double t[MAGCAL_UNKNOWNS];
+  for (int8_t row = MAGCAL_UNKNOWNS - 1; row >= 0; row--)
+  {
+    double sum = g[row][MAGCAL_UNKNOWNS];
+    for (uint8_t j = row + 1; j < MAGCAL_UNKNOWNS; j++)
+      sum -= g[row][j] * t[j];
+    t[row] = sum / g[row][row];
+  }
+
+  // The ellipsoid (x - c)' A (x - c) = k, with A = [a d e; d b f; e f c] and A c = -(g, h, i)
+  double a[3][3] = {{t[0], t[2], t[3]},
+                    {t[2], t[1], t[4]},
+                    {t[3], t[4], 1.0 - t[0] - t[1]}};
+  double adj[3][3]; // A is symmetric, and so is its adjugate
+  adj[0][0] = (a[1][1] * a[2][2]) - (a[1][2] * a[1][2]);
+  adj[0][1] = (a[0][2] * a[1][2]) - (a[0][1] * a[2][2]);
+  adj[0][2] = (a[0][1] * a[1][2]) - (a[0][2] * a[1][1]);
+  adj[1][1] = (a[0][0] * a[2][2]) - (a[0][2] * a[0][2]);
+  adj[1][2] = (a[0][2] * a[0][1]) - (a[0][0] * a[1][2]);
+  adj[2][2] = (a[0][0] * a[1][1]) - (a[0][1] * a[0][1]);
+  adj[1][0] = adj[0][1];
+  adj[2][0] = adj[0][2];
+  adj[2][1] = adj[1][2];
+  double det = (a[0][0] * adj[0][0]) + (a[0][1] * adj[1][0]) + (a[0][2] * adj[2][0]);
+  if (det == 0.0)
+    return ICM_20948_Stat_Err;
+
+  double c[3];
+  double k = -t[8];
+  for (uint8_t i = 0; i < 3; i++)
+    c[i] = -((adj[i][0] * t[5]) + (adj[i][1] * t[6]) + (adj[i][2] * t[7])) / det;
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    for (uint8_t j = 0; j < 3; j++)
+      k += c[i] * a[i][j] * c[j];
+  }
+  if (k == 0.0)
+    return ICM_20948_Stat_Err;
+
+  // Diagonalise A / k (Jacobi rotations): M = V diag(l) V'
+  double v[3][3] = {{1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}, {0.0, 0.0, 1.0}};
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    for (uint8_t j = 0; j < 3; j++)
+      a[i][j] /= k;
+  }
+  for (uint8_t sweep = 0; sweep < MAGCAL_JACOBI_SWEEPS; sweep++)
+  {
+    for (uint8_t p = 0; p < 2; p++)
+    {
+      for (uint8_t q = p + 1; q < 3; q++)
+      {
+        if (a[p][q] == 0.0)
+          continue;
+        double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+        double tn = 1.0 / (fabs(theta) + sqrt((theta * theta) + 1.0));
+        if (theta < 0.0)
+          tn = -tn;
+        double cs = 1.0 / sqrt((tn * tn) + 1.0);
+        double sn = tn * cs;
+        for (uint8_t i = 0; i < 3; i++) // Columns p and q
+        {
+          double ip = a[i][p];
+          double iq = a[i][q];
+          a[i][p] = (cs * ip) - (sn * iq);
+          a[i][q] = (sn * ip) + (cs * iq);
+          ip = v[i][p];
+          iq = v[i][q];
+          v[i][p] = (cs * ip) - (sn * iq);
+          v[i][q] = (sn * ip) + (cs * iq);
+        }
+        for (uint8_t j = 0; j < 3; j++) // Rows p and q
+        {
+          double pj = a[p][j];
+          double qj = a[q][j];
+          a[p][j] = (cs * pj) - (sn * qj);
+          a[q][j] = (sn * pj) + (cs * qj);
+        }
+      }
+    }
+  }
+  double l[3] = {a[0][0], a[1][1], a[2][2]};
+  if ((l[0] <= 0.0) || (l[1] <= 0.0) || (l[2] <= 0.0)) // Not an ellipsoid
+    return ICM_20948_Stat_Err;
+
+  // The semi-axes are 1 / sqrt(l). Scale the correction to their geometric mean, so the sphere keeps the field strength
+  double radius = pow(l[0] * l[1] * l[2], -1.0 / 6.0);
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    for (uint8_t j = 0; j < 3; j++)
+    {
+      double w = 0.0;
+      for (uint8_t n = 0; n < 3; n++)
+        w += v[i][n] * sqrt(l[n]) * v[j][n];
+      result->matrix[i][j] = (float)(w * radius);
+    }
+    result->offset[i] = (float)(cal->ref[i] + (c[i] * ICM_20948_MAGCAL_SCALE));
+  }
+  result->radius = (float)(radius * ICM_20948_MAGCAL_SCALE);
+
+  // The residual of each sample is k * ((x - c)' M (x - c) - 1), about 2k times its relative distance from the ellipsoid.
+  // At the solution the sum of their squares is the sum of rhs^2 minus the solution . the right hand side
+  double sse = ICM_20948_magcal_product(cal->s, MAGCAL_UNKNOWNS, MAGCAL_UNKNOWNS);
+  for (uint8_t i = 0; i < MAGCAL_UNKNOWNS; i++)
+    sse -= t[i] * ICM_20948_magcal_product(cal->s, i, MAGCAL_UNKNOWNS);
+  if (sse < 0.0)
+    sse = 0.0;
+  result->fit_error = (float)(sqrt(sse / (double)cal->samples) / (2.0 * fabs(k)));
+  result->samples = cal->samples;
+
+  return ICM_20948_Stat_Ok;
+}
+
+void ICM_20948_magcal_apply(const ICM_20948_MagCal_Result_t *result, ICM_20948_axis3named_t *mag)
+{
+  float d[3];
+  for (uint8_t i = 0; i < 3; i++)
+    d[i] = (float)mag->raw.i16bit[i] - result->offset[i];
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    float m = (result->matrix[i][0] * d[0]) + (result->matrix[i][1] * d[1]) + (result->matrix[i][2] * d[2]);
+    mag->raw.i16bit[i] = (int16_t)ICM_20948_magcal_round(m, 32767.0);
+  }
+}
+
+void ICM_20948_magcal_to_dmp(const ICM_20948_MagCal_Result_t *result, const int32_t b2s[9], int32_t mtx[9], int32_t bias[3])
+{
+  // The DMP computes mtx * raw - bias, with mtx = b2s * (the AK09916 axes in the chip frame: x, -y, -z) * 0.15uT * matrix
+  static const int8_t ak[3] = {1, -1, -1};
+  double mount[3][3];
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    for (uint8_t j = 0; j < 3; j++)
+    {
+      double r = (b2s == NULL) ? ((i == j) ? 1.0 : 0.0) : ((double)b2s[(i * 3) + j] / 1073741824.0);
+      mount[i][j] = r * ak[j] * MAGCAL_UT_PER_LSB;
+    }
+  }
+
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    double b = 0.0;
+    for (uint8_t j = 0; j < 3; j++)
+    {
+      double m = 0.0;
+      for (uint8_t n = 0; n < 3; n++)
+        m += mount[i][n] * (double)result->matrix[n][j];
+      mtx[(i * 3) + j] = ICM_20948_magcal_round(m * 1073741824.0, 2147483647.0); // uT per LSB, Q30
+      b += m * (double)result->offset[j];
+    }
+    bias[i] = ICM_20948_magcal_round(b * 65536.0, 2147483647.0); // uT, Q16
+  }
+}
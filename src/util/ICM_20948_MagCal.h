@@ -0,0 +1,75 @@
+/*
+
+Magnetometer hard- and soft-iron calibration
+
+The AK09916 readings (agmt.mag) are offset by fields from the board (hard iron) and distorted by nearby metal
+(soft iron), so as the sensor turns they trace an ellipsoid instead of a sphere centred on zero. ICM_20948_MagCal_t
+fits that ellipsoid as the samples arrive: each update adds the sample to a fixed set of sums (no sample buffer),
+and the fit can be solved at any time from the sums alone.
+
+  ICM_20948_MagCal_t cal;
+  ICM_20948_MagCal_Result_t result;
+  ICM_20948_magcal_init(&cal);
+  ...
+  myICM.getAGMT();
+  ICM_20948_magcal_update(&cal, &myICM.agmt.mag); // While the sensor is turned through as many orientations as possible
+  ...
+  if ((ICM_20948_magcal_solve(&cal, &result) == ICM_20948_Stat_Ok) && (result.fit_error < 0.02))
+  {
+    ICM_20948_magcal_apply(&result, &myICM.agmt.mag); // Correct each reading before it is used
+    myICM.setDMPCompassCalibration(&result);           // Or let the DMP apply it (CPASS_MTX_xx and CPASS_BIAS_x)
+  }
+
+The corrected reading is matrix * (raw - offset): a sphere centred on zero, with the radius (the local field
+strength) kept in LSB. Samples closer than ICM_20948_MAGCAL_MIN_STEP to the previous one are skipped, so that
+holding the sensor still does not swamp the fit. fit_error is the RMS distance of the samples from the fitted
+ellipsoid as a fraction of its radius: a few percent or less once the sensor has been turned through most
+orientations. Slow rotation about one axis only gives a poor (or no) fit.
+
+The sums are double: on targets where double is single precision (AVR) the fit is less precise but still usable.
+
+*/
+
+#ifndef _ICM_20948_MAGCAL_H_
+#define _ICM_20948_MAGCAL_H_
+
+#include "ICM_20948_C.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+
+#define ICM_20948_MAGCAL_MIN_STEP 8     // LSB (1.2uT). Samples closer than this to the last one used are skipped
+#define ICM_20948_MAGCAL_MIN_SAMPLES 32 // ICM_20948_magcal_solve returns ICM_20948_Stat_NoData below this
+#define ICM_20948_MAGCAL_SCALE 256.0    // LSB. The sums are of (raw - first sample) / ICM_20948_MAGCAL_SCALE, to keep them well conditioned
+#define ICM_20948_MAGCAL_MOMENTS 35     // Sums of x^p * y^q * z^r for p + q + r <= 4
+
+  typedef struct
+  {
+    double s[ICM_20948_MAGCAL_MOMENTS]; // The moments
+    int16_t ref[3];                     // The first sample: the origin of the sums
+    int16_t last[3];                    // The last sample used
+    uint32_t samples;                   // The number of samples used
+  } ICM_20948_MagCal_t;
+
+  typedef struct
+  {
+    float offset[3];    // Hard iron, LSB
+    float matrix[3][3]; // Soft iron (symmetric, no units)
+    float radius;       // The field strength, LSB (0.15uT per LSB)
+    float fit_error;    // RMS distance from the ellipsoid / radius
+    uint32_t samples;
+  } ICM_20948_MagCal_Result_t;
+
+  void ICM_20948_magcal_init(ICM_20948_MagCal_t *cal);
+  bool ICM_20948_magcal_update(ICM_20948_MagCal_t *cal, const ICM_20948_axis3named_t *mag); // false if the sample was skipped
+  ICM_20948_Status_e ICM_20948_magcal_solve(const ICM_20948_MagCal_t *cal, ICM_20948_MagCal_Result_t *result);    // ICM_20948_Stat_Err if the samples do not describe an ellipsoid
+  void ICM_20948_magcal_apply(const ICM_20948_MagCal_Result_t *result, ICM_20948_axis3named_t *mag);               // Correct a reading in place (LSB)
+  void ICM_20948_magcal_to_dmp(const ICM_20948_MagCal_Result_t *result, const int32_t b2s[9], int32_t mtx[9], int32_t bias[3]); // CPASS_MTX_00..22 (uT, Q30 per LSB) and CPASS_BIAS_X..Z (uT, Q16) for the mounting b2s (B2S_MTX, NULL = none)
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _ICM_20948_MAGCAL_H_ */
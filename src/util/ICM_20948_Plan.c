@@ -0,0 +1,218 @@
+#include "ICM_20948_Plan.h"
+
+// Bus cost of one register transaction: overhead bits + bits per data byte, and the address bytes sent
+#define PLAN_I2C_READ_BITS 30  // START, addr+W, reg, repeated START, addr+R, STOP (bytes are 9 bits with the ACK)
+#define PLAN_I2C_WRITE_BITS 20 // START, addr+W, reg, STOP
+#define PLAN_I2C_BYTE_BITS 9
+#define PLAN_I2C_READ_ADDR_BYTES 3
+#define PLAN_I2C_WRITE_ADDR_BYTES 2
+#define PLAN_SPI_BITS 10 // The address byte plus about a bit time of chip-select on either side
+#define PLAN_SPI_BYTE_BITS 8
+#define PLAN_SPI_ADDR_BYTES 1
+
+// The transactions made by ICM_20948_get_agmt: bank 2, ACCEL_CONFIG, GYRO_CONFIG_1 and ACCEL_CONFIG_2, then bank 0 and the AGMT burst last
+#define PLAN_AGMT_WRITES 2
+#define PLAN_AGMT_READS 4
+#define PLAN_AGMT_READ_BYTES (ICM_20948_AGMT_RAW_BYTES + 3)
+
+// inv_icm20948_read_dmp_data reads FIFO_COUNTH and FIFO_COUNTL (in one burst) before each packet
+#define PLAN_FIFO_COUNT_READS 1
+#define PLAN_FIFO_COUNT_BYTES 2
+
+typedef struct
+{
+  float reads;
+  float writes;
+  float read_bytes;
+  float write_bytes;
+} ICM_20948_Plan_Traffic_t;
+
+static float ICM_20948_plan_bus_s(const ICM_20948_Plan_Config_t *cfg, const ICM_20948_Plan_Traffic_t *t)
+{
+  float bits;
+  if (cfg->bus == ICM_20948_Plan_Bus_SPI)
+  {
+    bits = (t->reads + t->writes) * PLAN_SPI_BITS + (t->read_bytes + t->write_bytes) * PLAN_SPI_BYTE_BITS;
+  }
+  else
+  {
+    bits = t->reads * PLAN_I2C_READ_BITS + t->writes * PLAN_I2C_WRITE_BITS + (t->read_bytes + t->write_bytes) * PLAN_I2C_BYTE_BITS;
+  }
+  return bits / (float)cfg->bus_hz;
+}
+
+static float ICM_20948_plan_bus_bytes(const ICM_20948_Plan_Config_t *cfg, const ICM_20948_Plan_Traffic_t *t)
+{
+  if (cfg->bus == ICM_20948_Plan_Bus_SPI)
+  {
+    return (t->reads + t->writes) * PLAN_SPI_ADDR_BYTES + t->read_bytes + t->write_bytes;
+  }
+  return t->reads * PLAN_I2C_READ_ADDR_BYTES + t->writes * PLAN_I2C_WRITE_ADDR_BYTES + t->read_bytes + t->write_bytes;
+}
+
+uint16_t ICM_20948_plan_dmp_interval(float dmp_rate_hz, float odr_hz)
+{
+  if (odr_hz <= 0.0f)
+  {
+    return 0xFFFF;
+  }
+  float ticks = (dmp_rate_hz / odr_hz) + 0.5f;
+  if (ticks < 1.0f)
+  {
+    return 0; // As fast as the DMP runs
+  }
+  if (ticks > 65536.0f)
+  {
+    return 0xFFFF;
+  }
+  return (uint16_t)(((uint32_t)ticks) - 1);
+}
+
+// Simulate the DMP output counters to find the packets per second, FIFO bytes and FIFO reads
+static ICM_20948_Status_e ICM_20948_plan_dmp(const ICM_20948_Plan_Config_t *cfg, float dmp_rate_hz, float *packets, float *bytes, float *reads, uint16_t *max_bytes)
+{
+  uint32_t ticks[16]; // Output interval, in DMP ticks, of each DATA_OUT_CTL1 bit. 0 = not output
+  uint16_t header2_of[16];
+
+  for (uint8_t b = 0; b < 16; b++)
+  {
+    ticks[b] = 0;
+  }
+
+  for (uint8_t i = 0; i < cfg->num_sensors; i++)
+  {
+    uint16_t bits = inv_icm20948_sensor_to_control_bits(cfg->sensors[i].sensor);
+    if (bits == 0xFFFF)
+    {
+      return ICM_20948_Stat_SensorNotSupported;
+    }
+    if (cfg->sensors[i].odr_hz <= 0.0f)
+    {
+      continue; // Event sensor
+    }
+    uint32_t n = ((uint32_t)ICM_20948_plan_dmp_interval(dmp_rate_hz, cfg->sensors[i].odr_hz)) + 1;
+    for (uint8_t b = 0; b < 16; b++)
+    {
+      uint16_t bit = ((uint16_t)1) << b;
+      if ((bits & bit) && (bit != DMP_Data_Output_Control_1_Header2) && ((ticks[b] == 0) || (n < ticks[b])))
+      {
+        ticks[b] = n; // The fastest sensor sharing an output sets its rate
+      }
+    }
+  }
+
+  for (uint8_t b = 0; b < 16; b++)
+  {
+    header2_of[b] = inv_icm20948_control_bits_to_header2(((uint16_t)1) << b); // Assume the worst case: accuracy with every sample
+  }
+
+  uint32_t num_packets = 0;
+  uint32_t num_bytes = 0;
+  uint32_t num_reads = 0;
+  *max_bytes = 0;
+  for (uint32_t t = 0; t < ICM_20948_PLAN_TICKS; t++)
+  {
+    uint16_t header = 0;
+    uint16_t header2 = 0;
+    for (uint8_t b = 0; b < 16; b++)
+    {
+      if ((ticks[b] != 0) && ((t % ticks[b]) == 0))
+      {
+        header |= ((uint16_t)1) << b;
+        header2 |= header2_of[b];
+      }
+    }
+    if (header == 0)
+    {
+      continue; // Nothing due on this tick
+    }
+    if (header2 != 0)
+    {
+      header |= DMP_header_bitmap_Header2;
+    }
+
+    uint8_t n;
+    uint16_t size = inv_icm20948_dmp_packet_size(header, header2, &n);
+    num_packets++;
+    num_bytes += size;
+    num_reads += n;
+    if (size > *max_bytes)
+    {
+      *max_bytes = size;
+    }
+  }
+
+  float per_s = dmp_rate_hz / (float)ICM_20948_PLAN_TICKS;
+  *packets = (float)num_packets * per_s;
+  *bytes = (float)num_bytes * per_s;
+  *reads = (float)num_reads * per_s;
+  return ICM_20948_Stat_Ok;
+}
+
+ICM_20948_Status_e ICM_20948_plan(const ICM_20948_Plan_Config_t *cfg, ICM_20948_Plan_Result_t *result)
+{
+  ICM_20948_Plan_Traffic_t t;
+  float empty_polls = 0.0f; // FIFO checks that find nothing
+
+  if ((cfg == NULL) || (result == NULL) || (cfg->bus_hz == 0) || ((cfg->num_sensors > 0) && (cfg->sensors == NULL)))
+  {
+    return ICM_20948_Stat_ParamErr;
+  }
+
+  result->fifo_bytes_per_s = 0.0f;
+  result->max_drain_interval_s = 0.0f;
+  result->fifo_overflow = false;
+
+  if (cfg->mode == ICM_20948_Plan_Mode_DMP)
+  {
+    float dmp_rate_hz = (cfg->dmp_rate_hz > 0.0f) ? cfg->dmp_rate_hz : ICM_20948_PLAN_DMP_RATE_HZ;
+    float fifo_reads;
+    ICM_20948_Status_e retval = ICM_20948_plan_dmp(cfg, dmp_rate_hz, &result->samples_per_s, &result->fifo_bytes_per_s, &fifo_reads, &result->max_sample_bytes);
+    if (retval != ICM_20948_Stat_Ok)
+    {
+      return retval;
+    }
+
+    if (cfg->poll_hz > result->samples_per_s)
+    {
+      empty_polls = cfg->poll_hz - result->samples_per_s; // Roughly: every check beyond one per packet finds the FIFO empty
+    }
+    if (result->fifo_bytes_per_s > 0.0f)
+    {
+      result->max_drain_interval_s = ((float)(CFG_FIFO_SIZE - result->max_sample_bytes)) / result->fifo_bytes_per_s;
+      result->fifo_overflow = (cfg->poll_hz > 0.0f) && ((1.0f / cfg->poll_hz) > result->max_drain_interval_s);
+    }
+
+    t.reads = fifo_reads + ((result->samples_per_s + empty_polls) * PLAN_FIFO_COUNT_READS);
+    t.read_bytes = result->fifo_bytes_per_s + ((result->samples_per_s + empty_polls) * PLAN_FIFO_COUNT_BYTES);
+    t.writes = 0.0f; // The driver stays in bank 0
+    t.write_bytes = 0.0f;
+  }
+  else
+  {
+    result->samples_per_s = cfg->agmt_hz;
+    result->max_sample_bytes = ICM_20948_AGMT_RAW_BYTES;
+    t.reads = cfg->agmt_hz * PLAN_AGMT_READS;
+    t.read_bytes = cfg->agmt_hz * PLAN_AGMT_READ_BYTES;
+    t.writes = cfg->agmt_hz * PLAN_AGMT_WRITES; // The bank changes twice per sample
+    t.write_bytes = cfg->agmt_hz * PLAN_AGMT_WRITES;
+  }
+
+  float bus_s = ICM_20948_plan_bus_s(cfg, &t);
+  result->transactions_per_s = t.reads + t.writes;
+  result->payload_bytes_per_s = t.read_bytes + t.write_bytes;
+  result->bus_bytes_per_s = ICM_20948_plan_bus_bytes(cfg, &t);
+  result->bus_utilization = bus_s;
+  result->cpu_load = bus_s + ((result->transactions_per_s * cfg->cpu_us_per_transaction) + (result->samples_per_s * cfg->cpu_us_per_sample)) / 1000000.0f;
+
+  // The empty polls do not grow with the rates, so leave them out of the scale
+  float empty_s = 0.0f;
+  if (empty_polls > 0.0f)
+  {
+    ICM_20948_Plan_Traffic_t e = {empty_polls * PLAN_FIFO_COUNT_READS, 0.0f, empty_polls * PLAN_FIFO_COUNT_BYTES, 0.0f};
+    empty_s = ICM_20948_plan_bus_s(cfg, &e);
+  }
+  result->max_rate_scale = (((bus_s - empty_s) > 0.0f) && (empty_s < 1.0f)) ? ((1.0f - empty_s) / (bus_s - empty_s)) : 0.0f;
+
+  return ICM_20948_Stat_Ok;
+}
@@ -0,0 +1,96 @@
+/*
+
+A bus cost model for the ICM-20948 driver, for planning sensor rates
+
+Describe a configuration - the bus and its clock, getAGMT polling or the DMP FIFO, the enabled DMP sensors and
+their ODRs - and ICM_20948_plan works out what it costs: bus bytes and transactions per second, bus
+utilization, the FIFO fill rate and how long the FIFO can be left before it overflows, and the CPU load.
+It counts the transactions the driver actually makes (ICM_20948_get_agmt, inv_icm20948_read_dmp_data), so
+the numbers follow the library rather than the datasheet minimum.
+
+  const ICM_20948_Plan_Sensor_t sensors[] = {{INV_ICM20948_SENSOR_ORIENTATION, 225.0}, {INV_ICM20948_SENSOR_RAW_ACCELEROMETER, 56.25}};
+  ICM_20948_Plan_Config_t cfg = {0};
+  ICM_20948_Plan_Result_t plan;
+  cfg.bus = ICM_20948_Plan_Bus_I2C;
+  cfg.bus_hz = 400000;
+  cfg.mode = ICM_20948_Plan_Mode_DMP;
+  cfg.sensors = sensors;
+  cfg.num_sensors = 2;
+  cfg.poll_hz = 10; // Drain the FIFO ten times a second
+  ICM_20948_plan(&cfg, &plan);
+
+Bus timing is modelled bit by bit: an I2C register read is START, address+W, register, repeated START,
+address+R, the data and STOP, each byte with its ACK. Clock stretching, gaps between bytes and the
+32-byte chunking of some Wire libraries are not included, so treat the results as a lower bound on cost.
+The DMP is assumed to run at ICM_20948_PLAN_DMP_RATE_HZ with every output counter starting together.
+
+*/
+
+#ifndef _ICM_20948_PLAN_H_
+#define _ICM_20948_PLAN_H_
+
+#include "ICM_20948_C.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+
+#define ICM_20948_PLAN_DMP_RATE_HZ 225.0f // The DMP running rate used by the examples (see inv_icm20948_set_dmp_sensor_period)
+#define ICM_20948_PLAN_TICKS 2250         // Number of DMP ticks (10s at 225Hz) simulated to find the packet mix
+
+  typedef enum
+  {
+    ICM_20948_Plan_Bus_I2C = 0,
+    ICM_20948_Plan_Bus_SPI,
+  } ICM_20948_Plan_Bus_e;
+
+  typedef enum
+  {
+    ICM_20948_Plan_Mode_AGMT = 0, // Polling ICM_20948_get_agmt
+    ICM_20948_Plan_Mode_DMP,      // Reading DMP packets with inv_icm20948_read_dmp_data
+  } ICM_20948_Plan_Mode_e;
+
+  typedef struct
+  {
+    enum inv_icm20948_sensor sensor;
+    float odr_hz; // 0 for event sensors (e.g. the step detector) which add nothing to the steady-state load
+  } ICM_20948_Plan_Sensor_t;
+
+  typedef struct
+  {
+    ICM_20948_Plan_Bus_e bus;
+    uint32_t bus_hz; // I2C: 100000, 400000 or 1000000. SPI: up to 7000000
+    ICM_20948_Plan_Mode_e mode;
+    float agmt_hz;                          // AGMT: how often getAGMT is called
+    const ICM_20948_Plan_Sensor_t *sensors; // DMP: the enabled sensors and their ODRs
+    uint8_t num_sensors;
+    float dmp_rate_hz;            // DMP: the DMP running rate. 0 selects ICM_20948_PLAN_DMP_RATE_HZ
+    float poll_hz;                // DMP: how often the FIFO is checked and drained. 0 means once per packet
+    float cpu_us_per_transaction; // Software overhead of one serif call (driver plus bus library), on top of the bus time
+    float cpu_us_per_sample;      // Time to decode one AGMT sample or DMP packet (measure it with the benchmarks)
+  } ICM_20948_Plan_Config_t;
+
+  typedef struct
+  {
+    float samples_per_s;        // AGMT samples or DMP packets per second
+    uint16_t max_sample_bytes;  // The largest AGMT read or DMP packet
+    float fifo_bytes_per_s;     // FIFO fill rate. 0 in AGMT mode
+    float max_drain_interval_s; // The longest the FIFO (CFG_FIFO_SIZE) can go undrained before it overflows. 0 in AGMT mode
+    bool fifo_overflow;         // true if poll_hz is too slow for max_drain_interval_s
+    float transactions_per_s;   // Serif reads and writes per second
+    float payload_bytes_per_s;  // Register data bytes per second
+    float bus_bytes_per_s;      // Bytes on the bus per second, including the device and register addresses
+    float bus_utilization;      // Fraction of the time the bus is busy. Above 1 the configuration cannot run
+    float cpu_load;             // Fraction of CPU time: the (blocking) bus time plus the software overheads
+    float max_rate_scale;       // How far every rate could be multiplied before the bus saturates
+  } ICM_20948_Plan_Result_t;
+
+  ICM_20948_Status_e ICM_20948_plan(const ICM_20948_Plan_Config_t *cfg, ICM_20948_Plan_Result_t *result);
+  uint16_t ICM_20948_plan_dmp_interval(float dmp_rate_hz, float odr_hz); // The interval to pass to inv_icm20948_set_dmp_sensor_period for odr_hz (the actual ODR is dmp_rate_hz / (interval + 1))
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _ICM_20948_PLAN_H_ */
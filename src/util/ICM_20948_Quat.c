@@ -0,0 +1,340 @@
+#include "ICM_20948_Quat.h"
+
+#include <math.h> // sqrtf
+
+#define QUAT_Q30_SCALE (1.0f / 1073741824.0f) // 2^-30
+#define QUAT_RAD_TO_DEG 57.2957795f
+#define QUAT_PI 3.14159265f
+#define QUAT_HALF_PI 1.57079633f
+#define QUAT_CORDIC_STEPS 22
+
+// atan(2^-i) in degrees, Q16.16
+static const int32_t ICM_20948_quat_cordic_atan[QUAT_CORDIC_STEPS] = {
+    2949120, 1740967, 919879, 466945, 234379, 117304, 58666, 29335, 14668, 7334, 3667,
+    1833, 917, 458, 229, 115, 57, 29, 14, 7, 4, 2};
+
+// Float
+
+// atan2 in radians from a polynomial for atan on [0, 1]. Within 2e-6 radians
+static float ICM_20948_quat_atan2(float y, float x)
+{
+  float ax = (x < 0.0f) ? -x : x;
+  float ay = (y < 0.0f) ? -y : y;
+  float hi = (ax > ay) ? ax : ay;
+  float lo = (ax > ay) ? ay : ax;
+  if (hi == 0.0f)
+  {
+    return 0.0f;
+  }
+  float a = lo / hi;
+  float s = a * a;
+  float r = (((((-0.0117212f * s + 0.05265332f) * s - 0.11643287f) * s + 0.19354346f) * s - 0.33262347f) * s + 0.99997723f) * a;
+  if (ay > ax)
+  {
+    r = QUAT_HALF_PI - r;
+  }
+  if (x < 0.0f)
+  {
+    r = QUAT_PI - r;
+  }
+  return (y < 0.0f) ? -r : r;
+}
+
+void ICM_20948_quat_from_q30(int32_t q1, int32_t q2, int32_t q3, ICM_20948_Quat_t *q)
+{
+  q->x = (float)q1 * QUAT_Q30_SCALE;
+  q->y = (float)q2 * QUAT_Q30_SCALE;
+  q->z = (float)q3 * QUAT_Q30_SCALE;
+  q->w = (float)ICM_20948_fixed_quat_q0(q1, q2, q3) * QUAT_Q30_SCALE;
+}
+
+bool ICM_20948_quat_from_dmp(const icm_20948_DMP_data_t *data, uint16_t header_bit, ICM_20948_Quat_t *q)
+{
+  if ((data->header & header_bit) == 0)
+  {
+    return false;
+  }
+  if (header_bit == DMP_header_bitmap_Quat6)
+  {
+    ICM_20948_quat_from_q30(data->Quat6.Data.Q1, data->Quat6.Data.Q2, data->Quat6.Data.Q3, q);
+  }
+  else if (header_bit == DMP_header_bitmap_Quat9)
+  {
+    ICM_20948_quat_from_q30(data->Quat9.Data.Q1, data->Quat9.Data.Q2, data->Quat9.Data.Q3, q);
+  }
+  else if (header_bit == DMP_header_bitmap_Geomag)
+  {
+    ICM_20948_quat_from_q30(data->Geomag.Data.Q1, data->Geomag.Data.Q2, data->Geomag.Data.Q3, q);
+  }
+  else
+  {
+    return false;
+  }
+  return true;
+}
+
+void ICM_20948_quat_normalize(ICM_20948_Quat_t *q)
+{
+  float sum = (q->w * q->w) + (q->x * q->x) + (q->y * q->y) + (q->z * q->z);
+  if (sum > 0.0f)
+  {
+    float inv = 1.0f / sqrtf(sum);
+    q->w *= inv;
+    q->x *= inv;
+    q->y *= inv;
+    q->z *= inv;
+  }
+}
+
+void ICM_20948_quat_to_matrix(const ICM_20948_Quat_t *q, float m[3][3])
+{
+  float xx = q->x * q->x, yy = q->y * q->y, zz = q->z * q->z;
+  float xy = q->x * q->y, xz = q->x * q->z, yz = q->y * q->z;
+  float wx = q->w * q->x, wy = q->w * q->y, wz = q->w * q->z;
+
+  m[0][0] = 1.0f - 2.0f * (yy + zz);
+  m[0][1] = 2.0f * (xy - wz);
+  m[0][2] = 2.0f * (xz + wy);
+  m[1][0] = 2.0f * (xy + wz);
+  m[1][1] = 1.0f - 2.0f * (xx + zz);
+  m[1][2] = 2.0f * (yz - wx);
+  m[2][0] = 2.0f * (xz - wy);
+  m[2][1] = 2.0f * (yz + wx);
+  m[2][2] = 1.0f - 2.0f * (xx + yy);
+}
+
+void ICM_20948_quat_to_euler(const ICM_20948_Quat_t *q, ICM_20948_Euler_t *e)
+{
+  float t0 = 2.0f * ((q->w * q->x) + (q->y * q->z));
+  float t1 = 1.0f - 2.0f * ((q->x * q->x) + (q->y * q->y));
+  e->roll = ICM_20948_quat_atan2(t0, t1) * QUAT_RAD_TO_DEG;
+
+  float t2 = 2.0f * ((q->w * q->y) - (q->z * q->x));
+  t2 = (t2 > 1.0f) ? 1.0f : t2;
+  t2 = (t2 < -1.0f) ? -1.0f : t2;
+  e->pitch = ICM_20948_quat_atan2(t2, sqrtf(1.0f - (t2 * t2))) * QUAT_RAD_TO_DEG; // asin(t2)
+
+  float t3 = 2.0f * ((q->w * q->z) + (q->x * q->y));
+  float t4 = 1.0f - 2.0f * ((q->y * q->y) + (q->z * q->z));
+  e->yaw = ICM_20948_quat_atan2(t3, t4) * QUAT_RAD_TO_DEG;
+}
+
+void ICM_20948_quat_gravity(const ICM_20948_Quat_t *q, float g[3])
+{
+  // The bottom row of the rotation matrix: the world z axis in the sensor frame
+  g[0] = 2.0f * ((q->x * q->z) - (q->w * q->y));
+  g[1] = 2.0f * ((q->y * q->z) + (q->w * q->x));
+  g[2] = 1.0f - 2.0f * ((q->x * q->x) + (q->y * q->y));
+}
+
+void ICM_20948_quat_rotate(const ICM_20948_Quat_t *q, const float v[3], float out[3])
+{
+  float m[3][3];
+  ICM_20948_quat_to_matrix(q, m);
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    out[i] = (m[i][0] * v[0]) + (m[i][1] * v[1]) + (m[i][2] * v[2]);
+  }
+}
+
+// Fixed point. Products of two Q30 values are Q60 in an int64_t and are rounded back down once
+
+#define QUAT_ONE_Q60 (((int64_t)1) << 60)
+#define QUAT_MUL(a, b) ((int64_t)(a) * (int64_t)(b))
+
+// atan2 in degrees (Q16.16) by CORDIC vectoring: rotate (x, y) onto the x axis, adding up the angles. x and y must be below 2^29
+static int32_t ICM_20948_quat_q30_atan2(int32_t y, int32_t x)
+{
+  int32_t angle = 0;
+  if (x < 0)
+  {
+    angle = (y >= 0) ? (180L << 16) : -(180L << 16); // Rotate by 180 degrees into the right half-plane
+    x = -x;
+    y = -y;
+  }
+  for (uint8_t i = 0; i < QUAT_CORDIC_STEPS; i++)
+  {
+    int32_t dx = (y < 0) ? ~((~y) >> i) : (y >> i); // y / 2^i, rounded down
+    int32_t dy = (x < 0) ? ~((~x) >> i) : (x >> i);
+    if (y > 0)
+    {
+      x += dx;
+      y -= dy;
+      angle += ICM_20948_quat_cordic_atan[i];
+    }
+    else
+    {
+      x -= dx;
+      y += dy;
+      angle -= ICM_20948_quat_cordic_atan[i];
+    }
+  }
+  if (angle > (180L << 16))
+  {
+    angle -= (360L << 16);
+  }
+  else if (angle <= -(180L << 16))
+  {
+    angle += (360L << 16);
+  }
+  return angle;
+}
+
+void ICM_20948_quat_q30_from_q30(int32_t q1, int32_t q2, int32_t q3, ICM_20948_Quat_Q30_t *q)
+{
+  q->w = ICM_20948_fixed_quat_q0(q1, q2, q3);
+  q->x = q1;
+  q->y = q2;
+  q->z = q3;
+}
+
+bool ICM_20948_quat_q30_from_dmp(const icm_20948_DMP_data_t *data, uint16_t header_bit, ICM_20948_Quat_Q30_t *q)
+{
+  if ((data->header & header_bit) == 0)
+  {
+    return false;
+  }
+  if (header_bit == DMP_header_bitmap_Quat6)
+  {
+    ICM_20948_quat_q30_from_q30(data->Quat6.Data.Q1, data->Quat6.Data.Q2, data->Quat6.Data.Q3, q);
+  }
+  else if (header_bit == DMP_header_bitmap_Quat9)
+  {
+    ICM_20948_quat_q30_from_q30(data->Quat9.Data.Q1, data->Quat9.Data.Q2, data->Quat9.Data.Q3, q);
+  }
+  else if (header_bit == DMP_header_bitmap_Geomag)
+  {
+    ICM_20948_quat_q30_from_q30(data->Geomag.Data.Q1, data->Geomag.Data.Q2, data->Geomag.Data.Q3, q);
+  }
+  else
+  {
+    return false;
+  }
+  return true;
+}
+
+void ICM_20948_quat_q30_normalize(ICM_20948_Quat_Q30_t *q)
+{
+  uint64_t sum = (uint64_t)QUAT_MUL(q->w, q->w) + (uint64_t)QUAT_MUL(q->x, q->x) + (uint64_t)QUAT_MUL(q->y, q->y) + (uint64_t)QUAT_MUL(q->z, q->z);
+  int64_t norm = (int64_t)ICM_20948_fixed_sqrt(sum); // Q30
+  if (norm == 0)
+  {
+    return;
+  }
+  q->w = (int32_t)((QUAT_MUL(q->w, 1L << 30) + ((q->w < 0) ? -(norm / 2) : (norm / 2))) / norm); // Rounded
+  q->x = (int32_t)((QUAT_MUL(q->x, 1L << 30) + ((q->x < 0) ? -(norm / 2) : (norm / 2))) / norm);
+  q->y = (int32_t)((QUAT_MUL(q->y, 1L << 30) + ((q->y < 0) ? -(norm / 2) : (norm / 2))) / norm);
+  q->z = (int32_t)((QUAT_MUL(q->z, 1L << 30) + ((q->z < 0) ? -(norm / 2) : (norm / 2))) / norm);
+}
+
+void ICM_20948_quat_q30_to_matrix(const ICM_20948_Quat_Q30_t *q, int32_t m[3][3])
+{
+  int64_t xx = QUAT_MUL(q->x, q->x), yy = QUAT_MUL(q->y, q->y), zz = QUAT_MUL(q->z, q->z);
+  int64_t xy = QUAT_MUL(q->x, q->y), xz = QUAT_MUL(q->x, q->z), yz = QUAT_MUL(q->y, q->z);
+  int64_t wx = QUAT_MUL(q->w, q->x), wy = QUAT_MUL(q->w, q->y), wz = QUAT_MUL(q->w, q->z);
+
+  m[0][0] = ICM_20948_fixed_round(QUAT_ONE_Q60 - 2 * (yy + zz), 30);
+  m[0][1] = ICM_20948_fixed_round(2 * (xy - wz), 30);
+  m[0][2] = ICM_20948_fixed_round(2 * (xz + wy), 30);
+  m[1][0] = ICM_20948_fixed_round(2 * (xy + wz), 30);
+  m[1][1] = ICM_20948_fixed_round(QUAT_ONE_Q60 - 2 * (xx + zz), 30);
+  m[1][2] = ICM_20948_fixed_round(2 * (yz - wx), 30);
+  m[2][0] = ICM_20948_fixed_round(2 * (xz - wy), 30);
+  m[2][1] = ICM_20948_fixed_round(2 * (yz + wx), 30);
+  m[2][2] = ICM_20948_fixed_round(QUAT_ONE_Q60 - 2 * (xx + yy), 30);
+}
+
+void ICM_20948_quat_q30_to_euler(const ICM_20948_Quat_Q30_t *q, ICM_20948_Euler_Q16_t *e)
+{
+  // The same terms as the float version, in Q28 to leave headroom for the CORDIC gain
+  int32_t t0 = ICM_20948_fixed_round(2 * (QUAT_MUL(q->w, q->x) + QUAT_MUL(q->y, q->z)), 32);
+  int32_t t1 = ICM_20948_fixed_round(QUAT_ONE_Q60 - 2 * (QUAT_MUL(q->x, q->x) + QUAT_MUL(q->y, q->y)), 32);
+  e->roll = ICM_20948_quat_q30_atan2(t0, t1);
+
+  int32_t t2 = ICM_20948_fixed_round(2 * (QUAT_MUL(q->w, q->y) - QUAT_MUL(q->z, q->x)), 32);
+  t2 = (t2 > (1L << 28)) ? (1L << 28) : t2;
+  t2 = (t2 < -(1L << 28)) ? -(1L << 28) : t2;
+  int32_t c = (ICM_20948_fixed_quat_q0(t2 * 4, 0, 0) + 2) / 4; // sqrt(1 - t2^2), Q30 to Q28
+  e->pitch = ICM_20948_quat_q30_atan2(t2, c);                  // asin(t2)
+
+  int32_t t3 = ICM_20948_fixed_round(2 * (QUAT_MUL(q->w, q->z) + QUAT_MUL(q->x, q->y)), 32);
+  int32_t t4 = ICM_20948_fixed_round(QUAT_ONE_Q60 - 2 * (QUAT_MUL(q->y, q->y) + QUAT_MUL(q->z, q->z)), 32);
+  e->yaw = ICM_20948_quat_q30_atan2(t3, t4);
+}
+
+void ICM_20948_quat_q30_gravity(const ICM_20948_Quat_Q30_t *q, int32_t g[3])
+{
+  g[0] = ICM_20948_fixed_round(2 * (QUAT_MUL(q->x, q->z) - QUAT_MUL(q->w, q->y)), 30);
+  g[1] = ICM_20948_fixed_round(2 * (QUAT_MUL(q->y, q->z) + QUAT_MUL(q->w, q->x)), 30);
+  g[2] = ICM_20948_fixed_round(QUAT_ONE_Q60 - 2 * (QUAT_MUL(q->x, q->x) + QUAT_MUL(q->y, q->y)), 30);
+}
+
+void ICM_20948_quat_q30_rotate(const ICM_20948_Quat_Q30_t *q, const int32_t v[3], int32_t out[3])
+{
+  int32_t m[3][3];
+  ICM_20948_quat_q30_to_matrix(q, m);
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    out[i] = ICM_20948_fixed_round(QUAT_MUL(m[i][0], v[0]) + QUAT_MUL(m[i][1], v[1]) + QUAT_MUL(m[i][2], v[2]), 30);
+  }
+}
+
+// Batches
+
+uint32_t ICM_20948_quat_from_dmp_batch(const icm_20948_DMP_data_t *data, uint32_t n, uint16_t header_bit, ICM_20948_Quat_t *q)
+{
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < n; i++)
+  {
+    if (ICM_20948_quat_from_dmp(&data[i], header_bit, &q[count]))
+    {
+      count++;
+    }
+  }
+  return count;
+}
+
+uint32_t ICM_20948_quat_q30_from_dmp_batch(const icm_20948_DMP_data_t *data, uint32_t n, uint16_t header_bit, ICM_20948_Quat_Q30_t *q)
+{
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < n; i++)
+  {
+    if (ICM_20948_quat_q30_from_dmp(&data[i], header_bit, &q[count]))
+    {
+      count++;
+    }
+  }
+  return count;
+}
+
+void ICM_20948_quat_to_euler_batch(const ICM_20948_Quat_t *q, uint32_t n, ICM_20948_Euler_t *e)
+{
+  for (uint32_t i = 0; i < n; i++)
+  {
+    ICM_20948_quat_to_euler(&q[i], &e[i]);
+  }
+}
+
+void ICM_20948_quat_q30_to_euler_batch(const ICM_20948_Quat_Q30_t *q, uint32_t n, ICM_20948_Euler_Q16_t *e)
+{
+  for (uint32_t i = 0; i < n; i++)
+  {
+    ICM_20948_quat_q30_to_euler(&q[i], &e[i]);
+  }
+}
+
+void ICM_20948_quat_gravity_batch(const ICM_20948_Quat_t *q, uint32_t n, float (*g)[3])
+{
+  for (uint32_t i = 0; i < n; i++)
+  {
+    ICM_20948_quat_gravity(&q[i], g[i]);
+  }
+}
+
+void ICM_20948_quat_q30_gravity_batch(const ICM_20948_Quat_Q30_t *q, uint32_t n, int32_t (*g)[3])
+{
+  for (uint32_t i = 0; i < n; i++)
+  {
+    ICM_20948_quat_q30_gravity(&q[i], g[i]);
+  }
+}
@@ -0,0 +1,99 @@
+/*
+
+Quaternion math for the DMP orientation outputs
+
+The Quat6 (game rotation vector), Quat9 (rotation vector) and Geomag outputs carry Q1-Q3 of a unit quaternion,
+scaled by 2^30. Q0 is left out because it follows from Q0^2 + Q1^2 + Q2^2 + Q3^2 = 1. This module rebuilds Q0
+and turns the quaternion into a rotation matrix, Euler angles, the gravity vector, or rotates a vector with it.
+
+Each function has a float version (ICM_20948_quat_*, single precision only) and a fixed-point version
+(ICM_20948_quat_q30_*, integer arithmetic only) for targets without an FPU:
+
+  ICM_20948_Quat_t q;
+  ICM_20948_Euler_t e;
+  if (ICM_20948_quat_from_dmp(&data, DMP_header_bitmap_Quat6, &q))
+    ICM_20948_quat_to_euler(&q, &e); // Degrees
+
+The rotation takes sensor-frame vectors to the world frame. The Euler angles are roll about x, pitch about y and
+yaw about z, applied yaw first (as in the DMP examples).
+
+Q0 is rebuilt with an integer square root in both versions: in float, sqrt(1 - sum) loses most of Q0's bits when
+Q0 is small. Accuracy against double precision, for unit quaternions:
+  float: atan2 is a polynomial (within 2e-6 radians). The Euler angles are within 0.001 degrees, except that
+         roll and yaw get less precise within a few degrees of +/-90 degrees pitch, where they are ill-conditioned
+  q30:   Q0, the normalized quaternion, the matrix and gravity are within 1 LSB. Rotated vectors are within 1 unit.
+         atan2 is a CORDIC: the Euler angles (degrees, Q16.16) are within 0.001 degrees
+
+*/
+
+#ifndef _ICM_20948_QUAT_H_
+#define _ICM_20948_QUAT_H_
+
+#include "ICM_20948_C.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+
+  typedef struct
+  {
+    float w; // Q0
+    float x;
+    float y;
+    float z;
+  } ICM_20948_Quat_t;
+
+  typedef struct
+  {
+    int32_t w; // Q0. All scaled by 2^30
+    int32_t x;
+    int32_t y;
+    int32_t z;
+  } ICM_20948_Quat_Q30_t;
+
+  typedef struct
+  {
+    float roll; // Degrees
+    float pitch;
+    float yaw;
+  } ICM_20948_Euler_t;
+
+  typedef struct
+  {
+    int32_t roll; // Degrees, Q16.16
+    int32_t pitch;
+    int32_t yaw;
+  } ICM_20948_Euler_Q16_t;
+
+  // Float
+  void ICM_20948_quat_from_q30(int32_t q1, int32_t q2, int32_t q3, ICM_20948_Quat_t *q);                 // Rebuild Q0 from a DMP payload
+  bool ICM_20948_quat_from_dmp(const icm_20948_DMP_data_t *data, uint16_t header_bit, ICM_20948_Quat_t *q); // header_bit is DMP_header_bitmap_Quat6, _Quat9 or _Geomag. false if the data does not hold it
+  void ICM_20948_quat_normalize(ICM_20948_Quat_t *q);
+  void ICM_20948_quat_to_matrix(const ICM_20948_Quat_t *q, float m[3][3]);
+  void ICM_20948_quat_to_euler(const ICM_20948_Quat_t *q, ICM_20948_Euler_t *e);
+  void ICM_20948_quat_gravity(const ICM_20948_Quat_t *q, float g[3]);                  // The direction of gravity in the sensor frame (unit length)
+  void ICM_20948_quat_rotate(const ICM_20948_Quat_t *q, const float v[3], float out[3]); // Sensor frame to world frame
+
+  // Fixed point
+  void ICM_20948_quat_q30_from_q30(int32_t q1, int32_t q2, int32_t q3, ICM_20948_Quat_Q30_t *q);
+  bool ICM_20948_quat_q30_from_dmp(const icm_20948_DMP_data_t *data, uint16_t header_bit, ICM_20948_Quat_Q30_t *q);
+  void ICM_20948_quat_q30_normalize(ICM_20948_Quat_Q30_t *q);
+  void ICM_20948_quat_q30_to_matrix(const ICM_20948_Quat_Q30_t *q, int32_t m[3][3]); // Q30
+  void ICM_20948_quat_q30_to_euler(const ICM_20948_Quat_Q30_t *q, ICM_20948_Euler_Q16_t *e);
+  void ICM_20948_quat_q30_gravity(const ICM_20948_Quat_Q30_t *q, int32_t g[3]);                      // Q30
+  void ICM_20948_quat_q30_rotate(const ICM_20948_Quat_Q30_t *q, const int32_t v[3], int32_t out[3]); // Any units, |v| < 2^30
+
+  // Batches. The _from_dmp forms skip frames without header_bit and return the number of quaternions written
+  uint32_t ICM_20948_quat_from_dmp_batch(const icm_20948_DMP_data_t *data, uint32_t n, uint16_t header_bit, ICM_20948_Quat_t *q);
+  uint32_t ICM_20948_quat_q30_from_dmp_batch(const icm_20948_DMP_data_t *data, uint32_t n, uint16_t header_bit, ICM_20948_Quat_Q30_t *q);
+  void ICM_20948_quat_to_euler_batch(const ICM_20948_Quat_t *q, uint32_t n, ICM_20948_Euler_t *e);
+  void ICM_20948_quat_q30_to_euler_batch(const ICM_20948_Quat_Q30_t *q, uint32_t n, ICM_20948_Euler_Q16_t *e);
+  void ICM_20948_quat_gravity_batch(const ICM_20948_Quat_t *q, uint32_t n, float (*g)[3]);
+  void ICM_20948_quat_q30_gravity_batch(const ICM_20948_Quat_Q30_t *q, uint32_t n, int32_t (*g)[3]);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _ICM_20948_QUAT_H_ */
@@ -0,0 +1,331 @@
+#include "ICM_20948_Sim.h"
+#include "AK09916_REGISTERS.h"
+
+#include <string.h>
+
+// Register bits used by the model (from the datasheet)
+#define SIM_PWR_MGMT_1_DEVICE_RESET 0x80
+#define SIM_USER_CTRL_I2C_MST_EN 0x20
+#define SIM_PERIPH_ADDR_RNW 0x80
+#define SIM_PERIPH_CTRL_EN 0x80
+#define SIM_PERIPH_CTRL_LENG 0x0F
+#define SIM_I2C_MST_STATUS_PERIPH4_DONE 0x40
+#define SIM_I2C_MST_STATUS_PERIPH4_NACK 0x10
+#define SIM_FIFO_MODE_SNAPSHOT 0x1F
+#define SIM_AK09916_ST1_DRDY 0x01
+#define SIM_AK09916_CNTL3_SRST 0x01
+
+static void ICM_20948_sim_reset_mag(ICM_20948_Sim_t *sim)
+{
+  memset(sim->mag_regs, 0, sizeof(sim->mag_regs));
+  sim->mag_regs[AK09916_REG_WIA1] = (uint8_t)(MAG_AK09916_WHO_AM_I >> 8);
+  sim->mag_regs[AK09916_REG_WIA2] = (uint8_t)(MAG_AK09916_WHO_AM_I & 0xFF);
+}
+
+static void ICM_20948_sim_reset_regs(ICM_20948_Sim_t *sim)
+{
+  memset(sim->regs, 0, sizeof(sim->regs));
+  sim->bank = 0;
+  sim->regs[0][AGB0_REG_WHO_AM_I] = ICM_20948_WHOAMI;
+  sim->regs[0][AGB0_REG_LP_CONFIG] = 0x40;
+  sim->regs[0][AGB0_REG_PWR_MGMT_1] = 0x41; // Asleep, auto clock select
+  sim->regs[2][AGB2_REG_GYRO_CONFIG_1] = 0x01;
+  sim->regs[2][AGB2_REG_ACCEL_CONFIG] = 0x01;
+  sim->fifo_read = 0;
+  sim->fifo_count = 0;
+}
+
+void ICM_20948_sim_init(ICM_20948_Sim_t *sim)
+{
+  memset(sim, 0, sizeof(ICM_20948_Sim_t));
+  ICM_20948_sim_reset_regs(sim);
+  ICM_20948_sim_reset_mag(sim);
+}
+
+void ICM_20948_sim_serif(ICM_20948_Sim_t *sim, ICM_20948_Serif_t *serif)
+{
+  serif->write = ICM_20948_sim_write;
+  serif->read = ICM_20948_sim_read;
+  serif->user = (void *)sim;
+  serif->write_async = NULL;
+  serif->read_async = NULL;
+}
+
+// The AK09916 side of an I2C master transaction
+static uint8_t ICM_20948_sim_mag_read(ICM_20948_Sim_t *sim, uint8_t reg)
+{
+  if (reg >= ICM_20948_SIM_MAG_REGS)
+  {
+    return 0;
+  }
+  uint8_t val = sim->mag_regs[reg];
+  if (reg == AK09916_REG_ST2)
+  {
+    sim->mag_regs[AK09916_REG_ST1] &= ~SIM_AK09916_ST1_DRDY; // Reading ST2 ends the measurement read
+  }
+  return val;
+}
+
+static void ICM_20948_sim_mag_write(ICM_20948_Sim_t *sim, uint8_t reg, uint8_t val)
+{
+  if ((reg == AK09916_REG_CNTL3) && (val & SIM_AK09916_CNTL3_SRST))
+  {
+    ICM_20948_sim_reset_mag(sim);
+    return;
+  }
+  if ((reg == AK09916_REG_CNTL2) || (reg == AK09916_REG_CNTL3))
+  {
+    sim->mag_regs[reg] = val;
+  }
+}
+
+static void ICM_20948_sim_periph4_txn(ICM_20948_Sim_t *sim)
+{
+  uint8_t addr = sim->regs[3][AGB3_REG_I2C_PERIPH4_ADDR];
+  uint8_t reg = sim->regs[3][AGB3_REG_I2C_PERIPH4_REG];
+  uint8_t status = sim->regs[0][AGB0_REG_I2C_MST_STATUS] | SIM_I2C_MST_STATUS_PERIPH4_DONE;
+
+  if ((addr & 0x7F) == MAG_AK09916_I2C_ADDR)
+  {
+    if (addr & SIM_PERIPH_ADDR_RNW)
+    {
+      sim->regs[3][AGB3_REG_I2C_PERIPH4_DI] = ICM_20948_sim_mag_read(sim, reg);
+    }
+    else
+    {
+      ICM_20948_sim_mag_write(sim, reg, sim->regs[3][AGB3_REG_I2C_PERIPH4_DO]);
+    }
+  }
+  else
+  {
+    status |= SIM_I2C_MST_STATUS_PERIPH4_NACK; // Nobody home
+  }
+
+  sim->regs[3][AGB3_REG_I2C_PERIPH4_CTRL] &= ~SIM_PERIPH_CTRL_EN; // EN clears when the transaction is done
+  sim->regs[0][AGB0_REG_I2C_MST_STATUS] = status;
+}
+
+void ICM_20948_sim_tick(ICM_20948_Sim_t *sim)
+{
+  if ((sim->regs[0][AGB0_REG_USER_CTRL] & SIM_USER_CTRL_I2C_MST_EN) == 0)
+  {
+    return;
+  }
+
+  uint8_t ext = AGB0_REG_EXT_PERIPH_SENS_DATA_00;
+  for (uint8_t periph = 0; periph < 4; periph++)
+  {
+    uint8_t base = AGB3_REG_I2C_PERIPH0_ADDR + (4 * periph); // ADDR, REG, CTRL, DO
+    uint8_t addr = sim->regs[3][base];
+    uint8_t reg = sim->regs[3][base + 1];
+    uint8_t ctrl = sim->regs[3][base + 2];
+    uint8_t len = ctrl & SIM_PERIPH_CTRL_LENG;
+
+    if ((ctrl & SIM_PERIPH_CTRL_EN) == 0)
+    {
+      continue;
+    }
+
+    if ((addr & 0x7F) != MAG_AK09916_I2C_ADDR)
+    {
+      sim->regs[0][AGB0_REG_I2C_MST_STATUS] |= (1 << periph); // PERIPHn_NACK
+      ext += (addr & SIM_PERIPH_ADDR_RNW) ? len : 0;             // The slot still owns its EXT_PERIPH_SENS_DATA bytes
+      continue;
+    }
+
+    if (addr & SIM_PERIPH_ADDR_RNW)
+    {
+      for (uint8_t i = 0; (i < len) && (ext <= AGB0_REG_EXT_PERIPH_SENS_DATA_23); i++)
+      {
+        sim->regs[0][ext++] = ICM_20948_sim_mag_read(sim, reg + i);
+      }
+    }
+    else
+    {
+      ICM_20948_sim_mag_write(sim, reg, sim->regs[3][base + 3]);
+    }
+  }
+}
+
+void ICM_20948_sim_set_agmt(ICM_20948_Sim_t *sim, const ICM_20948_AGMT_t *agmt)
+{
+  const int16_t be[7] = {agmt->acc.axes.x, agmt->acc.axes.y, agmt->acc.axes.z,
+                         agmt->gyr.axes.x, agmt->gyr.axes.y, agmt->gyr.axes.z,
+                         agmt->tmp.val};
+  for (uint8_t i = 0; i < 7; i++) // ICM-20948 data is big-endian
+  {
+    sim->regs[0][AGB0_REG_ACCEL_XOUT_H + (2 * i)] = (uint8_t)(((uint16_t)be[i]) >> 8);
+    sim->regs[0][AGB0_REG_ACCEL_XOUT_H + (2 * i) + 1] = (uint8_t)(((uint16_t)be[i]) & 0xFF);
+  }
+
+  const int16_t le[3] = {agmt->mag.axes.x, agmt->mag.axes.y, agmt->mag.axes.z};
+  for (uint8_t i = 0; i < 3; i++) // AK09916 data is little-endian
+  {
+    sim->mag_regs[AK09916_REG_HXL + (2 * i)] = (uint8_t)(((uint16_t)le[i]) & 0xFF);
+    sim->mag_regs[AK09916_REG_HXL + (2 * i) + 1] = (uint8_t)(((uint16_t)le[i]) >> 8);
+  }
+  sim->mag_regs[AK09916_REG_ST1] = agmt->magStat1 | SIM_AK09916_ST1_DRDY;
+  sim->mag_regs[AK09916_REG_ST2] = agmt->magStat2;
+}
+
+uint32_t ICM_20948_sim_fifo_push(ICM_20948_Sim_t *sim, const uint8_t *data, uint32_t len)
+{
+  bool snapshot = ((sim->regs[0][AGB0_REG_FIFO_MODE] & SIM_FIFO_MODE_SNAPSHOT) != 0);
+  uint32_t stored = 0;
+
+  for (uint32_t i = 0; i < len; i++)
+  {
+    if (sim->fifo_count == ICM_20948_SIM_FIFO_SIZE)
+    {
+      sim->fifo_overflows++;
+      if (snapshot)
+      {
+        continue; // Snapshot mode: new data is dropped
+      }
+      sim->fifo_read = (sim->fifo_read + 1) % ICM_20948_SIM_FIFO_SIZE; // Stream mode: the oldest byte is overwritten
+      sim->fifo_count--;
+    }
+    sim->fifo[(sim->fifo_read + sim->fifo_count) % ICM_20948_SIM_FIFO_SIZE] = data[i];
+    sim->fifo_count++;
+    stored++;
+  }
+
+  return stored;
+}
+
+static uint8_t ICM_20948_sim_mem_addr_next(ICM_20948_Sim_t *sim, uint16_t *addr)
+{
+  *addr = (((uint16_t)sim->regs[0][AGB0_REG_MEM_BANK_SEL]) << 8) | sim->regs[0][AGB0_REG_MEM_START_ADDR];
+  sim->regs[0][AGB0_REG_MEM_START_ADDR]++; // Auto-increment (within the memory bank)
+  return (*addr < ICM_20948_SIM_DMP_MEM_SIZE);
+}
+
+static uint8_t ICM_20948_sim_read_reg(ICM_20948_Sim_t *sim, uint8_t reg)
+{
+  uint8_t val;
+  uint16_t addr;
+
+  if (reg == REG_BANK_SEL)
+  {
+    return (uint8_t)(sim->bank << 4);
+  }
+  if (sim->bank == 0)
+  {
+    switch (reg)
+    {
+    case AGB0_REG_FIFO_COUNT_H:
+      return (uint8_t)((sim->fifo_count >> 8) & 0x1F);
+    case AGB0_REG_FIFO_COUNT_L:
+      return (uint8_t)(sim->fifo_count & 0xFF);
+    case AGB0_REG_FIFO_R_W:
+      if (sim->fifo_count == 0)
+      {
+        return 0xFF;
+      }
+      val = sim->fifo[sim->fifo_read];
+      sim->fifo_read = (sim->fifo_read + 1) % ICM_20948_SIM_FIFO_SIZE;
+      sim->fifo_count--;
+      return val;
+    case AGB0_REG_MEM_R_W:
+      return ICM_20948_sim_mem_addr_next(sim, &addr) ? sim->dmp_mem[addr] : 0;
+    case AGB0_REG_I2C_MST_STATUS:
+      val = sim->regs[0][reg];
+      sim->regs[0][reg] = 0; // Read to clear
+      return val;
+    default:
+      break;
+    }
+  }
+  return sim->regs[sim->bank][reg & 0x7F];
+}
+
+static void ICM_20948_sim_write_reg(ICM_20948_Sim_t *sim, uint8_t reg, uint8_t val)
+{
+  uint16_t addr;
+
+  if (reg == REG_BANK_SEL)
+  {
+    sim->bank = (val >> 4) & 0x03;
+    return;
+  }
+  if (sim->bank == 0)
+  {
+    switch (reg)
+    {
+    case AGB0_REG_WHO_AM_I:
+    case AGB0_REG_FIFO_COUNT_H:
+    case AGB0_REG_FIFO_COUNT_L:
+      return; // Read only
+    case AGB0_REG_PWR_MGMT_1:
+      if (val & SIM_PWR_MGMT_1_DEVICE_RESET)
+      {
+        ICM_20948_sim_reset_regs(sim);
+        return;
+      }
+      break;
+    case AGB0_REG_FIFO_RST:
+      if (val & 0x1F)
+      {
+        sim->fifo_read = 0;
+        sim->fifo_count = 0;
+      }
+      break;
+    case AGB0_REG_FIFO_R_W:
+      ICM_20948_sim_fifo_push(sim, &val, 1);
+      return;
+    case AGB0_REG_MEM_R_W:
+      if (ICM_20948_sim_mem_addr_next(sim, &addr))
+      {
+        sim->dmp_mem[addr] = val;
+      }
+      return;
+    default:
+      break;
+    }
+  }
+  sim->regs[sim->bank][reg & 0x7F] = val;
+  if ((sim->bank == 3) && (reg == AGB3_REG_I2C_PERIPH4_CTRL) && (val & SIM_PERIPH_CTRL_EN))
+  {
+    ICM_20948_sim_periph4_txn(sim); // The transaction completes instantly
+  }
+}
+
+ICM_20948_Status_e ICM_20948_sim_write(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user)
+{
+  ICM_20948_Sim_t *sim = (ICM_20948_Sim_t *)user;
+  if ((sim == NULL) || ((pdata == NULL) && (len > 0)))
+  {
+    return ICM_20948_Stat_ParamErr;
+  }
+
+  sim->writes++;
+  for (uint32_t i = 0; i < len; i++)
+  {
+    ICM_20948_sim_write_reg(sim, regaddr, pdata[i]);
+    if (!((sim->bank == 0) && ((regaddr == AGB0_REG_FIFO_R_W) || (regaddr == AGB0_REG_MEM_R_W))))
+    {
+      regaddr = (regaddr + 1) & 0x7F; // Bursts auto-increment, except on the FIFO and memory ports
+    }
+  }
+  return ICM_20948_Stat_Ok;
+}
+
+ICM_20948_Status_e ICM_20948_sim_read(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user)
+{
+  ICM_20948_Sim_t *sim = (ICM_20948_Sim_t *)user;
+  if ((sim == NULL) || (pdata == NULL))
+  {
+    return ICM_20948_Stat_ParamErr;
+  }
+
+  sim->reads++;
+  for (uint32_t i = 0; i < len; i++)
+  {
+    pdata[i] = ICM_20948_sim_read_reg(sim, regaddr);
+    if (!((sim->bank == 0) && ((regaddr == AGB0_REG_FIFO_R_W) || (regaddr == AGB0_REG_MEM_R_W))))
+    {
+      regaddr = (regaddr + 1) & 0x7F; // Bursts auto-increment, except on the FIFO and memory ports
+    }
+  }
+  return ICM_20948_Stat_Ok;
+}
@@ -0,0 +1,67 @@
+/*
+
+A register-level ICM-20948 simulator that plugs in as a serif
+
+It lets the C interface (ICM_20948_C.h) run without hardware, e.g. in a host build. It models:
+  - the four user banks and REG_BANK_SEL
+  - DMP memory through MEM_BANK_SEL / MEM_START_ADDR / MEM_R_W (with address auto-increment)
+  - FIFO_COUNTH/L, FIFO_R_W (reads pop the FIFO) and FIFO_RST
+  - the I2C master: PERIPH4 single transactions and the PERIPH0-3 slots, talking to a simulated AK09916
+  - PWR_MGMT_1 DEVICE_RESET and the read-to-clear I2C_MST_STATUS
+It does not run the DMP: use ICM_20948_sim_fifo_push to put DMP packets (or anything else) in the FIFO.
+
+All state lives in the ICM_20948_Sim_t, so nothing is allocated unless you create one.
+
+  ICM_20948_Sim_t sim; // About 21kB
+  ICM_20948_Serif_t serif;
+  ICM_20948_sim_init(&sim);
+  ICM_20948_sim_serif(&sim, &serif);
+  ICM_20948_link_serif(&dev, &serif);
+
+*/
+
+#ifndef _ICM_20948_SIM_H_
+#define _ICM_20948_SIM_H_
+
+#include "ICM_20948_C.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+
+#define ICM_20948_SIM_DMP_MEM_SIZE 0x4000 // Enough for the firmware image (DMP_LOAD_START + DMP_CODE_SIZE) and all of the DMP registers
+#define ICM_20948_SIM_FIFO_SIZE 4096
+#define ICM_20948_SIM_MAG_REGS 0x40
+
+  typedef struct
+  {
+    uint8_t bank;                                // The selected user bank
+    uint8_t regs[4][128];                        // The four user banks
+    uint8_t dmp_mem[ICM_20948_SIM_DMP_MEM_SIZE]; // DMP memory
+    uint8_t fifo[ICM_20948_SIM_FIFO_SIZE];       // FIFO ring buffer
+    uint16_t fifo_read;                          // Index of the oldest byte in the FIFO
+    uint16_t fifo_count;                         // Number of bytes in the FIFO
+    uint32_t fifo_overflows;                     // Number of bytes lost because the FIFO was full
+    uint8_t mag_regs[ICM_20948_SIM_MAG_REGS];    // The AK09916 register file
+    uint32_t reads;                              // Number of serif reads
+    uint32_t writes;                             // Number of serif writes
+  } ICM_20948_Sim_t;
+
+  void ICM_20948_sim_init(ICM_20948_Sim_t *sim);                           // Power-on reset of the ICM-20948 and the AK09916
+  void ICM_20948_sim_serif(ICM_20948_Sim_t *sim, ICM_20948_Serif_t *serif); // Fill in a serif that talks to this simulator
+
+  // Stimulus
+  void ICM_20948_sim_set_agmt(ICM_20948_Sim_t *sim, const ICM_20948_AGMT_t *agmt); // Load the accel, gyro and temperature registers and the AK09916 measurement (sets DRDY)
+  void ICM_20948_sim_tick(ICM_20948_Sim_t *sim);                                   // Run one I2C master cycle: service the enabled PERIPH0-3 slots into EXT_PERIPH_SENS_DATA
+  uint32_t ICM_20948_sim_fifo_push(ICM_20948_Sim_t *sim, const uint8_t *data, uint32_t len); // Add bytes to the FIFO. Returns the number stored. In stream mode old bytes are overwritten when full
+
+  // The serif functions themselves. user must point to an ICM_20948_Sim_t
+  ICM_20948_Status_e ICM_20948_sim_write(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user);
+  ICM_20948_Status_e ICM_20948_sim_read(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _ICM_20948_SIM_H_ */
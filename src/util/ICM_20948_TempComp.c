@@ -0,0 +1,227 @@
+#include "ICM_20948_TempComp.h"
+
+#define TEMPCOMP_BLOB_BIN_BYTES 16
+
+// num / den (den > 0), rounded half away from zero
+static int32_t ICM_20948_tempcomp_div(int64_t num, int64_t den)
+{
+  if (num >= 0)
+    return (int32_t)((num + (den / 2)) / den);
+  return (int32_t)(-((-num + (den / 2)) / den));
+}
+
+static void ICM_20948_tempcomp_restart(ICM_20948_TempComp_t *tc) // Start a new window
+{
+  tc->n = 0;
+  tc->tmp_sum = 0;
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    tc->gyr_sum[i] = 0;
+    tc->gyr_sq[i] = 0;
+    tc->acc_sum[i] = 0;
+    tc->acc_sq[i] = 0;
+  }
+}
+
+// n * (sum of squares) - sum^2 is n^2 times the variance
+static bool ICM_20948_tempcomp_still(int64_t sum, int64_t sq, uint16_t n, uint16_t limit)
+{
+  int64_t nn = (int64_t)n * n;
+  return (((n * sq) - (sum * sum)) <= (nn * limit * limit));
+}
+
+void ICM_20948_tempcomp_init(ICM_20948_TempComp_t *tc, uint16_t window)
+{
+  for (uint8_t b = 0; b < ICM_20948_TEMPCOMP_BINS; b++)
+  {
+    for (uint8_t i = 0; i < 3; i++)
+      tc->bin[b].bias[i] = 0;
+    tc->bin[b].tmp = 0;
+    tc->bin[b].weight = 0;
+  }
+  if (window < 2)
+    window = 2;
+  if (window > ICM_20948_TEMPCOMP_MAX_WINDOW)
+    window = ICM_20948_TEMPCOMP_MAX_WINDOW;
+  tc->window = window;
+  tc->gyr_still = ICM_20948_TEMPCOMP_GYR_STILL;
+  tc->acc_still = ICM_20948_TEMPCOMP_ACC_STILL;
+  tc->cached = false;
+  ICM_20948_tempcomp_restart(tc);
+}
+
+bool ICM_20948_tempcomp_update(ICM_20948_TempComp_t *tc, const ICM_20948_AGMT_t *agmt)
+{
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    int64_t g = (int64_t)agmt->gyr.raw.i16bit[i] * (1 << agmt->fss.g); // LSB at +/- 250dps
+    int64_t a = (int64_t)agmt->acc.raw.i16bit[i] * (1 << agmt->fss.a); // LSB at +/- 2g
+    tc->gyr_sum[i] += g;
+    tc->gyr_sq[i] += g * g;
+    tc->acc_sum[i] += a;
+    tc->acc_sq[i] += a * a;
+  }
+  tc->tmp_sum += ICM_20948_fixed_tmp_cdegc(agmt->tmp.val);
+  tc->n++;
+  if (tc->n < tc->window)
+    return false;
+
+  bool still = true;
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    still = still && ICM_20948_tempcomp_still(tc->gyr_sum[i], tc->gyr_sq[i], tc->n, tc->gyr_still);
+    still = still && ICM_20948_tempcomp_still(tc->acc_sum[i], tc->acc_sq[i], tc->n, tc->acc_still);
+  }
+  if (!still)
+  {
+    ICM_20948_tempcomp_restart(tc);
+    return false;
+  }
+
+  // Add the window to the bin of its mean temperature: a running mean of the last ICM_20948_TEMPCOMP_MAX_WEIGHT windows
+  int32_t tmp = ICM_20948_tempcomp_div(tc->tmp_sum, tc->n);
+  int32_t b = tmp - ICM_20948_TEMPCOMP_BIN_MIN_CDEGC + (ICM_20948_TEMPCOMP_BIN_CDEGC / 2);
+  b = (b < 0) ? 0 : (b / ICM_20948_TEMPCOMP_BIN_CDEGC);
+  if (b >= ICM_20948_TEMPCOMP_BINS)
+    b = ICM_20948_TEMPCOMP_BINS - 1;
+
+  ICM_20948_TempComp_Bin_t *bin = &tc->bin[b];
+  if (bin->weight < ICM_20948_TEMPCOMP_MAX_WEIGHT)
+    bin->weight++;
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    int32_t mean = ICM_20948_tempcomp_div(tc->gyr_sum[i] * 256, tc->n); // Q8
+    bin->bias[i] += ICM_20948_tempcomp_div((int64_t)mean - bin->bias[i], bin->weight);
+  }
+  bin->tmp = (int16_t)(bin->tmp + ICM_20948_tempcomp_div((int64_t)tmp - bin->tmp, bin->weight));
+
+  tc->cached = false;
+  ICM_20948_tempcomp_restart(tc);
+  return true;
+}
+
+bool ICM_20948_tempcomp_bias(const ICM_20948_TempComp_t *tc, int32_t tmp_cdegc, int32_t bias[3])
+{
+  // The nearest bins with data at or below the temperature, and above it
+  const ICM_20948_TempComp_Bin_t *lo = NULL;
+  const ICM_20948_TempComp_Bin_t *hi = NULL;
+  for (uint8_t b = 0; b < ICM_20948_TEMPCOMP_BINS; b++)
+  {
+    const ICM_20948_TempComp_Bin_t *bin = &tc->bin[b];
+    if (bin->weight == 0)
+      continue;
+    if (bin->tmp <= tmp_cdegc)
+    {
+      lo = bin;
+    }
+    else
+    {
+      hi = bin;
+      break;
+    }
+  }
+
+  if ((lo == NULL) && (hi == NULL))
+  {
+    for (uint8_t i = 0; i < 3; i++)
+      bias[i] = 0;
+    return false;
+  }
+  if ((lo == NULL) || (hi == NULL)) // Outside the bins with data: hold the end value
+  {
+    const ICM_20948_TempComp_Bin_t *end = (lo == NULL) ? hi : lo;
+    for (uint8_t i = 0; i < 3; i++)
+      bias[i] = end->bias[i];
+    return true;
+  }
+
+  int64_t span = (int64_t)hi->tmp - lo->tmp; // > 0: the bin means are in order
+  int64_t t = (int64_t)tmp_cdegc - lo->tmp;
+  for (uint8_t i = 0; i < 3; i++)
+    bias[i] = lo->bias[i] + ICM_20948_tempcomp_div(((int64_t)hi->bias[i] - lo->bias[i]) * t, span);
+  return true;
+}
+
+void ICM_20948_tempcomp_apply(ICM_20948_TempComp_t *tc, ICM_20948_AGMT_t *agmt)
+{
+  // The temperature changes slowly: only interpolate again when it has moved by 0.1 degC
+  int16_t tmp = (int16_t)(ICM_20948_fixed_tmp_cdegc(agmt->tmp.val) / 10);
+  if ((!tc->cached) || (tmp != tc->cache_tmp))
+  {
+    ICM_20948_tempcomp_bias(tc, (int32_t)tmp * 10, tc->cache_bias);
+    tc->cache_tmp = tmp;
+    tc->cached = true;
+  }
+
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    int32_t g = (int32_t)agmt->gyr.raw.i16bit[i] - ICM_20948_fixed_round(tc->cache_bias[i], 8 + agmt->fss.g);
+    if (g > 32767)
+      g = 32767;
+    if (g < -32768)
+      g = -32768;
+    agmt->gyr.raw.i16bit[i] = (int16_t)g;
+  }
+}
+
+void ICM_20948_tempcomp_to_dmp(const int32_t bias[3], int32_t dmp[3])
+{
+  // One LSB at +/- 2000dps is 8 at +/- 250dps: Q8 / 8 * 2^15
+  for (uint8_t i = 0; i < 3; i++)
+    dmp[i] = bias[i] * 16;
+}
+
+static void ICM_20948_tempcomp_put(uint8_t *b, uint32_t v, uint8_t bytes) // Big-endian
+{
+  for (uint8_t i = 0; i < bytes; i++)
+    b[i] = (uint8_t)((v >> (8 * (bytes - 1 - i))) & 0xff);
+}
+
+static uint32_t ICM_20948_tempcomp_get(const uint8_t *b, uint8_t bytes)
+{
+  uint32_t v = 0;
+  for (uint8_t i = 0; i < bytes; i++)
+    v = (v << 8) | b[i];
+  return v;
+}
+
+void ICM_20948_tempcomp_save(const ICM_20948_TempComp_t *tc, uint8_t *blob)
+{
+  blob[0] = ICM_20948_TEMPCOMP_BLOB_VERSION;
+  blob[1] = ICM_20948_TEMPCOMP_BINS;
+  for (uint8_t b = 0; b < ICM_20948_TEMPCOMP_BINS; b++)
+  {
+    const ICM_20948_TempComp_Bin_t *bin = &tc->bin[b];
+    uint8_t *p = &blob[2 + (b * TEMPCOMP_BLOB_BIN_BYTES)];
+    ICM_20948_tempcomp_put(&p[0], (uint16_t)bin->tmp, 2);
+    ICM_20948_tempcomp_put(&p[2], bin->weight, 2);
+    for (uint8_t i = 0; i < 3; i++)
+      ICM_20948_tempcomp_put(&p[4 + (i * 4)], (uint32_t)bin->bias[i], 4);
+  }
+
+  uint16_t checksum = ICM_20948_fletcher16(blob, ICM_20948_TEMPCOMP_BLOB_BYTES - 2);
+  ICM_20948_tempcomp_put(&blob[ICM_20948_TEMPCOMP_BLOB_BYTES - 2], checksum, 2);
+}
+
+ICM_20948_Status_e ICM_20948_tempcomp_load(ICM_20948_TempComp_t *tc, const uint8_t *blob)
+{
+  if ((blob[0] != ICM_20948_TEMPCOMP_BLOB_VERSION) || (blob[1] != ICM_20948_TEMPCOMP_BINS))
+    return ICM_20948_Stat_ParamErr;
+
+  if (ICM_20948_tempcomp_get(&blob[ICM_20948_TEMPCOMP_BLOB_BYTES - 2], 2) != ICM_20948_fletcher16(blob, ICM_20948_TEMPCOMP_BLOB_BYTES - 2))
+    return ICM_20948_Stat_ParamErr;
+
+  for (uint8_t b = 0; b < ICM_20948_TEMPCOMP_BINS; b++)
+  {
+    ICM_20948_TempComp_Bin_t *bin = &tc->bin[b];
+    const uint8_t *p = &blob[2 + (b * TEMPCOMP_BLOB_BIN_BYTES)];
+    bin->tmp = (int16_t)ICM_20948_tempcomp_get(&p[0], 2);
+    bin->weight = (uint16_t)ICM_20948_tempcomp_get(&p[2], 2);
+    if (bin->weight > ICM_20948_TEMPCOMP_MAX_WEIGHT)
+      bin->weight = ICM_20948_TEMPCOMP_MAX_WEIGHT;
+    for (uint8_t i = 0; i < 3; i++)
+      bin->bias[i] = (int32_t)ICM_20948_tempcomp_get(&p[4 + (i * 4)], 4);
+  }
+  tc->cached = false;
+  return ICM_20948_Stat_Ok;
+}
@@ -0,0 +1,87 @@
+/*
+
+Gyro bias temperature compensation
+
+The gyro bias changes with the die temperature, most of all while the board warms up after power-on. The temperature
+is read with every sample (agmt.tmp), so ICM_20948_TempComp_t learns the bias against it: the samples are collected
+in windows, and when the gyro and accelerometer were both still for a whole window its mean gyro reading is the bias
+at the window's mean temperature. The windows are averaged into temperature bins, and the bias at any temperature is
+interpolated between the bins that have data (held at the value of the end bins outside them).
+
+  ICM_20948_TempComp_t tc;
+  ICM_20948_tempcomp_init(&tc, 100);         // Windows of 100 samples: one second at 100Hz
+  ICM_20948_tempcomp_load(&tc, savedBlob);   // Optional: a model saved earlier with ICM_20948_tempcomp_save
+  ...
+  myICM.getAGMT();
+  ICM_20948_tempcomp_update(&tc, &myICM.agmt); // Learn, from the uncorrected reading
+  ICM_20948_tempcomp_apply(&tc, &myICM.agmt);  // Then subtract the bias from agmt.gyr
+  ...
+  myICM.setDMPGyroBias(&tc);                   // Or give the DMP the bias at the current temperature (GYRO_BIAS_X..Z)
+
+The bias is held in gyro LSB at +/- 250dps (131 LSB per dps) in Q8, whatever the full scale of the samples.
+A window is still when the standard deviation of each gyro and accelerometer axis is below gyr_still and acc_still.
+Turning slowly at a constant rate looks still to the gyro, and to the accelerometer when the turn is about the
+vertical, so the model should only be left to learn when the sensor is known to be at rest most of the time.
+
+*/
+
+#ifndef _ICM_20948_TEMPCOMP_H_
+#define _ICM_20948_TEMPCOMP_H_
+
+#include "ICM_20948_C.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+
+#define ICM_20948_TEMPCOMP_BINS 16
+#define ICM_20948_TEMPCOMP_BIN_MIN_CDEGC -1000 // The centre of the first bin. The last is at 65 degC
+#define ICM_20948_TEMPCOMP_BIN_CDEGC 500       // The width of each bin
+#define ICM_20948_TEMPCOMP_MAX_WEIGHT 32       // Windows averaged per bin before older ones start to be forgotten
+#define ICM_20948_TEMPCOMP_MAX_WINDOW 4096     // Samples. Keeps the window sums within 64 bits
+#define ICM_20948_TEMPCOMP_GYR_STILL 131       // LSB at +/- 250dps (1dps)
+#define ICM_20948_TEMPCOMP_ACC_STILL 820       // LSB at +/- 2g (0.05g)
+
+  typedef struct
+  {
+    int32_t bias[3]; // Q8 LSB at +/- 250dps
+    int16_t tmp;     // centi-degC: the mean temperature of the windows in the bin
+    uint16_t weight; // The number of windows averaged (0 = no data)
+  } ICM_20948_TempComp_Bin_t;
+
+  typedef struct
+  {
+    ICM_20948_TempComp_Bin_t bin[ICM_20948_TEMPCOMP_BINS]; // The model
+    uint16_t window;                                       // Samples per window
+    uint16_t gyr_still;                                    // Standard deviation thresholds (see above)
+    uint16_t acc_still;
+    uint16_t n; // The window being collected
+    int32_t tmp_sum;
+    int64_t gyr_sum[3];
+    int64_t gyr_sq[3];
+    int64_t acc_sum[3];
+    int64_t acc_sq[3];
+    bool cached; // The bias last used by ICM_20948_tempcomp_apply
+    int16_t cache_tmp; // deci-degC
+    int32_t cache_bias[3];
+  } ICM_20948_TempComp_t;
+
+  void ICM_20948_tempcomp_init(ICM_20948_TempComp_t *tc, uint16_t window);                    // Clear the model. window is limited to ICM_20948_TEMPCOMP_MAX_WINDOW
+  bool ICM_20948_tempcomp_update(ICM_20948_TempComp_t *tc, const ICM_20948_AGMT_t *agmt);    // true when a still window has been added to the model
+  bool ICM_20948_tempcomp_bias(const ICM_20948_TempComp_t *tc, int32_t tmp_cdegc, int32_t bias[3]); // The bias at a temperature. false (and zero) if the model has no data
+  void ICM_20948_tempcomp_apply(ICM_20948_TempComp_t *tc, ICM_20948_AGMT_t *agmt);           // Correct agmt.gyr in place, at agmt.tmp (to 0.1 degC)
+  void ICM_20948_tempcomp_to_dmp(const int32_t bias[3], int32_t dmp[3]);                     // GYRO_BIAS_X..Z units: LSB at +/- 2000dps, Q15
+
+  // Save and restore the model. The blob is a version byte, a count byte (ICM_20948_TEMPCOMP_BINS), then for each bin the
+  // temperature (int16), weight (uint16) and bias (3 x int32), all big-endian, and a Fletcher-16 checksum
+#define ICM_20948_TEMPCOMP_BLOB_VERSION 1
+#define ICM_20948_TEMPCOMP_BLOB_BYTES (2 + (ICM_20948_TEMPCOMP_BINS * 16) + 2)
+  void ICM_20948_tempcomp_save(const ICM_20948_TempComp_t *tc, uint8_t *blob);               // blob is ICM_20948_TEMPCOMP_BLOB_BYTES
+  ICM_20948_Status_e ICM_20948_tempcomp_load(ICM_20948_TempComp_t *tc, const uint8_t *blob); // ICM_20948_Stat_ParamErr (and the model is unchanged) if the blob is not valid
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _ICM_20948_TEMPCOMP_H_ */
@@ -0,0 +1,170 @@
+#include "ICM_20948_Time.h"
+
+// How much of a late read moves the offset (as a shift)
+#define TIME_OFFSET_SHIFT 5
+
+uint32_t ICM_20948_time_gyro_period_ns(uint8_t gyro_smplrt_div, int8_t pll)
+{
+  // The same correction inv_icm20948_set_gyro_sf applies to GYRO_SF (which is proportional to the sample period)
+  uint8_t raw = (uint8_t)pll;
+  int32_t correction = (raw & 0x80) ? -(int32_t)(raw & 0x7F) : (int32_t)raw;
+  uint64_t num = 1000000000ULL * (1 + (uint64_t)gyro_smplrt_div) * ICM_20948_TIME_PLL_SCALE;
+  uint64_t den = (uint64_t)ICM_20948_TIME_BASE_RATE_HZ * (uint64_t)(ICM_20948_TIME_PLL_SCALE + correction);
+  return (uint32_t)((num + (den / 2)) / den);
+}
+
+void ICM_20948_timeline_init(ICM_20948_Timeline_t *tl, uint32_t tick_ns, uint32_t ticks_per_frame, ICM_20948_Timeline_Footer_e footer)
+{
+  tl->tick_ns = tick_ns;
+  tl->ticks_per_frame = (ticks_per_frame == 0) ? 1 : ticks_per_frame;
+  tl->footer = footer;
+  tl->started = false;
+  tl->last_footer = 0;
+  tl->sensor_ns = 0;
+  tl->synced = false;
+  tl->last_host_us = 0;
+  tl->host_ns = 0;
+  tl->ref_ns = 0;
+  tl->offset_ns = 0;
+  tl->skew_ppb = 0;
+  tl->last_out_ns = 0;
+  tl->syncs = 0;
+  tl->win_start_ns = 0;
+  tl->win_min_ns = 0;
+  tl->win_min_diff = 0;
+  tl->have_anchor = false;
+  tl->anchor_ns = 0;
+  tl->anchor_diff = 0;
+  tl->have_next = false;
+  tl->next_ns = 0;
+  tl->next_diff = 0;
+}
+
+void ICM_20948_timeline_restart(ICM_20948_Timeline_t *tl)
+{
+  tl->started = false;     // The footer count starts again
+  tl->synced = false;      // Re-seed the offset at the next sync. The skew is kept
+  tl->have_anchor = false; // The sensor timeline has a gap, so start measuring the skew again
+  tl->have_next = false;
+}
+
+uint64_t ICM_20948_timeline_frame(ICM_20948_Timeline_t *tl, const icm_20948_DMP_data_t *data)
+{
+  uint32_t ticks = tl->ticks_per_frame;
+
+  if (tl->footer == ICM_20948_Timeline_Footer_Delta)
+  {
+    ticks = data->Footer;
+  }
+  else if (tl->footer == ICM_20948_Timeline_Footer_Counter)
+  {
+    if (tl->started)
+    {
+      ticks = (uint16_t)(data->Footer - tl->last_footer); // Wraps
+    }
+    tl->last_footer = data->Footer;
+  }
+
+  if (tl->started)
+  {
+    tl->sensor_ns += (uint64_t)ticks * tl->tick_ns;
+  }
+  tl->started = true;
+  return tl->sensor_ns;
+}
+
+static int64_t ICM_20948_timeline_skew_ns(const ICM_20948_Timeline_t *tl, uint64_t sensor_ns)
+{
+  int64_t dt_us = ((int64_t)(sensor_ns - tl->ref_ns)) / 1000; // Signed: frames read before the last sync are older than ref_ns
+  return (dt_us * tl->skew_ppb) / 1000000;
+}
+
+void ICM_20948_timeline_sync(ICM_20948_Timeline_t *tl, uint32_t host_us)
+{
+  if (tl->syncs == 0)
+  {
+    tl->host_ns = ((uint64_t)host_us) * 1000;
+  }
+  else
+  {
+    tl->host_ns += ((uint64_t)(uint32_t)(host_us - tl->last_host_us)) * 1000;
+  }
+  tl->last_host_us = host_us;
+  tl->syncs++;
+
+  int64_t diff = (int64_t)(tl->host_ns - tl->sensor_ns);
+
+  if (!tl->synced)
+  {
+    tl->offset_ns = diff;
+    tl->ref_ns = tl->sensor_ns;
+    tl->synced = true;
+    tl->win_start_ns = tl->sensor_ns;
+    tl->win_min_ns = tl->sensor_ns;
+    tl->win_min_diff = diff;
+    return;
+  }
+
+  // Move the reference up to the newest frame, folding the skew so far into the offset
+  tl->offset_ns += ICM_20948_timeline_skew_ns(tl, tl->sensor_ns);
+  tl->ref_ns = tl->sensor_ns;
+
+  int64_t err = diff - tl->offset_ns;                          // How much later the frame was read than the model expects
+  int64_t step = (err < 0) ? err : (err >> TIME_OFFSET_SHIFT); // The frame cannot have been sampled after it was read: follow early reads at once, late ones (mostly latency) slowly
+  tl->offset_ns += step;
+
+  // The earliest read in each window has the least latency. The slope from the anchor to it is the skew
+  if (diff < tl->win_min_diff)
+  {
+    tl->win_min_diff = diff;
+    tl->win_min_ns = tl->sensor_ns;
+  }
+  if ((tl->sensor_ns - tl->win_start_ns) >= ICM_20948_TIME_SKEW_WINDOW_NS)
+  {
+    if (!tl->have_anchor)
+    {
+      tl->anchor_ns = tl->win_min_ns;
+      tl->anchor_diff = tl->win_min_diff;
+      tl->have_anchor = true;
+    }
+    else
+    {
+      uint64_t baseline = tl->win_min_ns - tl->anchor_ns;
+      int64_t skew = ((tl->win_min_diff - tl->anchor_diff) * 1000000) / ((int64_t)(baseline / 1000) + 1); // ppb
+      if (skew > ICM_20948_TIME_MAX_SKEW_PPB)
+        skew = ICM_20948_TIME_MAX_SKEW_PPB;
+      if (skew < -ICM_20948_TIME_MAX_SKEW_PPB)
+        skew = -ICM_20948_TIME_MAX_SKEW_PPB;
+      tl->skew_ppb = (int32_t)skew;
+
+      if ((!tl->have_next) && (baseline >= (ICM_20948_TIME_SKEW_BASELINE_NS / 2)))
+      {
+        tl->next_ns = tl->win_min_ns;
+        tl->next_diff = tl->win_min_diff;
+        tl->have_next = true;
+      }
+      else if (tl->have_next && (baseline >= ICM_20948_TIME_SKEW_BASELINE_NS))
+      {
+        tl->anchor_ns = tl->next_ns; // Move on, keeping at least half the baseline
+        tl->anchor_diff = tl->next_diff;
+        tl->next_ns = tl->win_min_ns;
+        tl->next_diff = tl->win_min_diff;
+      }
+    }
+    tl->win_start_ns = tl->sensor_ns;
+    tl->win_min_ns = tl->sensor_ns;
+    tl->win_min_diff = diff;
+  }
+}
+
+uint64_t ICM_20948_timeline_host_ns(ICM_20948_Timeline_t *tl, uint64_t sensor_ns)
+{
+  int64_t host = (int64_t)sensor_ns + tl->offset_ns + ICM_20948_timeline_skew_ns(tl, sensor_ns);
+  uint64_t out = (host < 0) ? 0 : (uint64_t)host;
+  if ((tl->last_out_ns != 0) && (out <= tl->last_out_ns))
+  {
+    out = tl->last_out_ns + 1;
+  }
+  tl->last_out_ns = out;
+  return out;
+}
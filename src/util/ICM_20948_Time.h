@@ -0,0 +1,100 @@
+/*
+
+Frame timestamps for DMP data
+
+The DMP packets carry no time, so ICM_20948_Timeline_t rebuilds it. Each frame is placed on a sensor timeline
+that advances by the gyro sample period, corrected by TIMEBASE_CORRECTION_PLL in the same way
+inv_icm20948_set_gyro_sf corrects GYRO_SF. How far it advances comes from the packet footer (the gyro count)
+or, without that, from the ODR interval.
+
+The sensor timeline is then mapped to host time by a clock model. At each drain (or interrupt) tell it the host
+time at which the newest frame was read. The model tracks the offset and the drift (skew) between the two clocks,
+so the frames of a long batch are spread out correctly instead of being bunched at the time they were read.
+
+  ICM_20948_Timeline_t tl;
+  ICM_20948_timeline_init(&tl, ICM_20948_time_gyro_period_ns(19, pll), 1, ICM_20948_Timeline_Footer_Delta);
+  ...
+  while (inv_icm20948_read_dmp_data(&dev, &data) ...) // Decode the whole batch
+  {
+    frame_ns[n++] = ICM_20948_timeline_frame(&tl, &data);
+  }
+  ICM_20948_timeline_sync(&tl, micros()); // The newest frame was read just now
+  for (i = 0; i < n; i++)
+    host_ns = ICM_20948_timeline_host_ns(&tl, frame_ns[i]);
+
+A frame cannot have been sampled after it was read, so the host time passed to ICM_20948_timeline_sync is an
+upper bound. The model follows the earliest reads closely and the late ones (bus or scheduling delays) only
+slowly, so host timestamps lag true time by the shortest read latency plus a little: a read that is later than
+the model expects moves it 1/32 of the way, and one that is earlier moves it all the way back.
+
+*/
+
+#ifndef _ICM_20948_TIME_H_
+#define _ICM_20948_TIME_H_
+
+#include "ICM_20948_C.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+
+#define ICM_20948_TIME_BASE_RATE_HZ 1125 // The gyro and accel sample rate with a divider of 0
+#define ICM_20948_TIME_PLL_SCALE 1270    // TIMEBASE_CORRECTION_PLL adjusts the sample clock by (1270 + pll) / 1270
+#define ICM_20948_TIME_MAX_SKEW_PPB 50000000 // The clock model never assumes more than 5% drift
+#define ICM_20948_TIME_SKEW_WINDOW_NS 4000000000ULL     // Sensor time over which the earliest read is found
+#define ICM_20948_TIME_SKEW_BASELINE_NS 256000000000ULL // The longest baseline the skew is measured over. Shorter tracks temperature changes faster, longer averages out more jitter
+
+  typedef enum
+  {
+    ICM_20948_Timeline_Footer_None = 0, // Ignore the footer: every frame is ticks_per_frame samples after the last
+    ICM_20948_Timeline_Footer_Delta,    // The footer counts the gyro samples since the previous packet. 0 means the same sample
+    ICM_20948_Timeline_Footer_Counter,  // The footer is a free-running 16-bit gyro sample counter
+  } ICM_20948_Timeline_Footer_e;
+
+  typedef struct
+  {
+    // Sensor timeline
+    uint32_t tick_ns;         // The corrected gyro sample period
+    uint32_t ticks_per_frame; // Samples between frames when the footer is not used: the ODR interval + 1 (up to 65536)
+    ICM_20948_Timeline_Footer_e footer;
+    bool started;
+    uint16_t last_footer;
+    uint64_t sensor_ns; // Sensor time of the newest frame
+
+    // Host clock model: host_ns = sensor_ns + offset_ns + skew_ppb * (sensor_ns - ref_ns) / 1e9
+    bool synced;
+    uint32_t last_host_us;
+    uint64_t host_ns; // host_us extended past its 32-bit wrap
+    uint64_t ref_ns;
+    int64_t offset_ns;
+    int32_t skew_ppb;
+    uint64_t last_out_ns; // Keeps ICM_20948_timeline_host_ns monotonic
+    uint32_t syncs;
+
+    // Skew: the slope from an anchor to the earliest read (least latency) of each window of ICM_20948_TIME_SKEW_WINDOW_NS.
+    // The anchor is itself a window's earliest read, moved on so the baseline stays between half and all of ICM_20948_TIME_SKEW_BASELINE_NS
+    uint64_t win_start_ns;
+    uint64_t win_min_ns;  // Sensor time of the window's earliest read
+    int64_t win_min_diff; // host - sensor at that read
+    bool have_anchor;
+    uint64_t anchor_ns;
+    int64_t anchor_diff;
+    bool have_next;
+    uint64_t next_ns; // The next anchor
+    int64_t next_diff;
+  } ICM_20948_Timeline_t;
+
+  uint32_t ICM_20948_time_gyro_period_ns(uint8_t gyro_smplrt_div, int8_t pll); // The true gyro sample period. pll is the TIMEBASE_CORRECTION_PLL byte (ICM_20948_Device_t::_gyroSFpll, which only inv_icm20948_set_gyro_sf sets)
+
+  void ICM_20948_timeline_init(ICM_20948_Timeline_t *tl, uint32_t tick_ns, uint32_t ticks_per_frame, ICM_20948_Timeline_Footer_e footer);
+  void ICM_20948_timeline_restart(ICM_20948_Timeline_t *tl);                                 // Call after the FIFO is reset or overflows: samples were lost, so the next sync realigns the host time
+  uint64_t ICM_20948_timeline_frame(ICM_20948_Timeline_t *tl, const icm_20948_DMP_data_t *data); // Place the next decoded frame on the sensor timeline. Returns its sensor time in ns
+  void ICM_20948_timeline_sync(ICM_20948_Timeline_t *tl, uint32_t host_us);                   // The newest frame was read at host_us (e.g. micros(). It may wrap)
+  uint64_t ICM_20948_timeline_host_ns(ICM_20948_Timeline_t *tl, uint64_t sensor_ns);          // Host time of a frame. Call in frame order: the result never goes backwards
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _ICM_20948_TIME_H_ */
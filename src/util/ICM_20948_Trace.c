@@ -0,0 +1,371 @@
+#include "ICM_20948_Trace.h"
+
+#include <string.h>
+
+#if defined(__linux__) && !defined(ARDUINO)
+#include <stdio.h>
+#include <stdlib.h>
+#endif
+
+static const uint8_t ICM_20948_trace_header[ICM_20948_TRACE_HEADER_SIZE] = {'I', 'C', 'M', 'T', ICM_20948_TRACE_VERSION, 0, 0, 0};
+
+static uint32_t ICM_20948_trace_put_varint(uint8_t *buff, uint32_t val)
+{
+  uint32_t n = 0;
+  while (val >= 0x80)
+  {
+    buff[n++] = (uint8_t)(val | 0x80);
+    val >>= 7;
+  }
+  buff[n++] = (uint8_t)val;
+  return n;
+}
+
+static ICM_20948_Status_e ICM_20948_trace_get_varint(const uint8_t *trace, uint32_t len, uint32_t *pos, uint32_t *val)
+{
+  uint32_t result = 0;
+  for (uint8_t shift = 0; shift < 35; shift += 7)
+  {
+    if (*pos >= len)
+    {
+      return ICM_20948_Stat_Err; // Truncated
+    }
+    uint8_t b = trace[(*pos)++];
+    if ((shift == 28) && (b & 0xF0))
+    {
+      return ICM_20948_Stat_Err; // The fifth byte holds bits 28-31 only: more than 32 bits, or a sixth byte
+    }
+    result |= ((uint32_t)(b & 0x7F)) << shift;
+    if ((b & 0x80) == 0)
+    {
+      *val = result;
+      return ICM_20948_Stat_Ok;
+    }
+  }
+  return ICM_20948_Stat_Err; // Not reached
+}
+
+static void ICM_20948_trace_emit(ICM_20948_Trace_Recorder_t *rec, const uint8_t *data, uint32_t len)
+{
+  if (len == 0)
+  {
+    return;
+  }
+  if ((rec->sink == NULL) || ((*rec->sink)(data, len, rec->sink_user) != ICM_20948_Stat_Ok))
+  {
+    rec->sink_errors++;
+    return;
+  }
+  rec->bytes += len;
+}
+
+static void ICM_20948_trace_log(ICM_20948_Trace_Recorder_t *rec, bool write, uint8_t regaddr, const uint8_t *pdata, uint32_t len, ICM_20948_Status_e status)
+{
+  uint8_t head[2 + 5 + 5 + 1]; // op, regaddr, two varints and the status
+  uint32_t n = 0;
+  uint32_t now = (rec->clock_us != NULL) ? rec->clock_us() : 0;
+
+  head[n++] = (write ? ICM_20948_TRACE_OP_WRITE : 0) | ((status != ICM_20948_Stat_Ok) ? ICM_20948_TRACE_OP_STATUS : 0) | ((pdata == NULL) ? ICM_20948_TRACE_OP_NODATA : 0);
+  head[n++] = regaddr;
+  n += ICM_20948_trace_put_varint(&head[n], now - rec->last_time);
+  n += ICM_20948_trace_put_varint(&head[n], len); // The length of the call, even with no data
+  if (status != ICM_20948_Stat_Ok)
+  {
+    head[n++] = (uint8_t)status;
+  }
+
+  ICM_20948_trace_emit(rec, head, n);
+  if (pdata != NULL)
+  {
+    ICM_20948_trace_emit(rec, pdata, len);
+  }
+  rec->last_time = now;
+  rec->records++;
+}
+
+ICM_20948_Status_e ICM_20948_trace_record_start(ICM_20948_Trace_Recorder_t *rec, const ICM_20948_Serif_t *inner, ICM_20948_Trace_Sink_t sink, void *sink_user, uint32_t (*clock_us)(void))
+{
+  if ((rec == NULL) || (inner == NULL) || (sink == NULL))
+  {
+    return ICM_20948_Stat_ParamErr;
+  }
+
+  rec->inner = inner;
+  rec->sink = sink;
+  rec->sink_user = sink_user;
+  rec->clock_us = clock_us;
+  rec->last_time = 0;
+  rec->records = 0;
+  rec->bytes = 0;
+  rec->sink_errors = 0;
+
+  ICM_20948_trace_emit(rec, ICM_20948_trace_header, ICM_20948_TRACE_HEADER_SIZE);
+  return (rec->sink_errors == 0) ? ICM_20948_Stat_Ok : ICM_20948_Stat_Err;
+}
+
+void ICM_20948_trace_record_serif(ICM_20948_Trace_Recorder_t *rec, ICM_20948_Serif_t *serif)
+{
+  serif->write = ICM_20948_trace_record_write;
+  serif->read = ICM_20948_trace_record_read;
+  serif->user = (void *)rec;
+  serif->write_async = NULL; // Records are written in bus order, so the recorder is synchronous
+  serif->read_async = NULL;
+}
+
+ICM_20948_Status_e ICM_20948_trace_record_write(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user)
+{
+  ICM_20948_Trace_Recorder_t *rec = (ICM_20948_Trace_Recorder_t *)user;
+  if ((rec == NULL) || (rec->inner->write == NULL))
+  {
+    return ICM_20948_Stat_NotImpl;
+  }
+
+  ICM_20948_Status_e retval = (*rec->inner->write)(regaddr, pdata, len, rec->inner->user);
+  ICM_20948_trace_log(rec, true, regaddr, pdata, len, retval);
+  return retval;
+}
+
+ICM_20948_Status_e ICM_20948_trace_record_read(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user)
+{
+  ICM_20948_Trace_Recorder_t *rec = (ICM_20948_Trace_Recorder_t *)user;
+  if ((rec == NULL) || (rec->inner->read == NULL))
+  {
+    return ICM_20948_Stat_NotImpl;
+  }
+
+  ICM_20948_Status_e retval = (*rec->inner->read)(regaddr, pdata, len, rec->inner->user);
+  ICM_20948_trace_log(rec, false, regaddr, pdata, len, retval);
+  return retval;
+}
+
+ICM_20948_Status_e ICM_20948_trace_check_header(const uint8_t *trace, uint32_t len)
+{
+  if ((trace == NULL) || (len < ICM_20948_TRACE_HEADER_SIZE) || (memcmp(trace, ICM_20948_trace_header, 4) != 0) || (trace[4] != ICM_20948_TRACE_VERSION))
+  {
+    return ICM_20948_Stat_Err;
+  }
+  return ICM_20948_Stat_Ok;
+}
+
+ICM_20948_Status_e ICM_20948_trace_next(const uint8_t *trace, uint32_t len, uint32_t *pos, ICM_20948_Trace_Record_t *record)
+{
+  uint32_t p = *pos;
+  uint32_t delta;
+  uint32_t dlen;
+
+  if (p >= len)
+  {
+    return ICM_20948_Stat_NoData;
+  }
+  if ((len - p) < 2)
+  {
+    return ICM_20948_Stat_Err;
+  }
+
+  uint8_t op = trace[p++];
+  uint8_t regaddr = trace[p++];
+  if ((ICM_20948_trace_get_varint(trace, len, &p, &delta) != ICM_20948_Stat_Ok) || (ICM_20948_trace_get_varint(trace, len, &p, &dlen) != ICM_20948_Stat_Ok))
+  {
+    return ICM_20948_Stat_Err;
+  }
+
+  ICM_20948_Status_e status = ICM_20948_Stat_Ok;
+  if (op & ICM_20948_TRACE_OP_STATUS)
+  {
+    if (p >= len)
+    {
+      return ICM_20948_Stat_Err;
+    }
+    status = (ICM_20948_Status_e)trace[p++];
+  }
+  bool nodata = ((op & ICM_20948_TRACE_OP_NODATA) != 0);
+  if ((!nodata) && (dlen > (len - p)))
+  {
+    return ICM_20948_Stat_Err; // The data runs off the end: a truncated trace
+  }
+
+  record->timestamp += delta;
+  record->write = ((op & ICM_20948_TRACE_OP_WRITE) != 0);
+  record->regaddr = regaddr;
+  record->status = status;
+  record->len = dlen;
+  record->data = nodata ? NULL : &trace[p];
+  *pos = nodata ? p : (p + dlen);
+  return ICM_20948_Stat_Ok;
+}
+
+ICM_20948_Status_e ICM_20948_trace_replay_init(ICM_20948_Trace_Replay_t *rep, const uint8_t *trace, uint32_t len, uint8_t flags)
+{
+  if (rep == NULL)
+  {
+    return ICM_20948_Stat_ParamErr;
+  }
+  ICM_20948_Status_e retval = ICM_20948_trace_check_header(trace, len);
+  if (retval != ICM_20948_Stat_Ok)
+  {
+    return retval;
+  }
+
+  rep->trace = trace;
+  rep->len = len;
+  rep->flags = flags;
+  ICM_20948_trace_replay_rewind(rep);
+  return ICM_20948_Stat_Ok;
+}
+
+void ICM_20948_trace_replay_rewind(ICM_20948_Trace_Replay_t *rep)
+{
+  rep->pos = ICM_20948_TRACE_HEADER_SIZE;
+  rep->timestamp = 0;
+  rep->records = 0;
+  rep->mismatches = 0;
+}
+
+void ICM_20948_trace_replay_serif(ICM_20948_Trace_Replay_t *rep, ICM_20948_Serif_t *serif)
+{
+  serif->write = ICM_20948_trace_replay_write;
+  serif->read = ICM_20948_trace_replay_read;
+  serif->user = (void *)rep;
+  serif->write_async = NULL;
+  serif->read_async = NULL;
+}
+
+ICM_20948_Status_e ICM_20948_trace_replay_write(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user)
+{
+  ICM_20948_Trace_Replay_t *rep = (ICM_20948_Trace_Replay_t *)user;
+  ICM_20948_Trace_Record_t record;
+  uint32_t pos;
+
+  if (rep == NULL)
+  {
+    return ICM_20948_Stat_ParamErr;
+  }
+
+  pos = rep->pos;
+  record.timestamp = rep->timestamp;
+  ICM_20948_Status_e retval = ICM_20948_trace_next(rep->trace, rep->len, &pos, &record);
+  if ((retval == ICM_20948_Stat_Ok) && record.write && (record.regaddr == regaddr) && (record.len == len))
+  {
+    if ((len > 0) && (((record.data == NULL) != (pdata == NULL)) || ((pdata != NULL) && (memcmp(record.data, pdata, len) != 0))))
+    {
+      rep->mismatches++; // Same register, different data
+      if (rep->flags & ICM_20948_TRACE_REPLAY_STRICT)
+      {
+        return ICM_20948_Stat_Err;
+      }
+    }
+    rep->pos = pos;
+    rep->timestamp = record.timestamp;
+    rep->records++;
+    return record.status;
+  }
+
+  // The driver made a write that is not next in the trace
+  rep->mismatches++;
+  if (rep->flags & ICM_20948_TRACE_REPLAY_STRICT)
+  {
+    return (retval == ICM_20948_Stat_NoData) ? ICM_20948_Stat_NoData : ICM_20948_Stat_Err;
+  }
+  return ICM_20948_Stat_Ok; // Accept it without consuming anything
+}
+
+ICM_20948_Status_e ICM_20948_trace_replay_read(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user)
+{
+  ICM_20948_Trace_Replay_t *rep = (ICM_20948_Trace_Replay_t *)user;
+  ICM_20948_Trace_Record_t record;
+  uint32_t pos;
+  uint32_t skipped = 0;
+
+  if ((rep == NULL) || (pdata == NULL))
+  {
+    return ICM_20948_Stat_ParamErr;
+  }
+
+  pos = rep->pos;
+  record.timestamp = rep->timestamp;
+  while (true)
+  {
+    ICM_20948_Status_e retval = ICM_20948_trace_next(rep->trace, rep->len, &pos, &record);
+    if (retval != ICM_20948_Stat_Ok)
+    {
+      rep->mismatches++;
+      return retval; // End of the trace (NoData) or a corrupt record (Err). Nothing is consumed
+    }
+    if ((!record.write) && (record.regaddr == regaddr) && (record.len == len) && (record.data != NULL))
+    {
+      break;
+    }
+    if (rep->flags & ICM_20948_TRACE_REPLAY_STRICT)
+    {
+      rep->mismatches++;
+      return ICM_20948_Stat_Err;
+    }
+    skipped++; // Non-strict: skip forward to the next matching read
+  }
+
+  memcpy(pdata, record.data, len);
+  rep->mismatches += skipped;
+  rep->pos = pos;
+  rep->timestamp = record.timestamp;
+  rep->records += skipped + 1;
+  return record.status;
+}
+
+#if defined(__linux__) && !defined(ARDUINO)
+
+ICM_20948_Status_e ICM_20948_trace_file_sink(const uint8_t *data, uint32_t len, void *user)
+{
+  FILE *fp = (FILE *)user;
+  if ((fp == NULL) || (fwrite(data, 1, len, fp) != len))
+  {
+    return ICM_20948_Stat_Err;
+  }
+  return ICM_20948_Stat_Ok;
+}
+
+ICM_20948_Status_e ICM_20948_trace_load_file(const char *path, uint8_t **trace, uint32_t *len)
+{
+  if ((path == NULL) || (trace == NULL) || (len == NULL))
+  {
+    return ICM_20948_Stat_ParamErr;
+  }
+  *trace = NULL; // Until the whole file is in and its header checks out
+  *len = 0;
+
+  FILE *fp = fopen(path, "rb");
+  if (fp == NULL)
+  {
+    return ICM_20948_Stat_Err;
+  }
+
+  long size = -1;
+  if (fseek(fp, 0, SEEK_END) == 0)
+  {
+    size = ftell(fp);
+  }
+  if ((size < 0) || ((unsigned long)size > 0xFFFFFFFFUL) || (fseek(fp, 0, SEEK_SET) != 0))
+  {
+    fclose(fp);
+    return ICM_20948_Stat_Err;
+  }
+
+  uint8_t *buff = (uint8_t *)malloc((size > 0) ? (size_t)size : 1);
+  if ((buff == NULL) || (fread(buff, 1, (size_t)size, fp) != (size_t)size))
+  {
+    free(buff);
+    fclose(fp);
+    return ICM_20948_Stat_Err;
+  }
+  fclose(fp);
+
+  if (ICM_20948_trace_check_header(buff, (uint32_t)size) != ICM_20948_Stat_Ok)
+  {
+    free(buff);
+    return ICM_20948_Stat_Err;
+  }
+  *trace = buff;
+  *len = (uint32_t)size;
+  return ICM_20948_Stat_Ok;
+}
+
+#endif /* __linux__ && !ARDUINO */
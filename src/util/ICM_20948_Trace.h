@@ -0,0 +1,123 @@
+/*
+
+Bus trace capture and replay for the C interface (ICM_20948_C.h)
+
+The recorder is a serif that wraps another serif. Every read and write is passed through to the real bus
+and then logged - register, data and a timestamp - to a sink function you provide (a file, an SD card,
+a serial port...). The replay serif feeds a recorded trace back into the unmodified driver, so a session
+captured on a field unit can be debugged, or benchmarked, on a host.
+
+Recording:
+
+  ICM_20948_Trace_Recorder_t rec;
+  ICM_20948_Serif_t serif;
+  ICM_20948_trace_record_start(&rec, &realSerif, mySink, mySinkUser, myClock_us); // Writes the trace header
+  ICM_20948_trace_record_serif(&rec, &serif);
+  ICM_20948_link_serif(&dev, &serif);
+
+Replay:
+
+  ICM_20948_Trace_Replay_t rep;
+  ICM_20948_trace_replay_init(&rep, traceData, traceLen, 0);
+  ICM_20948_trace_replay_serif(&rep, &serif);
+  ICM_20948_link_serif(&dev, &serif);
+
+The trace format (all multi-byte integers are unsigned LEB128 varints):
+
+  Header: 'I' 'C' 'M' 'T' version(1) 0 0 0
+  Record: op, regaddr, time delta (us), len, [status], data[len]
+    op bit 0: 1 = write, 0 = read
+    op bit 1: the status byte is present (the serif did not return ICM_20948_Stat_Ok)
+    op bit 2: no data follows: the serif was called with a NULL pdata (len is still the length of the call)
+  The time delta is from the previous record (from zero for the first one) and wraps with the 32-bit clock.
+  Reads log the data that came back from the bus, writes log the data that was sent.
+
+A replay must follow the same sequence of bus calls as the recording. Start recording before
+ICM_20948_link_serif / begin so the bank caches start out the same, or use non-strict replay:
+it skips recorded writes the driver does not make, accepts writes that are not in the trace, and
+skips forward to the next matching read.
+
+*/
+
+#ifndef _ICM_20948_TRACE_H_
+#define _ICM_20948_TRACE_H_
+
+#include "ICM_20948_C.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+
+#define ICM_20948_TRACE_VERSION 1
+#define ICM_20948_TRACE_HEADER_SIZE 8
+
+#define ICM_20948_TRACE_OP_WRITE 0x01
+#define ICM_20948_TRACE_OP_STATUS 0x02
+#define ICM_20948_TRACE_OP_NODATA 0x04
+
+#define ICM_20948_TRACE_REPLAY_STRICT 0x01 // Fail on the first call that does not match the trace
+
+  typedef ICM_20948_Status_e (*ICM_20948_Trace_Sink_t)(const uint8_t *data, uint32_t len, void *user); // Append len bytes to the trace
+
+  typedef struct
+  {
+    const ICM_20948_Serif_t *inner; // The serif that talks to the real bus
+    ICM_20948_Trace_Sink_t sink;    // Where the trace goes
+    void *sink_user;                // Passed to sink
+    uint32_t (*clock_us)(void);     // Microsecond clock for the timestamps. NULL records zero time deltas
+    uint32_t last_time;             // Timestamp of the previous record
+    uint32_t records;               // Number of records written
+    uint32_t bytes;                 // Number of trace bytes written, including the header
+    uint32_t sink_errors;           // Number of sink calls that failed. The bus calls still go through
+  } ICM_20948_Trace_Recorder_t;
+
+  typedef struct
+  {
+    uint32_t timestamp;        // Microseconds: the sum of the time deltas so far
+    bool write;                // true for a write, false for a read
+    uint8_t regaddr;           // The register that was accessed
+    ICM_20948_Status_e status; // What the serif returned
+    uint32_t len;              // Number of data bytes
+    const uint8_t *data;       // The data, inside the trace buffer. NULL if the call had none (ICM_20948_TRACE_OP_NODATA)
+  } ICM_20948_Trace_Record_t;
+
+  typedef struct
+  {
+    const uint8_t *trace; // The whole trace, including the header
+    uint32_t len;         // Its length in bytes
+    uint32_t pos;         // Offset of the next record
+    uint32_t timestamp;   // Timestamp of the last record consumed
+    uint8_t flags;        // ICM_20948_TRACE_REPLAY_STRICT
+    uint32_t records;     // Number of records consumed
+    uint32_t mismatches;  // Calls that did not match the trace (write data, skipped or unrecorded records)
+  } ICM_20948_Trace_Replay_t;
+
+  // Recording
+  ICM_20948_Status_e ICM_20948_trace_record_start(ICM_20948_Trace_Recorder_t *rec, const ICM_20948_Serif_t *inner, ICM_20948_Trace_Sink_t sink, void *sink_user, uint32_t (*clock_us)(void)); // Writes the header to the sink
+  void ICM_20948_trace_record_serif(ICM_20948_Trace_Recorder_t *rec, ICM_20948_Serif_t *serif);                                                                                              // Fill in a serif that records to rec
+  ICM_20948_Status_e ICM_20948_trace_record_write(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user);
+  ICM_20948_Status_e ICM_20948_trace_record_read(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user);
+
+  // Parsing
+  ICM_20948_Status_e ICM_20948_trace_check_header(const uint8_t *trace, uint32_t len);                                                   // ICM_20948_Stat_Err if this is not a trace we understand
+  ICM_20948_Status_e ICM_20948_trace_next(const uint8_t *trace, uint32_t len, uint32_t *pos, ICM_20948_Trace_Record_t *record); // Decode the record at *pos (start at ICM_20948_TRACE_HEADER_SIZE) and advance *pos. record->timestamp must hold the previous timestamp. ICM_20948_Stat_NoData at the end
+
+  // Replay
+  ICM_20948_Status_e ICM_20948_trace_replay_init(ICM_20948_Trace_Replay_t *rep, const uint8_t *trace, uint32_t len, uint8_t flags);
+  void ICM_20948_trace_replay_rewind(ICM_20948_Trace_Replay_t *rep); // Start again from the first record, e.g. to run a benchmark repeatedly
+  void ICM_20948_trace_replay_serif(ICM_20948_Trace_Replay_t *rep, ICM_20948_Serif_t *serif);
+  ICM_20948_Status_e ICM_20948_trace_replay_write(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user);
+  ICM_20948_Status_e ICM_20948_trace_replay_read(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user); // Returns ICM_20948_Stat_NoData once the trace runs out
+
+#if defined(__linux__) && !defined(ARDUINO)
+  // Host helpers
+  ICM_20948_Status_e ICM_20948_trace_file_sink(const uint8_t *data, uint32_t len, void *user);                  // A sink for stdio: user is the FILE *
+  ICM_20948_Status_e ICM_20948_trace_load_file(const char *path, uint8_t **trace, uint32_t *len);               // Read a whole trace file into memory. free(*trace) when done. On an error *trace is NULL and there is nothing to free
+#endif
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _ICM_20948_TRACE_H_ */
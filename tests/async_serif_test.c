@@ -0,0 +1,238 @@
+/*
+
+Asynchronous serif test
+
+A mock read_async / write_async on top of the simulator: each transfer is queued to a worker thread that waits
+TEST_LATENCY_US (a stand-in for a DMA transfer on a slow bus) before doing it and calling done. Checks that
+ICM_20948_get_agmt, ICM_20948_read_FIFO and the frame drain send their data bursts through the hook and still return
+the right data, that ICM_20948_decode_agmt gets the full scale from the device, and that the bus is marked busy
+for exactly as long as a transfer is in flight.
+
+*/
+
+#include "test_common.h"
+#include "ICM_20948_Frame.h"
+
+#include <pthread.h>
+#include <time.h>
+
+#define TEST_LATENCY_US 200
+
+typedef struct
+{
+  ICM_20948_Sim_t *sim;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  bool pending; // A transfer is waiting for the worker
+  bool write;
+  uint8_t regaddr;
+  uint8_t *pdata;
+  uint32_t len;
+  ICM_20948_Serif_Done_t done;
+  void *context;
+  bool stop;
+  uint32_t async_reads;
+  uint32_t async_writes;
+} Test_Mock_t;
+
+static ICM_20948_Device_t dev;
+static ICM_20948_Sim_t sim;
+static ICM_20948_Serif_t serif;
+static Test_Mock_t mock;
+
+static double test_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + ((double)ts.tv_nsec * 1e-9);
+}
+
+static void *test_worker(void *arg)
+{
+  Test_Mock_t *m = (Test_Mock_t *)arg;
+  pthread_mutex_lock(&m->lock);
+  for (;;)
+  {
+    while (!m->pending && !m->stop)
+      pthread_cond_wait(&m->wake, &m->lock);
+    if (m->stop)
+      break;
+    pthread_mutex_unlock(&m->lock);
+
+    struct timespec latency = {0, TEST_LATENCY_US * 1000L};
+    nanosleep(&latency, NULL);
+    ICM_20948_Status_e status = m->write ? ICM_20948_sim_write(m->regaddr, m->pdata, m->len, m->sim)
+                                         : ICM_20948_sim_read(m->regaddr, m->pdata, m->len, m->sim);
+
+    pthread_mutex_lock(&m->lock);
+    m->pending = false;
+    pthread_mutex_unlock(&m->lock);
+    m->done(status, m->context); // As an interrupt would: outside the lock
+    pthread_mutex_lock(&m->lock);
+  }
+  pthread_mutex_unlock(&m->lock);
+  return NULL;
+}
+
+static ICM_20948_Status_e test_start(bool write, uint8_t regaddr, uint8_t *pdata, uint32_t len, ICM_20948_Serif_Done_t done, void *context, void *user)
+{
+  Test_Mock_t *m = (Test_Mock_t *)user;
+  pthread_mutex_lock(&m->lock);
+  if (m->pending)
+  {
+    pthread_mutex_unlock(&m->lock);
+    return ICM_20948_Stat_Err; // One transfer at a time
+  }
+  m->pending = true;
+  m->write = write;
+  m->regaddr = regaddr;
+  m->pdata = pdata;
+  m->len = len;
+  m->done = done;
+  m->context = context;
+  if (write)
+    m->async_writes++;
+  else
+    m->async_reads++;
+  pthread_cond_signal(&m->wake);
+  pthread_mutex_unlock(&m->lock);
+  return ICM_20948_Stat_Ok;
+}
+
+// The blocking transfers go straight to the simulator
+static ICM_20948_Status_e test_read(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user)
+{
+  return ICM_20948_sim_read(regaddr, pdata, len, ((Test_Mock_t *)user)->sim);
+}
+
+static ICM_20948_Status_e test_write(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user)
+{
+  return ICM_20948_sim_write(regaddr, pdata, len, ((Test_Mock_t *)user)->sim);
+}
+
+static ICM_20948_Status_e test_read_async(uint8_t regaddr, uint8_t *pdata, uint32_t len, ICM_20948_Serif_Done_t done, void *context, void *user)
+{
+  return test_start(false, regaddr, pdata, len, done, context, user);
+}
+
+static ICM_20948_Status_e test_write_async(uint8_t regaddr, uint8_t *pdata, uint32_t len, ICM_20948_Serif_Done_t done, void *context, void *user)
+{
+  return test_start(true, regaddr, pdata, len, done, context, user);
+}
+
+static volatile bool user_done;
+static volatile ICM_20948_Status_e user_status;
+static void test_user_done(ICM_20948_Status_e status, void *context)
+{
+  (void)context;
+  user_status = status;
+  user_done = true;
+}
+
+int main(void)
+{
+  test_sim_device(&dev, &sim, &serif);
+
+  memset(&mock, 0, sizeof(mock));
+  mock.sim = &sim;
+  pthread_mutex_init(&mock.lock, NULL);
+  pthread_cond_init(&mock.wake, NULL);
+  pthread_t worker;
+  TEST_CHECK(pthread_create(&worker, NULL, test_worker, &mock) == 0);
+
+  ICM_20948_Serif_t async_serif;
+  async_serif.read = test_read;
+  async_serif.write = test_write;
+  async_serif.user = &mock;
+  async_serif.read_async = test_read_async;
+  async_serif.write_async = test_write_async;
+  ICM_20948_link_serif(&dev, &async_serif);
+
+  ICM_20948_fss_t fss;
+  fss.a = 2;
+  fss.g = 1;
+  TEST_CHECK(ICM_20948_set_full_scale(&dev, (ICM_20948_InternalSensorID_bm)(ICM_20948_Internal_Acc | ICM_20948_Internal_Gyr), fss) == ICM_20948_Stat_Ok);
+
+  // get_agmt: the data burst goes through read_async and waits for it
+  ICM_20948_AGMT_t in, out;
+  memset(&in, 0, sizeof(in));
+  in.acc.axes.x = 1000;
+  in.acc.axes.y = -2000;
+  in.acc.axes.z = 16384;
+  in.gyr.axes.x = -5;
+  in.gyr.axes.y = 123;
+  in.gyr.axes.z = -32768;
+  in.tmp.val = 4321;
+  ICM_20948_sim_set_agmt(&sim, &in);
+  uint32_t reads = mock.async_reads;
+  double start = test_now();
+  TEST_CHECK(ICM_20948_get_agmt(&dev, &out) == ICM_20948_Stat_Ok);
+  double elapsed = test_now() - start;
+  TEST_CHECK(mock.async_reads == reads + 1);
+  TEST_CHECK(elapsed >= (TEST_LATENCY_US * 1e-6));
+  TEST_CHECK((out.acc.axes.x == 1000) && (out.acc.axes.y == -2000) && (out.acc.axes.z == 16384));
+  TEST_CHECK((out.gyr.axes.x == -5) && (out.gyr.axes.y == 123) && (out.gyr.axes.z == -32768));
+  TEST_CHECK(out.tmp.val == 4321);
+  TEST_CHECK((out.fss.a == 2) && (out.fss.g == 1));
+  TEST_CHECK(!dev._bus_busy);
+
+  // get_agmt_async: decode with the device's full scale, which set_full_scale has just changed
+  fss.a = 3;
+  fss.g = 2;
+  TEST_CHECK(ICM_20948_set_full_scale(&dev, (ICM_20948_InternalSensorID_bm)(ICM_20948_Internal_Acc | ICM_20948_Internal_Gyr), fss) == ICM_20948_Stat_Ok);
+  uint8_t buff[ICM_20948_AGMT_RAW_BYTES];
+  ICM_20948_Sample_t slots[2];
+  ICM_20948_Sample_Queue_t queue;
+  ICM_20948_queue_init(&queue, slots, 2);
+  user_done = false;
+  TEST_CHECK(ICM_20948_get_agmt_async(&dev, buff, test_user_done, NULL) == ICM_20948_Stat_Ok);
+  TEST_CHECK(ICM_20948_queue_agmt(&dev, &queue, 0) == ICM_20948_Stat_BusBusy); // In flight
+  while (!user_done)
+  {
+  }
+  TEST_CHECK(user_status == ICM_20948_Stat_Ok);
+  TEST_CHECK(!dev._bus_busy);
+  ICM_20948_decode_agmt(buff, dev._fss, &out);
+  TEST_CHECK((out.acc.axes.x == 1000) && (out.gyr.axes.z == -32768) && (out.fss.a == 3) && (out.fss.g == 2));
+
+  // read_FIFO and the frame drain
+  uint8_t pattern[200], got[200];
+  for (uint16_t i = 0; i < sizeof(pattern); i++)
+    pattern[i] = (uint8_t)((i * 37) + 11);
+  ICM_20948_sim_fifo_push(&sim, pattern, 100);
+  reads = mock.async_reads;
+  TEST_CHECK(ICM_20948_read_FIFO(&dev, got, 60) == ICM_20948_Stat_Ok);
+  TEST_CHECK(ICM_20948_read_FIFO(&dev, &got[60], 40) == ICM_20948_Stat_Ok);
+  TEST_CHECK(mock.async_reads == reads + 2);
+  TEST_CHECK(memcmp(got, pattern, 100) == 0);
+
+  ICM_20948_sim_fifo_push(&sim, pattern, sizeof(pattern));
+  uint8_t drain_buf[256];
+  ICM_20948_Frame_Drain_t drain;
+  ICM_20948_frame_drain_init(&drain, drain_buf, sizeof(drain_buf));
+  reads = mock.async_reads;
+  TEST_CHECK(ICM_20948_frame_drain(&dev, &drain) == ICM_20948_Stat_Ok);
+  TEST_CHECK(drain.len == sizeof(pattern));
+  TEST_CHECK(mock.async_reads > reads);
+  TEST_CHECK(memcmp(drain_buf, pattern, sizeof(pattern)) == 0);
+
+  // execute_w_async goes through write_async too
+  uint8_t whoami = 0;
+  uint8_t zero = 0;
+  user_done = false;
+  TEST_CHECK(ICM_20948_execute_w_async(&dev, AGB0_REG_INT_ENABLE, &zero, 1, test_user_done, NULL) == ICM_20948_Stat_Ok);
+  while (!user_done)
+  {
+  }
+  TEST_CHECK(mock.async_writes == 1);
+  TEST_CHECK(ICM_20948_get_who_am_i(&dev, &whoami) == ICM_20948_Stat_Ok);
+  TEST_CHECK(whoami == ICM_20948_WHOAMI);
+
+  pthread_mutex_lock(&mock.lock);
+  mock.stop = true;
+  pthread_cond_signal(&mock.wake);
+  pthread_mutex_unlock(&mock.lock);
+  pthread_join(worker, NULL);
+
+  return test_result();
+}
@@ -0,0 +1,120 @@
+/*
+
+DMP bias save and restore test (inv_icm20948_get_dmp_biases / inv_icm20948_set_dmp_biases)
+
+Known biases, including the int32_t extremes, are put in the simulator's DMP memory, saved to a blob, cleared and
+restored: they must come back unchanged. A blob with any single bit flipped, or two bytes swapped, or the wrong
+version or count must be refused by both ICM_20948_bias_blob_decode and inv_icm20948_set_dmp_biases, and a refused
+blob must not touch the DMP memory.
+
+*/
+
+#include "test_common.h"
+#include "ICM_20948_DMP.h"
+
+static ICM_20948_Device_t dev;
+static ICM_20948_Sim_t sim;
+static ICM_20948_Serif_t serif;
+
+static const unsigned short test_regs[3] = {GYRO_BIAS_X, ACCEL_BIAS_X, CPASS_BIAS_X};
+static const int32_t test_biases[9] = {1, -2, 300000, -4000000, 5, 6, -7, 0x7FFFFFFF, (int32_t)0x80000000};
+
+static int32_t test_mem(uint8_t group, uint8_t axis) // As the DMP keeps it: big-endian
+{
+  const uint8_t *b = &sim.dmp_mem[test_regs[group] + (axis * 4)];
+  return (int32_t)(((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3]);
+}
+
+static void test_fill(const int32_t *bias)
+{
+  for (uint8_t i = 0; i < 9; i++)
+  {
+    uint8_t *b = &sim.dmp_mem[test_regs[i / 3] + ((i % 3) * 4)];
+    uint32_t v = (bias == NULL) ? 0 : (uint32_t)bias[i];
+    b[0] = (uint8_t)(v >> 24);
+    b[1] = (uint8_t)(v >> 16);
+    b[2] = (uint8_t)(v >> 8);
+    b[3] = (uint8_t)v;
+  }
+}
+
+static bool test_mem_is(const int32_t *bias)
+{
+  for (uint8_t i = 0; i < 9; i++)
+  {
+    if (test_mem(i / 3, i % 3) != ((bias == NULL) ? 0 : bias[i]))
+      return false;
+  }
+  return true;
+}
+
+// A damaged blob is refused by both, and leaves the (cleared) memory alone
+static bool test_refused(const uint8_t *blob)
+{
+  test_fill(NULL);
+  return (ICM_20948_bias_blob_decode(blob, NULL) == ICM_20948_Stat_ParamErr) &&
+         (inv_icm20948_set_dmp_biases(&dev, blob) == ICM_20948_Stat_ParamErr) && test_mem_is(NULL);
+}
+
+int main(void)
+{
+  test_sim_device(&dev, &sim, &serif);
+
+  // Save, clear, restore
+  uint8_t blob[ICM_20948_BIAS_BLOB_BYTES];
+  int32_t decoded[9];
+  test_fill(test_biases);
+  TEST_CHECK(inv_icm20948_get_dmp_biases(&dev, blob) == ICM_20948_Stat_Ok);
+  TEST_CHECK(ICM_20948_bias_blob_decode(blob, decoded) == ICM_20948_Stat_Ok);
+  TEST_CHECK(memcmp(decoded, test_biases, sizeof(decoded)) == 0);
+  test_fill(NULL);
+  TEST_CHECK(inv_icm20948_set_dmp_biases(&dev, blob) == ICM_20948_Stat_Ok);
+  TEST_CHECK(test_mem_is(test_biases));
+
+  // Every single-bit flip, the checksum included
+  uint32_t accepted = 0;
+  for (uint16_t bit = 0; bit < (ICM_20948_BIAS_BLOB_BYTES * 8); bit++)
+  {
+    blob[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+    if (!test_refused(blob))
+      accepted++;
+    blob[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+  }
+  TEST_CHECK(accepted == 0);
+
+  // Two different bytes swapped
+  accepted = 0;
+  for (uint16_t i = 2; i < (ICM_20948_BIAS_BLOB_BYTES - 3); i++)
+  {
+    if (blob[i] == blob[i + 1])
+      continue;
+    uint8_t keep = blob[i];
+    blob[i] = blob[i + 1];
+    blob[i + 1] = keep;
+    if (!test_refused(blob))
+      accepted++;
+    blob[i + 1] = blob[i];
+    blob[i] = keep;
+  }
+  TEST_CHECK(accepted == 0);
+
+  // The version and the count are checked before the checksum
+  uint8_t other[ICM_20948_BIAS_BLOB_BYTES];
+  memcpy(other, blob, sizeof(other));
+  other[0] = ICM_20948_BIAS_BLOB_VERSION + 1;
+  TEST_CHECK(test_refused(other));
+  memcpy(other, blob, sizeof(other));
+  other[1] = 8;
+  TEST_CHECK(test_refused(other));
+
+  // The undamaged blob still restores
+  TEST_CHECK(inv_icm20948_set_dmp_biases(&dev, blob) == ICM_20948_Stat_Ok);
+  TEST_CHECK(test_mem_is(test_biases));
+
+  // No DMP firmware: nothing to save
+  dev._dmp_firmware_available = false;
+  TEST_CHECK(inv_icm20948_get_dmp_biases(&dev, blob) == ICM_20948_Stat_DMPNotSupported);
+  TEST_CHECK(inv_icm20948_set_dmp_biases(&dev, blob) == ICM_20948_Stat_DMPNotSupported);
+
+  return test_result();
+}
@@ -0,0 +1,111 @@
+/*
+
+Bus statistics test (ICM_20948_USE_BUS_STATS)
+
+Built with its own copy of the C core and ICM_20948_USE_BUS_STATS defined (see CMakeLists.txt), since the statistics
+change ICM_20948_Device_t. Counts ICM_20948_get_agmt on the simulator against the ICM_20948_Bus_Ctx_GetAGMT bucket and
+checks every counter against what the serif saw: per call, bank 2 (ACCEL_CONFIG, GYRO_CONFIG_1 with a redundant bank
+select, ACCEL_CONFIG_2), then bank 0 and the 23-byte burst.
+
+*/
+
+#include "test_common.h"
+
+#if !defined(ICM_20948_USE_BUS_STATS)
+#error "Build this test with ICM_20948_USE_BUS_STATS"
+#endif
+
+#define TEST_CALLS 10
+
+static ICM_20948_Device_t dev;
+static ICM_20948_Sim_t sim;
+static ICM_20948_Serif_t serif;
+
+static uint32_t bus_reads;
+static uint32_t bus_writes;
+static uint32_t bus_read_bytes;
+static uint32_t bus_write_bytes;
+static uint32_t bank_writes;
+static uint32_t test_clock_us;
+
+static ICM_20948_Status_e test_read(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user)
+{
+  bus_reads++;
+  bus_read_bytes += len;
+  return ICM_20948_sim_read(regaddr, pdata, len, user);
+}
+
+static ICM_20948_Status_e test_write(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user)
+{
+  bus_writes++;
+  bus_write_bytes += len;
+  if (regaddr == REG_BANK_SEL)
+    bank_writes++;
+  return ICM_20948_sim_write(regaddr, pdata, len, user);
+}
+
+static uint32_t test_clock(void)
+{
+  return test_clock_us += 5; // So every transaction takes 5us
+}
+
+static bool test_stats_zero(ICM_20948_Bus_Ctx_e ctx)
+{
+  ICM_20948_Bus_Stats_t stats;
+  if (ICM_20948_get_bus_stats(&dev, ctx, &stats) != ICM_20948_Stat_Ok)
+    return false;
+  return (stats.reads == 0) && (stats.writes == 0) && (stats.bytes_read == 0) && (stats.bytes_written == 0) &&
+         (stats.bank_switches == 0) && (stats.bank_redundant == 0) && (stats.time_us == 0);
+}
+
+int main(void)
+{
+  test_sim_device(&dev, &sim, &serif);
+  serif.read = test_read;
+  serif.write = test_write;
+  ICM_20948_link_serif(&dev, &serif);
+  TEST_CHECK(ICM_20948_set_bus_stats_clock(&dev, test_clock) == ICM_20948_Stat_Ok);
+
+  TEST_CHECK(ICM_20948_reset_bus_stats(&dev) == ICM_20948_Stat_Ok);
+  for (uint8_t ctx = 0; ctx < ICM_20948_Bus_Ctx_NUM; ctx++)
+    TEST_CHECK(test_stats_zero((ICM_20948_Bus_Ctx_e)ctx));
+
+  bus_reads = bus_writes = bus_read_bytes = bus_write_bytes = bank_writes = 0;
+  for (uint32_t i = 0; i < TEST_CALLS; i++)
+  {
+    ICM_20948_AGMT_t agmt;
+    ICM_20948_BUS_CTX_ENTER(&dev, ICM_20948_Bus_Ctx_GetAGMT);
+    TEST_CHECK(ICM_20948_get_agmt(&dev, &agmt) == ICM_20948_Stat_Ok);
+    ICM_20948_BUS_CTX_LEAVE(&dev);
+  }
+  TEST_CHECK(dev._bus_ctx == ICM_20948_Bus_Ctx_Other);
+
+  ICM_20948_Bus_Stats_t stats;
+  TEST_CHECK(ICM_20948_get_bus_stats(&dev, ICM_20948_Bus_Ctx_GetAGMT, &stats) == ICM_20948_Stat_Ok);
+  printf("get_agmt x%d: %u reads (%u bytes), %u writes (%u bytes), %u bank switches, %u redundant, %u us\n", TEST_CALLS,
+         stats.reads, stats.bytes_read, stats.writes, stats.bytes_written, stats.bank_switches, stats.bank_redundant, stats.time_us);
+
+  // What the serif saw
+  TEST_CHECK((stats.reads == bus_reads) && (stats.bytes_read == bus_read_bytes));
+  TEST_CHECK((stats.writes == bus_writes) && (stats.bytes_written == bus_write_bytes));
+  TEST_CHECK(stats.bank_switches == bank_writes);
+  // And what get_agmt is meant to do
+  TEST_CHECK(stats.reads == 4 * TEST_CALLS);
+  TEST_CHECK(stats.bytes_read == (3 + ICM_20948_AGMT_RAW_BYTES) * TEST_CALLS);
+  TEST_CHECK((stats.writes == 2 * TEST_CALLS) && (stats.bytes_written == 2 * TEST_CALLS));
+  TEST_CHECK(stats.bank_switches == 2 * TEST_CALLS);
+  TEST_CHECK(stats.bank_redundant == TEST_CALLS);
+  TEST_CHECK(stats.time_us == 5 * (stats.reads + stats.writes));
+  for (uint8_t ctx = 0; ctx < ICM_20948_Bus_Ctx_NUM; ctx++)
+    if (ctx != ICM_20948_Bus_Ctx_GetAGMT)
+      TEST_CHECK(test_stats_zero((ICM_20948_Bus_Ctx_e)ctx));
+
+  // Outside the bucket, traffic counts against ICM_20948_Bus_Ctx_Other. A redundant bank select is not traffic
+  TEST_CHECK(ICM_20948_set_bank(&dev, 0) == ICM_20948_Stat_Ok);
+  TEST_CHECK(ICM_20948_get_bus_stats(&dev, ICM_20948_Bus_Ctx_Other, &stats) == ICM_20948_Stat_Ok);
+  TEST_CHECK((stats.bank_redundant == 1) && (stats.bank_switches == 0) && (stats.writes == 0));
+
+  TEST_CHECK(ICM_20948_get_bus_stats(&dev, ICM_20948_Bus_Ctx_NUM, &stats) == ICM_20948_Stat_ParamErr);
+
+  return test_result();
+}
@@ -0,0 +1,189 @@
+/*
+
+Decimation test (ICM_20948_Decim.h)
+
+Checks the filters the init functions design and the stages that run them:
+
+  DC gain:  every Q15 branch sums to exactly 32768, for every up, down and taps, so a constant input comes out
+            unchanged, and the float stage is within 1e-5 of it
+  response: for the two stages in the header example (1125Hz to 225Hz, 225Hz to 100Hz), sines are within 1% in the
+            passband and attenuated by at least 46dB in the stopband, in float and Q15. The bands are either side
+            of the transition band the header gives: 3.3 * down / (up * taps) of the output rate, about the cutoff
+  the rest: the output counts, full-scale input without overflow, a full-scale change, and bad parameters
+
+*/
+
+#include "test_common.h"
+#include "ICM_20948_Decim.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#define TEST_AMPLITUDE 10000.0
+#define TEST_INPUTS 20000
+#define TEST_SETTLE 2000 // Inputs before the outputs count
+
+static ICM_20948_Decim_t fd;
+static ICM_20948_Decim_Q15_t qd;
+
+// The amplitude of the output for a sine at f into a stage at rate: the RMS (times sqrt(2)) of the settled outputs
+static void test_response(uint8_t up, uint16_t down, double f, double rate, double *q15, double *flt)
+{
+  ICM_20948_decim_q15_init(&qd, up, down, ICM_20948_DECIM_MAX_TAPS);
+  ICM_20948_decim_init(&fd, up, down, ICM_20948_DECIM_MAX_TAPS);
+  double sq_q15 = 0, sq_flt = 0;
+  uint32_t n_q15 = 0, n_flt = 0;
+  for (uint32_t k = 0; k < TEST_INPUTS; k++)
+  {
+    double v = TEST_AMPLITUDE * sin(2.0 * M_PI * f * k / rate);
+    ICM_20948_AGMT_t in, out;
+    ICM_20948_AGMT_Scaled_t fin, fout;
+    memset(&in, 0, sizeof(in));
+    memset(&fin, 0, sizeof(fin));
+    in.gyr.axes.x = (int16_t)lrint(v);
+    fin.gyr.x = (float)v;
+    if (ICM_20948_decim_q15_update(&qd, &in, &out) && (k >= TEST_SETTLE))
+    {
+      sq_q15 += (double)out.gyr.axes.x * out.gyr.axes.x;
+      n_q15++;
+    }
+    if (ICM_20948_decim_update(&fd, &fin, &fout) && (k >= TEST_SETTLE))
+    {
+      sq_flt += (double)fout.gyr.x * fout.gyr.x;
+      n_flt++;
+    }
+  }
+  *q15 = sqrt(2.0 * sq_q15 / n_q15) / TEST_AMPLITUDE;
+  *flt = sqrt(2.0 * sq_flt / n_flt) / TEST_AMPLITUDE;
+}
+
+static void test_stage(uint8_t up, uint16_t down, double rate)
+{
+  double out_rate = rate * up / down;
+  double cutoff = ICM_20948_DECIM_CUTOFF * out_rate / 2.0;
+  double transition = 3.3 * down / (up * ICM_20948_DECIM_MAX_TAPS) * out_rate;
+  double pass = 0, stop = 0;
+  for (double f = 1.0; f < rate / 2.0; f += rate / 400.0)
+  {
+    double q15, flt;
+    if ((f > cutoff - (transition / 2.0)) && (f < cutoff + (transition / 2.0)))
+      continue;
+    test_response(up, down, f, rate, &q15, &flt);
+    if (f < cutoff)
+      pass = fmax(pass, fmax(fabs(q15 - 1.0), fabs(flt - 1.0)));
+    else
+      stop = fmax(stop, fmax(q15, flt));
+  }
+  printf("%.0fHz * %u / %u: passband error %.4f, stopband gain %.5f (%.1fdB)\n", rate, up, down, pass, stop, 20.0 * log10(stop));
+  TEST_CHECK(pass <= 0.01);
+  TEST_CHECK(stop <= 0.005); // -46dB
+}
+
+int main(void)
+{
+  // Every branch of every filter has a DC gain of exactly 1 in Q15
+  uint32_t bad_sums = 0;
+  for (uint8_t up = 1; up <= ICM_20948_DECIM_MAX_UP; up++)
+  {
+    for (uint16_t down = up; down <= 60; down++)
+    {
+      for (uint8_t taps = 2; taps <= ICM_20948_DECIM_MAX_TAPS; taps++)
+      {
+        TEST_CHECK(ICM_20948_decim_q15_init(&qd, up, down, taps) == ICM_20948_Stat_Ok);
+        for (uint8_t p = 0; p < up; p++)
+        {
+          int32_t sum = 0;
+          for (uint8_t k = 0; k < taps; k++)
+            sum += qd.h[p][k];
+          if (sum != 32768)
+            bad_sums++;
+        }
+      }
+    }
+  }
+  TEST_CHECK(bad_sums == 0);
+
+  // So a constant comes out unchanged, from every branch, and the float stage agrees
+  static const int16_t levels[] = {-32768, -12345, -1, 0, 1, 16384, 32767};
+  for (uint8_t i = 0; i < (sizeof(levels) / sizeof(levels[0])); i++)
+  {
+    ICM_20948_decim_q15_init(&qd, 4, 9, ICM_20948_DECIM_MAX_TAPS);
+    ICM_20948_decim_init(&fd, 4, 9, ICM_20948_DECIM_MAX_TAPS);
+    ICM_20948_AGMT_t in, out;
+    ICM_20948_AGMT_Scaled_t fin, fout;
+    memset(&in, 0, sizeof(in));
+    memset(&fin, 0, sizeof(fin));
+    in.acc.axes.x = in.acc.axes.y = in.acc.axes.z = levels[i];
+    in.gyr.axes.x = in.gyr.axes.y = in.gyr.axes.z = levels[i];
+    fin.acc.x = fin.acc.y = fin.acc.z = levels[i];
+    fin.gyr.x = fin.gyr.y = fin.gyr.z = levels[i];
+    bool exact = true, close = true;
+    for (uint32_t k = 0; k < 200; k++)
+    {
+      if (ICM_20948_decim_q15_update(&qd, &in, &out))
+        exact = exact && (out.acc.axes.x == levels[i]) && (out.acc.axes.z == levels[i]) && (out.gyr.axes.y == levels[i]);
+      if (ICM_20948_decim_update(&fd, &fin, &fout))
+        close = close && (fabs(fout.acc.x - levels[i]) <= 1e-5 * 32768.0) && (fabs(fout.gyr.z - levels[i]) <= 1e-5 * 32768.0);
+    }
+    TEST_CHECK(exact);
+    TEST_CHECK(close);
+  }
+
+  // The passband and stopband of the example cascade
+  test_stage(1, 5, 1125.0);
+  test_stage(4, 9, 225.0);
+
+  // The cascade at full scale: the output counts, no overflow, and the pass-through channels
+  ICM_20948_Decim_Q15_t to225, to100;
+  ICM_20948_decim_q15_init(&to225, 1, 5, ICM_20948_DECIM_MAX_TAPS);
+  ICM_20948_decim_q15_init(&to100, 4, 9, ICM_20948_DECIM_MAX_TAPS);
+  uint32_t n225 = 0, n100 = 0;
+  int32_t worst = 0;
+  ICM_20948_AGMT_t agmt225, agmt100;
+  memset(&agmt100, 0, sizeof(agmt100));
+  for (uint32_t k = 0; k < (1125 * 10); k++)
+  {
+    ICM_20948_AGMT_t in;
+    memset(&in, 0, sizeof(in));
+    in.gyr.axes.x = (k & 1) ? 32767 : -32768; // The Nyquist frequency at full scale
+    in.acc.axes.z = 16384;
+    in.mag.axes.x = 77;
+    in.tmp.val = 1234;
+    if (ICM_20948_decim_q15_update(&to225, &in, &agmt225))
+    {
+      n225++;
+      if (ICM_20948_decim_q15_update(&to100, &agmt225, &agmt100))
+      {
+        n100++;
+        if (k > TEST_SETTLE)
+          worst = (abs(agmt100.gyr.axes.x) > worst) ? abs(agmt100.gyr.axes.x) : worst;
+      }
+    }
+  }
+  TEST_CHECK((n225 == 2250) && (n100 == 1000));
+  TEST_CHECK(worst <= 2);
+  TEST_CHECK((agmt100.acc.axes.z == 16384) && (agmt100.mag.axes.x == 77) && (agmt100.tmp.val == 1234));
+
+  // A full-scale change restarts the history rather than mixing the two scales
+  ICM_20948_AGMT_t in, out;
+  memset(&in, 0, sizeof(in));
+  ICM_20948_decim_q15_init(&qd, 1, 5, ICM_20948_DECIM_MAX_TAPS);
+  in.gyr.axes.x = 1000;
+  for (uint32_t k = 0; k < 50; k++)
+    ICM_20948_decim_q15_update(&qd, &in, &out);
+  in.fss.g = 1;
+  in.gyr.axes.x = 500;
+  bool restarted = false;
+  for (uint32_t k = 0; k < 5; k++)
+    restarted = ICM_20948_decim_q15_update(&qd, &in, &out) || restarted;
+  TEST_CHECK(restarted && (out.gyr.axes.x == 500) && (out.fss.g == 1));
+
+  // Bad parameters
+  TEST_CHECK(ICM_20948_decim_q15_init(&qd, 0, 5, 16) == ICM_20948_Stat_ParamErr);
+  TEST_CHECK(ICM_20948_decim_q15_init(&qd, 5, 5, 16) == ICM_20948_Stat_ParamErr);
+  TEST_CHECK(ICM_20948_decim_q15_init(&qd, 3, 2, 16) == ICM_20948_Stat_ParamErr);
+  TEST_CHECK(ICM_20948_decim_q15_init(&qd, 1, 5, 1) == ICM_20948_Stat_ParamErr);
+  TEST_CHECK(ICM_20948_decim_init(&fd, 1, 5, ICM_20948_DECIM_MAX_TAPS + 1) == ICM_20948_Stat_ParamErr);
+
+  return test_result();
+}
@@ -0,0 +1,95 @@
+/*
+
+DMP batch mode and FIFO watermark test (inv_icm20948_set_dmp_batch, inv_icm20948_set_dmp_fifo_watermark)
+
+Checks the DMP memory the simulator ends up with: BM_BATCH_THLD, BM_BATCH_MASK and BM_BATCH_CNTR (big-endian), the
+batch mode bit in DATA_OUT_CTL2 and FIFO_WATERMARK. The batch bit must survive inv_icm20948_enable_dmp_sensor,
+which rewrites DATA_OUT_CTL2 with the accuracy bits of the enabled outputs, and turning batch mode off must keep
+those accuracy bits.
+
+*/
+
+#include "test_common.h"
+
+static ICM_20948_Device_t dev;
+static ICM_20948_Sim_t sim;
+static ICM_20948_Serif_t serif;
+
+static uint32_t test_mem(uint16_t reg, uint8_t bytes) // Big-endian, as the DMP stores it
+{
+  uint32_t v = 0;
+  for (uint8_t i = 0; i < bytes; i++)
+    v = (v << 8) | sim.dmp_mem[reg + i];
+  return v;
+}
+
+int main(void)
+{
+  test_sim_device(&dev, &sim, &serif);
+  const uint16_t mask = DMP_Data_ready_Accel | DMP_Data_ready_Gyro;
+  const uint16_t batch = DMP_Data_Output_Control_2_Batch_Mode_Enable;
+
+  // Refused without touching the bus
+  uint32_t writes = sim.writes;
+  TEST_CHECK(inv_icm20948_set_dmp_batch(&dev, true, 0, 100) == ICM_20948_Stat_ParamErr);
+  TEST_CHECK(inv_icm20948_set_dmp_batch(&dev, true, mask, 0) == ICM_20948_Stat_ParamErr);
+  TEST_CHECK(inv_icm20948_set_dmp_fifo_watermark(&dev, 0) == ICM_20948_Stat_ParamErr);
+  TEST_CHECK(inv_icm20948_set_dmp_fifo_watermark(&dev, CFG_FIFO_SIZE + 1) == ICM_20948_Stat_ParamErr);
+  TEST_CHECK(sim.writes == writes);
+
+  // Enable: threshold, mask, a zeroed counter and the batch bit
+  memset(&sim.dmp_mem[BM_BATCH_CNTR], 0x5A, 4); // Left over from an earlier batch
+  TEST_CHECK(inv_icm20948_set_dmp_batch(&dev, true, mask, 0x01020304) == ICM_20948_Stat_Ok);
+  TEST_CHECK(test_mem(BM_BATCH_THLD, 4) == 0x01020304);
+  TEST_CHECK(test_mem(BM_BATCH_MASK, 2) == mask);
+  TEST_CHECK(test_mem(BM_BATCH_CNTR, 4) == 0);
+  TEST_CHECK(test_mem(DATA_OUT_CTL2, 2) == batch);
+  TEST_CHECK(dev._dataOutCtl2 == batch);
+
+  // The counter reads back as the DMP left it
+  sim.dmp_mem[BM_BATCH_CNTR + 2] = 0x12;
+  sim.dmp_mem[BM_BATCH_CNTR + 3] = 0x34;
+  uint32_t count = 0;
+  TEST_CHECK(inv_icm20948_get_dmp_batch_count(&dev, &count) == ICM_20948_Stat_Ok);
+  TEST_CHECK(count == 0x1234);
+
+  // Enabling and disabling sensors rewrites DATA_OUT_CTL2: the batch bit must stay
+  uint16_t accuracy = inv_icm20948_control_bits_to_header2(inv_icm20948_sensor_to_control_bits(INV_ICM20948_SENSOR_RAW_ACCELEROMETER));
+  TEST_CHECK(accuracy != 0);
+  TEST_CHECK(inv_icm20948_enable_dmp_sensor(&dev, INV_ICM20948_SENSOR_RAW_ACCELEROMETER, 1) == ICM_20948_Stat_Ok);
+  TEST_CHECK(test_mem(DATA_OUT_CTL2, 2) == (uint32_t)(batch | accuracy));
+  TEST_CHECK(inv_icm20948_enable_dmp_sensor(&dev, INV_ICM20948_SENSOR_GAME_ROTATION_VECTOR, 1) == ICM_20948_Stat_Ok);
+  TEST_CHECK(test_mem(DATA_OUT_CTL2, 2) == (uint32_t)(batch | accuracy));
+  TEST_CHECK(inv_icm20948_enable_dmp_sensor(&dev, INV_ICM20948_SENSOR_RAW_ACCELEROMETER, 0) == ICM_20948_Stat_Ok);
+  TEST_CHECK(test_mem(DATA_OUT_CTL2, 2) == batch);
+  TEST_CHECK(inv_icm20948_enable_dmp_sensor(&dev, INV_ICM20948_SENSOR_RAW_ACCELEROMETER, 1) == ICM_20948_Stat_Ok);
+  TEST_CHECK(test_mem(BM_BATCH_THLD, 4) == 0x01020304); // Untouched
+  TEST_CHECK(test_mem(BM_BATCH_MASK, 2) == mask);
+
+  // Disable: the bit goes, the accuracy bits and the threshold stay, the counter restarts
+  sim.dmp_mem[BM_BATCH_CNTR + 3] = 0x77;
+  TEST_CHECK(inv_icm20948_set_dmp_batch(&dev, false, 0, 0) == ICM_20948_Stat_Ok);
+  TEST_CHECK(test_mem(DATA_OUT_CTL2, 2) == accuracy);
+  TEST_CHECK(dev._dataOutCtl2 == accuracy);
+  TEST_CHECK(test_mem(BM_BATCH_THLD, 4) == 0x01020304);
+  TEST_CHECK(test_mem(BM_BATCH_CNTR, 4) == 0);
+
+  // FIFO watermark
+  TEST_CHECK(inv_icm20948_set_dmp_fifo_watermark(&dev, 800) == ICM_20948_Stat_Ok);
+  TEST_CHECK(test_mem(FIFO_WATERMARK, 2) == 800);
+  TEST_CHECK(inv_icm20948_set_dmp_fifo_watermark(&dev, CFG_FIFO_SIZE) == ICM_20948_Stat_Ok);
+  TEST_CHECK(test_mem(FIFO_WATERMARK, 2) == CFG_FIFO_SIZE);
+
+  // The threshold for a window: samples in window_ms, at least one
+  TEST_CHECK(inv_icm20948_dmp_batch_threshold(1000, 225.0f) == 225);
+  TEST_CHECK(inv_icm20948_dmp_batch_threshold(1, 56.25f) == 1);
+  TEST_CHECK(inv_icm20948_dmp_batch_threshold(1000, 0.0f) == 0);
+
+  // Without the DMP firmware
+  dev._dmp_firmware_available = false;
+  TEST_CHECK(inv_icm20948_set_dmp_batch(&dev, true, mask, 100) == ICM_20948_Stat_DMPNotSupported);
+  TEST_CHECK(inv_icm20948_get_dmp_batch_count(&dev, &count) == ICM_20948_Stat_DMPNotSupported);
+  TEST_CHECK(inv_icm20948_set_dmp_fifo_watermark(&dev, 800) == ICM_20948_Stat_DMPNotSupported);
+
+  return test_result();
+}
@@ -0,0 +1,136 @@
+/*
+
+A fake Linux spidev on the simulator, for the spidev serif test and benchmark (ICM_20948_Linux_SPI.h)
+
+Link with -Wl,--wrap=open,--wrap=close,--wrap=ioctl (GNU ld) and include this in one file. Opening FAKE_SPI_PATH
+gives a device that carries out each SPI_IOC_MESSAGE on fake_spi_sim, chip-select by chip-select, and counts the
+ioctls that reach it. Every other path goes to the real open, close and ioctl, so a real /dev/spidevB.C still works.
+Above fake_spi_limit_hz the fake returns corrupt data, which is what the speed ramp looks for.
+
+*/
+
+#ifndef _ICM_20948_FAKE_SPIDEV_H_
+#define _ICM_20948_FAKE_SPIDEV_H_
+
+#include "ICM_20948_C.h"
+#include "ICM_20948_Sim.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+
+#define FAKE_SPI_PATH "/dev/spidev-fake"
+#define FAKE_SPI_FD 1002
+#define FAKE_SPI_BUFSIZ 4096 // spidev's default "bufsiz": the most bytes one message may carry
+
+int __real_open(const char *path, int flags, ...);
+int __real_close(int fd);
+int __real_ioctl(int fd, unsigned long request, ...);
+
+static ICM_20948_Sim_t fake_spi_sim;
+static uint32_t fake_spi_limit_hz = 100000000; // Reads above this come back corrupt
+static uint32_t fake_spi_max_speed_hz;
+static uint32_t fake_spi_syscalls;
+static uint64_t fake_spi_wire_ns; // SCLK time of all the bytes, at the speed of each transfer
+
+int __wrap_open(const char *path, int flags, ...)
+{
+  if (strcmp(path, FAKE_SPI_PATH) == 0)
+    return FAKE_SPI_FD;
+  return __real_open(path, flags);
+}
+
+int __wrap_close(int fd)
+{
+  if (fd == FAKE_SPI_FD)
+    return 0;
+  return __real_close(fd);
+}
+
+// One chip-select: the first byte is the address (bit 7 set for a read), the rest are the data
+static void fake_spi_transaction(struct spi_ioc_transfer *xfers, uint32_t n)
+{
+  static uint8_t tx[FAKE_SPI_BUFSIZ];
+  static uint8_t rx[FAKE_SPI_BUFSIZ];
+  uint32_t len = 0;
+  bool corrupt = false;
+  for (uint32_t i = 0; i < n; i++)
+  {
+    if (xfers[i].tx_buf != 0)
+      memcpy(&tx[len], (const void *)(uintptr_t)xfers[i].tx_buf, xfers[i].len);
+    else
+      memset(&tx[len], 0, xfers[i].len);
+    len += xfers[i].len;
+    fake_spi_wire_ns += (8000000000ULL * xfers[i].len) / xfers[i].speed_hz;
+    corrupt = corrupt || (xfers[i].speed_hz > fake_spi_limit_hz);
+  }
+
+  memset(rx, 0, len);
+  if (tx[0] & 0x80)
+  {
+    ICM_20948_sim_read(tx[0] & 0x7F, &rx[1], len - 1, &fake_spi_sim);
+    for (uint32_t i = 1; corrupt && (i < len); i++)
+      rx[i] ^= 0x5A;
+  }
+  else
+  {
+    ICM_20948_sim_write(tx[0], &tx[1], len - 1, &fake_spi_sim);
+  }
+
+  uint32_t pos = 0;
+  for (uint32_t i = 0; i < n; i++)
+  {
+    if (xfers[i].rx_buf != 0)
+      memcpy((void *)(uintptr_t)xfers[i].rx_buf, &rx[pos], xfers[i].len);
+    pos += xfers[i].len;
+  }
+}
+
+int __wrap_ioctl(int fd, unsigned long request, ...)
+{
+  va_list args;
+  va_start(args, request);
+  void *arg = va_arg(args, void *);
+  va_end(args);
+
+  if (fd != FAKE_SPI_FD)
+    return __real_ioctl(fd, request, arg);
+
+  if ((request == SPI_IOC_WR_MODE) || (request == SPI_IOC_WR_BITS_PER_WORD) || (request == SPI_IOC_WR_LSB_FIRST))
+    return 0;
+  if (request == SPI_IOC_WR_MAX_SPEED_HZ)
+  {
+    fake_spi_max_speed_hz = *(uint32_t *)arg;
+    return 0;
+  }
+  if ((_IOC_TYPE(request) == SPI_IOC_MAGIC) && (_IOC_NR(request) == 0) && (_IOC_DIR(request) == _IOC_WRITE))
+  {
+    struct spi_ioc_transfer *xfers = (struct spi_ioc_transfer *)arg;
+    uint32_t n = _IOC_SIZE(request) / sizeof(struct spi_ioc_transfer);
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < n; i++)
+      total += xfers[i].len;
+    fake_spi_syscalls++;
+    if (total > FAKE_SPI_BUFSIZ)
+    {
+      errno = EMSGSIZE; // As spidev does
+      return -1;
+    }
+    uint32_t first = 0;
+    for (uint32_t i = 0; i < n; i++)
+    {
+      if (xfers[i].cs_change || (i + 1 == n))
+      {
+        fake_spi_transaction(&xfers[first], i + 1 - first);
+        first = i + 1;
+      }
+    }
+    return (int)total;
+  }
+  errno = EINVAL;
+  return -1;
+}
+
+#endif /* _ICM_20948_FAKE_SPIDEV_H_ */
@@ -0,0 +1,214 @@
+/*
+
+Fixed-point conversion test (ICM_20948_fixed_*)
+
+Sweeps every int16_t reading at every full-scale setting through the fixed-point conversions and checks them
+against the bounds stated in ICM_20948_C.h: against the exact conversion (in double), and against the float
+path (ICM_20948_scale_agmt), which is itself off by a few float roundings. Then checks ICM_20948_fixed_sqrt
+(round to nearest, across the whole uint64_t range) and ICM_20948_fixed_quat_q0 (within 1 LSB of Q30, and 0 on overshoot).
+
+*/
+
+#include "test_common.h"
+
+#include <math.h>
+
+#define TEST_ONE_Q30 1073741824.0
+#define TEST_RANDOM 1000000
+
+static const double test_acc_lsb_per_g[4] = {16384.0, 8192.0, 4096.0, 2048.0};
+static const double test_gyr_lsb_per_dps[4] = {131.0, 65.5, 32.8, 16.4};
+
+static uint64_t test_seed = 1;
+
+static uint64_t test_rand(void) // xorshift64
+{
+  test_seed ^= test_seed << 13;
+  test_seed ^= test_seed >> 7;
+  test_seed ^= test_seed << 17;
+  return test_seed;
+}
+
+// The float path, with room for its own roundings (the factor, the product and the scaling to mdps etc.), 2^-24 each
+static bool test_near_float(double fixed, float ref, double bound)
+{
+  return fabs(fixed - (double)ref) <= bound + (fabs((double)ref) * 4e-7);
+}
+
+static void test_sweep(void)
+{
+  uint32_t bad_acc = 0, bad_gyr = 0, bad_mag = 0, bad_tmp = 0, bad_agmt = 0;
+  double worst_gyr = 0.0, worst_tmp = 0.0;
+
+  for (uint8_t fs = 0; fs < 4; fs++)
+  {
+    ICM_20948_fss_t fss;
+    fss.a = fs;
+    fss.g = fs;
+    ICM_20948_Scale_t scale;
+    ICM_20948_scale_init(&scale, fss);
+
+    for (int32_t r = -32768; r <= 32767; r++)
+    {
+      int16_t raw = (int16_t)r;
+      ICM_20948_AGMT_t agmt;
+      memset(&agmt, 0, sizeof(agmt));
+      agmt.acc.axes.x = agmt.acc.axes.y = agmt.acc.axes.z = raw;
+      agmt.gyr.axes.x = agmt.gyr.axes.y = agmt.gyr.axes.z = raw;
+      agmt.mag.axes.x = agmt.mag.axes.y = agmt.mag.axes.z = raw;
+      agmt.tmp.val = raw;
+      agmt.fss = fss;
+      ICM_20948_AGMT_Scaled_t scaled;
+      ICM_20948_scale_agmt(&scale, &agmt, &scaled);
+
+      // acc: exact, in Q16 mg
+      int32_t acc = ICM_20948_fixed_acc_mg_q16(raw, fs);
+      double acc_mg = (double)acc / 65536.0;
+      if ((acc_mg != (r * 1000.0 / test_acc_lsb_per_g[fs])) || !test_near_float(acc_mg, scaled.acc.x, 0.0))
+        bad_acc++;
+
+      // gyr: 0.75 mdps
+      int32_t gyr = ICM_20948_fixed_gyr_mdps(raw, fs);
+      double gyr_err = fabs(gyr - (r * 1000.0 / test_gyr_lsb_per_dps[fs]));
+      if (gyr_err > worst_gyr)
+        worst_gyr = gyr_err;
+      if ((gyr_err > 0.75) || !test_near_float(gyr, scaled.gyr.x * 1000.0f, 0.75))
+        bad_gyr++;
+
+      if (fs == 0) // mag and tmp do not depend on the full scale
+      {
+        // mag: exact, in nT
+        int32_t mag = ICM_20948_fixed_mag_nt(raw);
+        if ((mag != r * 150) || !test_near_float(mag, scaled.mag.x * 1000.0f, 0.0))
+          bad_mag++;
+
+        // tmp: 0.75 centi-degC
+        int32_t tmp = ICM_20948_fixed_tmp_cdegc(raw);
+        double tmp_err = fabs(tmp - ((((r - 21) / 333.87) + 21.0) * 100.0));
+        if (tmp_err > worst_tmp)
+          worst_tmp = tmp_err;
+        if ((tmp_err > 0.75) || !test_near_float(tmp, scaled.tmp * 100.0f, 0.75))
+          bad_tmp++;
+      }
+
+      // ICM_20948_fixed_agmt is the same conversions, using agmt->fss
+      ICM_20948_AGMT_Fixed_t fixed;
+      ICM_20948_fixed_agmt(&agmt, &fixed);
+      if ((fixed.acc.x != acc) || (fixed.acc.z != acc) || (fixed.gyr.y != gyr) || (fixed.mag.z != ICM_20948_fixed_mag_nt(raw)) ||
+          (fixed.tmp != ICM_20948_fixed_tmp_cdegc(raw)))
+        bad_agmt++;
+    }
+  }
+
+  printf("worst error: gyr %.3f mdps, tmp %.3f centi-degC\n", worst_gyr, worst_tmp);
+  TEST_CHECK(bad_acc == 0);
+  TEST_CHECK(bad_gyr == 0);
+  TEST_CHECK(bad_mag == 0);
+  TEST_CHECK(bad_tmp == 0);
+  TEST_CHECK(bad_agmt == 0);
+
+  // The extremes
+  TEST_CHECK(ICM_20948_fixed_acc_mg_q16(-32768, 3) == -32768 * 32000);
+  TEST_CHECK(ICM_20948_fixed_acc_mg_q16(32767, 3) == 32767 * 32000);
+  TEST_CHECK(ICM_20948_fixed_acc_mg_q16(1, 0xFF) == 32000); // Only the two FS_SEL bits count
+}
+
+// Round to nearest: (r - 0.5)^2 <= x < (r + 0.5)^2, i.e. r^2 - r < x <= r^2 + r (x is an integer). 2^32 does not fit: clamped
+static bool test_sqrt_ok(uint64_t x)
+{
+  uint64_t r = ICM_20948_fixed_sqrt(x);
+  if ((r != 0) && (x <= (r * r) - r))
+    return false;
+  if (r == 0xFFFFFFFF)
+    return true;
+  return x <= (r * r) + r;
+}
+
+static void test_sqrt(void)
+{
+  uint32_t bad = 0;
+
+  TEST_CHECK(ICM_20948_fixed_sqrt(0) == 0);
+  TEST_CHECK(ICM_20948_fixed_sqrt(1) == 1);
+  TEST_CHECK(ICM_20948_fixed_sqrt(2) == 1);
+  TEST_CHECK(ICM_20948_fixed_sqrt(3) == 2);
+  TEST_CHECK(ICM_20948_fixed_sqrt(((uint64_t)1) << 60) == (((uint32_t)1) << 30));
+  TEST_CHECK(ICM_20948_fixed_sqrt(0xFFFFFFFE00000001ULL) == 0xFFFFFFFF); // (2^32 - 1)^2
+  TEST_CHECK(ICM_20948_fixed_sqrt(0xFFFFFFFFFFFFFFFFULL) == 0xFFFFFFFF);
+
+  for (uint64_t x = 0; x < (1 << 20); x++) // Every small value
+    if (!test_sqrt_ok(x))
+      bad++;
+
+  for (uint64_t n = 1; n < 0xFFFFFFFF; n = (n * 3) + 1) // Either side of the squares and the rounding points
+  {
+    uint64_t sq = n * n;
+    if (!test_sqrt_ok(sq - 1) || !test_sqrt_ok(sq) || !test_sqrt_ok(sq + 1) || !test_sqrt_ok(sq + n) || !test_sqrt_ok(sq + n + 1))
+      bad++;
+    if ((ICM_20948_fixed_sqrt(sq) != n) || (ICM_20948_fixed_sqrt(sq + n) != n) || (ICM_20948_fixed_sqrt(sq + n + 1) != n + 1))
+      bad++;
+  }
+
+  for (uint32_t i = 0; i < TEST_RANDOM; i++)
+  {
+    uint64_t x = test_rand() >> (test_rand() % 64); // Spread over every magnitude
+    if (!test_sqrt_ok(x))
+      bad++;
+  }
+  TEST_CHECK(bad == 0);
+}
+
+static bool test_q0_ok(int32_t q1, int32_t q2, int32_t q3)
+{
+  double s = ((double)q1 * q1) + ((double)q2 * q2) + ((double)q3 * q3);
+  double exact = (s >= TEST_ONE_Q30 * TEST_ONE_Q30) ? 0.0 : sqrt((TEST_ONE_Q30 * TEST_ONE_Q30) - s);
+  return fabs(ICM_20948_fixed_quat_q0(q1, q2, q3) - exact) <= 1.0;
+}
+
+static void test_quat_q0(void)
+{
+  uint32_t bad = 0;
+  const int32_t one = 1 << 30;
+
+  TEST_CHECK(ICM_20948_fixed_quat_q0(0, 0, 0) == one);
+  TEST_CHECK(ICM_20948_fixed_quat_q0(one, 0, 0) == 0);
+  TEST_CHECK(ICM_20948_fixed_quat_q0(0, -one, 0) == 0);
+  TEST_CHECK(ICM_20948_fixed_quat_q0(0, 0, one - 1) > 0); // Just inside
+  TEST_CHECK(ICM_20948_fixed_quat_q0(one / 2, one / 2, one / 2) == one / 2);
+  TEST_CHECK(ICM_20948_fixed_quat_q0(one, one, one) == 0);                      // Overshoot
+  TEST_CHECK(ICM_20948_fixed_quat_q0(INT32_MIN, INT32_MIN, INT32_MIN) == 0);    // The largest sum of squares
+  TEST_CHECK(ICM_20948_fixed_quat_q0(INT32_MAX, INT32_MAX, INT32_MAX) == 0);
+  TEST_CHECK(ICM_20948_fixed_quat_q0(-one / 2, one / 2, -one / 2) == one / 2); // The sign does not matter
+
+  // Rounding noise: the DMP's Q1-Q3 of a unit quaternion can sum to just over 1
+  TEST_CHECK(ICM_20948_fixed_quat_q0(one - 1, 46341, 0) == 0);
+
+  for (uint32_t i = 0; i < TEST_RANDOM; i++)
+  {
+    // A random unit quaternion, of which the DMP sends Q1-Q3
+    double v[4], n = 0.0;
+    for (int k = 0; k < 4; k++)
+      v[k] = ((double)(test_rand() >> 11) / 9007199254740992.0) - 0.5;
+    if ((i % 4) == 0)
+      v[0] = 0.0; // q0 = 0: the vector part alone has unit length, so rounding can overshoot
+    for (int k = 0; k < 4; k++)
+      n += v[k] * v[k];
+    if (n == 0.0)
+      continue;
+    double scale = TEST_ONE_Q30 / sqrt(n);
+    int32_t q1 = (int32_t)lround(v[1] * scale);
+    int32_t q2 = (int32_t)lround(v[2] * scale);
+    int32_t q3 = (int32_t)lround(v[3] * scale);
+    if (!test_q0_ok(q1, q2, q3))
+      bad++;
+  }
+  TEST_CHECK(bad == 0);
+}
+
+int main(void)
+{
+  test_sweep();
+  test_sqrt();
+  test_quat_q0();
+  return test_result();
+}
@@ -0,0 +1,379 @@
+/*
+
+DMP FIFO parser fuzz test (inv_icm20948_read_dmp_frame, ICM_20948_frame_drain)
+
+Fills the simulator's FIFO with random bytes, valid packets and valid packets with random damage, and runs both
+parsers over it. For every call it checks that:
+  - the bus work is bounded: a fixed number of reads, and never more than one packet's worth of FIFO data
+  - nothing is written outside the packet buffer (icm_20948_DMP_Maximum_Packet_Bytes), the drain buffer or the
+    icm_20948_DMP_data_t that inv_icm20948_decode_dmp_packet fills: each is fenced with guard bytes
+  - every frame returned fits the headers and the buffer
+  - resync is bounded: a bad header empties the FIFO, and the parser gets through any FIFO in a bounded number
+    of calls
+Then it checks that disabling an output while its packets are still queued does not throw them away (or the
+packets behind them): they are valid until the FIFO is reset.
+
+  icm20948_frame_fuzz_test [rounds] [seed]
+
+*/
+
+#include "test_common.h"
+#include "ICM_20948_Frame.h"
+
+#include <stdlib.h>
+
+#define TEST_ROUNDS 2000
+#define TEST_GUARD 32
+#define TEST_GUARD_BYTE 0xCD
+#define TEST_DRAIN_MAX 1024
+// One packet: the count, the header, header2 and the rest each after up to ICM_20948_FIFO_POLLS count polls, the
+// bursts, and the read-modify-write of FIFO_RST for a resync
+#define TEST_MAX_READS_PER_FRAME (4 + (2 * (ICM_20948_FIFO_POLLS + 1)) + ((icm_20948_DMP_Maximum_Packet_Bytes + ICM_20948_FIFO_MAX_BURST - 1) / ICM_20948_FIFO_MAX_BURST))
+
+static ICM_20948_Device_t dev;
+static ICM_20948_Sim_t sim;
+static ICM_20948_Serif_t serif;
+static uint32_t test_seed = 1;
+
+static uint32_t fifo_bytes; // FIFO bytes read through the serif
+static uint32_t bus_reads;  // Serif reads
+static uint32_t fifo_resets;
+static uint32_t resyncs; // FIFO resets by the parsers
+
+static uint32_t test_rand(void) // xorshift32
+{
+  test_seed ^= test_seed << 13;
+  test_seed ^= test_seed >> 17;
+  test_seed ^= test_seed << 5;
+  return test_seed;
+}
+
+static ICM_20948_Status_e test_read(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user)
+{
+  bus_reads++;
+  if ((sim.bank == 0) && (regaddr == AGB0_REG_FIFO_R_W))
+    fifo_bytes += len;
+  return ICM_20948_sim_read(regaddr, pdata, len, user);
+}
+
+static ICM_20948_Status_e test_write(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user)
+{
+  if ((sim.bank == 0) && (regaddr == AGB0_REG_FIFO_RST) && ((pdata[0] & 0x1F) == 0x1F))
+    fifo_resets++;
+  return ICM_20948_sim_write(regaddr, pdata, len, user);
+}
+
+static void test_fence(uint8_t *area, uint32_t inside)
+{
+  memset(area, TEST_GUARD_BYTE, TEST_GUARD);
+  memset(&area[TEST_GUARD + inside], TEST_GUARD_BYTE, TEST_GUARD);
+}
+
+static bool test_fence_ok(const uint8_t *area, uint32_t inside)
+{
+  for (uint32_t i = 0; i < TEST_GUARD; i++)
+  {
+    if ((area[i] != TEST_GUARD_BYTE) || (area[TEST_GUARD + inside + i] != TEST_GUARD_BYTE))
+      return false;
+  }
+  return true;
+}
+
+// One packet with the given outputs and random payload. Returns its size
+static uint16_t test_packet(uint8_t *pkt, uint16_t header, uint16_t header2)
+{
+  if (header2 != 0)
+    header |= DMP_header_bitmap_Header2;
+  uint16_t size = inv_icm20948_dmp_packet_size(header, header2, NULL);
+  pkt[0] = (uint8_t)(header >> 8);
+  pkt[1] = (uint8_t)(header & 0xFF);
+  uint16_t i = icm_20948_DMP_Header_Bytes;
+  if (header2 != 0)
+  {
+    pkt[i++] = (uint8_t)(header2 >> 8);
+    pkt[i++] = (uint8_t)(header2 & 0xFF);
+  }
+  for (; i < size; i++)
+    pkt[i] = (uint8_t)test_rand();
+  return size;
+}
+
+// A random DATA_OUT_CTL1 and a FIFO to match: packets with those outputs, some damaged, some plain noise
+static uint32_t test_fill(uint16_t *ctl1)
+{
+  static const uint16_t outputs[] = {DMP_header_bitmap_Accel, DMP_header_bitmap_Gyro, DMP_header_bitmap_Compass, DMP_header_bitmap_Quat6,
+                                     DMP_header_bitmap_Quat9, DMP_header_bitmap_PQuat6, DMP_header_bitmap_Geomag, DMP_header_bitmap_Compass_Calibr};
+  static const uint16_t outputs2[] = {DMP_header2_bitmap_Accel_Accuracy, DMP_header2_bitmap_Gyro_Accuracy, DMP_header2_bitmap_Compass_Accuracy,
+                                      DMP_header2_bitmap_Activity_Recog, DMP_header2_bitmap_Pickup, DMP_header2_bitmap_Secondary_On_Off};
+  uint8_t stream[ICM_20948_SIM_FIFO_SIZE];
+  uint32_t len = 0;
+
+  *ctl1 = 0;
+  if ((test_rand() % 4) != 0) // Otherwise nothing is known about the outputs and only the header2 check applies
+  {
+    for (uint32_t i = 0; i < sizeof(outputs) / sizeof(outputs[0]); i++)
+      if (test_rand() & 1)
+        *ctl1 |= outputs[i];
+    if (*ctl1 == 0)
+      *ctl1 = DMP_header_bitmap_Quat6;
+  }
+
+  uint32_t target = test_rand() % (ICM_20948_SIM_FIFO_SIZE - icm_20948_DMP_Maximum_Packet_Bytes);
+  while (len < target)
+  {
+    uint32_t kind = test_rand() % 8;
+    if (kind == 0) // Noise
+    {
+      uint32_t n = 1 + (test_rand() % 40);
+      for (uint32_t i = 0; (i < n) && (len < target); i++)
+        stream[len++] = (uint8_t)test_rand();
+      continue;
+    }
+    uint16_t header = (*ctl1 != 0) ? *ctl1 : (uint16_t)(test_rand() & ~(DMP_header_bitmap_Header2 | icm_20948_DMP_Header_Step_Indicator));
+    uint16_t header2 = 0;
+    if ((test_rand() % 3) == 0)
+      header2 = outputs2[test_rand() % (sizeof(outputs2) / sizeof(outputs2[0]))];
+    if ((test_rand() % 5) == 0)
+      header |= DMP_header_bitmap_Step_Detector;
+    if ((header == 0) && (header2 == 0))
+      header = DMP_header_bitmap_Quat6;
+    uint16_t size = test_packet(&stream[len], header, header2);
+    if (kind == 1) // Damaged: one random byte anywhere in it, headers included
+      stream[len + (test_rand() % size)] = (uint8_t)test_rand();
+    if (kind == 2) // Cut short
+      size = (uint16_t)(test_rand() % size);
+    len += size;
+  }
+  ICM_20948_reset_FIFO(&dev);
+  dev._dataOutCtl1 = *ctl1;
+  dev._dataOutCtl1_fifo = *ctl1;
+  return ICM_20948_sim_fifo_push(&sim, stream, len);
+}
+
+static void test_read_frames(void)
+{
+  uint8_t packet[TEST_GUARD + icm_20948_DMP_Maximum_Packet_Bytes + TEST_GUARD];
+  uint8_t data[TEST_GUARD + sizeof(icm_20948_DMP_data_t) + TEST_GUARD];
+  uint16_t ctl1;
+  uint32_t queued = test_fill(&ctl1);
+
+  uint32_t calls = 0;
+  for (;;)
+  {
+    uint16_t before = sim.fifo_count;
+    uint32_t reads = bus_reads;
+    uint32_t bytes = fifo_bytes;
+    uint32_t resets = fifo_resets;
+    uint16_t len = 0xFFFF;
+    test_fence(packet, icm_20948_DMP_Maximum_Packet_Bytes);
+    ICM_20948_Status_e result = inv_icm20948_read_dmp_frame(&dev, &packet[TEST_GUARD], icm_20948_DMP_Maximum_Packet_Bytes, &len);
+    calls++;
+
+    TEST_CHECK(bus_reads - reads <= TEST_MAX_READS_PER_FRAME);
+    TEST_CHECK(fifo_bytes - bytes <= icm_20948_DMP_Maximum_Packet_Bytes);
+    TEST_CHECK(test_fence_ok(packet, icm_20948_DMP_Maximum_Packet_Bytes));
+    TEST_CHECK(fifo_resets - resets <= 1);
+    resyncs += fifo_resets - resets;
+    if (fifo_resets != resets)
+      TEST_CHECK(sim.fifo_count == 0); // A resync throws the rest away: nothing can be trusted after a bad header
+    else if (result != ICM_20948_Stat_FIFONoDataAvail)
+      TEST_CHECK(sim.fifo_count == before - (fifo_bytes - bytes)); // Otherwise exactly what was read is gone
+
+    if ((result == ICM_20948_Stat_Ok) || (result == ICM_20948_Stat_FIFOMoreDataAvail))
+    {
+      TEST_CHECK((len >= icm_20948_DMP_Header_Bytes + icm_20948_DMP_Footer_Bytes) && (len <= icm_20948_DMP_Maximum_Packet_Bytes));
+      TEST_CHECK(len == fifo_bytes - bytes);
+      TEST_CHECK(ICM_20948_frame_size(&packet[TEST_GUARD]) == len);
+      TEST_CHECK(ICM_20948_frame_valid(&packet[TEST_GUARD], len));
+      TEST_CHECK(inv_icm20948_check_dmp_header(ctl1, ICM_20948_frame_header(&packet[TEST_GUARD])) == ICM_20948_Stat_Ok);
+      test_fence(data, sizeof(icm_20948_DMP_data_t));
+      TEST_CHECK(inv_icm20948_decode_dmp_packet(&packet[TEST_GUARD], len, (icm_20948_DMP_data_t *)&data[TEST_GUARD]) == ICM_20948_Stat_Ok);
+      TEST_CHECK(test_fence_ok(data, sizeof(icm_20948_DMP_data_t)));
+    }
+    else if (result == ICM_20948_Stat_FIFONoDataAvail)
+    {
+      TEST_CHECK(sim.fifo_count < icm_20948_DMP_Header_Bytes);
+      break;
+    }
+    else
+    {
+      TEST_CHECK((result == ICM_20948_Stat_UnrecognisedDMPHeader) || (result == ICM_20948_Stat_UnrecognisedDMPHeader2) ||
+                 (result == ICM_20948_Stat_FIFOIncompleteData));
+    }
+    if (calls > (queued / icm_20948_DMP_Header_Bytes) + 2) // Every call takes at least a header
+    {
+      TEST_CHECK(false);
+      break;
+    }
+  }
+}
+
+static void test_drain_frames(void)
+{
+  static uint8_t buf[TEST_GUARD + TEST_DRAIN_MAX + TEST_GUARD];
+  uint16_t ctl1;
+  uint32_t queued = test_fill(&ctl1);
+  uint16_t cap = (uint16_t)(icm_20948_DMP_Maximum_Packet_Bytes + (test_rand() % (TEST_DRAIN_MAX - icm_20948_DMP_Maximum_Packet_Bytes + 1)));
+
+  ICM_20948_Frame_Drain_t drain;
+  ICM_20948_frame_drain_init(&drain, &buf[TEST_GUARD], cap);
+  test_fence(buf, cap);
+
+  uint32_t drains = 0;
+  for (;;)
+  {
+    uint32_t reads = bus_reads;
+    uint32_t bytes = fifo_bytes;
+    uint32_t resets = fifo_resets;
+    uint16_t kept = drain.len - drain.pos;
+    bool resync = drain.resync;
+    ICM_20948_Status_e result = ICM_20948_frame_drain(&dev, &drain);
+    drains++;
+
+    TEST_CHECK(bus_reads - reads <= 4u + (((uint32_t)cap + ICM_20948_FIFO_MAX_BURST - 1) / ICM_20948_FIFO_MAX_BURST));
+    TEST_CHECK(fifo_resets - resets == (resync ? 1 : 0));
+    resyncs += fifo_resets - resets;
+    TEST_CHECK(drain.len <= cap);
+    TEST_CHECK(drain.len == (resync ? 0 : kept) + (fifo_bytes - bytes));
+    TEST_CHECK(test_fence_ok(buf, cap));
+    if (result == ICM_20948_Stat_FIFONoDataAvail)
+    {
+      TEST_CHECK(sim.fifo_count == 0);
+      break;
+    }
+    TEST_CHECK(result == ICM_20948_Stat_Ok);
+
+    ICM_20948_Frame_View_t view;
+    while ((result = ICM_20948_frame_drain_next(&drain, &view)) == ICM_20948_Stat_Ok)
+    {
+      TEST_CHECK((view.frame >= &buf[TEST_GUARD]) && (view.frame + view.size <= &buf[TEST_GUARD + cap]));
+      TEST_CHECK((view.size <= icm_20948_DMP_Maximum_Packet_Bytes) && (view.size == ICM_20948_frame_size(view.frame)));
+      TEST_CHECK(ICM_20948_frame_valid(view.frame, view.size));
+      TEST_CHECK(view.header == ICM_20948_frame_header(view.frame));
+      TEST_CHECK(inv_icm20948_check_dmp_header(ctl1, view.header) == ICM_20948_Stat_Ok);
+    }
+    if (result != ICM_20948_Stat_FIFONoDataAvail)
+    {
+      TEST_CHECK(drain.resync && (drain.len == 0)); // Bad data: drop the buffer, reset the FIFO at the next drain
+    }
+    if (drains > (queued / icm_20948_DMP_Header_Bytes) + 2)
+    {
+      TEST_CHECK(false);
+      break;
+    }
+  }
+}
+
+// The activity output decodes the same through the struct and the frame accessor, and frame_valid wants the exact size
+static void test_activity(void)
+{
+  uint8_t pkt[icm_20948_DMP_Maximum_Packet_Bytes];
+  uint16_t size = test_packet(pkt, DMP_header_bitmap_Quat6, DMP_header2_bitmap_Activity_Recog);
+  const uint8_t *p = ICM_20948_frame_field(pkt, 0, DMP_header2_bitmap_Activity_Recog);
+  TEST_CHECK(p != NULL);
+  if (p == NULL)
+    return;
+  const uint8_t activity[6] = {0x02, 0x20, 0x12, 0x34, 0x56, 0x78}; // Walk to Still at 0x12345678
+  memcpy((uint8_t *)p, activity, sizeof(activity));
+
+  icm_20948_DMP_data_t data;
+  memset(&data, 0xFF, sizeof(data));
+  TEST_CHECK(inv_icm20948_decode_dmp_packet(pkt, size, &data) == ICM_20948_Stat_Ok);
+  TEST_CHECK(data.Activity_Recognition.Data.Timestamp == 0x12345678);
+  TEST_CHECK(data.Activity_Recognition.Data.State_Start.Walk && !data.Activity_Recognition.Data.State_Start.Still);
+  TEST_CHECK(data.Activity_Recognition.Data.State_End.Still && !data.Activity_Recognition.Data.State_End.Walk);
+
+  icm_20948_DMP_Activity_t start, end;
+  uint32_t timestamp = 0;
+  TEST_CHECK(ICM_20948_frame_activity(pkt, &start, &end, &timestamp));
+  TEST_CHECK((timestamp == 0x12345678) && start.Walk && end.Still);
+
+  TEST_CHECK(ICM_20948_frame_valid(pkt, size));
+  TEST_CHECK(!ICM_20948_frame_valid(pkt, size - 1));
+  TEST_CHECK(!ICM_20948_frame_valid(pkt, size + 1));
+  TEST_CHECK(!ICM_20948_frame_valid(pkt, 3)); // The header2 is not all there
+}
+
+// Disabling an output while its packets are queued: they are still read, and so is everything behind them
+static void test_disable_with_packets_queued(void)
+{
+  uint8_t stream[512];
+  uint32_t len = 0;
+  uint8_t packet[icm_20948_DMP_Maximum_Packet_Bytes];
+  uint16_t size;
+
+  TEST_CHECK(inv_icm20948_enable_dmp_sensor(&dev, INV_ICM20948_SENSOR_GAME_ROTATION_VECTOR, 1) == ICM_20948_Stat_Ok);
+  TEST_CHECK(inv_icm20948_enable_dmp_sensor(&dev, INV_ICM20948_SENSOR_RAW_ACCELEROMETER, 1) == ICM_20948_Stat_Ok);
+  TEST_CHECK(ICM_20948_reset_FIFO(&dev) == ICM_20948_Stat_Ok);
+  uint16_t quat6 = inv_icm20948_sensor_to_control_bits(INV_ICM20948_SENSOR_GAME_ROTATION_VECTOR); // Quat6 (and header2 for the accuracy)
+  uint16_t accel = inv_icm20948_sensor_to_control_bits(INV_ICM20948_SENSOR_RAW_ACCELEROMETER);
+  TEST_CHECK(dev._dataOutCtl1 == (quat6 | accel));
+
+  for (uint32_t i = 0; i < 4; i++)
+    len += test_packet(&stream[len], DMP_header_bitmap_Quat6 | DMP_header_bitmap_Accel, 0);
+  for (uint32_t i = 0; i < 4; i++)
+    len += test_packet(&stream[len], DMP_header_bitmap_Quat6, 0);
+
+  TEST_CHECK(inv_icm20948_enable_dmp_sensor(&dev, INV_ICM20948_SENSOR_RAW_ACCELEROMETER, 0) == ICM_20948_Stat_Ok);
+  TEST_CHECK(dev._dataOutCtl1 == quat6);
+  TEST_CHECK(dev._dataOutCtl1_fifo == (quat6 | accel));
+
+  // One frame at a time
+  ICM_20948_sim_fifo_push(&sim, stream, len);
+  uint32_t resets = fifo_resets;
+  uint32_t frames = 0;
+  ICM_20948_Status_e result;
+  while (((result = inv_icm20948_read_dmp_frame(&dev, packet, sizeof(packet), &size)) == ICM_20948_Stat_Ok) || (result == ICM_20948_Stat_FIFOMoreDataAvail))
+  {
+    TEST_CHECK(ICM_20948_frame_header(packet) == ((frames < 4) ? (DMP_header_bitmap_Quat6 | DMP_header_bitmap_Accel) : DMP_header_bitmap_Quat6));
+    frames++;
+  }
+  TEST_CHECK((result == ICM_20948_Stat_FIFONoDataAvail) && (frames == 8) && (fifo_resets == resets));
+
+  // Drained
+  uint8_t buf[512];
+  ICM_20948_Frame_Drain_t drain;
+  ICM_20948_Frame_View_t view;
+  ICM_20948_frame_drain_init(&drain, buf, sizeof(buf));
+  ICM_20948_sim_fifo_push(&sim, stream, len);
+  TEST_CHECK(ICM_20948_frame_drain(&dev, &drain) == ICM_20948_Stat_Ok);
+  frames = 0;
+  while ((result = ICM_20948_frame_drain_next(&drain, &view)) == ICM_20948_Stat_Ok)
+    frames++;
+  TEST_CHECK((result == ICM_20948_Stat_FIFONoDataAvail) && (frames == 8) && !drain.resync);
+
+  // Once the FIFO has been reset the disabled output cannot be in it, so a header with it is corrupt again
+  TEST_CHECK(ICM_20948_reset_FIFO(&dev) == ICM_20948_Stat_Ok);
+  TEST_CHECK(dev._dataOutCtl1_fifo == quat6);
+  ICM_20948_sim_fifo_push(&sim, stream, len);
+  resets = fifo_resets;
+  TEST_CHECK(inv_icm20948_read_dmp_frame(&dev, packet, sizeof(packet), &size) == ICM_20948_Stat_UnrecognisedDMPHeader);
+  TEST_CHECK((fifo_resets == resets + 1) && (sim.fifo_count == 0));
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t rounds = TEST_ROUNDS;
+  if (argc > 1)
+    rounds = (uint32_t)strtoul(argv[1], NULL, 0);
+  if (argc > 2)
+    test_seed = (uint32_t)strtoul(argv[2], NULL, 0) | 1;
+  printf("%u rounds, seed %u\n", rounds, test_seed);
+
+  test_sim_device(&dev, &sim, &serif);
+  serif.read = test_read;
+  serif.write = test_write;
+  ICM_20948_link_serif(&dev, &serif);
+
+  for (uint32_t r = 0; (r < rounds) && (test_failures == 0); r++)
+  {
+    test_read_frames();
+    test_drain_frames();
+  }
+  printf("%u resyncs\n", resyncs);
+  TEST_CHECK(resyncs > rounds); // The damage must have been found, or the fuzzing is not reaching the resync
+  test_activity();
+  test_disable_with_packets_queued();
+
+  return test_result();
+}
@@ -0,0 +1,178 @@
+/*
+
+Fusion test (ICM_20948_Fusion.h)
+
+A synthetic stream: a body turning on three axes at up to 0.6 rad/s, with noisy gyro, accelerometer and
+magnetometer readings made from the true orientation (and, optionally, a gyro bias). Both filters start at the
+identity, some 70 degrees from the truth, and run side by side. After 30 s they must have converged: the orientation
+(9-axis) or the tilt (6-axis, where yaw is free to drift) must be close to the truth, the integral gain must take out
+the bias, and the Q30 filter must track the float filter to within 0.1 degrees and stay a unit quaternion.
+
+*/
+
+#include "test_common.h"
+#include "ICM_20948_Fusion.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#define TEST_RATE 100    // Hz
+#define TEST_SECONDS 120 // Of stream
+#define TEST_SETTLE 30   // Seconds before the errors count
+#define TEST_Q30 1073741824.0
+
+typedef struct
+{
+  double w, x, y, z;
+} Test_Quat_t;
+
+typedef struct
+{
+  double err_float; // The worst error against the truth after TEST_SETTLE, degrees
+  double err_q30;
+  double float_vs_q30; // The worst difference between the two filters, degrees
+  double norm_q30;     // The worst | |q|^2 - 1 | of the Q30 filter
+} Test_Result_t;
+
+static Test_Quat_t test_mul(Test_Quat_t a, Test_Quat_t b)
+{
+  Test_Quat_t r = {(a.w * b.w) - (a.x * b.x) - (a.y * b.y) - (a.z * b.z),
+                   (a.w * b.x) + (a.x * b.w) + (a.y * b.z) - (a.z * b.y),
+                   (a.w * b.y) - (a.x * b.z) + (a.y * b.w) + (a.z * b.x),
+                   (a.w * b.z) + (a.x * b.y) - (a.y * b.x) + (a.z * b.w)};
+  return r;
+}
+
+// A world-frame vector in the sensor frame
+static void test_to_sensor(Test_Quat_t q, const double v[3], double out[3])
+{
+  double w = q.w, x = q.x, y = q.y, z = q.z;
+  double m[3][3] = {{1 - 2 * ((y * y) + (z * z)), 2 * ((x * y) - (w * z)), 2 * ((x * z) + (w * y))},
+                    {2 * ((x * y) + (w * z)), 1 - 2 * ((x * x) + (z * z)), 2 * ((y * z) - (w * x))},
+                    {2 * ((x * z) - (w * y)), 2 * ((y * z) + (w * x)), 1 - 2 * ((x * x) + (y * y))}};
+  for (uint32_t i = 0; i < 3; i++)
+    out[i] = (m[0][i] * v[0]) + (m[1][i] * v[1]) + (m[2][i] * v[2]);
+}
+
+static double test_noise(void)
+{
+  double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+  double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+  return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+// The angle between two orientations, degrees
+static double test_angle(Test_Quat_t a, Test_Quat_t b)
+{
+  double d = fabs((a.w * b.w) + (a.x * b.x) + (a.y * b.y) + (a.z * b.z));
+  return 2.0 * acos((d > 1.0) ? 1.0 : d) * 180.0 / M_PI;
+}
+
+// The angle between the directions of gravity in the sensor frame, degrees
+static double test_tilt(Test_Quat_t a, Test_Quat_t b)
+{
+  const double up[3] = {0, 0, 1};
+  double ga[3], gb[3];
+  test_to_sensor(a, up, ga);
+  test_to_sensor(b, up, gb);
+  double d = (ga[0] * gb[0]) + (ga[1] * gb[1]) + (ga[2] * gb[2]);
+  return acos((d > 1.0) ? 1.0 : d) * 180.0 / M_PI;
+}
+
+static Test_Result_t test_run(bool use_mag, float ki, double bias_dps)
+{
+  const double dt = 1.0 / TEST_RATE;
+  const double up[3] = {0, 0, 1};
+  const double field[3] = {20, 0, -40}; // uT: north and down
+  Test_Quat_t truth = {0.8, 0.3, -0.2, 0.4};
+  double n = sqrt((truth.w * truth.w) + (truth.x * truth.x) + (truth.y * truth.y) + (truth.z * truth.z));
+  truth.w /= n;
+  truth.x /= n;
+  truth.y /= n;
+  truth.z /= n;
+
+  ICM_20948_Fusion_t ff;
+  ICM_20948_Fusion_Q30_t fq;
+  ICM_20948_fusion_init(&ff, TEST_RATE, ICM_20948_FUSION_KP, ki);
+  ICM_20948_fusion_q30_init(&fq, TEST_RATE, ICM_20948_FUSION_KP_Q16, (int32_t)lround(ki * 65536.0));
+
+  Test_Result_t result = {0, 0, 0, 0};
+  srand(5);
+  for (uint32_t i = 0; i < TEST_SECONDS * TEST_RATE; i++)
+  {
+    double t = i * dt;
+    double w[3] = {0.5 * sin(0.7 * t), 0.4 * cos(0.3 * t), 0.6 * sin((0.2 * t) + 1.0)}; // rad/s in the sensor frame
+
+    ICM_20948_AGMT_t s;
+    memset(&s, 0, sizeof(s));
+    s.fss.a = 0; // +/- 2g: 16384 LSB/g
+    s.fss.g = 2; // +/- 1000dps: 32.8 LSB/dps
+    double a[3], m[3];
+    test_to_sensor(truth, up, a);
+    test_to_sensor(truth, field, m);
+    s.gyr.axes.x = (int16_t)lround(((w[0] * 180.0 / M_PI) + bias_dps + (0.05 * test_noise())) * 32.8);
+    s.gyr.axes.y = (int16_t)lround(((w[1] * 180.0 / M_PI) + bias_dps + (0.05 * test_noise())) * 32.8);
+    s.gyr.axes.z = (int16_t)lround(((w[2] * 180.0 / M_PI) + bias_dps + (0.05 * test_noise())) * 32.8);
+    s.acc.axes.x = (int16_t)lround((a[0] * 16384.0) + (30.0 * test_noise()));
+    s.acc.axes.y = (int16_t)lround((a[1] * 16384.0) + (30.0 * test_noise()));
+    s.acc.axes.z = (int16_t)lround((a[2] * 16384.0) + (30.0 * test_noise()));
+    s.mag.axes.x = (int16_t)lround((m[0] / 0.15) + (2.0 * test_noise())); // The AK09916 y and z axes point the other way
+    s.mag.axes.y = (int16_t)lround((-m[1] / 0.15) + (2.0 * test_noise()));
+    s.mag.axes.z = (int16_t)lround((-m[2] / 0.15) + (2.0 * test_noise()));
+
+    ICM_20948_fusion_update(&ff, &s, use_mag);
+    ICM_20948_fusion_q30_update(&fq, &s, use_mag);
+
+    // Turn the truth by w for one update
+    double theta = sqrt((w[0] * w[0]) + (w[1] * w[1]) + (w[2] * w[2])) * dt;
+    if (theta > 0)
+    {
+      double k = sin(theta / 2.0) * dt / theta;
+      Test_Quat_t dq = {cos(theta / 2.0), w[0] * k, w[1] * k, w[2] * k};
+      truth = test_mul(truth, dq);
+    }
+
+    if (t >= TEST_SETTLE)
+    {
+      Test_Quat_t qf = {ff.q.w, ff.q.x, ff.q.y, ff.q.z};
+      Test_Quat_t qq = {fq.q.w / TEST_Q30, fq.q.x / TEST_Q30, fq.q.y / TEST_Q30, fq.q.z / TEST_Q30};
+      result.err_float = fmax(result.err_float, use_mag ? test_angle(truth, qf) : test_tilt(truth, qf));
+      result.err_q30 = fmax(result.err_q30, use_mag ? test_angle(truth, qq) : test_tilt(truth, qq));
+      result.float_vs_q30 = fmax(result.float_vs_q30, test_angle(qf, qq));
+      double norm = (qq.w * qq.w) + (qq.x * qq.x) + (qq.y * qq.y) + (qq.z * qq.z);
+      result.norm_q30 = fmax(result.norm_q30, fabs(norm - 1.0));
+    }
+  }
+  printf("%d-axis, ki %.2f, gyro bias %.1f dps: float %.3f deg, q30 %.3f deg, float vs q30 %.4f deg, |q30|^2 - 1 %.2g\n",
+         use_mag ? 9 : 6, ki, bias_dps, result.err_float, result.err_q30, result.float_vs_q30, result.norm_q30);
+  return result;
+}
+
+static void test_common_bounds(const Test_Result_t *r)
+{
+  TEST_CHECK(r->float_vs_q30 <= 0.1);
+  TEST_CHECK(r->norm_q30 <= 1e-8);
+}
+
+int main(void)
+{
+  // 9-axis: the whole orientation converges
+  Test_Result_t r = test_run(true, ICM_20948_FUSION_KI, 0.0);
+  TEST_CHECK((r.err_float <= 3.0) && (r.err_q30 <= 3.0));
+  test_common_bounds(&r);
+
+  // 6-axis: the tilt converges
+  r = test_run(false, ICM_20948_FUSION_KI, 0.0);
+  TEST_CHECK((r.err_float <= 0.5) && (r.err_q30 <= 0.5));
+  test_common_bounds(&r);
+
+  // A gyro bias: the proportional term alone leaves an error, the integral term takes it out
+  Test_Result_t biased = test_run(true, 0.0f, 1.5);
+  test_common_bounds(&biased);
+  r = test_run(true, 0.5f, 1.5);
+  TEST_CHECK((r.err_float <= 0.5) && (r.err_q30 <= 0.5));
+  TEST_CHECK((r.err_float < biased.err_float / 10.0) && (r.err_q30 < biased.err_q30 / 10.0));
+  test_common_bounds(&r);
+
+  return test_result();
+}
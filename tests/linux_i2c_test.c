@@ -0,0 +1,203 @@
+/*
+
+Linux i2c-dev serif test (ICM_20948_Linux_I2C.h)
+
+open, close and ioctl are wrapped at link time (GNU ld --wrap) with a fake adapter that carries out each I2C_RDWR
+message on the simulator, so the serif runs unchanged without an adapter. Checks the data, the syscall count, a
+failing held-back bank select, and that a failed open never closes a descriptor it did not open.
+
+If ICM_20948_I2C_STUB is set to the path of an i2c-stub adapter (modprobe i2c-stub chip_addr=0x69), the open is also
+tried on it. i2c-stub is SMBus only, so it must be refused with ICM_20948_Stat_NotImpl.
+
+*/
+
+#include "test_common.h"
+#include "ICM_20948_Linux_I2C.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#define FAKE_I2C_PATH "/dev/i2c-fake"     // A plain-I2C adapter with the simulator at ICM_20948_I2C_ADDR_AD1
+#define FAKE_SMBUS_PATH "/dev/i2c-fake-smbus" // An SMBus-only adapter
+#define FAKE_I2C_FD 1000
+#define FAKE_SMBUS_FD 1001
+
+int __real_open(const char *path, int flags, ...);
+int __real_close(int fd);
+int __real_ioctl(int fd, unsigned long request, ...);
+
+static ICM_20948_Sim_t sim;
+static uint32_t fake_closes;   // close calls on the fake descriptors
+static uint32_t fake_close0;   // close(0) calls
+static uint32_t fake_fail;     // Fail this many I2C_RDWR calls from now
+static uint32_t fake_max_msgs; // The most messages in one I2C_RDWR
+
+int __wrap_open(const char *path, int flags, ...)
+{
+  if (strcmp(path, FAKE_I2C_PATH) == 0)
+    return FAKE_I2C_FD;
+  if (strcmp(path, FAKE_SMBUS_PATH) == 0)
+    return FAKE_SMBUS_FD;
+  return __real_open(path, flags);
+}
+
+int __wrap_close(int fd)
+{
+  if (fd == 0)
+  {
+    fake_close0++;
+    return 0; // Keep stdin
+  }
+  if ((fd == FAKE_I2C_FD) || (fd == FAKE_SMBUS_FD))
+  {
+    fake_closes++;
+    return 0;
+  }
+  return __real_close(fd);
+}
+
+static int fake_rdwr(struct i2c_rdwr_ioctl_data *xfer)
+{
+  if (fake_fail > 0)
+  {
+    fake_fail--;
+    errno = EREMOTEIO; // NAK
+    return -1;
+  }
+  if (xfer->nmsgs > fake_max_msgs)
+    fake_max_msgs = xfer->nmsgs;
+  for (uint32_t i = 0; i < xfer->nmsgs; i++)
+  {
+    struct i2c_msg *msg = &xfer->msgs[i];
+    if ((msg->addr != ICM_20948_I2C_ADDR_AD1) || (msg->flags & I2C_M_RD) || (msg->len == 0))
+    {
+      errno = ENXIO;
+      return -1;
+    }
+    if ((i + 1 < xfer->nmsgs) && (xfer->msgs[i + 1].flags & I2C_M_RD)) // Register pointer, repeated start, data
+    {
+      ICM_20948_sim_read(msg->buf[0], xfer->msgs[i + 1].buf, xfer->msgs[i + 1].len, &sim);
+      i++;
+    }
+    else
+    {
+      ICM_20948_sim_write(msg->buf[0], &msg->buf[1], msg->len - 1, &sim);
+    }
+  }
+  return (int)xfer->nmsgs;
+}
+
+int __wrap_ioctl(int fd, unsigned long request, ...)
+{
+  va_list args;
+  va_start(args, request);
+  void *arg = va_arg(args, void *);
+  va_end(args);
+
+  if ((fd != FAKE_I2C_FD) && (fd != FAKE_SMBUS_FD))
+    return __real_ioctl(fd, request, arg);
+
+  if (request == I2C_FUNCS)
+  {
+    *(unsigned long *)arg = (fd == FAKE_I2C_FD) ? (I2C_FUNC_I2C | I2C_FUNC_SMBUS_EMUL) : I2C_FUNC_SMBUS_EMUL;
+    return 0;
+  }
+  if ((request == I2C_RDWR) && (fd == FAKE_I2C_FD))
+    return fake_rdwr((struct i2c_rdwr_ioctl_data *)arg);
+  errno = EINVAL;
+  return -1;
+}
+
+int main(void)
+{
+  ICM_20948_Linux_I2C_t bus;
+  ICM_20948_Serif_t serif;
+  ICM_20948_Device_t dev;
+
+  // Failed opens leave nothing to close
+  TEST_CHECK(ICM_20948_linux_i2c_open(NULL, FAKE_I2C_PATH, ICM_20948_I2C_ADDR_AD1) == ICM_20948_Stat_ParamErr);
+  TEST_CHECK(ICM_20948_linux_i2c_open(&bus, NULL, ICM_20948_I2C_ADDR_AD1) == ICM_20948_Stat_ParamErr);
+  TEST_CHECK(bus.fd == -1);
+  ICM_20948_linux_i2c_close(&bus);
+  TEST_CHECK(ICM_20948_linux_i2c_open(&bus, "/nonexistent/i2c-9", ICM_20948_I2C_ADDR_AD1) == ICM_20948_Stat_Err);
+  TEST_CHECK(bus.fd == -1);
+  ICM_20948_linux_i2c_close(&bus);
+  TEST_CHECK(ICM_20948_linux_i2c_open(&bus, FAKE_SMBUS_PATH, ICM_20948_I2C_ADDR_AD1) == ICM_20948_Stat_NotImpl);
+  TEST_CHECK((bus.fd == -1) && (fake_closes == 1));
+  ICM_20948_linux_i2c_close(&bus);
+  TEST_CHECK((fake_close0 == 0) && (fake_closes == 1));
+
+  const char *stub = getenv("ICM_20948_I2C_STUB");
+  if (stub != NULL)
+  {
+    TEST_CHECK(ICM_20948_linux_i2c_open(&bus, stub, ICM_20948_I2C_ADDR_AD1) == ICM_20948_Stat_NotImpl);
+    TEST_CHECK(bus.fd == -1);
+  }
+  else
+  {
+    printf("ICM_20948_I2C_STUB not set: skipping the i2c-stub adapter\n");
+  }
+
+  // The fake adapter
+  ICM_20948_sim_init(&sim);
+  TEST_CHECK(ICM_20948_linux_i2c_open(&bus, FAKE_I2C_PATH, ICM_20948_I2C_ADDR_AD1) == ICM_20948_Stat_Ok);
+  ICM_20948_linux_i2c_serif(&bus, &serif);
+  memset(&dev, 0, sizeof(dev));
+  dev._last_bank = 255;
+  dev._last_mems_bank = 255;
+  ICM_20948_link_serif(&dev, &serif);
+  TEST_CHECK(ICM_20948_check_id(&dev) == ICM_20948_Stat_Ok);
+  TEST_CHECK(ICM_20948_sleep(&dev, false) == ICM_20948_Stat_Ok);
+
+  ICM_20948_AGMT_t in, out;
+  memset(&in, 0, sizeof(in));
+  in.acc.axes.x = -1234;
+  in.acc.axes.z = 16384;
+  in.gyr.axes.y = 777;
+  in.tmp.val = 100;
+  ICM_20948_sim_set_agmt(&sim, &in);
+  ICM_20948_linux_i2c_reset_counters(&bus);
+  TEST_CHECK(ICM_20948_get_agmt(&dev, &out) == ICM_20948_Stat_Ok);
+  TEST_CHECK((out.acc.axes.x == -1234) && (out.acc.axes.z == 16384) && (out.gyr.axes.y == 777) && (out.tmp.val == 100));
+  TEST_CHECK(bus.transactions == 6); // Two bank selects and four reads...
+  TEST_CHECK(bus.syscalls == 4);     // ...with the bank selects riding along with the reads
+  TEST_CHECK(fake_max_msgs == 3);
+  TEST_CHECK(bus.bytes == 2 + 3 + ICM_20948_AGMT_RAW_BYTES);
+
+  // A held-back bank select that fails: Ok at first, then the next access fails without being done in the wrong bank
+  uint8_t before = sim.regs[0][AGB0_REG_USER_CTRL];
+  TEST_CHECK(ICM_20948_set_bank(&dev, 3) == ICM_20948_Stat_Ok);
+  TEST_CHECK(bus.bank_pending);
+  fake_fail = 1;
+  uint8_t value = 0xFF;
+  TEST_CHECK(ICM_20948_execute_w(&dev, AGB0_REG_USER_CTRL, &value, 1) == ICM_20948_Stat_Err); // Meant for bank 3
+  TEST_CHECK(bus.bank_pending && (sim.bank == 0) && (sim.regs[0][AGB0_REG_USER_CTRL] == before));
+  TEST_CHECK(ICM_20948_execute_r(&dev, AGB0_REG_USER_CTRL, &value, 1) == ICM_20948_Stat_Ok); // Retried with this one
+  TEST_CHECK(!bus.bank_pending && (sim.bank == 3));
+
+  // flush gives the status of the bank select itself
+  TEST_CHECK(ICM_20948_set_bank(&dev, 0) == ICM_20948_Stat_Ok);
+  fake_fail = 1;
+  TEST_CHECK(ICM_20948_linux_i2c_flush(&bus) == ICM_20948_Stat_Err);
+  TEST_CHECK(bus.bank_pending && (sim.bank == 3));
+  TEST_CHECK(ICM_20948_linux_i2c_flush(&bus) == ICM_20948_Stat_Ok);
+  TEST_CHECK(!bus.bank_pending && (sim.bank == 0));
+
+  // The FIFO drain is one syscall per read, whatever the length
+  uint8_t pattern[200], got[200];
+  for (uint16_t i = 0; i < sizeof(pattern); i++)
+    pattern[i] = (uint8_t)(i ^ 0xA5);
+  ICM_20948_sim_fifo_push(&sim, pattern, sizeof(pattern));
+  ICM_20948_linux_i2c_reset_counters(&bus);
+  TEST_CHECK(ICM_20948_read_FIFO(&dev, got, sizeof(got)) == ICM_20948_Stat_Ok);
+  TEST_CHECK((bus.syscalls == 1) && (memcmp(got, pattern, sizeof(got)) == 0));
+
+  ICM_20948_linux_i2c_close(&bus);
+  TEST_CHECK((bus.fd == -1) && (fake_closes == 2) && (fake_close0 == 0));
+
+  return test_result();
+}
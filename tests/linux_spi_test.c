@@ -0,0 +1,204 @@
+/*
+
+Linux spidev serif test (ICM_20948_Linux_SPI.h)
+
+On the fake spidev of fake_spidev.h. Checks that the ramp settles on max_hz itself when it is not a whole MHz, and
+compares the serif against a naive spidev serif that does one ioctl per register (and sends bank selects straight
+away): the ioctls that reach the fake, and the bus time (bytes on the wire at the ramped clock, modelled), for a
+getAGMT and for a 512 byte FIFO drain, both through ICM_20948_linux_spi_drain_FIFO and in ICM_20948_FIFO_MAX_BURST
+pieces as the DMP parser reads it. The time the ioctls take is measured by benchmarks/linux_spi_bench.c.
+
+*/
+
+#include "test_common.h"
+#include "ICM_20948_Linux_SPI.h"
+#include "fake_spidev.h"
+
+// The naive serif: one full-duplex ioctl per register byte, and bank selects sent as they come
+static ICM_20948_Status_e naive_xfer(ICM_20948_Linux_SPI_t *bus, uint8_t addr, uint8_t *data)
+{
+  uint8_t tx[2] = {addr, *data};
+  uint8_t rx[2] = {0, 0};
+  struct spi_ioc_transfer xfer;
+  memset(&xfer, 0, sizeof(xfer));
+  xfer.tx_buf = (unsigned long)tx;
+  xfer.rx_buf = (unsigned long)rx;
+  xfer.len = 2;
+  xfer.speed_hz = bus->speed_hz;
+  xfer.bits_per_word = 8;
+  bus->syscalls++;
+  if (ioctl(bus->fd, SPI_IOC_MESSAGE(1), &xfer) < 0)
+    return ICM_20948_Stat_Err;
+  *data = rx[1];
+  return ICM_20948_Stat_Ok;
+}
+
+static ICM_20948_Status_e naive_write(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user)
+{
+  ICM_20948_Linux_SPI_t *bus = (ICM_20948_Linux_SPI_t *)user;
+  bus->transactions++;
+  for (uint32_t i = 0; i < len; i++)
+  {
+    uint8_t reg = ((regaddr == AGB0_REG_FIFO_R_W) || (regaddr == AGB0_REG_MEM_R_W)) ? regaddr : (uint8_t)(regaddr + i); // These do not auto-increment
+    if (naive_xfer(bus, reg & 0x7F, &pdata[i]) != ICM_20948_Stat_Ok)
+      return ICM_20948_Stat_Err;
+  }
+  return ICM_20948_Stat_Ok;
+}
+
+static ICM_20948_Status_e naive_read(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user)
+{
+  ICM_20948_Linux_SPI_t *bus = (ICM_20948_Linux_SPI_t *)user;
+  bus->transactions++;
+  for (uint32_t i = 0; i < len; i++)
+  {
+    uint8_t reg = ((regaddr == AGB0_REG_FIFO_R_W) || (regaddr == AGB0_REG_MEM_R_W)) ? regaddr : (uint8_t)(regaddr + i);
+    pdata[i] = 0;
+    if (naive_xfer(bus, reg | 0x80, &pdata[i]) != ICM_20948_Stat_Ok)
+      return ICM_20948_Stat_Err;
+  }
+  return ICM_20948_Stat_Ok;
+}
+
+static ICM_20948_Status_e test_read_async(uint8_t regaddr, uint8_t *pdata, uint32_t len, ICM_20948_Serif_Done_t done, void *context, void *user)
+{
+  (void)regaddr;
+  (void)pdata;
+  (void)len;
+  (void)done;
+  (void)context;
+  (void)user;
+  return ICM_20948_Stat_Err;
+}
+
+static void test_device(ICM_20948_Device_t *dev, ICM_20948_Serif_t *serif)
+{
+  memset(dev, 0, sizeof(ICM_20948_Device_t));
+  dev->_last_bank = 255;
+  dev->_last_mems_bank = 255;
+  ICM_20948_link_serif(dev, serif);
+}
+
+// Syscalls and bus time for one getAGMT and a 512 byte FIFO drain, in one read and in ICM_20948_FIFO_MAX_BURST pieces
+static void test_compare(const char *name, ICM_20948_Device_t *dev, uint32_t *agmt_syscalls, uint32_t *drain_syscalls, uint32_t *burst_syscalls)
+{
+  ICM_20948_AGMT_t in, out;
+  memset(&in, 0, sizeof(in));
+  in.acc.axes.x = 321;
+  in.gyr.axes.z = -321;
+  ICM_20948_sim_set_agmt(&fake_spi_sim, &in);
+  dev->_last_bank = 255; // Start each from the same state
+  fake_spi_syscalls = 0;
+  fake_spi_wire_ns = 0;
+  TEST_CHECK(ICM_20948_get_agmt(dev, &out) == ICM_20948_Stat_Ok);
+  TEST_CHECK((out.acc.axes.x == 321) && (out.gyr.axes.z == -321));
+  *agmt_syscalls = fake_spi_syscalls;
+  uint64_t agmt_ns = fake_spi_wire_ns;
+
+  uint8_t pattern[512], got[512];
+  for (uint16_t i = 0; i < sizeof(pattern); i++)
+    pattern[i] = (uint8_t)(i * 7);
+
+  ICM_20948_sim_fifo_push(&fake_spi_sim, pattern, sizeof(pattern));
+  memset(got, 0, sizeof(got));
+  fake_spi_syscalls = 0;
+  fake_spi_wire_ns = 0;
+  TEST_CHECK(ICM_20948_linux_spi_drain_FIFO(dev, got, sizeof(got)) == ICM_20948_Stat_Ok);
+  TEST_CHECK(memcmp(got, pattern, sizeof(got)) == 0);
+  *drain_syscalls = fake_spi_syscalls;
+  uint64_t drain_ns = fake_spi_wire_ns;
+
+  ICM_20948_sim_fifo_push(&fake_spi_sim, pattern, sizeof(pattern));
+  memset(got, 0, sizeof(got));
+  fake_spi_syscalls = 0;
+  fake_spi_wire_ns = 0;
+  for (uint16_t pos = 0; pos < sizeof(got); pos += ICM_20948_FIFO_MAX_BURST) // As the DMP parser reads it
+    TEST_CHECK(ICM_20948_read_FIFO(dev, &got[pos], ICM_20948_FIFO_MAX_BURST) == ICM_20948_Stat_Ok);
+  TEST_CHECK(memcmp(got, pattern, sizeof(got)) == 0);
+  *burst_syscalls = fake_spi_syscalls;
+
+  printf("%-8s getAGMT: %3u syscalls, %5.1f us on the bus. 512 byte FIFO drain: %3u syscalls, %6.1f us on the bus; in %d byte reads: %3u syscalls, "
+         "%6.1f us\n",
+         name, *agmt_syscalls, agmt_ns / 1000.0, *drain_syscalls, drain_ns / 1000.0, ICM_20948_FIFO_MAX_BURST, *burst_syscalls,
+         fake_spi_wire_ns / 1000.0);
+}
+
+// A full FIFO takes two messages, each within spidev's bufsiz
+static void test_drain_full(ICM_20948_Device_t *dev)
+{
+  static uint8_t pattern[ICM_20948_SIM_FIFO_SIZE], got[ICM_20948_SIM_FIFO_SIZE];
+  for (uint32_t i = 0; i < sizeof(pattern); i++)
+    pattern[i] = (uint8_t)((i * 13) + (i >> 8));
+  ICM_20948_reset_FIFO(dev);
+  TEST_CHECK(ICM_20948_sim_fifo_push(&fake_spi_sim, pattern, sizeof(pattern)) == sizeof(pattern));
+  fake_spi_syscalls = 0;
+  TEST_CHECK(ICM_20948_linux_spi_drain_FIFO(dev, got, sizeof(got)) == ICM_20948_Stat_Ok);
+  TEST_CHECK(fake_spi_syscalls == 2);
+  TEST_CHECK(memcmp(got, pattern, sizeof(got)) == 0);
+}
+
+int main(void)
+{
+  ICM_20948_Linux_SPI_t bus;
+  ICM_20948_Serif_t serif;
+  ICM_20948_Device_t dev;
+
+  TEST_CHECK(ICM_20948_linux_spi_open(&bus, NULL, 1000000) == ICM_20948_Stat_ParamErr);
+  TEST_CHECK(bus.fd == -1);
+
+  ICM_20948_sim_init(&fake_spi_sim);
+  TEST_CHECK(ICM_20948_linux_spi_open(&bus, FAKE_SPI_PATH, 1000000) == ICM_20948_Stat_Ok);
+  ICM_20948_linux_spi_serif(&bus, &serif);
+  test_device(&dev, &serif);
+  TEST_CHECK(ICM_20948_sleep(&dev, false) == ICM_20948_Stat_Ok);
+
+  // The ramp: clamped to max_hz, and backing off at the wiring limit
+  fake_spi_limit_hz = 100000000;
+  TEST_CHECK(ICM_20948_linux_spi_ramp_speed(&dev, &bus, 6500000) == ICM_20948_Stat_Ok);
+  TEST_CHECK((bus.speed_hz == 6500000) && (fake_spi_max_speed_hz == 6500000));
+  TEST_CHECK(ICM_20948_linux_spi_ramp_speed(&dev, &bus, 2500000) == ICM_20948_Stat_Ok); // Never slows down
+  TEST_CHECK(bus.speed_hz == 6500000);
+  TEST_CHECK(ICM_20948_linux_spi_set_speed(&bus, 1000000) == ICM_20948_Stat_Ok);
+  TEST_CHECK(ICM_20948_linux_spi_ramp_speed(&dev, &bus, 9000000) == ICM_20948_Stat_Ok);
+  TEST_CHECK(bus.speed_hz == ICM_20948_LINUX_SPI_MAX_SPEED);
+  fake_spi_limit_hz = 4500000;
+  TEST_CHECK(ICM_20948_linux_spi_set_speed(&bus, 1000000) == ICM_20948_Stat_Ok);
+  TEST_CHECK(ICM_20948_linux_spi_ramp_speed(&dev, &bus, ICM_20948_LINUX_SPI_MAX_SPEED) == ICM_20948_Stat_Ok);
+  TEST_CHECK(bus.speed_hz == 4000000);
+  fake_spi_limit_hz = 100000000;
+  TEST_CHECK(ICM_20948_linux_spi_set_speed(&bus, 6500000) == ICM_20948_Stat_Ok);
+
+  // Batched against naive, at the same clock
+  uint32_t agmt_batched, drain_batched, burst_batched, agmt_naive, drain_naive, burst_naive;
+  test_compare("batched", &dev, &agmt_batched, &drain_batched, &burst_batched);
+
+  ICM_20948_Linux_SPI_t naive_bus = bus;
+  ICM_20948_Serif_t naive_serif = serif;
+  naive_serif.read = naive_read;
+  naive_serif.write = naive_write;
+  naive_serif.user = &naive_bus;
+  ICM_20948_Device_t naive_dev;
+  test_device(&naive_dev, &naive_serif);
+  test_compare("naive", &naive_dev, &agmt_naive, &drain_naive, &burst_naive);
+
+  TEST_CHECK(agmt_batched == 4); // Bank selects ride along with the reads
+  TEST_CHECK(agmt_naive == 2 + 3 + ICM_20948_AGMT_RAW_BYTES);
+  TEST_CHECK(drain_batched == 1);
+  TEST_CHECK(burst_batched == 512 / ICM_20948_FIFO_MAX_BURST);
+  TEST_CHECK((drain_naive == 512) && (burst_naive == 512));
+
+  test_drain_full(&dev);
+
+  // Not on a serif with read_async: ICM_20948_read_FIFO_async would return before the data is in
+  uint8_t byte;
+  ICM_20948_Serif_t async_serif = serif;
+  async_serif.read_async = test_read_async;
+  ICM_20948_link_serif(&dev, &async_serif);
+  fake_spi_syscalls = 0;
+  TEST_CHECK(ICM_20948_linux_spi_drain_FIFO(&dev, &byte, 1) == ICM_20948_Stat_ParamErr);
+  TEST_CHECK(fake_spi_syscalls == 0);
+
+  ICM_20948_linux_spi_close(&bus);
+  TEST_CHECK(bus.fd == -1);
+  return test_result();
+}
@@ -0,0 +1,155 @@
+/*
+
+Magnetometer calibration test (ICM_20948_MagCal.h)
+
+Samples are made from a known hard-iron offset and soft-iron matrix: unit vectors, scaled to a field of 333 LSB
+(50uT), distorted by S and moved by the offset. The fit must recover the offset, and its matrix must undo S (matrix
+* S * 333 = radius * I), with and without 2 LSB of noise, on the full sphere and on a band of limited tilt. Turning
+about one axis must not give a fit that passes, and the DMP form must give the same correction as the float one.
+
+*/
+
+#include "test_common.h"
+#include "ICM_20948_MagCal.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#define TEST_FIELD 333.0 // LSB
+#define TEST_SAMPLES 5000
+
+typedef enum
+{
+  TEST_SPHERE = 0, // Random orientations
+  TEST_BAND,       // Turning about z, tilted up to 23 degrees
+  TEST_PLANE,      // Turning about z only
+} test_path_e;
+
+static const double test_s[3][3] = {{1.10, 0.05, -0.03}, {0.05, 0.92, 0.04}, {-0.03, 0.04, 1.00}};
+static const double test_offset[3] = {120.0, -250.0, 80.0};
+
+static double test_noise(void)
+{
+  double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+  double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+  return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+static void test_sample(test_path_e path, uint32_t i, double noise, ICM_20948_axis3named_t *m)
+{
+  double u[3];
+  if (path == TEST_SPHERE)
+  {
+    for (uint32_t k = 0; k < 3; k++)
+      u[k] = test_noise();
+  }
+  else
+  {
+    double az = i * 0.01;
+    double el = (path == TEST_BAND) ? (0.4 * sin(i * 0.0013)) : 0.0;
+    u[0] = cos(el) * cos(az);
+    u[1] = cos(el) * sin(az);
+    u[2] = sin(el);
+  }
+  double n = sqrt((u[0] * u[0]) + (u[1] * u[1]) + (u[2] * u[2]));
+  for (uint32_t k = 0; k < 3; k++)
+  {
+    double v = test_offset[k];
+    for (uint32_t j = 0; j < 3; j++)
+      v += test_s[k][j] * u[j] / n * TEST_FIELD;
+    m->raw.i16bit[k] = (int16_t)lround(v + (noise * test_noise()));
+  }
+}
+
+static ICM_20948_Status_e test_fit(test_path_e path, double noise, ICM_20948_MagCal_Result_t *r)
+{
+  ICM_20948_MagCal_t cal;
+  ICM_20948_axis3named_t m;
+  ICM_20948_magcal_init(&cal);
+  srand(3);
+  for (uint32_t i = 0; i < TEST_SAMPLES; i++)
+  {
+    test_sample(path, i, noise, &m);
+    ICM_20948_magcal_update(&cal, &m);
+  }
+  return ICM_20948_magcal_solve(&cal, r);
+}
+
+// The worst error of the offset (LSB) and of matrix * S * TEST_FIELD / radius against I
+static void test_errors(const ICM_20948_MagCal_Result_t *r, double *offset, double *matrix)
+{
+  *offset = 0;
+  *matrix = 0;
+  for (uint32_t i = 0; i < 3; i++)
+  {
+    *offset = fmax(*offset, fabs(r->offset[i] - test_offset[i]));
+    for (uint32_t j = 0; j < 3; j++)
+    {
+      double ws = 0;
+      for (uint32_t k = 0; k < 3; k++)
+        ws += r->matrix[i][k] * test_s[k][j];
+      *matrix = fmax(*matrix, fabs((ws * TEST_FIELD / r->radius) - ((i == j) ? 1.0 : 0.0)));
+    }
+  }
+}
+
+static void test_recovery(test_path_e path, double noise, double max_offset, double max_matrix)
+{
+  ICM_20948_MagCal_Result_t r;
+  double offset, matrix;
+  TEST_CHECK(test_fit(path, noise, &r) == ICM_20948_Stat_Ok);
+  test_errors(&r, &offset, &matrix);
+  printf("path %d, noise %.0f LSB: offset %.3f LSB, matrix %.5f, radius %.2f, fit_error %.5f\n", path, noise, offset, matrix, r.radius, r.fit_error);
+  TEST_CHECK(offset <= max_offset);
+  TEST_CHECK(matrix <= max_matrix);
+  TEST_CHECK(fabs(r.radius - TEST_FIELD) <= 2.0);
+  TEST_CHECK(r.fit_error < 0.02);
+}
+
+int main(void)
+{
+  test_recovery(TEST_SPHERE, 0.0, 0.1, 0.001);
+  test_recovery(TEST_SPHERE, 2.0, 0.2, 0.001);
+  test_recovery(TEST_BAND, 0.0, 0.2, 0.002);
+  test_recovery(TEST_BAND, 2.0, 0.5, 0.01);
+
+  // Turning about one axis cannot fix the ellipsoid: no fit, or one that fails the fit_error check
+  ICM_20948_MagCal_Result_t r;
+  TEST_CHECK(test_fit(TEST_PLANE, 0.0, &r) != ICM_20948_Stat_Ok);
+  TEST_CHECK((test_fit(TEST_PLANE, 2.0, &r) != ICM_20948_Stat_Ok) || (r.fit_error >= 0.02));
+
+  // Too few samples, and a sensor held still
+  ICM_20948_MagCal_t cal;
+  ICM_20948_axis3named_t m;
+  ICM_20948_magcal_init(&cal);
+  for (uint32_t i = 0; i < ICM_20948_MAGCAL_MIN_SAMPLES - 1; i++)
+  {
+    test_sample(TEST_SPHERE, i, 0.0, &m);
+    TEST_CHECK(ICM_20948_magcal_update(&cal, &m));
+    TEST_CHECK(!ICM_20948_magcal_update(&cal, &m));
+  }
+  TEST_CHECK(ICM_20948_magcal_solve(&cal, &r) == ICM_20948_Stat_NoData);
+
+  // The DMP form: mtx * raw - bias is the corrected reading in uT, in the chip frame (AK09916 y and z flipped)
+  TEST_CHECK(test_fit(TEST_SPHERE, 0.0, &r) == ICM_20948_Stat_Ok);
+  int32_t mtx[9], bias[3];
+  ICM_20948_magcal_to_dmp(&r, NULL, mtx, bias);
+  double dmp_error = 0;
+  for (uint32_t i = 0; i < 100; i++)
+  {
+    test_sample(TEST_SPHERE, i, 0.0, &m);
+    ICM_20948_axis3named_t corrected = m;
+    ICM_20948_magcal_apply(&r, &corrected);
+    for (uint32_t k = 0; k < 3; k++)
+    {
+      double dmp = -bias[k] / 65536.0;
+      for (uint32_t j = 0; j < 3; j++)
+        dmp += (mtx[(k * 3) + j] / 1073741824.0) * m.raw.i16bit[j];
+      dmp_error = fmax(dmp_error, fabs(dmp - ((k == 0) ? 0.15 : -0.15) * corrected.raw.i16bit[k]));
+    }
+  }
+  printf("DMP form vs apply: %.3f uT\n", dmp_error);
+  TEST_CHECK(dmp_error <= 0.15); // apply rounds to the LSB
+
+  return test_result();
+}
@@ -0,0 +1,120 @@
+/*
+
+Mount matrix test (ICM_20948_mount_matrix, ICM_20948_mount_check, inv_icm20948_set_dmp_mount)
+
+Each of the 24 ICM_20948_Mount_e values must give a different rotation: entries of 0 or +/-1 (Q30) with rows that
+are exactly orthonormal and a determinant of +1, checked here in integer arithmetic, and with the chip's x and y axes
+where the name says. Each is written to the simulator and read back, and CPASS_MTX must be B2S_MTX with the AK09916
+y and z axes flipped, at 0.15uT per LSB. ICM_20948_mount_check must refuse a reflection and a skewed matrix.
+
+*/
+
+#include "test_common.h"
+#include "ICM_20948_DMP.h"
+
+#define TEST_ONE (1L << 30)
+
+static ICM_20948_Device_t dev;
+static ICM_20948_Sim_t sim;
+static ICM_20948_Serif_t serif;
+
+static int32_t test_mem(unsigned short reg, uint8_t i) // Big-endian, as the DMP keeps it
+{
+  const uint8_t *b = &sim.dmp_mem[reg + (i * 4)];
+  return (int32_t)(((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3]);
+}
+
+// The rotation the name of a mounting describes: Aa_Bb is chip x along body +/-A and chip y along body +/-B
+static void test_expected(uint8_t mount, int32_t column_x[3], int32_t column_y[3])
+{
+  uint8_t x_axis = mount / 8;
+  bool x_neg = ((mount / 4) % 2) != 0;
+  uint8_t y_axis = (((mount / 2) % 2) == 0) ? ((x_axis == 0) ? 1 : 0) : ((x_axis == 2) ? 1 : 2); // The lower or higher remaining axis
+  bool y_neg = (mount % 2) != 0;
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    column_x[i] = (i == x_axis) ? (x_neg ? -TEST_ONE : TEST_ONE) : 0;
+    column_y[i] = (i == y_axis) ? (y_neg ? -TEST_ONE : TEST_ONE) : 0;
+  }
+}
+
+int main(void)
+{
+  test_sim_device(&dev, &sim, &serif);
+
+  int32_t all[ICM_20948_Mount_NUM][9];
+  for (uint8_t m = 0; m < ICM_20948_Mount_NUM; m++)
+  {
+    int32_t *b2s = all[m];
+    TEST_CHECK(ICM_20948_mount_matrix((ICM_20948_Mount_e)m, b2s) == ICM_20948_Stat_Ok);
+
+    bool unit_entries = true;
+    for (uint8_t i = 0; i < 9; i++)
+      unit_entries = unit_entries && ((b2s[i] == 0) || (b2s[i] == TEST_ONE) || (b2s[i] == -TEST_ONE));
+    TEST_CHECK(unit_entries);
+
+    // Orthonormal rows, exactly
+    bool orthonormal = true;
+    for (uint8_t i = 0; i < 3; i++)
+    {
+      for (uint8_t j = 0; j < 3; j++)
+      {
+        int64_t dot = 0;
+        for (uint8_t k = 0; k < 3; k++)
+          dot += (int64_t)b2s[(i * 3) + k] * b2s[(j * 3) + k];
+        orthonormal = orthonormal && (dot == ((i == j) ? ((int64_t)1 << 60) : 0));
+      }
+    }
+    TEST_CHECK(orthonormal);
+
+    // Determinant +1, in units of 2^30
+    int64_t det = 0;
+    for (uint8_t k = 0; k < 3; k++)
+    {
+      uint8_t k1 = (k + 1) % 3;
+      uint8_t k2 = (k + 2) % 3;
+      int64_t cross = (((int64_t)b2s[k1] * b2s[3 + k2]) - ((int64_t)b2s[k2] * b2s[3 + k1])) >> 30;
+      det += (cross * b2s[6 + k]) >> 30;
+    }
+    TEST_CHECK(det == TEST_ONE);
+    TEST_CHECK(ICM_20948_mount_check(b2s) == ICM_20948_Stat_Ok);
+
+    // The chip axes where the name puts them: columns 0 and 1
+    int32_t column_x[3], column_y[3];
+    test_expected(m, column_x, column_y);
+    TEST_CHECK((b2s[0] == column_x[0]) && (b2s[3] == column_x[1]) && (b2s[6] == column_x[2]));
+    TEST_CHECK((b2s[1] == column_y[0]) && (b2s[4] == column_y[1]) && (b2s[7] == column_y[2]));
+
+    for (uint8_t n = 0; n < m; n++)
+      TEST_CHECK(memcmp(all[n], b2s, sizeof(all[n])) != 0);
+
+    // Into the DMP and back
+    int32_t back[9];
+    TEST_CHECK(inv_icm20948_set_dmp_mount(&dev, b2s) == ICM_20948_Stat_Ok);
+    TEST_CHECK(inv_icm20948_get_dmp_mount(&dev, back) == ICM_20948_Stat_Ok);
+    TEST_CHECK(memcmp(back, b2s, sizeof(back)) == 0);
+    bool cpass_ok = true;
+    for (uint8_t i = 0; i < 9; i++)
+    {
+      int32_t expected = (b2s[i] == 0) ? 0 : ((b2s[i] > 0) ? ICM_20948_CPASS_UT_PER_LSB_Q30 : -ICM_20948_CPASS_UT_PER_LSB_Q30);
+      if ((i % 3) != 0)
+        expected = -expected;
+      cpass_ok = cpass_ok && (test_mem(CPASS_MTX_00, i) == expected) && (test_mem(B2S_MTX_00, i) == b2s[i]);
+    }
+    TEST_CHECK(cpass_ok);
+  }
+  TEST_CHECK(ICM_20948_mount_matrix(ICM_20948_Mount_NUM, all[0]) == ICM_20948_Stat_ParamErr);
+
+  // A rotation that is not axis-aligned passes; a reflection and a skew do not, and are not written
+  static const int32_t tilted[9] = {ICM_20948_Q30(0.8660254), ICM_20948_Q30(-0.5), 0, ICM_20948_Q30(0.5), ICM_20948_Q30(0.8660254), 0, 0, 0, ICM_20948_Q30(1.0)};
+  static const int32_t reflection[9] = {TEST_ONE, 0, 0, 0, TEST_ONE, 0, 0, 0, -TEST_ONE};
+  static const int32_t skew[9] = {TEST_ONE, ICM_20948_Q30(0.1), 0, 0, TEST_ONE, 0, 0, 0, TEST_ONE};
+  TEST_CHECK(ICM_20948_mount_check(tilted) == ICM_20948_Stat_Ok);
+  TEST_CHECK(ICM_20948_mount_check(reflection) == ICM_20948_Stat_ParamErr);
+  TEST_CHECK(ICM_20948_mount_check(skew) == ICM_20948_Stat_ParamErr);
+  uint32_t writes = sim.writes;
+  TEST_CHECK(inv_icm20948_set_dmp_mount(&dev, reflection) == ICM_20948_Stat_ParamErr);
+  TEST_CHECK(sim.writes == writes);
+
+  return test_result();
+}
@@ -0,0 +1,153 @@
+/*
+
+Bus cost model test (ICM_20948_plan)
+
+The planner counts the transactions the driver makes rather than measuring them, so check its counts against the
+driver on the simulator: the serif reads, writes and bytes of ICM_20948_get_agmt (steady state, with bank 0 left
+selected by the previous call) and of inv_icm20948_read_dmp_data draining packets of a known mix, one per tick.
+
+*/
+
+#include "test_common.h"
+#include "ICM_20948_Plan.h"
+
+#include <math.h>
+
+#define TEST_SAMPLES 10
+
+static ICM_20948_Device_t dev;
+static ICM_20948_Sim_t sim;
+static ICM_20948_Serif_t serif;
+
+static uint32_t bus_reads;
+static uint32_t bus_writes;
+static uint32_t bus_read_bytes;
+static uint32_t bus_write_bytes;
+
+static ICM_20948_Status_e test_read(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user)
+{
+  bus_reads++;
+  bus_read_bytes += len;
+  return ICM_20948_sim_read(regaddr, pdata, len, user);
+}
+
+static ICM_20948_Status_e test_write(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user)
+{
+  bus_writes++;
+  bus_write_bytes += len;
+  return ICM_20948_sim_write(regaddr, pdata, len, user);
+}
+
+static void test_count_reset(void)
+{
+  bus_reads = 0;
+  bus_writes = 0;
+  bus_read_bytes = 0;
+  bus_write_bytes = 0;
+}
+
+static bool test_near(float planned, uint32_t counted)
+{
+  return fabsf(planned - (float)counted) < 0.01f;
+}
+
+static void test_agmt(void)
+{
+  ICM_20948_Plan_Config_t cfg;
+  ICM_20948_Plan_Result_t plan;
+  memset(&cfg, 0, sizeof(cfg));
+  cfg.bus = ICM_20948_Plan_Bus_SPI;
+  cfg.bus_hz = 7000000;
+  cfg.mode = ICM_20948_Plan_Mode_AGMT;
+  cfg.agmt_hz = TEST_SAMPLES; // One second's worth is TEST_SAMPLES calls
+  TEST_CHECK(ICM_20948_plan(&cfg, &plan) == ICM_20948_Stat_Ok);
+
+  ICM_20948_AGMT_t agmt;
+  TEST_CHECK(ICM_20948_get_agmt(&dev, &agmt) == ICM_20948_Stat_Ok); // Leaves bank 0 selected, as every later call does
+  test_count_reset();
+  for (uint32_t i = 0; i < TEST_SAMPLES; i++)
+    TEST_CHECK(ICM_20948_get_agmt(&dev, &agmt) == ICM_20948_Stat_Ok);
+
+  printf("get_agmt x%d: planned %.0f transactions, %.0f bytes; counted %u, %u\n", TEST_SAMPLES, plan.transactions_per_s,
+         plan.payload_bytes_per_s, bus_reads + bus_writes, bus_read_bytes + bus_write_bytes);
+  TEST_CHECK(plan.max_sample_bytes == ICM_20948_AGMT_RAW_BYTES);
+  TEST_CHECK(test_near(plan.transactions_per_s, bus_reads + bus_writes));
+  TEST_CHECK(test_near(plan.payload_bytes_per_s, bus_read_bytes + bus_write_bytes));
+}
+
+static void test_dmp(void)
+{
+  // All at the DMP rate, so every tick gives the same packet. It takes more than one ICM_20948_FIFO_MAX_BURST
+  static const ICM_20948_Plan_Sensor_t sensors[] = {{INV_ICM20948_SENSOR_RAW_ACCELEROMETER, ICM_20948_PLAN_DMP_RATE_HZ},
+                                                    {INV_ICM20948_SENSOR_GYROSCOPE, ICM_20948_PLAN_DMP_RATE_HZ},
+                                                    {INV_ICM20948_SENSOR_ORIENTATION, ICM_20948_PLAN_DMP_RATE_HZ}};
+  const uint8_t num_sensors = sizeof(sensors) / sizeof(sensors[0]);
+  ICM_20948_Plan_Config_t cfg;
+  ICM_20948_Plan_Result_t plan;
+  memset(&cfg, 0, sizeof(cfg));
+  cfg.bus = ICM_20948_Plan_Bus_I2C;
+  cfg.bus_hz = 400000;
+  cfg.mode = ICM_20948_Plan_Mode_DMP;
+  cfg.sensors = sensors;
+  cfg.num_sensors = num_sensors;
+  cfg.poll_hz = 0; // Drained once per packet
+  TEST_CHECK(ICM_20948_plan(&cfg, &plan) == ICM_20948_Stat_Ok);
+  TEST_CHECK(test_near(plan.samples_per_s, (uint32_t)ICM_20948_PLAN_DMP_RATE_HZ));
+
+  // The same packet, built the way the planner assumes: every output with its accuracy
+  uint16_t header = 0;
+  uint16_t header2 = 0;
+  for (uint8_t i = 0; i < num_sensors; i++)
+  {
+    uint16_t bits = inv_icm20948_sensor_to_control_bits(sensors[i].sensor);
+    header |= bits & ~DMP_Data_Output_Control_1_Header2;
+    header2 |= inv_icm20948_control_bits_to_header2(bits);
+  }
+  TEST_CHECK(header2 != 0);
+  header |= DMP_header_bitmap_Header2;
+  uint16_t size = inv_icm20948_dmp_packet_size(header, header2, NULL);
+  TEST_CHECK((size == plan.max_sample_bytes) && (size > ICM_20948_FIFO_MAX_BURST));
+
+  uint8_t packet[icm_20948_DMP_Maximum_Packet_Bytes];
+  memset(packet, 0, sizeof(packet));
+  packet[0] = (uint8_t)(header >> 8);
+  packet[1] = (uint8_t)(header & 0xFF);
+  packet[2] = (uint8_t)(header2 >> 8);
+  packet[3] = (uint8_t)(header2 & 0xFF);
+  ICM_20948_reset_FIFO(&dev);
+  dev._dataOutCtl1 = header & ~DMP_header_bitmap_Header2;
+  dev._dataOutCtl1_fifo = dev._dataOutCtl1;
+  for (uint32_t i = 0; i < TEST_SAMPLES; i++)
+    TEST_CHECK(ICM_20948_sim_fifo_push(&sim, packet, size) == size);
+
+  TEST_CHECK(ICM_20948_set_bank(&dev, 0) == ICM_20948_Stat_Ok);
+  test_count_reset();
+  for (uint32_t i = 0; i < TEST_SAMPLES; i++)
+  {
+    icm_20948_DMP_data_t data;
+    ICM_20948_Status_e result = inv_icm20948_read_dmp_data(&dev, &data);
+    TEST_CHECK((result == ICM_20948_Stat_Ok) || (result == ICM_20948_Stat_FIFOMoreDataAvail));
+  }
+  TEST_CHECK(sim.fifo_count == 0);
+
+  float per_packet = 1.0f / plan.samples_per_s;
+  printf("read_dmp_data x%d (%u-byte packets): planned %.2f transactions, %.2f bytes; counted %u, %u\n", TEST_SAMPLES, size,
+         plan.transactions_per_s * per_packet * TEST_SAMPLES, plan.payload_bytes_per_s * per_packet * TEST_SAMPLES,
+         bus_reads + bus_writes, bus_read_bytes + bus_write_bytes);
+  TEST_CHECK(bus_writes == 0);
+  TEST_CHECK(test_near(plan.transactions_per_s * per_packet * TEST_SAMPLES, bus_reads));
+  TEST_CHECK(test_near(plan.payload_bytes_per_s * per_packet * TEST_SAMPLES, bus_read_bytes));
+}
+
+int main(void)
+{
+  test_sim_device(&dev, &sim, &serif);
+  serif.read = test_read;
+  serif.write = test_write;
+  ICM_20948_link_serif(&dev, &serif);
+
+  test_agmt();
+  test_dmp();
+
+  return test_result();
+}
@@ -0,0 +1,144 @@
+/*
+
+Quaternion math test (ICM_20948_Quat.h)
+
+Random unit quaternions, quantized to Q30 as the DMP sends them, go through the float and the fixed-point versions
+and are checked against double precision with the bounds the header gives:
+
+  q30:   Q0, the matrix, gravity and normalize within 1 LSB, rotated vectors within 1 unit, Euler within 0.001 degrees
+  float: Euler within 0.001 degrees away from +/-90 degrees pitch, rotated vectors within 2e-6
+
+*/
+
+#include "test_common.h"
+#include "ICM_20948_Quat.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#define TEST_QUATS 200000
+#define TEST_Q30 1073741824.0
+
+static double test_rand(void)
+{
+  return ((double)rand() / (double)RAND_MAX) * 2.0 - 1.0;
+}
+
+// The difference of two angles in degrees, wrapped to [0, 180]
+static double test_angle(double a, double b)
+{
+  double d = fmod(fabs(a - b), 360.0);
+  return (d > 180.0) ? (360.0 - d) : d;
+}
+
+int main(void)
+{
+  double q30_q0 = 0, q30_euler = 0, q30_matrix = 0, q30_gravity = 0, q30_rotate = 0, q30_normalize = 0;
+  double float_euler = 0, float_rotate = 0;
+
+  srand(7);
+  for (uint32_t i = 0; i < TEST_QUATS; i++)
+  {
+    // A random unit quaternion with Q0 >= 0, as the DMP keeps it
+    double a[4], n = 0;
+    for (uint32_t j = 0; j < 4; j++)
+    {
+      a[j] = test_rand();
+      n += a[j] * a[j];
+    }
+    n = (a[0] < 0) ? -sqrt(n) : sqrt(n);
+    if (n == 0)
+      continue;
+    int32_t q1 = (int32_t)llround((a[1] / n) * TEST_Q30);
+    int32_t q2 = (int32_t)llround((a[2] / n) * TEST_Q30);
+    int32_t q3 = (int32_t)llround((a[3] / n) * TEST_Q30);
+
+    // The reference, in double from the same Q30 inputs
+    double x = q1 / TEST_Q30, y = q2 / TEST_Q30, z = q3 / TEST_Q30;
+    double s = (x * x) + (y * y) + (z * z);
+    double w = (s < 1.0) ? sqrt(1.0 - s) : 0.0;
+    double sinp = 2.0 * ((w * y) - (z * x));
+    sinp = (sinp > 1.0) ? 1.0 : ((sinp < -1.0) ? -1.0 : sinp);
+    double roll = atan2(2.0 * ((w * x) + (y * z)), 1.0 - 2.0 * ((x * x) + (y * y))) * 180.0 / M_PI;
+    double pitch = asin(sinp) * 180.0 / M_PI;
+    double yaw = atan2(2.0 * ((w * z) + (x * y)), 1.0 - 2.0 * ((y * y) + (z * z))) * 180.0 / M_PI;
+
+    // Fixed point
+    ICM_20948_Quat_Q30_t qq;
+    ICM_20948_quat_q30_from_q30(q1, q2, q3, &qq);
+    q30_q0 = fmax(q30_q0, fabs(qq.w - (w * TEST_Q30)));
+
+    ICM_20948_Euler_Q16_t eq;
+    ICM_20948_quat_q30_to_euler(&qq, &eq);
+    q30_euler = fmax(q30_euler, test_angle(eq.roll / 65536.0, roll));
+    q30_euler = fmax(q30_euler, test_angle(eq.pitch / 65536.0, pitch));
+    q30_euler = fmax(q30_euler, test_angle(eq.yaw / 65536.0, yaw));
+
+    // The matrix, gravity and rotation are exact functions of the Q0 they were given: compare with that one
+    double wq = qq.w / TEST_Q30;
+    double m[3][3] = {{1.0 - 2.0 * ((y * y) + (z * z)), 2.0 * ((x * y) - (wq * z)), 2.0 * ((x * z) + (wq * y))},
+                      {2.0 * ((x * y) + (wq * z)), 1.0 - 2.0 * ((x * x) + (z * z)), 2.0 * ((y * z) - (wq * x))},
+                      {2.0 * ((x * z) - (wq * y)), 2.0 * ((y * z) + (wq * x)), 1.0 - 2.0 * ((x * x) + (y * y))}};
+    int32_t mq[3][3], g[3];
+    ICM_20948_quat_q30_to_matrix(&qq, mq);
+    ICM_20948_quat_q30_gravity(&qq, g);
+    for (uint32_t r = 0; r < 3; r++)
+    {
+      for (uint32_t c = 0; c < 3; c++)
+        q30_matrix = fmax(q30_matrix, fabs(mq[r][c] - (m[r][c] * TEST_Q30)));
+      q30_gravity = fmax(q30_gravity, fabs(g[r] - (m[2][r] * TEST_Q30)));
+    }
+
+    int32_t v[3] = {(int32_t)(test_rand() * 5e8), (int32_t)(test_rand() * 5e8), 12345}, out[3];
+    ICM_20948_quat_q30_rotate(&qq, v, out);
+    for (uint32_t r = 0; r < 3; r++)
+      q30_rotate = fmax(q30_rotate, fabs(out[r] - ((m[r][0] * v[0]) + (m[r][1] * v[1]) + (m[r][2] * v[2]))));
+
+    ICM_20948_Quat_Q30_t qn = {(qq.w / 2) * 3, (qq.x / 2) * 3, (qq.y / 2) * 3, (qq.z / 2) * 3};
+    ICM_20948_quat_q30_normalize(&qn);
+    q30_normalize = fmax(q30_normalize, fmax(fmax(fabs((double)qn.w - qq.w), fabs((double)qn.x - qq.x)), fmax(fabs((double)qn.y - qq.y), fabs((double)qn.z - qq.z))));
+
+    // Float
+    ICM_20948_Quat_t qf;
+    ICM_20948_Euler_t ef;
+    ICM_20948_quat_from_q30(q1, q2, q3, &qf);
+    ICM_20948_quat_to_euler(&qf, &ef);
+    if (fabs(pitch) < 80.0) // Roll and yaw are ill-conditioned near +/-90 degrees pitch
+    {
+      float_euler = fmax(float_euler, test_angle(ef.roll, roll));
+      float_euler = fmax(float_euler, test_angle(ef.pitch, pitch));
+      float_euler = fmax(float_euler, test_angle(ef.yaw, yaw));
+    }
+
+    float fv[3] = {1.0f, 2.0f, 3.0f}, fo[3];
+    ICM_20948_quat_rotate(&qf, fv, fo);
+    for (uint32_t r = 0; r < 3; r++)
+      float_rotate = fmax(float_rotate, fabs(fo[r] - (m[r][0] + (2.0 * m[r][1]) + (3.0 * m[r][2]))));
+  }
+
+  printf("q30: Q0 %.3f LSB, Euler %.6f deg, matrix %.3f LSB, gravity %.3f LSB, rotate %.3f, normalize %.3f LSB\n",
+         q30_q0, q30_euler, q30_matrix, q30_gravity, q30_rotate, q30_normalize);
+  printf("float: Euler %.6f deg, rotate %.3g\n", float_euler, float_rotate);
+  TEST_CHECK(q30_q0 <= 1.0);
+  TEST_CHECK(q30_euler <= 0.001);
+  TEST_CHECK(q30_matrix <= 1.0);
+  TEST_CHECK(q30_gravity <= 1.0);
+  TEST_CHECK(q30_rotate <= 1.0);
+  TEST_CHECK(q30_normalize <= 1.0);
+  TEST_CHECK(float_euler <= 0.001);
+  TEST_CHECK(float_rotate <= 2e-6);
+
+  // The identity and a half turn about x
+  ICM_20948_Quat_Q30_t qq;
+  ICM_20948_Euler_Q16_t eq;
+  ICM_20948_quat_q30_from_q30(0, 0, 0, &qq);
+  TEST_CHECK(qq.w == (1L << 30));
+  ICM_20948_quat_q30_to_euler(&qq, &eq);
+  TEST_CHECK((abs(eq.roll) <= 1) && (abs(eq.pitch) <= 1) && (abs(eq.yaw) <= 1));
+  ICM_20948_quat_q30_from_q30(1L << 30, 0, 0, &qq);
+  TEST_CHECK(qq.w == 0);
+  ICM_20948_quat_q30_to_euler(&qq, &eq);
+  TEST_CHECK((test_angle(eq.roll / 65536.0, 180.0) <= 0.001) && (abs(eq.pitch) <= 1) && (abs(eq.yaw) <= 1));
+
+  return test_result();
+}
@@ -0,0 +1,241 @@
+/*
+
+Sample queue test (ICM_20948_queue_agmt)
+
+Checks that the producer is one bank 0 burst with no bank select, tagged with the cached full scale, and that it
+refuses (ICM_20948_Stat_BusBusy) rather than change the bank, interrupt a transfer or read in the middle of a bank
+switch. Then, on the simulator, runs a producer thread at 1.1kHz against a consumer thread that stalls now and then,
+and an unpaced producer that waits for room against one that does not stall (to keep both sides of the queue busy):
+every sample must arrive whole and in order, and every one that did not must be counted as dropped.
+
+*/
+
+#include "test_common.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#define TEST_CAPACITY 8
+#define TEST_PACED_SAMPLES 1100 // One second at 1.1kHz
+#define TEST_PACED_PERIOD_NS 909091
+#define TEST_BURST_SAMPLES 200000
+
+static ICM_20948_Device_t dev;
+static ICM_20948_Sim_t sim;
+static ICM_20948_Serif_t serif;
+static ICM_20948_Sample_t buffer[TEST_CAPACITY];
+static ICM_20948_Sample_Queue_t queue;
+
+static volatile bool producer_done;
+static bool consumer_stalls;
+static uint32_t producer_errors;
+static uint32_t consumer_bad;
+static uint32_t consumer_popped;
+
+// Sample n: every field is a function of n, so a torn sample shows
+static void test_sample(uint32_t n, ICM_20948_AGMT_t *agmt)
+{
+  int16_t v = (int16_t)(n & 0x7FFF);
+  memset(agmt, 0, sizeof(ICM_20948_AGMT_t));
+  agmt->acc.axes.x = v;
+  agmt->acc.axes.y = (int16_t)~v;
+  agmt->acc.axes.z = (int16_t)(v ^ 0x5555);
+  agmt->gyr.axes.x = (int16_t)(v ^ 0x2AAA);
+  agmt->gyr.axes.y = (int16_t)-v;
+  agmt->gyr.axes.z = (int16_t)(v >> 3);
+  agmt->tmp.val = (int16_t)(v ^ 0x1234);
+}
+
+static bool test_sample_ok(const ICM_20948_Sample_t *sample)
+{
+  ICM_20948_AGMT_t expect;
+  test_sample(sample->timestamp, &expect);
+  return (sample->agmt.acc.axes.x == expect.acc.axes.x) && (sample->agmt.acc.axes.y == expect.acc.axes.y) &&
+         (sample->agmt.acc.axes.z == expect.acc.axes.z) && (sample->agmt.gyr.axes.x == expect.gyr.axes.x) &&
+         (sample->agmt.gyr.axes.y == expect.gyr.axes.y) && (sample->agmt.gyr.axes.z == expect.gyr.axes.z) &&
+         (sample->agmt.tmp.val == expect.tmp.val) && (sample->agmt.fss.a == 1) && (sample->agmt.fss.g == 3);
+}
+
+static void *test_producer(void *arg)
+{
+  uint32_t samples = *(uint32_t *)arg;
+  bool paced = (samples == TEST_PACED_SAMPLES);
+  struct timespec next;
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  for (uint32_t n = 1; n <= samples; n++)
+  {
+    if (paced)
+    {
+      next.tv_nsec += TEST_PACED_PERIOD_NS;
+      if (next.tv_nsec >= 1000000000L)
+      {
+        next.tv_nsec -= 1000000000L;
+        next.tv_sec++;
+      }
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+    else
+    {
+      while (ICM_20948_queue_count(&queue) == TEST_CAPACITY)
+        sched_yield();
+    }
+    ICM_20948_AGMT_t agmt;
+    test_sample(n, &agmt);
+    ICM_20948_sim_set_agmt(&sim, &agmt); // The data-ready event
+    ICM_20948_Status_e status = ICM_20948_queue_agmt(&dev, &queue, n);
+    if ((status != ICM_20948_Stat_Ok) && (status != ICM_20948_Stat_QueueFull))
+      producer_errors++;
+  }
+  producer_done = true;
+  return NULL;
+}
+
+static void *test_consumer(void *arg)
+{
+  (void)arg;
+  uint32_t last = 0;
+  uint32_t pops = 0;
+  for (;;)
+  {
+    bool done = producer_done; // Read before the pop, so an empty queue after it really is the end
+    ICM_20948_Sample_t sample;
+    if (ICM_20948_queue_pop(&queue, &sample) == ICM_20948_Stat_Ok)
+    {
+      if ((sample.timestamp <= last) || !test_sample_ok(&sample))
+        consumer_bad++;
+      last = sample.timestamp;
+      consumer_popped++;
+      if (consumer_stalls && ((++pops % 200) == 0)) // Stall now and then so that the queue fills
+      {
+        struct timespec stall = {0, 20000000L};
+        nanosleep(&stall, NULL);
+      }
+    }
+    else if (done)
+    {
+      break;
+    }
+    else
+    {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+static void test_threads(uint32_t samples, bool stalls)
+{
+  ICM_20948_queue_init(&queue, buffer, TEST_CAPACITY);
+  producer_done = false;
+  producer_errors = 0;
+  consumer_bad = 0;
+  consumer_popped = 0;
+  consumer_stalls = stalls;
+
+  pthread_t producer, consumer;
+  TEST_CHECK(pthread_create(&consumer, NULL, test_consumer, NULL) == 0);
+  TEST_CHECK(pthread_create(&producer, NULL, test_producer, &samples) == 0);
+  pthread_join(producer, NULL);
+  pthread_join(consumer, NULL);
+
+  printf("%u samples: %u popped, %u dropped\n", samples, consumer_popped, queue._dropped);
+  TEST_CHECK(producer_errors == 0);
+  TEST_CHECK(consumer_bad == 0);
+  TEST_CHECK(consumer_popped + queue._dropped == samples);
+  TEST_CHECK(consumer_popped >= TEST_CAPACITY);
+  TEST_CHECK(stalls ? (queue._dropped > 0) : (queue._dropped == 0)); // The stalls must have filled it. Otherwise the producer waits
+}
+
+// A serif that takes an "interrupt" in the middle of every read
+static uint32_t isr_calls;
+static ICM_20948_Status_e isr_status;
+static ICM_20948_Status_e test_read_with_isr(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user)
+{
+  isr_calls++;
+  isr_status = ICM_20948_queue_agmt(&dev, &queue, 1);
+  return ICM_20948_sim_read(regaddr, pdata, len, user);
+}
+
+// A serif that takes an "interrupt" as a bank select starts: after set_bank has updated its record of the bank but
+// before the transfer is marked busy (the bank register itself still holds the old bank)
+static uint32_t bank_isr_calls;
+static ICM_20948_Status_e bank_isr_status;
+static ICM_20948_Status_e test_write_with_isr(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user)
+{
+  if (regaddr == REG_BANK_SEL)
+  {
+    bank_isr_calls++;
+    dev._bus_busy = false;
+    bank_isr_status = ICM_20948_queue_agmt(&dev, &queue, 2);
+    dev._bus_busy = true;
+  }
+  return ICM_20948_sim_write(regaddr, pdata, len, user);
+}
+
+int main(void)
+{
+  test_sim_device(&dev, &sim, &serif);
+  ICM_20948_queue_init(&queue, buffer, TEST_CAPACITY);
+
+  ICM_20948_fss_t fss;
+  fss.a = 1;
+  fss.g = 3;
+  TEST_CHECK(ICM_20948_set_full_scale(&dev, (ICM_20948_InternalSensorID_bm)(ICM_20948_Internal_Acc | ICM_20948_Internal_Gyr), fss) == ICM_20948_Stat_Ok);
+  TEST_CHECK((dev._fss.a == 1) && (dev._fss.g == 3));
+
+  // Another bank selected: refuse without touching the bus
+  uint32_t reads = sim.reads, writes = sim.writes;
+  TEST_CHECK(dev._last_bank == 2);
+  TEST_CHECK(ICM_20948_queue_agmt(&dev, &queue, 1) == ICM_20948_Stat_BusBusy);
+  TEST_CHECK((sim.reads == reads) && (sim.writes == writes));
+  TEST_CHECK((dev._last_bank == 2) && (sim.bank == 2));
+  TEST_CHECK((queue._dropped == 1) && (ICM_20948_queue_count(&queue) == 0));
+
+  // get_agmt leaves bank 0 selected. Then each queued sample is exactly one read
+  ICM_20948_AGMT_t agmt;
+  test_sample(7, &agmt);
+  ICM_20948_sim_set_agmt(&sim, &agmt);
+  TEST_CHECK(ICM_20948_get_agmt(&dev, &agmt) == ICM_20948_Stat_Ok);
+  TEST_CHECK((dev._last_bank == 0) && (agmt.acc.axes.x == 7) && (agmt.fss.a == 1) && (agmt.fss.g == 3));
+  reads = sim.reads;
+  writes = sim.writes;
+  TEST_CHECK(ICM_20948_queue_agmt(&dev, &queue, 7) == ICM_20948_Stat_Ok);
+  TEST_CHECK((sim.reads == reads + 1) && (sim.writes == writes));
+  ICM_20948_Sample_t sample;
+  TEST_CHECK(ICM_20948_queue_pop(&queue, &sample) == ICM_20948_Stat_Ok);
+  TEST_CHECK(test_sample_ok(&sample));
+
+  // An interrupt during an application transfer must not start another
+  ICM_20948_Serif_t isr_serif = serif;
+  isr_serif.read = test_read_with_isr;
+  ICM_20948_link_serif(&dev, &isr_serif);
+  uint8_t whoami = 0;
+  TEST_CHECK(ICM_20948_get_who_am_i(&dev, &whoami) == ICM_20948_Stat_Ok);
+  TEST_CHECK((isr_calls > 0) && (isr_status == ICM_20948_Stat_BusBusy) && (ICM_20948_queue_count(&queue) == 0));
+  TEST_CHECK(whoami == ICM_20948_WHOAMI);
+  TEST_CHECK(!dev._bus_busy);
+  ICM_20948_link_serif(&dev, &serif);
+
+  // An interrupt between the two halves of a bank switch (2 to 0) must not read bank 2 as sample data
+  isr_serif = serif;
+  isr_serif.write = test_write_with_isr;
+  ICM_20948_link_serif(&dev, &isr_serif);
+  TEST_CHECK(ICM_20948_set_bank(&dev, 2) == ICM_20948_Stat_Ok);
+  uint32_t dropped = queue._dropped;
+  bank_isr_calls = 0;
+  TEST_CHECK(ICM_20948_get_agmt(&dev, &agmt) == ICM_20948_Stat_Ok); // Reads the bank 2 configs, then selects bank 0
+  TEST_CHECK((bank_isr_calls == 1) && (bank_isr_status == ICM_20948_Stat_BusBusy));
+  TEST_CHECK((ICM_20948_queue_count(&queue) == 0) && (queue._dropped == dropped + 1));
+  TEST_CHECK((dev._last_bank == 0) && (sim.bank == 0));
+  TEST_CHECK(ICM_20948_queue_agmt(&dev, &queue, 7) == ICM_20948_Stat_Ok); // And once it is done, sampling goes on
+  TEST_CHECK((ICM_20948_queue_pop(&queue, &sample) == ICM_20948_Stat_Ok) && test_sample_ok(&sample));
+  ICM_20948_link_serif(&dev, &serif);
+
+  // Producer and consumer threads
+  test_threads(TEST_PACED_SAMPLES, true);
+  test_threads(TEST_BURST_SAMPLES, false);
+  TEST_CHECK(dev._last_bank == 0);
+
+  return test_result();
+}
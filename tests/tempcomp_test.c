@@ -0,0 +1,156 @@
+/*
+
+Gyro bias temperature compensation test (ICM_20948_TempComp.h)
+
+A model is learned from a synthetic 40 minute warm-up (25 to 45 degC at 100Hz, still and moving spells, every gyro
+full scale) whose true bias is known, and must match it. It is then saved and loaded into a fresh model, which must
+be the same bin for bin and give the same bias at every temperature. A blob with any single bit flipped, or the wrong
+version or count, must be refused and leave the model it was loaded into unchanged.
+
+*/
+
+#include "test_common.h"
+#include "ICM_20948_TempComp.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#define TEST_RATE 100 // Hz
+
+// The true bias, LSB at +/- 250dps
+static double test_truth(uint8_t axis, double degc)
+{
+  static const double at25[3] = {50, -30, 12};
+  static const double slope[3] = {2, -1.5, 0.5};
+  double d = degc - 25.0;
+  return at25[axis] + (slope[axis] * d) + ((axis == 0) ? (0.05 * d * d) : 0.0);
+}
+
+static double test_noise(void)
+{
+  double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+  double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+  return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+static void test_learn(ICM_20948_TempComp_t *tc)
+{
+  srand(3);
+  for (uint32_t k = 0; k < (TEST_RATE * 60 * 40); k++)
+  {
+    double degc = 25.0 + (20.0 * (1.0 - exp(-(double)k / (TEST_RATE * 600.0))));
+    bool moving = ((k / 3000) % 3) == 1;
+    ICM_20948_AGMT_t agmt;
+    memset(&agmt, 0, sizeof(agmt));
+    agmt.fss.g = (k / 50000) % 4;
+    for (uint8_t i = 0; i < 3; i++)
+    {
+      double g = test_truth(i, degc) + (10.0 * test_noise()) + (moving ? (3000.0 * sin((k * 0.05) + i)) : 0.0);
+      agmt.gyr.raw.i16bit[i] = (int16_t)lrint(g / (1 << agmt.fss.g));
+      agmt.acc.raw.i16bit[i] = (int16_t)lrint(((i == 2) ? 16384.0 : 0.0) + (40.0 * test_noise()) + (moving ? (4000.0 * sin(k * 0.03)) : 0.0));
+    }
+    agmt.tmp.val = (int16_t)lrint(((degc - 21.0) * 333.87) + 21.0);
+    ICM_20948_tempcomp_update(tc, &agmt);
+  }
+}
+
+static bool test_same_model(const ICM_20948_TempComp_t *a, const ICM_20948_TempComp_t *b)
+{
+  for (uint8_t n = 0; n < ICM_20948_TEMPCOMP_BINS; n++)
+  {
+    if ((a->bin[n].tmp != b->bin[n].tmp) || (a->bin[n].weight != b->bin[n].weight) ||
+        (a->bin[n].bias[0] != b->bin[n].bias[0]) || (a->bin[n].bias[1] != b->bin[n].bias[1]) || (a->bin[n].bias[2] != b->bin[n].bias[2]))
+      return false;
+  }
+  return true;
+}
+
+// A damaged blob is refused and the model it was loaded into is left alone
+static bool test_refused(const ICM_20948_TempComp_t *model, const uint8_t *blob)
+{
+  ICM_20948_TempComp_t target = *model;
+  return (ICM_20948_tempcomp_load(&target, blob) == ICM_20948_Stat_ParamErr) && test_same_model(&target, model);
+}
+
+int main(void)
+{
+  ICM_20948_TempComp_t tc;
+  int32_t bias[3];
+  ICM_20948_tempcomp_init(&tc, TEST_RATE);
+  TEST_CHECK(!ICM_20948_tempcomp_bias(&tc, 3000, bias));
+  TEST_CHECK((bias[0] == 0) && (bias[1] == 0) && (bias[2] == 0));
+
+  // Learn, and compare with the truth over the warm-up
+  test_learn(&tc);
+  double worst = 0;
+  for (int32_t cdegc = 2600; cdegc <= 4400; cdegc += 50)
+  {
+    TEST_CHECK(ICM_20948_tempcomp_bias(&tc, cdegc, bias));
+    for (uint8_t i = 0; i < 3; i++)
+      worst = fmax(worst, fabs((bias[i] / 256.0) - test_truth(i, cdegc / 100.0)));
+  }
+  printf("model error 26 to 44 degC: %.2f LSB at +/- 250dps\n", worst);
+  TEST_CHECK(worst <= 5.0);
+
+  // Save and load into a fresh model
+  uint8_t blob[ICM_20948_TEMPCOMP_BLOB_BYTES];
+  ICM_20948_TempComp_t loaded;
+  ICM_20948_tempcomp_save(&tc, blob);
+  ICM_20948_tempcomp_init(&loaded, TEST_RATE);
+  TEST_CHECK(ICM_20948_tempcomp_load(&loaded, blob) == ICM_20948_Stat_Ok);
+  TEST_CHECK(test_same_model(&loaded, &tc));
+  bool same_bias = true;
+  for (int32_t cdegc = -2000; cdegc <= 8000; cdegc += 25)
+  {
+    int32_t other[3];
+    ICM_20948_tempcomp_bias(&tc, cdegc, bias);
+    ICM_20948_tempcomp_bias(&loaded, cdegc, other);
+    same_bias = same_bias && (memcmp(bias, other, sizeof(bias)) == 0);
+  }
+  TEST_CHECK(same_bias);
+
+  // The extremes of each field survive too
+  ICM_20948_TempComp_t edge;
+  ICM_20948_tempcomp_init(&edge, TEST_RATE);
+  edge.bin[0].tmp = -1234;
+  edge.bin[0].weight = ICM_20948_TEMPCOMP_MAX_WEIGHT;
+  edge.bin[0].bias[0] = (int32_t)0x80000000;
+  edge.bin[0].bias[1] = 0x7FFFFFFF;
+  edge.bin[0].bias[2] = -1;
+  edge.bin[ICM_20948_TEMPCOMP_BINS - 1].tmp = 6600;
+  edge.bin[ICM_20948_TEMPCOMP_BINS - 1].weight = 1;
+  edge.bin[ICM_20948_TEMPCOMP_BINS - 1].bias[0] = 256;
+  ICM_20948_tempcomp_save(&edge, blob);
+  ICM_20948_tempcomp_init(&loaded, TEST_RATE);
+  TEST_CHECK(ICM_20948_tempcomp_load(&loaded, blob) == ICM_20948_Stat_Ok);
+  TEST_CHECK(test_same_model(&loaded, &edge));
+
+  // Every single-bit flip, the checksum included, into both a fresh and a trained model
+  ICM_20948_TempComp_t fresh;
+  ICM_20948_tempcomp_init(&fresh, TEST_RATE);
+  ICM_20948_tempcomp_save(&tc, blob);
+  uint32_t accepted = 0;
+  for (uint16_t bit = 0; bit < (ICM_20948_TEMPCOMP_BLOB_BYTES * 8); bit++)
+  {
+    blob[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+    if (!test_refused(&fresh, blob) || !test_refused(&edge, blob))
+      accepted++;
+    blob[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+  }
+  TEST_CHECK(accepted == 0);
+
+  // The version and the count
+  uint8_t other[ICM_20948_TEMPCOMP_BLOB_BYTES];
+  memcpy(other, blob, sizeof(other));
+  other[0] = ICM_20948_TEMPCOMP_BLOB_VERSION + 1;
+  TEST_CHECK(test_refused(&edge, other));
+  memcpy(other, blob, sizeof(other));
+  other[1] = ICM_20948_TEMPCOMP_BINS - 1;
+  TEST_CHECK(test_refused(&edge, other));
+
+  // The undamaged blob still loads
+  TEST_CHECK(ICM_20948_tempcomp_load(&edge, blob) == ICM_20948_Stat_Ok);
+  TEST_CHECK(test_same_model(&edge, &tc));
+
+  return test_result();
+}
@@ -0,0 +1,62 @@
+/*
+
+Shared by the host tests in /tests
+
+Each test is a plain C program: it reports every failed check on stderr and exits nonzero if there were any,
+which is all ctest needs. The tests (like the benchmarks in /benchmarks) build on the host only: none of this is
+part of the Arduino library.
+
+  ICM_20948_Device_t dev;
+  ICM_20948_Sim_t sim;
+  ICM_20948_Serif_t serif;
+  test_sim_device(&dev, &sim, &serif); // A device on a freshly reset simulator, awake
+  TEST_CHECK(ICM_20948_check_id(&dev) == ICM_20948_Stat_Ok);
+  ...
+  return test_result();
+
+*/
+
+#ifndef _ICM_20948_TEST_COMMON_H_
+#define _ICM_20948_TEST_COMMON_H_
+
+#include "ICM_20948_C.h"
+#include "ICM_20948_Sim.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static int test_failures = 0;
+
+#define TEST_CHECK(cond)                                                       \
+  do                                                                           \
+  {                                                                            \
+    if (!(cond))                                                               \
+    {                                                                          \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      test_failures++;                                                         \
+    }                                                                          \
+  } while (0)
+
+static inline void test_sim_device(ICM_20948_Device_t *dev, ICM_20948_Sim_t *sim, ICM_20948_Serif_t *serif)
+{
+  memset(dev, 0, sizeof(ICM_20948_Device_t));
+  dev->_last_bank = 255; // Invalid, so the first ICM_20948_set_bank always writes
+  dev->_last_mems_bank = 255;
+  dev->_dmp_firmware_available = true;
+  ICM_20948_sim_init(sim);
+  ICM_20948_sim_serif(sim, serif);
+  ICM_20948_link_serif(dev, serif);
+  ICM_20948_sleep(dev, false);
+}
+
+static inline int test_result(void)
+{
+  if (test_failures != 0)
+  {
+    fprintf(stderr, "%d check(s) failed\n", test_failures);
+    return 1;
+  }
+  return 0;
+}
+
+#endif /* _ICM_20948_TEST_COMMON_H_ */
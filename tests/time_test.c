@@ -0,0 +1,221 @@
+/*
+
+Frame timestamp test (ICM_20948_Time.h)
+
+Checks the sensor timeline (the footer as a per-packet Delta and as a wrapping Counter), the offset update (early
+reads at once, late reads by 1/32), the 4 s skew window, the 256 s baseline and the 5% skew clamp. Then runs the
+clock model on a synthetic stream: a sensor clock with a known drift, drained in batches with a jittery read latency
+(and now and then a long stall), read on a 32-bit microsecond clock that wraps. The skew must converge to the drift,
+and every host timestamp must be monotonic and lag the true sample time by the shortest read latency plus what the
+late reads have added (1/32 of how late each was, until an earlier read).
+
+*/
+
+#include "test_common.h"
+#include "ICM_20948_Time.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#define TEST_TICKS_PER_PACKET 5   // 225Hz packets from a 1125Hz gyro
+#define TEST_PACKETS_PER_DRAIN 45 // Drained five times a second
+#define TEST_LATENCY_MIN_NS 150000.0
+#define TEST_SECONDS 1800 // Long enough for the baseline to reach its full 256 s several times
+
+static uint32_t test_seed = 1;
+
+static double test_uniform(void) // xorshift32, in [0, 1)
+{
+  test_seed ^= test_seed << 13;
+  test_seed ^= test_seed >> 17;
+  test_seed ^= test_seed << 5;
+  return (double)test_seed / 4294967296.0;
+}
+
+static uint64_t test_frame(ICM_20948_Timeline_t *tl, uint16_t footer)
+{
+  icm_20948_DMP_data_t data;
+  memset(&data, 0, sizeof(data));
+  data.Footer = footer;
+  return ICM_20948_timeline_frame(tl, &data);
+}
+
+static void test_footers(void)
+{
+  const uint32_t tick = ICM_20948_time_gyro_period_ns(0, 0);
+  TEST_CHECK(tick == 888889); // 1 / 1125Hz
+  TEST_CHECK(ICM_20948_time_gyro_period_ns(4, 0) == 4444444);
+  TEST_CHECK(ICM_20948_time_gyro_period_ns(0, 10) < tick); // A positive correction speeds the clock up
+  TEST_CHECK(ICM_20948_time_gyro_period_ns(0, (int8_t)0x8A) > tick); // Sign and magnitude: -10
+
+  // Delta: the footer counts the samples since the previous packet. The first frame is time 0
+  ICM_20948_Timeline_t tl;
+  ICM_20948_timeline_init(&tl, tick, 1, ICM_20948_Timeline_Footer_Delta);
+  TEST_CHECK(test_frame(&tl, 1234) == 0);
+  TEST_CHECK(test_frame(&tl, 5) == 5ULL * tick);
+  TEST_CHECK(test_frame(&tl, 0) == 5ULL * tick); // The same sample
+  TEST_CHECK(test_frame(&tl, 65535) == 65540ULL * tick);
+
+  // Counter: a free-running 16-bit count, which wraps
+  ICM_20948_timeline_init(&tl, tick, 1, ICM_20948_Timeline_Footer_Counter);
+  TEST_CHECK(test_frame(&tl, 65530) == 0);
+  TEST_CHECK(test_frame(&tl, 65535) == 5ULL * tick);
+  TEST_CHECK(test_frame(&tl, 4) == 10ULL * tick); // Across the wrap
+  TEST_CHECK(test_frame(&tl, 9) == 15ULL * tick);
+
+  // None: every frame is ticks_per_frame samples on, whatever the footer says
+  ICM_20948_timeline_init(&tl, tick, TEST_TICKS_PER_PACKET, ICM_20948_Timeline_Footer_None);
+  TEST_CHECK(test_frame(&tl, 77) == 0);
+  TEST_CHECK(test_frame(&tl, 1) == 5ULL * tick);
+
+  // After a restart the counter starts again: the next frame adds nothing, whatever the footer was
+  ICM_20948_timeline_init(&tl, tick, 1, ICM_20948_Timeline_Footer_Counter);
+  test_frame(&tl, 100);
+  test_frame(&tl, 110);
+  ICM_20948_timeline_restart(&tl);
+  TEST_CHECK(test_frame(&tl, 5000) == 10ULL * tick);
+  TEST_CHECK(test_frame(&tl, 5001) == 11ULL * tick);
+}
+
+static void test_offset(void)
+{
+  const uint32_t tick = ICM_20948_time_gyro_period_ns(0, 0);
+  const uint32_t second = 1125; // Ticks
+  ICM_20948_Timeline_t tl;
+  ICM_20948_timeline_init(&tl, tick, 1, ICM_20948_Timeline_Footer_Delta);
+
+  // The first sync sets the offset
+  test_frame(&tl, 0);
+  ICM_20948_timeline_sync(&tl, 1000);
+  TEST_CHECK(tl.offset_ns == 1000000);
+  TEST_CHECK(ICM_20948_timeline_host_ns(&tl, 0) == 1000000);
+
+  // A late read (3.2ms more latency) moves it by 1/32
+  uint64_t s = test_frame(&tl, second);
+  ICM_20948_timeline_sync(&tl, (uint32_t)(1000 + (s / 1000) + 3200));
+  int64_t diff = (int64_t)(((1000 + (s / 1000) + 3200) * 1000) - s);
+  TEST_CHECK(tl.offset_ns == 1000000 + ((diff - 1000000) >> 5));
+
+  // An early read moves it all the way at once: the frame cannot have been sampled after it was read
+  s = test_frame(&tl, second);
+  ICM_20948_timeline_sync(&tl, (uint32_t)((s / 1000) + 500));
+  TEST_CHECK(tl.offset_ns == (int64_t)(((s / 1000) + 500) * 1000) - (int64_t)s);
+  TEST_CHECK(tl.skew_ppb == 0); // Not one window yet
+}
+
+// The skew window and baseline on exact reads: no latency, a known drift
+static void test_skew_window(int32_t drift_ppb, int32_t expect_ppb)
+{
+  const uint32_t tick = ICM_20948_time_gyro_period_ns(0, 0);
+  ICM_20948_Timeline_t tl;
+  ICM_20948_timeline_init(&tl, tick, 1, ICM_20948_Timeline_Footer_Delta);
+
+  bool skew_early = false;
+  bool anchor_moved = false;
+  uint64_t first_anchor = 0;
+  uint64_t longest_baseline = 0;
+  for (uint32_t n = 0; n < 300 * 10; n++) // 300 s, synced ten times a second
+  {
+    uint64_t s = test_frame(&tl, 1125 / 10); // The first frame is time 0 whatever its footer
+    double host_ns = (double)s * (1.0 + (drift_ppb / 1e9));
+    ICM_20948_timeline_sync(&tl, (uint32_t)(host_ns / 1000.0));
+    if ((s < 2 * ICM_20948_TIME_SKEW_WINDOW_NS) && (tl.skew_ppb != 0))
+      skew_early = true; // It takes an anchor (the first window) and a second window
+    if (tl.have_anchor)
+    {
+      if (first_anchor == 0)
+        first_anchor = tl.anchor_ns + 1;
+      else if (tl.anchor_ns + 1 != first_anchor)
+        anchor_moved = true;
+      if (s - tl.anchor_ns > longest_baseline)
+        longest_baseline = s - tl.anchor_ns;
+    }
+  }
+  printf("drift %d ppb: skew %d ppb, longest baseline %.1f s\n", drift_ppb, tl.skew_ppb, longest_baseline / 1e9);
+  TEST_CHECK(!skew_early);
+  TEST_CHECK(abs(tl.skew_ppb - expect_ppb) <= 100); // The host clock has 1us steps
+  TEST_CHECK(anchor_moved); // 300 s is past the 256 s baseline
+  TEST_CHECK(longest_baseline <= ICM_20948_TIME_SKEW_BASELINE_NS + (2 * ICM_20948_TIME_SKEW_WINDOW_NS));
+}
+
+// A stream with drift and jitter
+static void test_stream(double drift_ppm, double jitter_ns, ICM_20948_Timeline_Footer_e footer)
+{
+  const uint32_t tick = ICM_20948_time_gyro_period_ns(0, 0);
+  const double true_tick_ns = tick * (1.0 + (drift_ppm / 1e6)); // The sensor's clock, in host time
+  const uint64_t host_us0 = 0xFFFFFFFFULL - 5000000;             // micros() wraps 5 s in
+  const uint32_t drains = TEST_SECONDS * 5;
+
+  ICM_20948_Timeline_t tl;
+  ICM_20948_timeline_init(&tl, tick, TEST_TICKS_PER_PACKET, footer);
+
+  uint64_t sample = 0; // Gyro ticks since the first packet
+  uint16_t counter = 65000;
+  uint64_t frame_ns[TEST_PACKETS_PER_DRAIN];
+  double frame_true[TEST_PACKETS_PER_DRAIN];
+  uint64_t last_out = 0;
+  bool monotonic = true;
+  double err_min = 1e18, err_max = -1e18, worst = 0.0;
+  double lag = 0.0; // What the late reads have added to the offset, beyond the shortest latency
+
+  for (uint32_t d = 0; d < drains; d++)
+  {
+    for (uint32_t i = 0; i < TEST_PACKETS_PER_DRAIN; i++)
+    {
+      if ((d != 0) || (i != 0))
+        sample += TEST_TICKS_PER_PACKET;
+      counter = (uint16_t)(counter + TEST_TICKS_PER_PACKET);
+      frame_ns[i] = test_frame(&tl, (footer == ICM_20948_Timeline_Footer_Counter) ? counter : TEST_TICKS_PER_PACKET);
+      frame_true[i] = (double)sample * true_tick_ns; // Host ns since host_us0
+    }
+
+    // Read some time after the newest frame: mostly a little over the minimum, now and then a long stall
+    double u = test_uniform();
+    double latency = TEST_LATENCY_MIN_NS + (jitter_ns * u * u * u);
+    if (test_uniform() < 0.05)
+      latency += 20000000.0;
+    uint64_t read_us = host_us0 + (uint64_t)((frame_true[TEST_PACKETS_PER_DRAIN - 1] + latency) / 1000.0);
+    ICM_20948_timeline_sync(&tl, (uint32_t)read_us); // Wraps
+    double late = latency - TEST_LATENCY_MIN_NS;
+    lag = ((d == 0) || (late < lag)) ? late : (lag + ((late - lag) / 32.0));
+
+    for (uint32_t i = 0; i < TEST_PACKETS_PER_DRAIN; i++)
+    {
+      uint64_t out = ICM_20948_timeline_host_ns(&tl, frame_ns[i]);
+      if (out <= last_out)
+        monotonic = false;
+      last_out = out;
+      double err = (double)out - ((double)(host_us0 * 1000) + frame_true[i]); // How late the host timestamp is
+      if (d >= drains / 2) // Once converged
+      {
+        if (err < err_min)
+          err_min = err;
+        if (err > err_max)
+          err_max = err;
+        if (fabs(err - (TEST_LATENCY_MIN_NS + lag)) > worst)
+          worst = fabs(err - (TEST_LATENCY_MIN_NS + lag));
+      }
+    }
+  }
+
+  printf("drift %+.0f ppm, jitter %.1f ms, footer %d: skew %d ppb, lag %.0f to %.0f us, %.0f us from the model\n", drift_ppm,
+         jitter_ns / 1e6, footer, tl.skew_ppb, err_min / 1e3, err_max / 1e3, worst / 1e3);
+  TEST_CHECK(monotonic);
+  TEST_CHECK(fabs(tl.skew_ppb - (drift_ppm * 1000.0)) <= 200.0); // 0.2 ppm
+  TEST_CHECK(err_min >= TEST_LATENCY_MIN_NS - 20000.0);           // Never ahead of the sample (but for the skew error and 1us steps)
+  TEST_CHECK(worst <= 20000.0);                                   // Behind it by the shortest latency plus the lag the late reads added
+}
+
+int main(void)
+{
+  test_footers();
+  test_offset();
+  test_skew_window(40000, 40000);
+  test_skew_window(-25000, -25000);
+  test_skew_window(80000000, ICM_20948_TIME_MAX_SKEW_PPB); // 8%: clamped to 5%
+  test_skew_window(-80000000, -ICM_20948_TIME_MAX_SKEW_PPB);
+  test_stream(40.0, 2000000.0, ICM_20948_Timeline_Footer_Delta);
+  test_stream(-60.0, 2000000.0, ICM_20948_Timeline_Footer_Counter);
+  test_stream(15.0, 8000000.0, ICM_20948_Timeline_Footer_None);
+  return test_result();
+}
@@ -0,0 +1,166 @@
+/*
+
+Bus trace test (ICM_20948_Trace.h)
+
+Records calls into a memory sink and decodes them again: a call with a NULL pdata keeps its length and carries no
+data, varints longer than 32 bits are refused, and ICM_20948_trace_load_file leaves nothing behind on an error.
+
+*/
+
+#include "test_common.h"
+#include "ICM_20948_Trace.h"
+
+#include <stdlib.h>
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+typedef struct
+{
+  uint8_t data[256];
+  uint32_t len;
+} Test_Sink_t;
+
+static ICM_20948_Status_e test_sink(const uint8_t *data, uint32_t len, void *user)
+{
+  Test_Sink_t *sink = (Test_Sink_t *)user;
+  if (len > (sizeof(sink->data) - sink->len))
+  {
+    return ICM_20948_Stat_Err;
+  }
+  memcpy(&sink->data[sink->len], data, len);
+  sink->len += len;
+  return ICM_20948_Stat_Ok;
+}
+
+// The bus under the recorder: takes a NULL pdata, as a serif that only clocks out dummy bytes might
+static ICM_20948_Status_e test_write(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user)
+{
+  (void)regaddr;
+  (void)pdata;
+  (void)len;
+  (void)user;
+  return ICM_20948_Stat_Ok;
+}
+
+static ICM_20948_Status_e test_read(uint8_t regaddr, uint8_t *pdata, uint32_t len, void *user)
+{
+  (void)user;
+  for (uint32_t i = 0; (pdata != NULL) && (i < len); i++)
+    pdata[i] = (uint8_t)(regaddr + i);
+  return ICM_20948_Stat_Ok;
+}
+
+#if defined(__linux__)
+static void test_file(const char *path, const uint8_t *data, uint32_t len)
+{
+  FILE *fp = fopen(path, "wb");
+  TEST_CHECK(fp != NULL);
+  if (fp != NULL)
+  {
+    TEST_CHECK(fwrite(data, 1, len, fp) == len);
+    fclose(fp);
+  }
+}
+#endif
+
+int main(void)
+{
+  ICM_20948_Serif_t inner = {test_write, test_read, NULL, NULL, NULL};
+  ICM_20948_Trace_Recorder_t rec;
+  Test_Sink_t sink;
+  ICM_20948_Serif_t serif;
+  memset(&sink, 0, sizeof(sink));
+  TEST_CHECK(ICM_20948_trace_record_start(&rec, &inner, test_sink, &sink, NULL) == ICM_20948_Stat_Ok);
+  ICM_20948_trace_record_serif(&rec, &serif);
+
+  uint8_t data[2] = {1, 2};
+  uint8_t buff[4];
+  TEST_CHECK(serif.write(0x10, NULL, 3, serif.user) == ICM_20948_Stat_Ok);
+  TEST_CHECK(serif.write(0x11, data, 2, serif.user) == ICM_20948_Stat_Ok);
+  TEST_CHECK(serif.read(0x20, buff, 4, serif.user) == ICM_20948_Stat_Ok);
+  TEST_CHECK(rec.sink_errors == 0);
+
+  // The NULL-data write keeps its length and the records after it still line up
+  ICM_20948_Trace_Record_t record;
+  uint32_t pos = ICM_20948_TRACE_HEADER_SIZE;
+  memset(&record, 0, sizeof(record));
+  TEST_CHECK(ICM_20948_trace_check_header(sink.data, sink.len) == ICM_20948_Stat_Ok);
+  TEST_CHECK(ICM_20948_trace_next(sink.data, sink.len, &pos, &record) == ICM_20948_Stat_Ok);
+  TEST_CHECK(record.write && (record.regaddr == 0x10) && (record.len == 3) && (record.data == NULL));
+  TEST_CHECK(ICM_20948_trace_next(sink.data, sink.len, &pos, &record) == ICM_20948_Stat_Ok);
+  TEST_CHECK(record.write && (record.regaddr == 0x11) && (record.len == 2) && (record.data[0] == 1) && (record.data[1] == 2));
+  TEST_CHECK(ICM_20948_trace_next(sink.data, sink.len, &pos, &record) == ICM_20948_Stat_Ok);
+  TEST_CHECK(!record.write && (record.regaddr == 0x20) && (record.len == 4) && (record.data[3] == 0x23));
+  TEST_CHECK(ICM_20948_trace_next(sink.data, sink.len, &pos, &record) == ICM_20948_Stat_NoData);
+
+  // The replay matches the NULL-data write by length
+  ICM_20948_Trace_Replay_t rep;
+  TEST_CHECK(ICM_20948_trace_replay_init(&rep, sink.data, sink.len, ICM_20948_TRACE_REPLAY_STRICT) == ICM_20948_Stat_Ok);
+  ICM_20948_trace_replay_serif(&rep, &serif);
+  TEST_CHECK(serif.write(0x10, NULL, 3, serif.user) == ICM_20948_Stat_Ok);
+  TEST_CHECK(serif.write(0x11, data, 2, serif.user) == ICM_20948_Stat_Ok);
+  TEST_CHECK((rep.records == 2) && (rep.mismatches == 0));
+
+  // Varints: five bytes carry 32 bits and no more
+  uint8_t trace[ICM_20948_TRACE_HEADER_SIZE + 8];
+  memcpy(trace, sink.data, ICM_20948_TRACE_HEADER_SIZE);
+  const uint8_t max_delta[8] = {0x00, 0x30, 0xFF, 0xFF, 0xFF, 0xFF, 0x0F, 0x00};
+  memcpy(&trace[ICM_20948_TRACE_HEADER_SIZE], max_delta, 8);
+  pos = ICM_20948_TRACE_HEADER_SIZE;
+  record.timestamp = 0;
+  TEST_CHECK(ICM_20948_trace_next(trace, sizeof(trace), &pos, &record) == ICM_20948_Stat_Ok);
+  TEST_CHECK((record.timestamp == 0xFFFFFFFF) && (record.len == 0) && (pos == sizeof(trace)));
+  const uint8_t over[3][8] = {{0x00, 0x30, 0x80, 0x80, 0x80, 0x80, 0x10, 0x00},  // Bit 32
+                              {0x00, 0x30, 0xFF, 0xFF, 0xFF, 0xFF, 0x7F, 0x00},  // Bits 32-34
+                              {0x00, 0x30, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00}}; // A sixth byte
+  for (uint32_t i = 0; i < 3; i++)
+  {
+    memcpy(&trace[ICM_20948_TRACE_HEADER_SIZE], over[i], 8);
+    pos = ICM_20948_TRACE_HEADER_SIZE;
+    TEST_CHECK(ICM_20948_trace_next(trace, sizeof(trace), &pos, &record) == ICM_20948_Stat_Err);
+    TEST_CHECK(pos == ICM_20948_TRACE_HEADER_SIZE);
+  }
+
+#if defined(__linux__)
+  // load_file: on every error *trace is NULL and there is nothing to free
+  char path[] = "/tmp/icm20948_trace_testXXXXXX";
+  int fd = mkstemp(path);
+  TEST_CHECK(fd >= 0);
+  if (fd >= 0)
+  {
+    close(fd);
+    uint8_t *loaded = buff; // Not NULL, so a leftover shows
+    uint32_t loaded_len = 1234;
+    TEST_CHECK(ICM_20948_trace_load_file("/nonexistent/trace.bin", &loaded, &loaded_len) == ICM_20948_Stat_Err);
+    TEST_CHECK((loaded == NULL) && (loaded_len == 0));
+
+    uint8_t bad[ICM_20948_TRACE_HEADER_SIZE] = {'I', 'C', 'M', 'X', ICM_20948_TRACE_VERSION, 0, 0, 0};
+    test_file(path, bad, sizeof(bad));
+    loaded = buff;
+    TEST_CHECK(ICM_20948_trace_load_file(path, &loaded, &loaded_len) == ICM_20948_Stat_Err);
+    TEST_CHECK((loaded == NULL) && (loaded_len == 0));
+
+    bad[3] = 'T';
+    bad[4] = ICM_20948_TRACE_VERSION + 1; // From the future
+    test_file(path, bad, sizeof(bad));
+    loaded = buff;
+    TEST_CHECK(ICM_20948_trace_load_file(path, &loaded, &loaded_len) == ICM_20948_Stat_Err);
+    TEST_CHECK(loaded == NULL);
+
+    test_file(path, sink.data, 4); // Shorter than the header
+    loaded = buff;
+    TEST_CHECK(ICM_20948_trace_load_file(path, &loaded, &loaded_len) == ICM_20948_Stat_Err);
+    TEST_CHECK(loaded == NULL);
+
+    test_file(path, sink.data, sink.len);
+    TEST_CHECK(ICM_20948_trace_load_file(path, &loaded, &loaded_len) == ICM_20948_Stat_Ok);
+    TEST_CHECK((loaded != NULL) && (loaded_len == sink.len) && (memcmp(loaded, sink.data, sink.len) == 0));
+    free(loaded);
+    remove(path);
+  }
+#endif
+
+  return test_result();
+}